@@ -43,7 +43,7 @@
 // Internal buffer sizes (Ensure these are all sized large enough for holding their respective data)
 #define MQTT_PACKET_BUFFER_SIZE     50000 // Size of buffer for storing mqtt packet bytes during recv call
 #define MQTT_TOPIC_BUFFER_SIZE      40   // Size of buffer storing topic data strings
-#define MQTT_PAYLOAD_BUFFER_SIZE    200  // Size of buffer storing payload data strings
+#define MQTT_PAYLOAD_BUFFER_SIZE    512  // Size of buffer storing payload data strings (large enough for a full panel cmd)
 #define MQTT_PUBLISH_LIST_SIZE      200  // Maximum number of outstanding QoS 2 & 3 message
 
 #endif //_ALERT_PANEL_CONFIG_H
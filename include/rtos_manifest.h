@@ -0,0 +1,65 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file rtos_manifest.h
+* @brief Every task, queue and semaphore the application creates
+*
+* All of them are statically allocated, so none can fail at run time. The modules that own them declare the storage,
+* sized here, which keeps it under the module's name in the linker map that scripts/ram_report.py reads after each
+* link. The FreeRTOS heap is left to lwIP and the cyw43 driver.
+*/
+#ifndef _RTOS_MANIFEST_H
+#define _RTOS_MANIFEST_H
+
+// FreeRTOS-Kernel includes
+#include "FreeRTOS.h"
+
+// Task stack depths, in words
+#define LAUNCH_TASK_STACK_DEPTH             (configMINIMAL_STACK_SIZE + 256) // main.c, WifiConnect, then diag logs
+#define LOG_TASK_STACK_DEPTH                (configMINIMAL_STACK_SIZE + 256) // log.c, console commands log a Message under sscanf
+#define ACTIVITY_LED_TASK_STACK_DEPTH       configMINIMAL_STACK_SIZE    // activity_led.c
+#define MQTT_TASK_STACK_DEPTH               8192                        // mqtt.c
+#define KEYPAD_TASK_STACK_DEPTH             configMINIMAL_STACK_SIZE    // keypad.c
+#define BUTTON_MONITOR_TASK_STACK_DEPTH     configMINIMAL_STACK_SIZE    // button_monitor.c
+#define LED_MONITOR_TASK_STACK_DEPTH        configMINIMAL_STACK_SIZE    // led_monitor.c
+#define LED_STATE_TASK_STACK_DEPTH          configMINIMAL_STACK_SIZE    // led_monitor.c
+#define STORAGE_TASK_STACK_DEPTH            configMINIMAL_STACK_SIZE    // storage.c
+#define FAULT_TASK_STACK_DEPTH              256                         // system.c, one per core, created by Fault()
+#define IDLE_TASK_STACK_DEPTH               configMINIMAL_STACK_SIZE    // system.c, one per core
+#define TIMER_TASK_STACK_DEPTH              configTIMER_TASK_STACK_DEPTH // system.c
+
+// Queue lengths, in items
+#define KEYPAD_LED_EVENT_QUEUE_LENGTH       10  // keypad.c, KeypadLedEvent_t
+#define KEYPAD_ANIMATION_QUEUE_LENGTH       1   // keypad.c, KeypadAnimationParams_t
+#define MQTT_COMMAND_QUEUE_LENGTH           20  // mqtt.c, MqttCommand_t
+#define MQTT_SUBSCRIPTION_QUEUE_LENGTH      20  // mqtt.c, MqttMessage_t
+#define MQTT_BACKGROUND_QUEUE_LENGTH        1   // mqtt.c, MqttPublishData_t
+
+// Semaphores, a StaticSemaphore_t each
+// keypad.c: button_event_signal (binary), led_state_mutex (mutex), led_state_signal (binary),
+//           led_event_send_mutex (mutex)
+// mqtt.c: background_mutex (mutex)
+// storage.c: pending_mutex (mutex)
+
+#endif //_RTOS_MANIFEST_H
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+# MIT License
+#
+# Copyright (c) 2024 tijy
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Decodes tokenized alert-panel logs (built with -DLOG_TOKENIZED=ON, see src/log_token.h).
+
+Reads the log output (a file or stdin) and the ELF of the same build, and prints every '$' record line as
+the text the untokenized build would have logged. Other lines are passed through unchanged, e.g.
+
+    cat /dev/ttyACM0 | log_decode.py build/alert_panel_app.elf
+"""
+
+import argparse
+import base64
+import binascii
+import re
+import struct
+import sys
+
+# Keep in step with src/log_token.h and src/log.c
+HASH_LENGTH = 80
+TOKEN_TEXT = 0
+LEVELS = ["DEBUG", "INFO", "WARN", "ERROR", "FATAL"]
+SECTION = ".log_tokens"
+ENTRY_MARKER = b"\xff"
+
+CONVERSION_RE = re.compile(
+    r"%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<precision>\*|\d*))?(?P<length>hh|h|ll|l|j|z|t|L)?(?P<conversion>[diouxXeEfFgGaAcsp%])"
+)
+
+
+class TruncatedRecord(Exception):
+    pass
+
+
+def token(fmt):
+    """65599 hash of the first HASH_LENGTH bytes and the length, as LOG_TOKEN() folds it."""
+    value = len(fmt)
+    coefficient = 65599
+
+    for char in fmt[:HASH_LENGTH]:
+        value = (value + coefficient * char) & 0xFFFFFFFF
+        coefficient = (coefficient * 65599) & 0xFFFFFFFF
+
+    return value
+
+
+def read_section(path, name):
+    """Contents of a named section of an ELF32/ELF64 little endian file."""
+    with open(path, "rb") as elf:
+        data = elf.read()
+
+    if data[:4] != b"\x7fELF" or data[5] != 1:
+        sys.exit(f"{path}: not a little endian ELF file")
+
+    if data[4] == 1:
+        shoff, = struct.unpack_from("<I", data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x2E)
+        header = "<IIIIIIIIII"
+    else:
+        shoff, = struct.unpack_from("<Q", data, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x3A)
+        header = "<IIQQQQIIQQ"
+
+    sections = [struct.unpack_from(header, data, shoff + (i * shentsize)) for i in range(shnum)]
+    names_offset = sections[shstrndx][4]
+
+    for section in sections:
+        start = names_offset + section[0]
+        section_name = data[start:data.index(b"\0", start)].decode()
+
+        if section_name == name:
+            return data[section[4]:section[4] + section[5]]
+
+    sys.exit(f"{path}: no {name} section, was it built with LOG_TOKENIZED?")
+
+
+def read_tokens(path):
+    """Token to (files, format) for every log call in the ELF."""
+    tokens = {}
+
+    # Entries are '\xff' file '\0' format '\0', padding between them is skipped
+    for entry in read_section(path, SECTION).split(ENTRY_MARKER)[1:]:
+        parts = entry.split(b"\0")
+
+        if len(parts) < 2:
+            continue
+
+        file, fmt = parts[0].decode(errors="replace"), parts[1]
+        files, _ = tokens.setdefault(token(fmt), (set(), fmt.decode(errors="replace")))
+        files.add(file)
+
+    return tokens
+
+
+class Record:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def varint(self):
+        value = 0
+        shift = 0
+
+        while True:
+            if self.pos >= len(self.data):
+                raise TruncatedRecord()
+
+            byte = self.data[self.pos]
+            self.pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+
+            if byte < 0x80:
+                return (value >> 1) ^ -(value & 1)
+
+    def double(self):
+        if self.pos + 8 > len(self.data):
+            raise TruncatedRecord()
+
+        value, = struct.unpack_from("<d", self.data, self.pos)
+        self.pos += 8
+        return value
+
+    def string(self):
+        if self.pos >= len(self.data):
+            raise TruncatedRecord()
+
+        length = self.data[self.pos]
+        value = self.data[self.pos + 1:self.pos + 1 + length]
+        self.pos += 1 + length
+        return value.decode(errors="replace")
+
+
+def format_message(fmt, record):
+    """printf formatting of fmt, taking each argument from the record as its conversion needs."""
+    out = []
+    last = 0
+
+    for match in CONVERSION_RE.finditer(fmt):
+        out.append(fmt[last:match.start()])
+        last = match.end()
+        conversion = match["conversion"]
+
+        if conversion == "%":
+            out.append("%")
+            continue
+
+        try:
+            width = record.varint() if match["width"] == "*" else match["width"]
+            precision = record.varint() if match["precision"] == "*" else match["precision"]
+            spec = "%" + match["flags"] + (str(width) if width is not None else "")
+            spec += "." + str(precision) if precision is not None else ""
+            bits = 64 if match["length"] in ("ll", "j") else 32
+
+            if conversion == "s":
+                out.append((spec + "s") % record.string())
+            elif conversion in "eEfFgGaA":
+                out.append((spec + ("f" if conversion in "aA" else conversion)) % record.double())
+            elif conversion == "c":
+                out.append((spec + "c") % chr(record.varint() & 0xFF))
+            elif conversion == "p":
+                out.append((spec + "s") % hex(record.varint() & 0xFFFFFFFF))
+            elif conversion in "di":
+                out.append((spec + "d") % record.varint())
+            else:
+                value = record.varint() & ((1 << bits) - 1)
+                out.append((spec + ("d" if conversion == "u" else conversion)) % value)
+        except TruncatedRecord:
+            out.append("<truncated>")
+            return "".join(out)
+
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+def decode_line(line, tokens):
+    try:
+        data = base64.b64decode(line[1:].strip(), validate=True)
+    except (binascii.Error, ValueError):
+        return line
+
+    if len(data) < 9:
+        return line
+
+    record_token, time_ms, level_core = struct.unpack_from("<IIB", data)
+    record = Record(data[9:])
+    level = LEVELS[level_core & 0x0F] if (level_core & 0x0F) < len(LEVELS) else "?"
+
+    if record_token == TOKEN_TEXT:
+        try:
+            module = record.string()
+            message = record.string()
+        except TruncatedRecord:
+            module, message = "?", "<truncated>"
+    elif record_token in tokens:
+        files, fmt = tokens[record_token]
+        module = "|".join(sorted(files))
+        message = format_message(fmt, record)
+    else:
+        module = "?"
+        message = f"<unknown token {record_token:08x}, is the ELF from the same build?>"
+
+    line = f"[{time_ms // 1000}.{time_ms % 1000:03}] [{level}] [{module}] [{level_core >> 4}] {message}"
+    return line if line.endswith("\n") else line + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="ELF of the running build")
+    parser.add_argument("log", nargs="?", default="-", help="log output, '-' (default) for stdin")
+    args = parser.parse_args()
+    tokens = read_tokens(args.elf)
+    log = sys.stdin if args.log == "-" else open(args.log, errors="replace")
+
+    for line in log:
+        sys.stdout.write(decode_line(line, tokens) if line.startswith("$") else line)
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+# MIT License
+#
+# Copyright (c) 2024 tijy
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Prints the RAM each part of an alert-panel build takes, from the linker map.
+
+Every input section placed in a RAM region is added to the module that defined it: each src/*.c file on its own, and the
+FreeRTOS heap, FreeRTOS-Kernel, lwIP, cyw43-driver, coreMQTT, tiny-json, pico-sdk and C library as a whole. The RTOS
+objects of each module are statically allocated (see include/rtos_manifest.h), so they count under the module. The build
+runs this after each link, e.g.
+
+    ram_report.py build/alert_panel_app.elf.map
+"""
+
+import argparse
+import re
+import sys
+from collections import defaultdict
+
+# Library objects, by a part of their path, first match wins
+LIBRARIES = [
+    ("heap_4.c", "FreeRTOS heap"),
+    ("FreeRTOS-Kernel", "FreeRTOS-Kernel"),
+    ("lwip", "lwIP"),
+    ("cyw43", "cyw43-driver"),
+    ("coreMQTT", "coreMQTT"),
+    ("tiny-json", "tiny-json"),
+    ("pico-sdk", "pico-sdk"),
+    ("pico_sdk", "pico-sdk"),
+]
+
+APP_OBJECT_RE = re.compile(r"\.dir/src/([\w-]+)\.c\.obj$")
+ARCHIVE_RE = re.compile(r"lib([\w-]+)\.a\(")
+REGION_RE = re.compile(r"^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+SECTION_RE = re.compile(r"^ (\S+)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(.+))?$")
+PLACEMENT_RE = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(.+)$")
+
+
+def module(path):
+    """Name a RAM user is reported under."""
+    match = APP_OBJECT_RE.search(path)
+
+    if match:
+        return match.group(1)
+
+    for part, name in LIBRARIES:
+        if part in path:
+            return name
+
+    match = ARCHIVE_RE.search(path)
+    return f"lib{match.group(1)}" if match else "other"
+
+
+def read_map(path):
+    """RAM regions {name: (origin, length)} and bytes per module."""
+    regions = {}
+    usage = defaultdict(int)
+    part = None
+    pending = None
+
+    with open(path, errors="replace") as map_file:
+        for line in map_file:
+            line = line.rstrip("\n")
+
+            if line.startswith("Memory Configuration"):
+                part = "regions"
+                continue
+
+            if line.startswith("Linker script and memory map"):
+                part = "sections"
+                continue
+
+            if part == "regions":
+                match = REGION_RE.match(line)
+
+                if match and match.group(1) not in ("FLASH", "*default*"):
+                    regions[match.group(1)] = (int(match.group(2), 16), int(match.group(3), 16))
+
+                continue
+
+            if part != "sections":
+                continue
+
+            # An input section is its name then address, size and object, on one line or over two when the name is long
+            match = SECTION_RE.match(line)
+
+            if match and not match.group(1).startswith("*"):
+                if match.group(2) is None:
+                    pending = match.group(1)
+                    continue
+
+                placement = (match.group(2), match.group(3), match.group(4))
+            elif pending is not None and PLACEMENT_RE.match(line):
+                placement = PLACEMENT_RE.match(line).groups()
+            else:
+                pending = None
+                continue
+
+            pending = None
+            address, size, obj = int(placement[0], 16), int(placement[1], 16), placement[2].strip()
+
+            if size > 0 and any(origin <= address < origin + length for origin, length in regions.values()):
+                usage[module(obj)] += size
+
+    return regions, usage
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="linker map of the build")
+    args = parser.parse_args()
+
+    try:
+        regions, usage = read_map(args.map)
+    except OSError as error:
+        sys.exit(f"{args.map}: {error.strerror}")
+
+    if not regions:
+        sys.exit(f"{args.map}: no RAM regions, not a GNU ld map?")
+
+    total = sum(usage.values())
+    available = sum(length for _, length in regions.values())
+    print(f"RAM by module, {args.map}")
+
+    for name, size in sorted(usage.items(), key=lambda item: -item[1]):
+        print(f"  {name:<20} {size:>8}")
+
+    print(f"  {'total':<20} {total:>8} of {available} ({total * 100 // available}%), the rest is left to malloc")
+
+
+if __name__ == "__main__":
+    main()
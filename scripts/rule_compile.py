@@ -0,0 +1,358 @@
+#!/usr/bin/env python3
+# MIT License
+#
+# Copyright (c) 2024 tijy
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Compiles alert-panel rules to the bytecode run by src/keypad_rule.c.
+
+One rule per line, '#' starts a comment:
+
+    on <trigger> <key|any> [if <condition>]: <action>[; <action>...]
+
+trigger:    press, hold, double_press, triple_press, hold_repeat, hold_release or led (the key's led state changed)
+condition:  comparisons (==, !=, <, >, <=, >=) of numbers, 'key' (position of the triggering key) and
+            on(k), brightness(k), red(k), green(k), blue(k), effect(k), combined with and, or, not and parentheses
+action:     on k | off k | brightness k <0-255> | colour k <r> <g> <b> | effect k none|flash|pulse
+k:          a key id (0-f, 10-3f for chained keypads), 'key' for the triggering key, or 'all' (actions only)
+
+Examples:
+
+    on hold f: off all
+    on led 0 if red(0) == 255 and green(0) == 0 and blue(0) == 0: effect 1 flash
+
+Send the output as the payload of <client id>/rule/cmd, e.g.
+    rule_compile.py rules.txt -o rules.bin && mosquitto_pub -t alert_panel_1/rule/cmd -f rules.bin
+An empty payload removes every rule.
+"""
+
+import argparse
+import re
+import sys
+
+# Keep in step with src/keypad.h and src/keypad_rule.h
+PROGRAM_SIZE = 256
+STACK_SIZE = 8
+TRIGGERS = {
+    "press": 1,
+    "hold": 2,
+    "double_press": 3,
+    "triple_press": 4,
+    "hold_repeat": 5,
+    "hold_release": 6,
+    "led": 0x10,
+}
+KEY_ANY = 0xFF
+KEY_TRIGGER = 0xFE
+KEY_ALL = 0xFF
+EFFECTS = {"none": 1, "flash": 2, "pulse": 3}
+
+OP_END = 0x00
+OP_PUSH = 0x01
+OP_KEY = 0x02
+OP_GET = {"on": 0x03, "brightness": 0x04, "red": 0x05, "green": 0x06, "blue": 0x07, "effect": 0x08}
+OP_EQ = 0x10
+OP_LT = 0x11
+OP_AND = 0x12
+OP_OR = 0x13
+OP_NOT = 0x14
+OP_JZ = 0x18
+OP_SET_ON = 0x20
+OP_SET_OFF = 0x21
+OP_SET_BRIGHTNESS = 0x22
+OP_SET_COLOUR = 0x23
+OP_SET_EFFECT = 0x24
+
+# operand count, pops and pushes of each opcode, as KEYPAD_RULE_OP_INFO
+OP_STACK = {
+    OP_END: (0, 0, 0),
+    OP_PUSH: (1, 0, 1),
+    OP_KEY: (0, 0, 1),
+    **{op: (1, 0, 1) for op in OP_GET.values()},
+    OP_EQ: (0, 2, 1),
+    OP_LT: (0, 2, 1),
+    OP_AND: (0, 2, 1),
+    OP_OR: (0, 2, 1),
+    OP_NOT: (0, 1, 1),
+    OP_JZ: (1, 1, 0),
+    OP_SET_ON: (1, 0, 0),
+    OP_SET_OFF: (1, 0, 0),
+    OP_SET_BRIGHTNESS: (2, 0, 0),
+    OP_SET_COLOUR: (4, 0, 0),
+    OP_SET_EFFECT: (2, 0, 0),
+}
+
+TOKEN_RE = re.compile(r"\s*(==|!=|<=|>=|<|>|\(|\)|[A-Za-z_0-9]+)")
+
+
+class RuleError(Exception):
+    pass
+
+
+def key_position(text, allow_trigger=True, allow_all=False):
+    """Key id to position in KEYPAD_KEY_ID, mirrors KeypadKeyPosition()."""
+    text = text.lower()
+
+    if allow_trigger and text == "key":
+        return KEY_TRIGGER
+
+    if allow_all and text == "all":
+        return KEY_ALL
+
+    if re.fullmatch(r"[0-9a-f]", text):
+        return int(text, 16)
+
+    if re.fullmatch(r"[1-3][0-9a-f]", text):
+        return int(text[0]) * 16 + int(text[1], 16)
+
+    raise RuleError(f"invalid key '{text}'")
+
+
+def byte(text):
+    value = int(text, 0)
+
+    if not 0 <= value <= 255:
+        raise RuleError(f"value {text} is not 0-255")
+
+    return value
+
+
+class Condition:
+    """Recursive descent over the condition tokens, emits stack code."""
+
+    def __init__(self, text):
+        self.tokens = TOKEN_RE.findall(text)
+
+        if "".join(self.tokens) != re.sub(r"\s+", "", text):
+            raise RuleError(f"cannot parse condition '{text}'")
+
+        self.pos = 0
+
+    def compile(self):
+        code = self.parse_or()
+
+        if self.pos != len(self.tokens):
+            raise RuleError(f"unexpected '{self.tokens[self.pos]}' in condition")
+
+        return code
+
+    def peek(self):
+        return self.tokens[self.pos] if self.pos < len(self.tokens) else None
+
+    def take(self, expected=None):
+        token = self.peek()
+
+        if token is None or (expected is not None and token != expected):
+            raise RuleError(f"expected '{expected or 'value'}' in condition")
+
+        self.pos += 1
+        return token
+
+    def parse_or(self):
+        code = self.parse_and()
+
+        while self.peek() == "or":
+            self.take()
+            code += self.parse_and() + [OP_OR]
+
+        return code
+
+    def parse_and(self):
+        code = self.parse_not()
+
+        while self.peek() == "and":
+            self.take()
+            code += self.parse_not() + [OP_AND]
+
+        return code
+
+    def parse_not(self):
+        if self.peek() == "not":
+            self.take()
+            return self.parse_not() + [OP_NOT]
+
+        return self.parse_compare()
+
+    def parse_compare(self):
+        left = self.parse_value()
+        op = self.peek()
+
+        if op not in ("==", "!=", "<", ">", "<=", ">="):
+            return left
+
+        self.take()
+        right = self.parse_value()
+        return {
+            "==": left + right + [OP_EQ],
+            "!=": left + right + [OP_EQ, OP_NOT],
+            "<": left + right + [OP_LT],
+            ">": right + left + [OP_LT],
+            "<=": right + left + [OP_LT, OP_NOT],
+            ">=": left + right + [OP_LT, OP_NOT],
+        }[op]
+
+    def parse_value(self):
+        token = self.take()
+
+        if token == "(":
+            code = self.parse_or()
+            self.take(")")
+            return code
+
+        if token == "key":
+            return [OP_KEY]
+
+        if token in OP_GET:
+            self.take("(")
+            key = key_position(self.take())
+            self.take(")")
+            return [OP_GET[token], key]
+
+        if re.fullmatch(r"[0-9]+|0x[0-9a-fA-F]+", token):
+            return [OP_PUSH, byte(token)]
+
+        raise RuleError(f"unexpected '{token}' in condition")
+
+
+def stack_depth(code):
+    """Deepest stack reached by straight line code, the keypad rejects programs that go past STACK_SIZE."""
+    depth = deepest = pc = 0
+
+    while pc < len(code):
+        operands, pops, pushes = OP_STACK[code[pc]]
+        depth += pushes - pops
+        deepest = max(deepest, depth)
+        pc += 1 + operands
+
+    return deepest
+
+
+def compile_action(text):
+    words = text.split()
+
+    if not words:
+        raise RuleError("empty action")
+
+    name, args = words[0].lower(), words[1:]
+    expected = {"on": 1, "off": 1, "brightness": 2, "colour": 4, "color": 4, "effect": 2}
+
+    if name not in expected:
+        raise RuleError(f"unknown action '{name}'")
+
+    if len(args) != expected[name]:
+        raise RuleError(f"'{name}' takes {expected[name]} arguments")
+
+    key = key_position(args[0], allow_all=True)
+
+    if name == "on":
+        return [OP_SET_ON, key]
+
+    if name == "off":
+        return [OP_SET_OFF, key]
+
+    if name == "brightness":
+        return [OP_SET_BRIGHTNESS, key, byte(args[1])]
+
+    if name in ("colour", "color"):
+        return [OP_SET_COLOUR, key] + [byte(arg) for arg in args[1:]]
+
+    if args[1].lower() not in EFFECTS:
+        raise RuleError(f"unknown effect '{args[1]}'")
+
+    return [OP_SET_EFFECT, key, EFFECTS[args[1].lower()]]
+
+
+def compile_rule(line):
+    match = re.fullmatch(r"on\s+(\w+)\s+(\w+)(?:\s+if\s+(.+?))?\s*:\s*(.+)", line)
+
+    if not match:
+        raise RuleError("expected 'on <trigger> <key> [if <condition>]: <actions>'")
+
+    trigger, key, condition, actions = match.groups()
+
+    if trigger not in TRIGGERS:
+        raise RuleError(f"unknown trigger '{trigger}'")
+
+    key = KEY_ANY if key == "any" else key_position(key, allow_trigger=False)
+    body = []
+
+    for action in actions.split(";"):
+        body += compile_action(action)
+
+    if condition:
+        test = Condition(condition).compile()
+
+        if stack_depth(test) > STACK_SIZE:
+            raise RuleError(f"condition needs a stack deeper than {STACK_SIZE}, split it or nest it less")
+
+        if len(body) > 255:
+            raise RuleError("actions too long to skip")
+
+        body = test + [OP_JZ, len(body)] + body
+
+    if len(body) > 255:
+        raise RuleError("rule body is longer than 255 bytes")
+
+    return bytes([TRIGGERS[trigger], key, len(body)] + body)
+
+
+def compile_rules(text):
+    program = b""
+
+    for number, line in enumerate(text.splitlines(), 1):
+        line = line.split("#", 1)[0].strip()
+
+        if not line:
+            continue
+
+        try:
+            program += compile_rule(line)
+        except (RuleError, ValueError) as error:
+            raise RuleError(f"line {number}: {error}") from None
+
+    if len(program) > PROGRAM_SIZE:
+        raise RuleError(f"program is {len(program)} bytes, the limit is {PROGRAM_SIZE}")
+
+    return program
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("rules", help="rule source file, '-' for stdin")
+    parser.add_argument("-o", "--output", help="write the program to this file, otherwise print it as hex")
+    args = parser.parse_args()
+    source = sys.stdin.read() if args.rules == "-" else open(args.rules).read()
+
+    try:
+        program = compile_rules(source)
+    except RuleError as error:
+        sys.exit(f"{args.rules}: {error}")
+
+    if args.output:
+        with open(args.output, "wb") as output:
+            output.write(program)
+    else:
+        print(program.hex())
+
+    print(f"{len(program)}/{PROGRAM_SIZE} bytes", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -39,6 +39,8 @@
 
 // alert-panel includes
 #include "log.h"
+#include "rtos_manifest.h"
+#include "supervisor.h"
 #include "system.h"
 
 /**
@@ -59,6 +61,12 @@
  */
 #define DEFAULT_DELAY   ( 10000U )
 
+/**
+ * @brief Longest time (ms) between loops before the supervisor restarts the panel
+ *
+ */
+#define HEARTBEAT_DEADLINE  ( 2 * DEFAULT_DELAY )
+
 /**
  * @brief
  *
@@ -71,6 +79,18 @@ static uint32_t activity_led_interval;
  */
 static TaskHandle_t activity_led_task_handle;
 
+/**
+ * @brief
+ *
+ */
+static StackType_t activity_led_task_stack[ACTIVITY_LED_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t activity_led_task_buffer;
+
 /**
  * @brief
  *
@@ -90,8 +110,9 @@ void ActivityLedInit()
 
 void ActivityLedTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask)
 {
-    xTaskCreatePinnedToCore(ActivityLedTask, "ActivityLedTask", configMINIMAL_STACK_SIZE, NULL, priority, &activity_led_task_handle,
-                            core_affinity_mask);
+    xTaskCreateStaticPinnedToCore(ActivityLedTask, "ActivityLedTask", ACTIVITY_LED_TASK_STACK_DEPTH, NULL, priority,
+                                  activity_led_task_stack, &activity_led_task_buffer, &activity_led_task_handle,
+                                  core_affinity_mask);
 }
 
 /*-----------------------------------------------------------*/
@@ -123,9 +144,12 @@ static void ActivityLedTask(void *params)
     bool flash = true;
     uint32_t delay = DEFAULT_DELAY;
     uint32_t received_value;
+    SupervisorRegister(HEARTBEAT_DEADLINE);
 
     while (1)
     {
+        SupervisorCheckIn();
+
         // How long should we wait for notify timeout?
         // If the LED is permenantly on or off, we don't have
         // to cycle quickly to 'flash' the LED
@@ -37,11 +37,21 @@
 // alert-panel includes
 #include "keypad.h"
 #include "button_msg.h"
+#include "rtos_manifest.h"
 #include "system.h"
 #include "mqtt.h"
 #include "log.h"
+#include "util.h"
 #include "alert_panel_config.h"
 
+/**
+ * @brief Most button events taken from the keypad at a time
+ *
+ */
+#define BUTTON_MONITOR_BATCH_SIZE   16
+
+_Static_assert(BUTTON_MONITOR_BATCH_SIZE >= KEYPAD_BUTTON_EVENTS_MAX, "A batch must hold every event of a key");
+
 /**
  * @brief
  *
@@ -60,6 +70,24 @@ static char payload_buffer[MQTT_PAYLOAD_BUFFER_SIZE];
  */
 static char topic_buffer[MQTT_TOPIC_BUFFER_SIZE];
 
+/**
+ * @brief Button events taken from the keypad in one go
+ *
+ */
+static KeypadButtonParams_t button_events[BUTTON_MONITOR_BATCH_SIZE];
+
+/**
+ * @brief
+ *
+ */
+static StackType_t button_monitor_task_stack[BUTTON_MONITOR_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t button_monitor_task_buffer;
+
 /**
  * @brief Monitors mqtt for keypad button events and publishes them via mqtt
  *
@@ -67,12 +95,21 @@ static char topic_buffer[MQTT_TOPIC_BUFFER_SIZE];
  */
 static void ButtonMonitorTask(void *params);
 
+/**
+ * @brief Logs the time spent in each stage from reading the buttons to handing the publish to mqtt,
+ * the network part is logged by mqtt
+ *
+ * @param timestamps
+ */
+static void ButtonMonitorLogLatency(const KeypadButtonTimestamps_t *timestamps);
+
 /*-----------------------------------------------------------*/
 
 void ButtonMonitorTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask)
 {
-    xTaskCreatePinnedToCore(ButtonMonitorTask, "ButtonMonitorTask", configMINIMAL_STACK_SIZE, &core_affinity_mask, priority, NULL,
-                            core_affinity_mask);
+    xTaskCreateStaticPinnedToCore(ButtonMonitorTask, "ButtonMonitorTask", BUTTON_MONITOR_TASK_STACK_DEPTH,
+                                  &core_affinity_mask, priority, button_monitor_task_stack, &button_monitor_task_buffer,
+                                  NULL, core_affinity_mask);
 }
 
 /*-----------------------------------------------------------*/
@@ -83,11 +120,31 @@ static void ButtonMonitorTask(void *params)
 
     while (1)
     {
-        // Wait for a button press/hold event
-        KeypadButtonParams_t params = KeypadButtonEventQueueReceive();
-        LogPrintDebug("Received keypad button event, id:%c, e:%u\n", params.key_id, params.event);
-        ButtonMsgBuildStateTopic(&params, topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
-        ButtonMsgBuildStatePayload(&params, payload_buffer, MQTT_PAYLOAD_BUFFER_SIZE);
-        MqttSubmitPublish(topic_buffer, strlen(topic_buffer), payload_buffer, strlen(payload_buffer), MQTTQoS2, false);
+        // Wait for button events, everything that piled up while mqtt was busy comes at once, coalesced
+        uint8_t count = KeypadButtonEventReceive(button_events, BUTTON_MONITOR_BATCH_SIZE);
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+            KeypadButtonParams_t *params = &button_events[i];
+            LogPrintDebug("Received keypad button event, id:%s, e:%u, n:%u\n", params->key_id, params->event, params->count);
+            ButtonMsgBuildStateTopic(params, topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+            ButtonMsgBuildStatePayload(params, payload_buffer, MQTT_PAYLOAD_BUFFER_SIZE);
+            params->timestamps.formatted_us = GetTimeUs();
+            MqttSubmitPublish(topic_buffer, strlen(topic_buffer), payload_buffer, strlen(payload_buffer), MQTTQoS2, false);
+            params->timestamps.submitted_us = GetTimeUs();
+            ButtonMonitorLogLatency(&params->timestamps);
+        }
     }
 }
+
+/*-----------------------------------------------------------*/
+
+static void ButtonMonitorLogLatency(const KeypadButtonTimestamps_t *timestamps)
+{
+    LogPrintDebug("Button event latency us, detect:%lu, queue:%lu, format:%lu, submit:%lu, total:%lu\n",
+                  (uint32_t)(timestamps->detected_us - timestamps->polled_us),
+                  (uint32_t)(timestamps->received_us - timestamps->detected_us),
+                  (uint32_t)(timestamps->formatted_us - timestamps->received_us),
+                  (uint32_t)(timestamps->submitted_us - timestamps->formatted_us),
+                  (uint32_t)(timestamps->submitted_us - timestamps->polled_us));
+}
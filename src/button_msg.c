@@ -39,14 +39,65 @@
 #include "alert_panel_config.h"
 
 // button states: from alert-panel to broker (publish)
-#define BUTTON_STATE_TOPIC_FMT         MQTT_CLIENT_ID "/button/state/%c"
+#define BUTTON_STATE_TOPIC_FMT         MQTT_CLIENT_ID "/button/state/%s"
 #define BUTTON_STATE_PAYLOAD_PRESS    "press"
 #define BUTTON_STATE_PAYLOAD_HOLD     "hold"
+#define BUTTON_STATE_PAYLOAD_DOUBLE_PRESS   "double_press"
+#define BUTTON_STATE_PAYLOAD_TRIPLE_PRESS   "triple_press"
+#define BUTTON_STATE_PAYLOAD_HOLD_REPEAT    "hold_repeat"
+#define BUTTON_STATE_PAYLOAD_HOLD_RELEASE   "hold_release"
+#define BUTTON_STATE_PAYLOAD_CHORD          "chord"
+
+// Adds the detection time (us since start) to button state payloads
+#define BUTTON_STATE_PAYLOAD_TIMESTAMP      true
+
+// button chords: from alert-panel to broker (publish)
+#define BUTTON_CHORD_TOPIC              MQTT_CLIENT_ID "/button/chord"
+
+// button gesture timings: from broker to alert-panel (subscription)
+#define BUTTON_CONFIG_TOPIC             MQTT_CLIENT_ID "/button/config"
+
+/**
+ * @brief
+ *
+ */
+static char json_str[MQTT_PAYLOAD_BUFFER_SIZE];
+
+/**
+ * @brief
+ *
+ */
+static json_t pool[8];
+
+/**
+ * @brief
+ *
+ * @param event
+ * @return const char*
+ */
+static const char *ButtonMsgEventName(KeypadButtonEvent_t event);
+
+/**
+ * @brief Reads an optional ms timing property
+ *
+ * @param json_obj
+ * @param name
+ * @param value left unchanged if the property is missing
+ * @return true
+ * @return false if the property is present but not an integer 0-65535
+ */
+static bool ButtonMsgParseTiming(json_t const *json_obj, const char *name, uint16_t *value);
 
 /*-----------------------------------------------------------*/
 
 void ButtonMsgBuildStateTopic(KeypadButtonParams_t *params, char *topic_buffer, size_t buffer_size)
 {
+    if (params->event == CHORD)
+    {
+        snprintf(topic_buffer, buffer_size, BUTTON_CHORD_TOPIC);
+        return;
+    }
+
     snprintf(topic_buffer,
              buffer_size,
              BUTTON_STATE_TOPIC_FMT,
@@ -62,8 +113,164 @@ void ButtonMsgBuildStatePayload(KeypadButtonParams_t *params, char *payload_buff
     bool comma_needed = false;
     // 2) Add event
     snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
-             "\"event_type\":\"%s\"", params->event == PRESS ? BUTTON_STATE_PAYLOAD_PRESS : BUTTON_STATE_PAYLOAD_HOLD);
+             "\"event_type\":\"%s\"", ButtonMsgEventName(params->event));
     comma_needed = true;
-    // 3) End json
+
+    // 3) Add the keys of a chord
+    if (params->event == CHORD)
+    {
+        if (comma_needed)
+        {
+            strncat(payload_buffer, ",", buffer_size - strlen(payload_buffer) - 1);
+        }
+
+        strncat(payload_buffer, "\"keys\":\"", buffer_size - strlen(payload_buffer) - 1);
+
+        for (uint8_t i = 0; i < KEYPAD_KEYS; i++)
+        {
+            if (params->keys & ((KeypadMask_t)1 << i))
+            {
+                strncat(payload_buffer, i > __builtin_ctzll(params->keys) ? "," : "", buffer_size - strlen(payload_buffer) - 1);
+                strncat(payload_buffer, KEYPAD_KEY_ID[i], buffer_size - strlen(payload_buffer) - 1);
+            }
+        }
+
+        strncat(payload_buffer, "\"", buffer_size - strlen(payload_buffer) - 1);
+    }
+
+    // 4) Add how many times the event happened, more than 1 only when events backed up and were coalesced
+    if (comma_needed)
+    {
+        strncat(payload_buffer, ",", buffer_size - strlen(payload_buffer) - 1);
+    }
+
+    snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
+             "\"count\":%u", params->count);
+
+    // 5) Add the time the event was detected
+    if (BUTTON_STATE_PAYLOAD_TIMESTAMP)
+    {
+        if (comma_needed)
+        {
+            strncat(payload_buffer, ",", buffer_size - strlen(payload_buffer) - 1);
+        }
+
+        snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
+                 "\"timestamp_us\":%llu", (unsigned long long)params->timestamps.detected_us);
+    }
+
+    // 6) End json
     strncat(payload_buffer, "}", buffer_size - strlen(payload_buffer) - 1);
 }
+
+/*-----------------------------------------------------------*/
+
+void ButtonMsgBuildConfigTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, BUTTON_CONFIG_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+bool ButtonMsgIsConfigTopic(const char *topic, size_t topic_length)
+{
+    return topic_length == strlen(BUTTON_CONFIG_TOPIC) &&
+           strncmp(topic, BUTTON_CONFIG_TOPIC, topic_length) == 0;
+}
+
+/*-----------------------------------------------------------*/
+
+bool ButtonMsgParseConfigPayload(KeypadButtonConfig_t *config, const char *payload, size_t payload_length)
+{
+    // Sanity check
+    if (payload_length >= MQTT_PAYLOAD_BUFFER_SIZE)
+    {
+        LogPrintError("payload_length >= MQTT_PAYLOAD_BUFFER_SIZE\n");
+        return false;
+    }
+
+    // Copy payload into json_string as this will be modified
+    memcpy(json_str, payload, payload_length);
+    json_str[payload_length] = '\0';
+    json_t const *json_obj = json_create(json_str, pool, sizeof(pool) / sizeof(pool[0]));
+
+    if (!json_obj || json_getType(json_obj) != JSON_OBJ)
+    {
+        LogPrintError("Failed to create json object\n");
+        return false;
+    }
+
+    return ButtonMsgParseTiming(json_obj, "hold_ms", &config->hold_ms) &&
+           ButtonMsgParseTiming(json_obj, "repeat_ms", &config->repeat_ms) &&
+           ButtonMsgParseTiming(json_obj, "multi_press_ms", &config->multi_press_ms) &&
+           ButtonMsgParseTiming(json_obj, "chord_ms", &config->chord_ms);
+}
+
+/*-----------------------------------------------------------*/
+
+bool ButtonMsgEventFromName(const char *name, KeypadButtonEvent_t *event)
+{
+    for (KeypadButtonEvent_t i = PRESS; i <= CHORD; i++)
+    {
+        if (strcmp(name, ButtonMsgEventName(i)) == 0)
+        {
+            *event = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*-----------------------------------------------------------*/
+
+static const char *ButtonMsgEventName(KeypadButtonEvent_t event)
+{
+    switch (event)
+    {
+        case PRESS:
+            return BUTTON_STATE_PAYLOAD_PRESS;
+
+        case HOLD:
+            return BUTTON_STATE_PAYLOAD_HOLD;
+
+        case DOUBLE_PRESS:
+            return BUTTON_STATE_PAYLOAD_DOUBLE_PRESS;
+
+        case TRIPLE_PRESS:
+            return BUTTON_STATE_PAYLOAD_TRIPLE_PRESS;
+
+        case HOLD_REPEAT:
+            return BUTTON_STATE_PAYLOAD_HOLD_REPEAT;
+
+        case HOLD_RELEASE:
+            return BUTTON_STATE_PAYLOAD_HOLD_RELEASE;
+
+        case CHORD:
+            return BUTTON_STATE_PAYLOAD_CHORD;
+    }
+
+    return BUTTON_STATE_PAYLOAD_PRESS;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool ButtonMsgParseTiming(json_t const *json_obj, const char *name, uint16_t *value)
+{
+    json_t const *prop = json_getProperty(json_obj, name);
+
+    if (!prop)
+    {
+        return true;
+    }
+
+    if (json_getType(prop) != JSON_INTEGER || json_getInteger(prop) < 0 ||
+        json_getInteger(prop) > KEYPAD_BUTTON_TIMING_MAX)
+    {
+        LogPrintError("Button config %s must be an integer 0-%u\n", name, KEYPAD_BUTTON_TIMING_MAX);
+        return false;
+    }
+
+    *value = (uint16_t)json_getInteger(prop);
+    return true;
+}
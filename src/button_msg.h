@@ -30,6 +30,8 @@
 
 // standard includes
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 // alert-panel includes
 #include "keypad.h"
@@ -52,4 +54,43 @@ void ButtonMsgBuildStateTopic(KeypadButtonParams_t *params, char *topic_buffer,
  */
 void ButtonMsgBuildStatePayload(KeypadButtonParams_t *params, char *payload_buffer, size_t buffer_size);
 
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void ButtonMsgBuildConfigTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic
+ * @param topic_length
+ * @return true if topic is the button config topic
+ * @return false
+ */
+bool ButtonMsgIsConfigTopic(const char *topic, size_t topic_length);
+
+/**
+ * @brief Parses gesture timings, properties missing from the payload are left unchanged in config
+ *
+ * @param config
+ * @param payload
+ * @param payload_length
+ * @return true
+ * @return false
+ */
+bool ButtonMsgParseConfigPayload(KeypadButtonConfig_t *config, const char *payload, size_t payload_length);
+
+/**
+ * @brief Looks up a button event by its payload name, e.g. "press"
+ *
+ * @param name
+ * @param event
+ * @return true
+ * @return false if name is not an event name
+ */
+bool ButtonMsgEventFromName(const char *name, KeypadButtonEvent_t *event);
+
 #endif //_BUTTON_MSG_H
\ No newline at end of file
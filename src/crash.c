@@ -0,0 +1,247 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file crash.c
+* @brief
+*/
+#include "crash.h"
+
+// standard includes
+#include <stddef.h>
+#include <string.h>
+
+// pico-sdk includes
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+
+// FreeRTOS-Kernel includes
+#include "task.h"
+
+/**
+ * @brief Watchdog scratch 0 while scratch 1-3 and the RAM record describe a crash
+ *
+ */
+#define CRASH_MAGIC 0x43524153 // "CRAS"
+
+/**
+ * @brief Record of this run, in a section start up neither zeroes nor loads
+ *
+ */
+static CrashRecord_t __uninitialized_ram(crash_record);
+
+/**
+ * @brief Record of the last run
+ *
+ */
+static CrashRecord_t crash_last;
+
+/**
+ * @brief Cleared once the record has been handed out
+ *
+ */
+static bool crash_last_valid = false;
+
+/**
+ * @brief FNV-1a over a record, up to its checksum
+ *
+ * @param record
+ * @return uint32_t
+ */
+static uint32_t CrashChecksum(const CrashRecord_t *record);
+
+/*-----------------------------------------------------------*/
+
+void CrashInit(void)
+{
+    if (watchdog_hw->scratch[0] == CRASH_MAGIC)
+    {
+        crash_last_valid = true;
+
+        if (crash_record.checksum == CrashChecksum(&crash_record) && crash_record.checksum == watchdog_hw->scratch[3])
+        {
+            crash_last = crash_record;
+        }
+        else
+        {
+            // RAM record damaged, only the scratch summary is left
+            memset(&crash_last, 0, sizeof(CrashRecord_t));
+            crash_last.reason = (CrashReason_t)(watchdog_hw->scratch[1] & 0xff);
+            crash_last.core = (uint8_t)(watchdog_hw->scratch[1] >> 8);
+            crash_last.uptime_ms = watchdog_hw->scratch[2];
+        }
+    }
+    else if (watchdog_enable_caused_reboot())
+    {
+        // Nothing recorded the reset, but the record still holds the log entries leading up to it. It has no checksum
+        // and a hang may have come from corrupt memory, so only the log entries are taken and each is bounded
+        crash_last_valid = true;
+        memset(&crash_last, 0, sizeof(CrashRecord_t));
+        crash_last.reason = CRASH_WATCHDOG;
+#ifdef LOG_TOKENIZED
+        crash_last.tokenized = true;
+#endif
+
+        for (uint8_t core = 0; core < configNUMBER_OF_CORES; core++)
+        {
+            for (uint8_t i = 0; i < CRASH_LOG_ENTRIES; i++)
+            {
+                crash_last.log[core][i] = crash_record.log[core][i];
+
+                if (crash_last.log[core][i].length > CRASH_LOG_ENTRY_SIZE)
+                {
+                    crash_last.log[core][i].length = CRASH_LOG_ENTRY_SIZE;
+                }
+            }
+        }
+    }
+
+    watchdog_hw->scratch[0] = 0;
+    memset(&crash_record, 0, sizeof(CrashRecord_t));
+}
+
+/*-----------------------------------------------------------*/
+
+bool CrashLastGet(CrashRecord_t *record)
+{
+    // crash_last is not written after CrashInit(), only the hand out needs the lock
+    taskENTER_CRITICAL();
+    bool valid = crash_last_valid;
+    crash_last_valid = false;
+    taskEXIT_CRITICAL();
+
+    if (valid)
+    {
+        *record = crash_last;
+    }
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+void CrashLogAppend(uint8_t level, const void *entry, uint16_t length)
+{
+    // Frozen once a fault is recorded, the checksum covers it
+    if (crash_record.reason != CRASH_NONE)
+    {
+        return;
+    }
+
+    // Each core only writes its own history, with interrupts disabled, so no lock is needed
+    uint8_t core = portGET_CORE_ID();
+    CrashLogEntry_t *log_entry = &crash_record.log[core][crash_record.log_next[core] % CRASH_LOG_ENTRIES];
+    log_entry->time_us = (uint32_t)time_us_64();
+    log_entry->level = level;
+    log_entry->length = length < CRASH_LOG_ENTRY_SIZE ? length : CRASH_LOG_ENTRY_SIZE;
+    memcpy(log_entry->data, entry, log_entry->length);
+    crash_record.log_next[core]++;
+}
+
+/*-----------------------------------------------------------*/
+
+void CrashRecordFault(CrashReason_t reason, const char *task)
+{
+    // A fault while handling another keeps the first reason
+    if (crash_record.reason != CRASH_NONE)
+    {
+        return;
+    }
+
+    if (task == NULL && xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
+    {
+        task = pcTaskGetName(xTaskGetCurrentTaskHandle());
+    }
+
+    crash_record.reason = reason;
+    strncpy(crash_record.task, task != NULL ? task : "", CRASH_TASK_NAME_SIZE - 1);
+    crash_record.task[CRASH_TASK_NAME_SIZE - 1] = '\0';
+    crash_record.core = portGET_CORE_ID();
+#ifdef LOG_TOKENIZED
+    crash_record.tokenized = true;
+#endif
+    crash_record.uptime_ms = (uint32_t)(time_us_64() / 1000);
+    crash_record.heap_free = xPortGetFreeHeapSize();
+    crash_record.heap_min = xPortGetMinimumEverFreeHeapSize();
+    crash_record.checksum = CrashChecksum(&crash_record);
+    watchdog_hw->scratch[1] = reason | (crash_record.core << 8);
+    watchdog_hw->scratch[2] = crash_record.uptime_ms;
+    watchdog_hw->scratch[3] = crash_record.checksum;
+    watchdog_hw->scratch[0] = CRASH_MAGIC;
+}
+
+/*-----------------------------------------------------------*/
+
+const char *CrashReasonName(CrashReason_t reason)
+{
+    switch (reason)
+    {
+        case CRASH_FAULT:
+            return "fault";
+
+        case CRASH_STACK_OVERFLOW:
+            return "stack_overflow";
+
+        case CRASH_HARD_FAULT:
+            return "hard_fault";
+
+        case CRASH_TASK_STALL:
+            return "task_stall";
+
+        case CRASH_WATCHDOG:
+            return "watchdog";
+
+        default:
+            return "unknown";
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t CrashChecksum(const CrashRecord_t *record)
+{
+    const uint8_t *bytes = (const uint8_t *)record;
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < offsetof(CrashRecord_t, checksum); i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/*-----------------------------------------------------------*/
+
+void isr_hardfault(void)
+{
+    // Replaces the pico-sdk handler, which stops in a breakpoint, so the panel records the fault and restarts. The
+    // current task's handle and name may be what is corrupt, so the task is left empty rather than read
+    CrashRecordFault(CRASH_HARD_FAULT, "");
+    watchdog_enable(1, 1);
+
+    while (1)
+    {
+        // wait
+    }
+}
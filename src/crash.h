@@ -0,0 +1,150 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file crash.h
+* @brief Public functions in this module file are thread-safe
+*
+* The crash record lives in RAM that start up leaves alone, so it survives the watchdog reset that ends a fault. The log
+* rings copy every entry into it as they go, giving the last few log entries of each core. On a fault the reason,
+* task, uptime and heap state are added and a checksum and summary are written to watchdog scratch registers 0-3,
+* which a power cycle clears. CrashInit() takes a valid record at the next boot and empties it for the new run. After
+* a watchdog reset with no fault recorded, only the log entries are kept.
+*/
+#ifndef _CRASH_H
+#define _CRASH_H
+
+// standard includes
+#include <stdint.h>
+#include <stdbool.h>
+
+// FreeRTOS-Kernel includes
+#include "FreeRTOS.h"
+
+/**
+ * @brief Last log entries kept per core
+ *
+ */
+#define CRASH_LOG_ENTRIES       4
+
+/**
+ * @brief Bytes kept of each log entry, text or tokenized record
+ *
+ */
+#define CRASH_LOG_ENTRY_SIZE    96
+
+/**
+ * @brief
+ *
+ */
+#define CRASH_TASK_NAME_SIZE    configMAX_TASK_NAME_LEN
+
+/**
+ * @brief
+ *
+ */
+typedef enum
+{
+    CRASH_NONE = 0,
+    CRASH_FAULT = 1,            // Fault(), the FATAL log entry before it says why
+    CRASH_STACK_OVERFLOW = 2,
+    CRASH_HARD_FAULT = 3,
+    CRASH_TASK_STALL = 4,       // a supervised task missed its heartbeat deadline
+    CRASH_WATCHDOG = 5          // the watchdog reset with no fault recorded, the supervisor itself did not run
+}
+CrashReason_t;
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    uint32_t time_us;
+    uint8_t level;
+    uint8_t length; // 0 if unused
+    uint8_t data[CRASH_LOG_ENTRY_SIZE];
+}
+CrashLogEntry_t;
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    CrashReason_t reason;
+    char task[CRASH_TASK_NAME_SIZE];
+    uint8_t core;
+    bool tokenized; // log entries are LOG_TOKENIZED records
+    uint32_t uptime_ms;
+    uint32_t heap_free;
+    uint32_t heap_min;
+    CrashLogEntry_t log[configNUMBER_OF_CORES][CRASH_LOG_ENTRIES];
+    uint32_t log_next[configNUMBER_OF_CORES];
+    uint32_t checksum;
+}
+CrashRecord_t;
+
+/**
+ * @brief Takes the record of the last run, if it crashed, and starts an empty one, call before anything logs
+ *
+ */
+void CrashInit(void);
+
+/**
+ * @brief Gets the record of the last run, once per boot so it is only reported once
+ *
+ * @param record
+ * @return true
+ * @return false if the last run did not crash or the record was already taken
+ */
+bool CrashLastGet(CrashRecord_t *record);
+
+/**
+ * @brief Copies a log entry into the calling core's history, called by the log rings with interrupts disabled
+ *
+ * @param level
+ * @param entry
+ * @param length
+ */
+void CrashLogAppend(uint8_t level, const void *entry, uint16_t length);
+
+/**
+ * @brief Completes the record of this run ahead of the watchdog reset, the first reason given is kept
+ * Also safe from a fault handler
+ *
+ * @param reason
+ * @param task name of the failing task, NULL for the current one (not from a fault handler, "" there)
+ */
+void CrashRecordFault(CrashReason_t reason, const char *task);
+
+/**
+ * @brief
+ *
+ * @param reason
+ * @return const char*
+ */
+const char *CrashReasonName(CrashReason_t reason);
+
+#endif //_CRASH_H
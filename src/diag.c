@@ -0,0 +1,265 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file diag.c
+* @brief
+*/
+#include "diag.h"
+
+// standard includes
+#include <string.h>
+#include <stdbool.h>
+
+// FreeRTOS-Kernel includes
+#include "task.h"
+
+// alert-panel includes
+#include "diag_msg.h"
+#include "log.h"
+#include "mqtt.h"
+#include "system.h"
+#include "util.h"
+#include "alert_panel_config.h"
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    QueueHandle_t queue;
+    UBaseType_t peak;
+}
+DiagQueuePeak_t;
+
+/**
+ * @brief Run time counter of a task at the last report
+ *
+ */
+typedef struct
+{
+    TaskHandle_t task;
+    uint64_t run_time_us;
+}
+DiagTaskRunTime_t;
+
+/**
+ * @brief Guarded by the FreeRTOS ISR lock, free slots have no queue
+ *
+ */
+static DiagQueuePeak_t queue_peaks[DIAG_QUEUES];
+
+/**
+ * @brief
+ *
+ */
+static DiagTaskRunTime_t run_times[DIAG_TASKS];
+
+/**
+ * @brief
+ *
+ */
+static uint64_t sample_time_us = 0;
+
+/**
+ * @brief
+ *
+ */
+static uint32_t sample_time_ms = 0;
+
+/**
+ * @brief Built at each sample, cleared once submitted
+ *
+ */
+static MqttMessage_t tasks_message;
+
+/**
+ * @brief
+ *
+ */
+static MqttMessage_t system_message;
+
+/**
+ * @brief Fills both messages with a new set of diagnostics
+ *
+ */
+static void DiagSample(void);
+
+/**
+ * @brief Submits whichever message is still waiting, tasks first, one per call as only one can wait at a time
+ *
+ */
+static void DiagSend(void);
+
+/*-----------------------------------------------------------*/
+
+void DiagQueueSent(QueueHandle_t queue)
+{
+    UBaseType_t waiting = uxQueueMessagesWaiting(queue);
+    UBaseType_t interrupts = taskENTER_CRITICAL_FROM_ISR();
+
+    for (uint8_t i = 0; i < DIAG_QUEUES; i++)
+    {
+        if (queue_peaks[i].queue == NULL)
+        {
+            queue_peaks[i].queue = queue;
+        }
+
+        if (queue_peaks[i].queue == queue)
+        {
+            queue_peaks[i].peak = waiting > queue_peaks[i].peak ? waiting : queue_peaks[i].peak;
+            break;
+        }
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR(interrupts);
+}
+
+/*-----------------------------------------------------------*/
+
+void DiagPoll(void)
+{
+    uint32_t time_now = GetTimeMs();
+
+    if (GetElapsedMs(sample_time_ms, time_now) >= DIAG_PERIOD)
+    {
+        DiagSample();
+        sample_time_ms = time_now;
+    }
+
+    DiagSend();
+}
+
+/*-----------------------------------------------------------*/
+
+static void DiagSample(void)
+{
+    static TaskStatus_t tasks[DIAG_TASKS]; // Too large for the task stack
+    static DiagMsgTaskParams_t task_params[DIAG_TASKS];
+    static DiagTaskRunTime_t last_run_times[DIAG_TASKS];
+    static DiagMsgQueueParams_t queue_params[DIAG_QUEUES];
+    static QueueHandle_t queues[DIAG_QUEUES];
+    uint64_t time_now_us = GetTimeUs();
+    uint64_t elapsed_us = time_now_us - sample_time_us;
+    UBaseType_t count = uxTaskGetSystemState(tasks, DIAG_TASKS, NULL);
+
+    if (count == 0)
+    {
+        LogPrintWarn("More than %u tasks, diagnostics left out\n", DIAG_TASKS);
+    }
+
+    memcpy(last_run_times, run_times, sizeof(run_times));
+    memset(run_times, 0, sizeof(run_times));
+
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        uint64_t run_time_us = tasks[i].ulRunTimeCounter;
+        uint64_t last_run_time_us = 0;
+
+        // A task started since the last report counts from when it started
+        for (uint8_t j = 0; j < DIAG_TASKS; j++)
+        {
+            if (last_run_times[j].task == tasks[i].xHandle)
+            {
+                last_run_time_us = last_run_times[j].run_time_us;
+                break;
+            }
+        }
+
+        uint64_t busy_us = run_time_us > last_run_time_us ? run_time_us - last_run_time_us : 0;
+        run_times[i].task = tasks[i].xHandle;
+        run_times[i].run_time_us = run_time_us;
+        task_params[i].name = tasks[i].pcTaskName;
+        task_params[i].core = tasks[i].uxCoreAffinityMask == AFFINITY_CORE_0 ? 0 :
+                              tasks[i].uxCoreAffinityMask == AFFINITY_CORE_1 ? 1 : -1;
+        task_params[i].cpu_permille = elapsed_us > 0 ? (uint16_t)((busy_us * 1000) / elapsed_us) : 0;
+        task_params[i].stack_free = tasks[i].usStackHighWaterMark * sizeof(StackType_t);
+    }
+
+    sample_time_us = time_now_us;
+    DiagMsgBuildTasksTopic(tasks_message.topic.data, MQTT_TOPIC_BUFFER_SIZE);
+    tasks_message.topic.length = strlen(tasks_message.topic.data);
+    uint8_t built = DiagMsgBuildTasksPayload(task_params, (uint8_t)count, tasks_message.payload.data,
+                                             MQTT_PAYLOAD_BUFFER_SIZE);
+    tasks_message.payload.length = strlen(tasks_message.payload.data);
+
+    if (built < count)
+    {
+        LogPrintWarn("%lu of %lu tasks left out of the diagnostics, no room\n",
+                     (unsigned long)(count - built),
+                     (unsigned long)count);
+    }
+
+    DiagMsgSystemParams_t system_params =
+    {
+        .uptime_s = (uint32_t)(time_now_us / 1000000),
+        .heap_free = xPortGetFreeHeapSize(),
+        .heap_min = xPortGetMinimumEverFreeHeapSize(),
+        .queues = queue_params,
+        .queue_count = 0
+    };
+
+    UBaseType_t interrupts = taskENTER_CRITICAL_FROM_ISR();
+
+    for (uint8_t i = 0; i < DIAG_QUEUES && queue_peaks[i].queue != NULL; i++)
+    {
+        queue_params[i].peak = queue_peaks[i].peak;
+        queues[i] = queue_peaks[i].queue;
+        system_params.queue_count++;
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR(interrupts);
+    MqttPublishStatsGet(&system_params.publish);
+
+    for (uint8_t i = 0; i < system_params.queue_count; i++)
+    {
+        const char *name = pcQueueGetName(queues[i]);
+        queue_params[i].name = name != NULL ? name : "unnamed";
+        queue_params[i].length = uxQueueMessagesWaiting(queues[i]) + uxQueueSpacesAvailable(queues[i]);
+    }
+
+    DiagMsgBuildSystemTopic(system_message.topic.data, MQTT_TOPIC_BUFFER_SIZE);
+    system_message.topic.length = strlen(system_message.topic.data);
+    DiagMsgBuildSystemPayload(&system_params, system_message.payload.data, MQTT_PAYLOAD_BUFFER_SIZE);
+    system_message.payload.length = strlen(system_message.payload.data);
+}
+
+/*-----------------------------------------------------------*/
+
+static void DiagSend(void)
+{
+    MqttMessage_t *message = tasks_message.topic.length > 0 ? &tasks_message : &system_message;
+
+    if (message->topic.length == 0)
+    {
+        return;
+    }
+
+    // Waits for the next call if MQTT is busy or not connected, a new sample replaces it in the end
+    if (MqttSubmitBackgroundPublish(message->topic.data, message->topic.length, message->payload.data,
+                                    message->payload.length, MQTTQoS0, false))
+    {
+        message->topic.length = 0;
+    }
+}
@@ -0,0 +1,71 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file diag.h
+* @brief DiagQueueSent() is thread-safe, DiagPoll() is NOT, only LaunchTask calls it
+*
+* Publishes run time diagnostics every DIAG_PERIOD, as background publishes (see MqttSubmitBackgroundPublish): the CPU
+* share of each task since the last report and the stack it has never used to <client id>/diag/tasks, and the heap's
+* free and least ever free space and the deepest each application queue has been to <client id>/diag/system. CPU
+* shares come from the FreeRTOS run time stats, which count the 1 MHz timer.
+*/
+#ifndef _DIAG_H
+#define _DIAG_H
+
+// FreeRTOS-Kernel includes
+#include "FreeRTOS.h"
+#include "queue.h"
+
+/**
+ * @brief How often (ms) diagnostics are published
+ *
+ */
+#define DIAG_PERIOD     (60 * 1000)
+
+/**
+ * @brief Most tasks reported
+ *
+ */
+#define DIAG_TASKS      24
+
+/**
+ * @brief Most queues whose depth is tracked
+ *
+ */
+#define DIAG_QUEUES     8
+
+/**
+ * @brief Notes how deep a queue is after a send, call after every successful send to it
+ *
+ * @param queue named in the queue registry
+ */
+void DiagQueueSent(QueueHandle_t queue);
+
+/**
+ * @brief Takes a new set of diagnostics every DIAG_PERIOD and publishes them, call about once a second
+ *
+ */
+void DiagPoll(void);
+
+#endif //_DIAG_H
@@ -0,0 +1,117 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file diag_msg.c
+* @brief
+*/
+#include "diag_msg.h"
+
+// standard includes
+#include <stdio.h>
+
+// alert-panel includes
+#include "alert_panel_config.h"
+
+// task cpu share and stack: from alert-panel to broker (publish)
+#define DIAG_TASKS_TOPIC    MQTT_CLIENT_ID "/diag/tasks"
+
+// heap and queues: from alert-panel to broker (publish)
+#define DIAG_SYSTEM_TOPIC   MQTT_CLIENT_ID "/diag/system"
+
+/*-----------------------------------------------------------*/
+
+void DiagMsgBuildTasksTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, DIAG_TASKS_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+uint8_t DiagMsgBuildTasksPayload(const DiagMsgTaskParams_t *tasks, uint8_t count, char *payload_buffer,
+                                 size_t buffer_size)
+{
+    // Room is kept for the closing brace
+    size_t length = snprintf(payload_buffer, buffer_size, "{");
+    uint8_t built = 0;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        int written = snprintf(payload_buffer + length, buffer_size - length - 1, "%s\"%s\":[%d,%u.%u,%lu]",
+                               built > 0 ? "," : "", tasks[i].name, tasks[i].core, tasks[i].cpu_permille / 10,
+                               tasks[i].cpu_permille % 10, (unsigned long)tasks[i].stack_free);
+
+        if (written < 0 || (size_t)written >= buffer_size - length - 1)
+        {
+            break;
+        }
+
+        length += written;
+        built++;
+    }
+
+    snprintf(payload_buffer + length, buffer_size - length, "}");
+    return built;
+}
+
+/*-----------------------------------------------------------*/
+
+void DiagMsgBuildSystemTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, DIAG_SYSTEM_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+void DiagMsgBuildSystemPayload(const DiagMsgSystemParams_t *params, char *payload_buffer, size_t buffer_size)
+{
+    // Room is kept for the closing braces
+    const MqttPublishStats_t *publish = &params->publish;
+    size_t length = snprintf(payload_buffer, buffer_size,
+                             "{\"uptime_s\":%lu,\"heap_free\":%lu,\"heap_min\":%lu,\"publish\":{\"count\":%lu,"
+                             "\"queue_us\":[%lu,%lu],\"send_us\":[%lu,%lu],\"ack_us\":[%lu,%lu]},\"queues\":{",
+                             (unsigned long)params->uptime_s, (unsigned long)params->heap_free,
+                             (unsigned long)params->heap_min, (unsigned long)publish->publishes,
+                             (unsigned long)(publish->publishes > 0 ? publish->queue_us_total / publish->publishes : 0),
+                             (unsigned long)publish->queue_us_max,
+                             (unsigned long)(publish->publishes > 0 ? publish->send_us_total / publish->publishes : 0),
+                             (unsigned long)publish->send_us_max,
+                             (unsigned long)(publish->acks > 0 ? publish->ack_us_total / publish->acks : 0),
+                             (unsigned long)publish->ack_us_max);
+
+    for (uint8_t i = 0; i < params->queue_count && length < buffer_size - 2; i++)
+    {
+        int written = snprintf(payload_buffer + length, buffer_size - length - 2, "%s\"%s\":[%lu,%lu]",
+                               i > 0 ? "," : "", params->queues[i].name, (unsigned long)params->queues[i].peak,
+                               (unsigned long)params->queues[i].length);
+
+        if (written < 0 || (size_t)written >= buffer_size - length - 2)
+        {
+            break;
+        }
+
+        length += written;
+    }
+
+    snprintf(payload_buffer + length, buffer_size - length, "}}");
+}
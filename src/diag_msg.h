@@ -0,0 +1,119 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file diag_msg.h
+* @brief Public functions in this module file are NOT thread-safe
+*/
+#ifndef _DIAG_MSG_H
+#define _DIAG_MSG_H
+
+// standard includes
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// alert-panel includes
+#include "mqtt.h"
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    const char *name;
+    int8_t core;                // -1 when the task may run on either core
+    uint16_t cpu_permille;      // of its core's time since the last report
+    uint32_t stack_free;        // bytes never used since the task started
+}
+DiagMsgTaskParams_t;
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    const char *name;
+    uint32_t peak;              // most items ever waiting
+    uint32_t length;
+}
+DiagMsgQueueParams_t;
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    uint32_t uptime_s;
+    uint32_t heap_free;
+    uint32_t heap_min;          // least ever free
+    MqttPublishStats_t publish;
+    const DiagMsgQueueParams_t *queues;
+    uint8_t queue_count;
+}
+DiagMsgSystemParams_t;
+
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void DiagMsgBuildTasksTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief Builds the task payload, e.g. {"KeypadTask":[0,1.2,344]}, core, CPU % and stack bytes free
+ * Tasks that do not fit are left out
+ *
+ * @param tasks
+ * @param count
+ * @param payload_buffer
+ * @param buffer_size
+ * @return uint8_t number of tasks in the payload
+ */
+uint8_t DiagMsgBuildTasksPayload(const DiagMsgTaskParams_t *tasks, uint8_t count, char *payload_buffer,
+                                 size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void DiagMsgBuildSystemTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief Builds the system payload, e.g. {"uptime_s":60,"heap_free":30112,"heap_min":28004,"publish":{"count":42,
+ * "queue_us":[150,900],"send_us":[420,2100],"ack_us":[8200,31000]},"queues":{"command_queue":[3,20]}}, the average
+ * and max publish latencies since start, and a queue's peak and length. Queues that do not fit are left out
+ *
+ * @param params
+ * @param payload_buffer
+ * @param buffer_size
+ */
+void DiagMsgBuildSystemPayload(const DiagMsgSystemParams_t *params, char *payload_buffer, size_t buffer_size);
+
+#endif //_DIAG_MSG_H
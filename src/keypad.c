@@ -33,36 +33,220 @@
 // FreeRTOS-Kernel includes
 #include "task.h"
 #include "queue.h"
+#include "semphr.h"
 
 // alert-panel includes
+#include "diag.h"
 #include "keypad_driver.h"
+#include "keypad_gesture.h"
+#include "keypad_scene.h"
+#include "keypad_binding.h"
+#include "keypad_rule.h"
+#include "keypad_animation.h"
+#include "rtos_manifest.h"
+#include "supervisor.h"
 #include "system.h"
 #include "log.h"
 #include "util.h"
 
 /**
- * @brief
+ * @brief Default gesture timings (ms), repeat, multi-press and chords are off until configured
  *
  */
-#define KEYPAD_BUTTON_HOLD_DURATION  800
+#define KEYPAD_BUTTON_HOLD_DURATION         800
+#define KEYPAD_BUTTON_REPEAT_DURATION       0
+#define KEYPAD_BUTTON_MULTI_PRESS_DURATION  0
+#define KEYPAD_BUTTON_CHORD_DURATION        0
 
 /**
- * @brief
+ * @brief Button poll periods (ms), fast while buttons are in use and slow once the keypad has been idle for a while
  *
  */
-#define KEYPAD_POLL_PERIOD  10
+#define KEYPAD_POLL_PERIOD_FAST     10
+#define KEYPAD_POLL_PERIOD_SLOW     50
 
 /**
- * @brief
+ * @brief How long (ms) polling stays fast after the last button activity
+ *
+ */
+#define KEYPAD_POLL_ACTIVE_DURATION 5000
+
+/**
+ * @brief How often (ms) poll statistics are logged
+ *
+ */
+#define KEYPAD_POLL_STATS_PERIOD    (15 * 60 * 1000)
+
+/**
+ * @brief A button poll starting later than this (ms) after it was due counts as a missed deadline
+ *
+ */
+#define KEYPAD_POLL_DEADLINE        2
+
+/**
+ * @brief An led event written to the keypad later than this (ms) after it was queued counts as a missed deadline
+ *
+ */
+#define KEYPAD_LED_EVENT_DEADLINE   (KEYPAD_POLL_PERIOD_SLOW + KEYPAD_POLL_DEADLINE)
+
+/**
+ * @brief Most led events applied before flushing, so a burst of commands still reaches the leds steadily
+ *
+ */
+#define KEYPAD_LED_EVENT_BUDGET     4
+
+/**
+ * @brief Longest time (ms) between loops before the supervisor restarts the panel
+ *
+ */
+#define KEYPAD_HEARTBEAT_DEADLINE   2000
+
+/**
+ * @brief Chords waiting to be taken, further chords are dropped until there is room
+ *
+ */
+#define KEYPAD_BUTTON_CHORDS        4
+
+/**
+ * @brief Temporal dithering of led levels, this flushes the leds every poll period
+ *
+ */
+#define KEYPAD_LED_DITHERING    false
+
+/**
+ * @brief How the keypads are mounted, clockwise rotation (0, 90, 180 or 270) of the pcb relative to the key id layout,
+ * mirrored flips the key id layout left to right first. Key ids run left to right, top to bottom, 4 per row
+ *
+ */
+#define KEYPAD_ROTATION     90
+#define KEYPAD_MIRRORED     false
+
+_Static_assert(KEYPAD_ROTATION == 0 || KEYPAD_ROTATION == 90 || KEYPAD_ROTATION == 180 || KEYPAD_ROTATION == 270,
+               "KEYPAD_ROTATION must be 0, 90, 180 or 270");
+
+/**
+ * @brief Row and column of key id position p (0-15) within a keypad
+ *
+ */
+#define KEYPAD_LAYOUT_ROW(p)    ((p) / 4)
+#define KEYPAD_LAYOUT_COL(p)    (KEYPAD_MIRRORED ? 3 - ((p) % 4) : ((p) % 4))
+
+/**
+ * @brief Pcb x/y (driver index x + 4y) of key id position p within a keypad
+ *
+ */
+#define KEYPAD_LAYOUT_X(p) \
+    (KEYPAD_ROTATION == 0 ? KEYPAD_LAYOUT_COL(p) : KEYPAD_ROTATION == 90 ? 3 - KEYPAD_LAYOUT_ROW(p) : \
+     KEYPAD_ROTATION == 180 ? 3 - KEYPAD_LAYOUT_COL(p) : KEYPAD_LAYOUT_ROW(p))
+#define KEYPAD_LAYOUT_Y(p) \
+    (KEYPAD_ROTATION == 0 ? KEYPAD_LAYOUT_ROW(p) : KEYPAD_ROTATION == 90 ? KEYPAD_LAYOUT_COL(p) : \
+     KEYPAD_ROTATION == 180 ? 3 - KEYPAD_LAYOUT_ROW(p) : 3 - KEYPAD_LAYOUT_COL(p))
+#define KEYPAD_LAYOUT_INDEX(p)  (KEYPAD_LAYOUT_X(p) + (4 * KEYPAD_LAYOUT_Y(p)))
+
+/**
+ * @brief Inverse of the above, key id position of driver index i (0-15) within a keypad
  *
  */
-const char KEYPAD_KEY_ID[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+#define KEYPAD_LAYOUT_INV_ROW(i) \
+    (KEYPAD_ROTATION == 0 ? (i) / 4 : KEYPAD_ROTATION == 90 ? 3 - ((i) % 4) : \
+     KEYPAD_ROTATION == 180 ? 3 - ((i) / 4) : (i) % 4)
+#define KEYPAD_LAYOUT_INV_COL(i) \
+    (KEYPAD_ROTATION == 0 ? (i) % 4 : KEYPAD_ROTATION == 90 ? (i) / 4 : \
+     KEYPAD_ROTATION == 180 ? 3 - ((i) % 4) : 3 - ((i) / 4))
+#define KEYPAD_LAYOUT_POSITION(i) \
+    ((4 * KEYPAD_LAYOUT_INV_ROW(i)) + (KEYPAD_MIRRORED ? 3 - KEYPAD_LAYOUT_INV_COL(i) : KEYPAD_LAYOUT_INV_COL(i)))
+
+/**
+ * @brief Expands f(b, 0) ... f(b, 15)
+ *
+ */
+#define KEYPAD_BOARD_KEYS(f, b) \
+    f(b, 0), f(b, 1), f(b, 2), f(b, 3), f(b, 4), f(b, 5), f(b, 6), f(b, 7), \
+    f(b, 8), f(b, 9), f(b, 10), f(b, 11), f(b, 12), f(b, 13), f(b, 14), f(b, 15)
+
+#define KEYPAD_BOARD_INDEX(b, p)    (((b) * 16) + KEYPAD_LAYOUT_INDEX(p))
+#define KEYPAD_BOARD_POSITION(b, i) (((b) * 16) + KEYPAD_LAYOUT_POSITION(i))
+#define KEYPAD_LAYOUT_ROUND_TRIP(p) (KEYPAD_LAYOUT_POSITION(KEYPAD_LAYOUT_INDEX(p)) == (p))
+
+_Static_assert(KEYPAD_LAYOUT_ROUND_TRIP(0) && KEYPAD_LAYOUT_ROUND_TRIP(1) && KEYPAD_LAYOUT_ROUND_TRIP(2) &&
+               KEYPAD_LAYOUT_ROUND_TRIP(3) && KEYPAD_LAYOUT_ROUND_TRIP(4) && KEYPAD_LAYOUT_ROUND_TRIP(5) &&
+               KEYPAD_LAYOUT_ROUND_TRIP(6) && KEYPAD_LAYOUT_ROUND_TRIP(7) && KEYPAD_LAYOUT_ROUND_TRIP(8) &&
+               KEYPAD_LAYOUT_ROUND_TRIP(9) && KEYPAD_LAYOUT_ROUND_TRIP(10) && KEYPAD_LAYOUT_ROUND_TRIP(11) &&
+               KEYPAD_LAYOUT_ROUND_TRIP(12) && KEYPAD_LAYOUT_ROUND_TRIP(13) && KEYPAD_LAYOUT_ROUND_TRIP(14) &&
+               KEYPAD_LAYOUT_ROUND_TRIP(15), "KEYPAD_LAYOUT_POSITION must invert KEYPAD_LAYOUT_INDEX");
+
+/**
+ * @brief Key ids of chained keypad b (b > 0), the first keypad keeps the single character ids
+ *
+ */
+#define KEYPAD_BOARD_KEY_ID(b) \
+    #b "0", #b "1", #b "2", #b "3", #b "4", #b "5", #b "6", #b "7", \
+    #b "8", #b "9", #b "a", #b "b", #b "c", #b "d", #b "e", #b "f"
 
 /**
  * @brief
  *
  */
-const uint8_t KEYPAD_KEY_INDEX[] = {0x03, 0x07, 0x0b, 0x0f, 0x02, 0x06, 0x0a, 0x0e, 0x01, 0x05, 0x09, 0x0d, 0x00, 0x04, 0x08, 0x0c};
+const char *const KEYPAD_KEY_ID[KEYPAD_KEYS] =
+{
+    "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "a", "b", "c", "d", "e", "f",
+#if KEYPAD_DRIVER_BOARDS > 1
+    KEYPAD_BOARD_KEY_ID(1),
+#endif
+#if KEYPAD_DRIVER_BOARDS > 2
+    KEYPAD_BOARD_KEY_ID(2),
+#endif
+#if KEYPAD_DRIVER_BOARDS > 3
+    KEYPAD_BOARD_KEY_ID(3),
+#endif
+};
+
+/**
+ * @brief Driver key index of each key id position
+ *
+ */
+const uint8_t KEYPAD_KEY_INDEX[KEYPAD_KEYS] =
+{
+    KEYPAD_BOARD_KEYS(KEYPAD_BOARD_INDEX, 0),
+#if KEYPAD_DRIVER_BOARDS > 1
+    KEYPAD_BOARD_KEYS(KEYPAD_BOARD_INDEX, 1),
+#endif
+#if KEYPAD_DRIVER_BOARDS > 2
+    KEYPAD_BOARD_KEYS(KEYPAD_BOARD_INDEX, 2),
+#endif
+#if KEYPAD_DRIVER_BOARDS > 3
+    KEYPAD_BOARD_KEYS(KEYPAD_BOARD_INDEX, 3),
+#endif
+};
+
+/**
+ * @brief Key id position of each driver key index
+ *
+ */
+const uint8_t KEYPAD_KEY_POSITION[KEYPAD_KEYS] =
+{
+    KEYPAD_BOARD_KEYS(KEYPAD_BOARD_POSITION, 0),
+#if KEYPAD_DRIVER_BOARDS > 1
+    KEYPAD_BOARD_KEYS(KEYPAD_BOARD_POSITION, 1),
+#endif
+#if KEYPAD_DRIVER_BOARDS > 2
+    KEYPAD_BOARD_KEYS(KEYPAD_BOARD_POSITION, 2),
+#endif
+#if KEYPAD_DRIVER_BOARDS > 3
+    KEYPAD_BOARD_KEYS(KEYPAD_BOARD_POSITION, 3),
+#endif
+};
+
+/**
+ * @brief Led parameters applied together and written to the device with a single flush
+ *
+ */
+typedef struct
+{
+    uint8_t count;
+    KeypadLedParams_t params[KEYPAD_KEYS];
+}
+KeypadLedBatch_t;
 
 /**
  * @brief
@@ -70,208 +254,950 @@ const uint8_t KEYPAD_KEY_INDEX[] = {0x03, 0x07, 0x0b, 0x0f, 0x02, 0x06, 0x0a, 0x
  */
 typedef enum
 {
-    RELEASED = 0,
-    PRESSED = 1,
-    HELD = 2
+    LED_BATCH = 1,
+    LED_SCENE = 2,
+    LED_BINDING = 3,
+    LED_RULE = 4,
+    LED_FADE = 5,
+    LED_ANIMATION = 6,
 }
-KeyButtonState_t;
+KeypadLedEventType_t;
 
 /**
- * @brief
+ * @brief Incoming led event, either led parameters (written at once or faded to), a scene action, a binding action,
+ * a rule program or an animation marker, whose timeline waits on animation_queue so the other events stay small
  *
  */
 typedef struct
 {
-    KeyButtonState_t last_state;
-    uint32_t last_updated;
+    KeypadLedEventType_t type;
+    uint32_t queued_ms;
+    union
+    {
+        KeypadLedBatch_t batch;
+        KeypadSceneParams_t scene;
+        KeypadBindingParams_t binding;
+        KeypadRuleProgram_t rule;
+        KeypadLedFadeParams_t fade;
+    };
+}
+KeypadLedEvent_t;
+
+/**
+ * @brief Button polling and led event statistics since the last report
+ *
+ */
+typedef struct
+{
+    uint32_t polls;             // button scans, each reads all KEYPAD_DRIVER_BOARDS expanders
+    uint32_t presses;
+    uint32_t latency_total;     // sum of the poll period in force at each press, the worst case detection latency
+    uint32_t latency_max;
+    uint32_t fast_time;         // ms spent polling at the fast rate
+    uint32_t coalesced;         // button events merged into one already waiting
+    uint32_t dropped;           // events dropped with no room left for them to wait
+    uint32_t poll_misses;       // polls started more than KEYPAD_POLL_DEADLINE late
+    uint32_t poll_late_max;
+    uint32_t led_events;
+    uint32_t led_misses;        // led events written to the keypad more than KEYPAD_LED_EVENT_DEADLINE after being queued
+    uint32_t led_late_max;
+    uint32_t frames;            // animation frames rendered
+    uint32_t frame_misses;      // frames rendered a whole frame period or more late
+    uint32_t since;
+}
+KeypadPollStats_t;
+
+/**
+ * @brief Run of one button event type on a key, repeats of the type only bump the count
+ *
+ */
+typedef struct
+{
+    uint8_t event;  // KeypadButtonEvent_t
+    uint8_t count;  // saturating
+}
+KeypadButtonRun_t;
+
+/**
+ * @brief Button events waiting to be taken by KeypadButtonEventReceive, guarded by a critical section
+ * Fixed size whatever the backlog, an event repeating the last one waiting on its key only bumps a count, so posting
+ * never blocks the poll. Any other event starts a new run, so each key's events stay in order
+ *
+ */
+typedef struct
+{
+    KeypadButtonRun_t runs[KEYPAD_KEYS][KEYPAD_BUTTON_EVENTS_MAX];  // by position, oldest first
+    uint8_t run_counts[KEYPAD_KEYS];
+    KeypadButtonTimestamps_t timestamps[KEYPAD_KEYS];   // of the first event waiting on each key
+    KeypadMask_t keys;                                  // positions with any run
+    KeypadMask_t chords[KEYPAD_BUTTON_CHORDS];          // oldest first, positions
+    KeypadButtonTimestamps_t chord_timestamps[KEYPAD_BUTTON_CHORDS];
+    uint8_t chord_count;
+}
+KeypadButtonPending_t;
+
+/**
+ * @brief Gesture timings, guarded by a critical section as they are set from other tasks
+ *
+ */
+static KeypadButtonConfig_t button_config =
+{
+    .hold_ms = KEYPAD_BUTTON_HOLD_DURATION,
+    .repeat_ms = KEYPAD_BUTTON_REPEAT_DURATION,
+    .multi_press_ms = KEYPAD_BUTTON_MULTI_PRESS_DURATION,
+    .chord_ms = KEYPAD_BUTTON_CHORD_DURATION
+};
+
+/**
+ * @brief Set when button_config changed and the gesture recogniser needs reconfiguring
+ *
+ */
+static bool button_config_changed;
+
+/**
+ * @brief
+ *
+ */
+static KeypadPollStats_t poll_stats;
+
+/**
+ * @brief Button states and time of the last activity, for choosing the poll period
+ *
+ */
+static KeypadMask_t poll_last_buttons;
+
+/**
+ * @brief
+ *
+ */
+static uint32_t poll_last_active;
+
+/**
+ * @brief Incoming led parameter messages
+ *
+ */
+static QueueHandle_t led_event_queue;
+
+/**
+ * @brief
+ *
+ */
+static uint8_t led_event_queue_storage[KEYPAD_LED_EVENT_QUEUE_LENGTH * sizeof(KeypadLedEvent_t)];
+
+/**
+ * @brief
+ *
+ */
+static StaticQueue_t led_event_queue_buffer;
+
+/**
+ * @brief Led event being sent, built here rather than on the sending task's stack, guarded by led_event_send_mutex
+ *
+ */
+static KeypadLedEvent_t led_event_send;
+
+/**
+ * @brief
+ *
+ */
+static SemaphoreHandle_t led_event_send_mutex;
+
+/**
+ * @brief
+ *
+ */
+static StaticSemaphore_t led_event_send_mutex_buffer;
+
+/**
+ * @brief Incoming animation timelines, each taken when its LED_ANIMATION marker comes off led_event_queue
+ *
+ */
+static QueueHandle_t animation_queue;
+
+/**
+ * @brief
+ *
+ */
+static uint8_t animation_queue_storage[KEYPAD_ANIMATION_QUEUE_LENGTH * sizeof(KeypadAnimationParams_t)];
+
+/**
+ * @brief
+ *
+ */
+static StaticQueue_t animation_queue_buffer;
+
+/**
+ * @brief Outgoing button events
+ *
+ */
+static KeypadButtonPending_t button_pending;
+
+/**
+ * @brief Given when button events are posted
+ *
+ */
+static SemaphoreHandle_t button_event_signal;
+
+/**
+ * @brief
+ *
+ */
+static StaticSemaphore_t button_event_signal_buffer;
+
+/**
+ * @brief Applied led state of each key (by position in KEYPAD_KEY_ID), guarded by led_state_mutex
+ *
+ */
+static KeypadLedState_t led_state[KEYPAD_KEYS];
+
+/**
+ * @brief Keys whose applied led state changed since the last KeypadLedStateChangeReceive
+ *
+ */
+static KeypadMask_t led_state_changed;
+
+/**
+ * @brief Effect last requested for each key (by position in KEYPAD_KEY_ID), only touched by KeypadTask
+ *
+ */
+static KeypadLedEffect_t led_effect[KEYPAD_KEYS];
+
+/**
+ * @brief
+ *
+ */
+static SemaphoreHandle_t led_state_mutex;
+
+/**
+ * @brief
+ *
+ */
+static StaticSemaphore_t led_state_mutex_buffer;
+
+/**
+ * @brief Given whenever led_state_changed gains new bits
+ *
+ */
+static SemaphoreHandle_t led_state_signal;
+
+/**
+ * @brief
+ *
+ */
+static StaticSemaphore_t led_state_signal_buffer;
+
+/**
+ * @brief
+ *
+ */
+static StackType_t keypad_task_stack[KEYPAD_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t keypad_task_buffer;
+
+/**
+ * @brief
+ *
+ * @param params
+ */
+static void KeypadTask(void *params);
+
+/**
+ * @brief Takes led_event_send for building an event of the given type, released by KeypadLedEventQueuePost
+ *
+ * @param type
+ * @return KeypadLedEvent_t*
+ */
+static KeypadLedEvent_t *KeypadLedEventSendTake(KeypadLedEventType_t type);
+
+/**
+ * @brief Stamps led_event_send, queues it for the keypad task and releases it
+ *
+ */
+static void KeypadLedEventQueuePost();
+
+/**
+ * @brief Receive submitted led parameters to be written to the device
+ * Returns once the next button poll is due, events still queued wait for the next call
+ *
+ * @param ticks_to_wait
+ * @param poll_due time (ms) the next button poll is due
+ */
+static void KeypadLedEventQueueReceive(TickType_t ticks_to_wait, uint32_t poll_due);
+
+/**
+ * @brief Processes a single led parameter and calls approproate keypad driver functions to write to device
+ *
+ * @param params
+ */
+static void KeypadProcessLedEvent(const KeypadLedParams_t *params);
+
+/**
+ * @brief Fades a key to led parameters, anything that cannot be faded is written at once
+ *
+ * @param params
+ * @param time_now
+ */
+static void KeypadProcessFadeEvent(const KeypadLedFadeParams_t *params, uint32_t time_now);
+
+/**
+ * @brief Renders and flushes an animation frame, then commits the led state of keys that stopped animating
+ *
+ * @param time_now
+ */
+static void KeypadAnimationFrame(uint32_t time_now);
+
+/**
+ * @brief Updates the led state model from what was just flushed to the device
+ *
+ */
+static KeypadMask_t KeypadLedStateCommit();
+
+/**
+ * @brief Commits the applied led state and runs the led rules of the keys that changed
+ * Changes made by those rules are committed without running rules again, so rules cannot trigger each other endlessly
+ *
+ */
+static void KeypadLedStateUpdate();
+
+/**
+ * @brief Carries out a scene action
+ *
+ * @param params
+ * @return true if the keypad needs flushing
+ */
+static bool KeypadProcessSceneEvent(KeypadSceneParams_t *params);
+
+/**
+ * @brief Carries out a binding action
+ *
+ * @param params
+ */
+static void KeypadProcessBindingEvent(KeypadBindingParams_t *params);
+
+/**
+ * @brief Applies the led bindings of keys that saw a button event
+ *
+ * @param keys key indexes, as reported by the gesture recogniser
+ * @param event
+ * @return true if any led was written
+ * @return false
+ */
+static bool KeypadButtonBindingsApply(KeypadMask_t keys, KeypadButtonEvent_t event);
+
+/**
+ * @brief Runs the rules of a trigger for each key and applies the led writes they make
+ *
+ * @param positions key positions
+ * @param trigger
+ * @return true if any led was written
+ * @return false
+ */
+static bool KeypadRulesRun(KeypadMask_t positions, uint8_t trigger);
+
+/**
+ * @brief Polls the buttons and runs the gesture recogniser
+ *
+ * @param time_now
+ * @param period the poll period that was in force (ms)
+ * @return uint32_t the period until the next poll (ms)
+ */
+static uint32_t KeypadButtonStatePoll(uint32_t time_now, uint32_t period);
+
+/**
+ * @brief Logs poll statistics once KEYPAD_POLL_STATS_PERIOD has passed, then restarts them
+ *
+ * @param time_now
+ */
+static void KeypadPollStatsReport(uint32_t time_now);
+
+/**
+ * @brief Posts one event for every key in the mask, never blocks
+ *
+ * @param keys mask of key indexes
+ * @param event
+ * @param timestamps
+ * @return true if anything was posted
+ * @return false
+ */
+static bool KeypadButtonEventPostKeys(KeypadMask_t keys, KeypadButtonEvent_t event, const KeypadButtonTimestamps_t *timestamps);
+
+/**
+ * @brief Posts a single chord event for all keys in the mask, never blocks
+ *
+ * @param keys mask of key indexes
+ * @param timestamps
+ * @return true if anything was posted
+ * @return false
+ */
+static bool KeypadButtonEventPostChord(KeypadMask_t keys, const KeypadButtonTimestamps_t *timestamps);
+
+/**
+ * @brief Gets the key id position from id, faults on an unknown id (ids are validated when messages are parsed)
+ *
+ * @param key_id
+ * @return uint8_t
+ */
+static uint8_t KeypadPositionFromId(const char *key_id);
+
+/**
+ * @brief Converts a mask of driver key indexes to a mask of positions in KEYPAD_KEY_ID
+ *
+ * @param indexes
+ * @return KeypadMask_t
+ */
+static KeypadMask_t KeypadPositionsFromIndexes(KeypadMask_t indexes);
+
+/**
+ * @brief Converts a 0-255 uint value to a 0-65535 keypad driver brightness level
+ *
+ * @param in
+ * @return uint16_t
+ */
+static uint16_t KeypadUint8ToBrightnessLevel(uint8_t in);
+
+/*-----------------------------------------------------------*/
+
+int KeypadInit()
+{
+    led_event_queue = xQueueCreateStatic(KEYPAD_LED_EVENT_QUEUE_LENGTH, sizeof(KeypadLedEvent_t),
+                                         led_event_queue_storage, &led_event_queue_buffer);
+    vQueueAddToRegistry(led_event_queue, "led_event_queue");
+    led_event_send_mutex = xSemaphoreCreateMutexStatic(&led_event_send_mutex_buffer);
+    vQueueAddToRegistry(led_event_send_mutex, "led_event_send_mutex");
+    animation_queue = xQueueCreateStatic(KEYPAD_ANIMATION_QUEUE_LENGTH, sizeof(KeypadAnimationParams_t),
+                                         animation_queue_storage, &animation_queue_buffer);
+    vQueueAddToRegistry(animation_queue, "animation_queue");
+
+    memset(&button_pending, 0, sizeof(button_pending));
+    button_event_signal = xSemaphoreCreateBinaryStatic(&button_event_signal_buffer);
+    vQueueAddToRegistry(button_event_signal, "button_event_signal");
+
+    // Everything starts OFF, mark all keys as changed so the initial state gets published
+    memset(led_state, 0, sizeof(led_state));
+    led_state_changed = (KeypadMask_t)~0 >> ((sizeof(KeypadMask_t) * 8) - KEYPAD_KEYS);
+
+    for (uint8_t i = 0; i < KEYPAD_KEYS; i++)
+    {
+        led_state[i].effect = NONE;
+        led_effect[i] = NONE;
+    }
+
+    led_state_mutex = xSemaphoreCreateMutexStatic(&led_state_mutex_buffer);
+    vQueueAddToRegistry(led_state_mutex, "led_state_mutex");
+
+    led_state_signal = xSemaphoreCreateBinaryStatic(&led_state_signal_buffer);
+    vQueueAddToRegistry(led_state_signal, "led_state_signal");
+
+    xSemaphoreGive(led_state_signal);
 }
-KeyButtonPollState_t;
 
-/**
- * @brief
- *
- */
-static KeyButtonPollState_t last_button_state[KEYPAD_KEYS];
+/*-----------------------------------------------------------*/
+
+void KeypadTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask)
+{
+    xTaskCreateStaticPinnedToCore(KeypadTask, "KeypadTask", KEYPAD_TASK_STACK_DEPTH, NULL, priority, keypad_task_stack,
+                                  &keypad_task_buffer, NULL, core_affinity_mask);
+}
+
+/*-----------------------------------------------------------*/
+
+bool KeypadKeyPosition(const char *key_id, size_t length, uint8_t *position)
+{
+    // Ids follow KEYPAD_KEY_ID's pattern, a hex key optionally preceded by the keypad number, so decode them directly
+    uint8_t board = 0;
+
+    if (length == 2 && key_id[0] >= '1' && key_id[0] < '0' + KEYPAD_DRIVER_BOARDS)
+    {
+        board = key_id[0] - '0';
+    }
+    else if (length != 1)
+    {
+        return false;
+    }
+
+    char key = key_id[length - 1];
+
+    if (key >= '0' && key <= '9')
+    {
+        *position = (board * KEYPAD_DRIVER_BOARD_KEYS) + (key - '0');
+        return true;
+    }
+
+    if (key >= 'a' && key <= 'f')
+    {
+        *position = (board * KEYPAD_DRIVER_BOARD_KEYS) + (key - 'a' + 10);
+        return true;
+    }
+
+    return false;
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadTask(void *params)
+{
+    LogPrintInfo("KeypadTask running...\n");
+    // Initialise keypad driver
+    KeypadDriverInit();
+    KeypadDriverSetDithering(KEYPAD_LED_DITHERING);
+    KeypadSceneInit();
+    KeypadBindingInit();
+    KeypadRuleInit();
+    KeypadButtonConfig_t config;
+    KeypadButtonConfigGet(&config);
+    uint32_t time_now = GetTimeMs();
+    KeypadGestureInit(&config, time_now);
+    poll_stats.since = time_now;
+    uint32_t poll_period = KEYPAD_POLL_PERIOD_SLOW;
+    uint32_t next_poll = time_now;
+    SupervisorRegister(KEYPAD_HEARTBEAT_DEADLINE);
+
+    // Input and rendering share the task, so the keypad driver has a single owner, but are sliced so neither can
+    // starve the other: led events give way as soon as a poll or animation frame is due, and both are bounded work
+    while (1)
+    {
+        SupervisorCheckIn();
+        // 1) Process any led set events that have been queued, until the next button poll or animation frame is due
+        time_now = GetTimeMs();
+        uint32_t next_due = next_poll;
+
+        if (KeypadAnimationKeys() != 0 && (int32_t)(KeypadAnimationNextFrame() - next_poll) < 0)
+        {
+            next_due = KeypadAnimationNextFrame();
+        }
+
+        int32_t ms_to_wait = (int32_t)(next_due - time_now);
+        KeypadLedEventQueueReceive(ms_to_wait > 0 ? pdMS_TO_TICKS(ms_to_wait) : 0, next_due);
+        time_now = GetTimeMs();
+
+        // 2) Render an animation frame
+        if (KeypadAnimationKeys() != 0 && (int32_t)(time_now - KeypadAnimationNextFrame()) >= 0)
+        {
+            KeypadAnimationFrame(time_now);
+        }
+
+        if ((int32_t)(time_now - next_poll) < 0)
+        {
+            continue; // Woken early by led events or an animation frame
+        }
+
+        // 3) Process any button change events
+        uint32_t late = time_now - next_poll;
+        poll_stats.poll_misses += late > KEYPAD_POLL_DEADLINE;
+        poll_stats.poll_late_max = late > poll_stats.poll_late_max ? late : poll_stats.poll_late_max;
+        poll_period = KeypadButtonStatePoll(time_now, poll_period);
+        next_poll = time_now + poll_period;
+        KeypadPollStatsReport(time_now);
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static KeypadLedEvent_t *KeypadLedEventSendTake(KeypadLedEventType_t type)
+{
+    xSemaphoreTake(led_event_send_mutex, portMAX_DELAY);
+    led_event_send.type = type;
+    return &led_event_send;
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadLedEventQueuePost()
+{
+    led_event_send.queued_ms = GetTimeMs();
+
+    if (xQueueSend(led_event_queue, &led_event_send, portMAX_DELAY) != pdTRUE)
+    {
+        LogPrintFatal("Failed to send to led_event_queue");
+        Fault();
+    }
+
+    DiagQueueSent(led_event_queue);
+    xSemaphoreGive(led_event_send_mutex);
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadLedEventQueueSend(KeypadLedParams_t *params)
+{
+    KeypadLedEventQueueSendBatch(params, 1);
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadLedEventQueueSendBatch(KeypadLedParams_t *params, uint8_t count)
+{
+    if (count > KEYPAD_KEYS)
+    {
+        LogPrintFatal("Led batch count %u > KEYPAD_KEYS", count);
+        Fault();
+    }
+
+    KeypadLedEvent_t *event = KeypadLedEventSendTake(LED_BATCH);
+    event->batch.count = count;
+    memcpy(event->batch.params, params, count * sizeof(KeypadLedParams_t));
+    KeypadLedEventQueuePost();
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadLedEventQueueSendFade(KeypadLedFadeParams_t *params)
+{
+    KeypadLedEvent_t *event = KeypadLedEventSendTake(LED_FADE);
+    event->fade = *params;
+    KeypadLedEventQueuePost();
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadAnimationEventQueueSend(KeypadAnimationParams_t *params)
+{
+    // Queued while led_event_send is held, so timelines and their markers are taken in the same order
+    KeypadLedEventSendTake(LED_ANIMATION);
+
+    if (xQueueSend(animation_queue, params, portMAX_DELAY) != pdTRUE)
+    {
+        LogPrintFatal("Failed to send to animation_queue");
+        Fault();
+    }
+
+    DiagQueueSent(animation_queue);
+    KeypadLedEventQueuePost();
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadSceneEventQueueSend(KeypadSceneParams_t *params)
+{
+    KeypadLedEvent_t *event = KeypadLedEventSendTake(LED_SCENE);
+    event->scene = *params;
+    KeypadLedEventQueuePost();
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadBindingEventQueueSend(KeypadBindingParams_t *params)
+{
+    KeypadLedEvent_t *event = KeypadLedEventSendTake(LED_BINDING);
+    event->binding = *params;
+    KeypadLedEventQueuePost();
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadRuleEventQueueSend(KeypadRuleProgram_t *program)
+{
+    KeypadLedEvent_t *event = KeypadLedEventSendTake(LED_RULE);
+    event->rule = *program;
+    KeypadLedEventQueuePost();
+}
+
+/*-----------------------------------------------------------*/
+
+uint8_t KeypadButtonEventReceive(KeypadButtonParams_t *params, uint8_t max)
+{
+    uint8_t count = 0;
+
+    while (count == 0)
+    {
+        if (xSemaphoreTake(button_event_signal, portMAX_DELAY) != pdTRUE)
+        {
+            LogPrintFatal("button_event_signal take failed\n");
+            Fault();
+        }
+
+        uint64_t received_us = GetTimeUs();
+        bool more = false;
+        taskENTER_CRITICAL();
+
+        // 1) Chords, oldest first
+        while (button_pending.chord_count > 0 && count < max)
+        {
+            KeypadButtonParams_t *out = &params[count++];
+            out->event = CHORD;
+            out->count = 1;
+            out->keys = button_pending.chords[0];
+            out->timestamps = button_pending.chord_timestamps[0];
+            strncpy(out->key_id, KEYPAD_KEY_ID[__builtin_ctzll(out->keys)], KEYPAD_KEY_ID_SIZE);
+            button_pending.chord_count--;
+            memmove(&button_pending.chords[0], &button_pending.chords[1], button_pending.chord_count * sizeof(KeypadMask_t));
+            memmove(&button_pending.chord_timestamps[0], &button_pending.chord_timestamps[1],
+                    button_pending.chord_count * sizeof(KeypadButtonTimestamps_t));
+        }
+
+        // 2) Per key events, a key at a time so its events stay in order (a hold before its hold_release)
+        while (button_pending.keys != 0)
+        {
+            uint8_t position = __builtin_ctzll(button_pending.keys);
+            const KeypadButtonRun_t *runs = button_pending.runs[position];
+            uint8_t runs_count = button_pending.run_counts[position];
+
+            if (count + runs_count > max)
+            {
+                break;
+            }
+
+            for (uint8_t i = 0; i < runs_count; i++)
+            {
+                KeypadButtonParams_t *out = &params[count++];
+                out->event = (KeypadButtonEvent_t)runs[i].event;
+                out->count = runs[i].count;
+                out->keys = 0;
+                out->timestamps = button_pending.timestamps[position];
+                strncpy(out->key_id, KEYPAD_KEY_ID[position], KEYPAD_KEY_ID_SIZE);
+            }
+
+            button_pending.run_counts[position] = 0;
+            button_pending.keys &= button_pending.keys - 1;
+        }
+
+        more = button_pending.keys != 0 || button_pending.chord_count > 0;
+        taskEXIT_CRITICAL();
+
+        if (more)
+        {
+            xSemaphoreGive(button_event_signal); // Left over for the next call
+        }
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+            params[i].timestamps.received_us = received_us;
+        }
+    }
+
+    return count;
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadButtonConfigGet(KeypadButtonConfig_t *config)
+{
+    taskENTER_CRITICAL();
+    *config = button_config;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadButtonConfigSet(const KeypadButtonConfig_t *config)
+{
+    taskENTER_CRITICAL();
+    button_config = *config;
+    button_config_changed = true;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadLedEventQueueReceive(TickType_t ticks_to_wait, uint32_t poll_due)
+{
+    static KeypadLedEvent_t event; // Too large for the task stack
+    static KeypadAnimationParams_t animation; // Too large for the task stack
+    uint32_t queued_ms[KEYPAD_LED_EVENT_BUDGET];
+    uint8_t received = 0;
+    bool flush_needed = false;
+
+    while (received < KEYPAD_LED_EVENT_BUDGET)
+    {
+        if (xQueueReceive(led_event_queue, &event, ticks_to_wait) == pdTRUE)
+        {
+            uint32_t time_now = GetTimeMs();
+            queued_ms[received++] = event.queued_ms;
 
-/**
- * @brief Incoming led parameter messages
- *
- */
-static QueueHandle_t led_event_queue;
+            switch (event.type)
+            {
+                case LED_BATCH:
+                    for (uint8_t i = 0; i < event.batch.count; i++)
+                    {
+                        KeypadProcessLedEvent(&event.batch.params[i]);
+                    }
 
-/**
- * @brief Outgoing button event messages
- *
- */
-static QueueHandle_t button_event_queue;
+                    flush_needed = true;
+                    break;
 
-/**
- * @brief
- *
- * @param params
- */
-static void KeypadTask(void *params);
+                case LED_SCENE:
+                    flush_needed |= KeypadProcessSceneEvent(&event.scene);
+                    break;
 
-/**
- * @brief Receive submitted led paramerts to be written to the device
- *
- * @param ticks_to_wait
- */
-static void KeypadLedEventQueueReceive(TickType_t ticks_to_wait);
+                case LED_BINDING:
+                    KeypadProcessBindingEvent(&event.binding);
+                    break;
 
-/**
- * @brief Processes a single led parameter and calls approproate keypad driver functions to write to device
- *
- * @param params
- */
-static void KeypadProcessLedEvent(KeypadLedParams_t *params);
+                case LED_RULE:
+                    if (!KeypadRuleLoad(&event.rule))
+                    {
+                        LogPrintError("Rejected %u byte rule program, the running rules are unchanged\n",
+                                      event.rule.length);
+                    }
 
-/**
- * @brief
- *
- */
-static void KeypadButtonStatePoll();
+                    break;
 
-/**
- * @brief
- *
- * @param params
- */
-static void KeypadButtonEventQueueSend(KeypadButtonParams_t *params);
+                case LED_FADE:
+                    KeypadProcessFadeEvent(&event.fade, time_now);
+                    flush_needed = true;
+                    break;
 
-/**
- * @brief Gets the key index from id (key ids are oriented differently to the pcb layout)
- *
- * @param key_id
- * @return uint8_t
- */
-static uint8_t KeypadIndexFromId(char key_id);
+                case LED_ANIMATION:
+                    // Queued before its marker, so already waiting
+                    if (xQueueReceive(animation_queue, &animation, 0) == pdTRUE)
+                    {
+                        KeypadAnimationStart(&animation, time_now);
+                        flush_needed = true;
+                    }
 
-/**
- * @brief
- *
- * @param key_index
- * @return char
- */
-static char KeypadIdFromIndex(uint8_t key_index);
+                    break;
+            }
 
-/**
- * @brief Converts a 0-255 uint value to a 0.0f-1.0f float value
- *
- * @param in
- * @return float
- */
-static float KeypadUint8ToBrightnessFloat(uint8_t in);
+            // Give way to a button poll that has come due, the rest of the queue is picked up after it
+            if ((int32_t)(GetTimeMs() - poll_due) >= 0)
+            {
+                break;
+            }
 
-/*-----------------------------------------------------------*/
+            ticks_to_wait = 0; // Try to get more data from the queue if it exists,
+        }
+        else
+        {
+            // we timed out
+            break;
+        }
+    }
 
-int KeypadInit()
-{
-    // Clear button states
-    memset(last_button_state, 0, sizeof(last_button_state));
-    led_event_queue = xQueueCreate(20, sizeof(KeypadLedParams_t));
+    if (flush_needed || KEYPAD_LED_DITHERING)
+    {
+        KeypadDriverFlush();
+    }
 
-    if (led_event_queue == NULL)
+    if (flush_needed)
     {
-        LogPrintFatal("Failed to create led_event_queue");
-        Fault();
+        KeypadLedStateUpdate();
     }
 
-    button_event_queue = xQueueCreate(20, sizeof(KeypadButtonParams_t));
+    // Measured up to the driver write, which is when the change shows on the keypad
+    uint32_t written_ms = GetTimeMs();
 
-    if (button_event_queue == NULL)
+    for (uint8_t i = 0; i < received; i++)
     {
-        LogPrintFatal("Failed to create button_event_queue");
-        Fault();
+        uint32_t late = written_ms - queued_ms[i];
+        poll_stats.led_events++;
+        poll_stats.led_misses += late > KEYPAD_LED_EVENT_DEADLINE;
+        poll_stats.led_late_max = late > poll_stats.led_late_max ? late : poll_stats.led_late_max;
     }
 }
 
 /*-----------------------------------------------------------*/
 
-void KeypadTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask)
+void KeypadLedStateGet(KeypadLedState_t *states)
 {
-    xTaskCreatePinnedToCore(KeypadTask, "KeypadTask", configMINIMAL_STACK_SIZE, NULL, priority, NULL, core_affinity_mask);
+    xSemaphoreTake(led_state_mutex, portMAX_DELAY);
+    memcpy(states, led_state, sizeof(led_state));
+    xSemaphoreGive(led_state_mutex);
 }
 
 /*-----------------------------------------------------------*/
 
-static void KeypadTask(void *params)
+KeypadMask_t KeypadLedStateChangeReceive(KeypadLedState_t *states)
 {
-    LogPrintInfo("KeypadTask running...\n");
-    // Initialise keypad driver
-    KeypadDriverInit();
-    TickType_t ticks_to_wait = pdMS_TO_TICKS(KEYPAD_POLL_PERIOD);
+    KeypadMask_t changed = 0;
 
-    while (1)
+    while (changed == 0)
     {
-        // 1) Process any led set events that have been queued
-        KeypadLedEventQueueReceive(ticks_to_wait);
-        // 2) Process any button change events
-        KeypadButtonStatePoll();
+        if (xSemaphoreTake(led_state_signal, portMAX_DELAY) != pdTRUE)
+        {
+            LogPrintFatal("led_state_signal take failed\n");
+            Fault();
+        }
+
+        xSemaphoreTake(led_state_mutex, portMAX_DELAY);
+        memcpy(states, led_state, sizeof(led_state));
+        changed = led_state_changed;
+        led_state_changed = 0;
+        xSemaphoreGive(led_state_mutex);
     }
+
+    return changed;
 }
 
 /*-----------------------------------------------------------*/
 
-void KeypadLedEventQueueSend(KeypadLedParams_t *params)
+static KeypadMask_t KeypadLedStateCommit()
 {
-    if (xQueueSend(led_event_queue, params, portMAX_DELAY) != pdTRUE)
+    static KeypadDriverLed_t leds[KEYPAD_KEYS]; // Too large for the task stack
+    KeypadDriverGetLeds(leds, KEYPAD_KEYS);
+    KeypadMask_t changed = 0;
+    // Animated keys are committed once they settle, not every frame
+    KeypadMask_t animated = KeypadAnimationKeys();
+    xSemaphoreTake(led_state_mutex, portMAX_DELAY);
+
+    for (uint8_t i = 0; i < KEYPAD_KEYS; i++)
     {
-        LogPrintFatal("Failed to send to led_event_queue");
-        Fault();
-    }
-}
+        if (animated & ((KeypadMask_t)1 << i))
+        {
+            continue;
+        }
 
-/*-----------------------------------------------------------*/
+        KeypadDriverLed_t *led = &leds[KEYPAD_KEY_INDEX[i]];
+        KeypadLedState_t state =
+        {
+            .state = led->on,
+            .brightness = (uint8_t)((led->level + 128) / 257),
+            .red = led->red,
+            .green = led->green,
+            .blue = led->blue,
+            .effect = led_effect[i]
+        };
+
+        KeypadLedState_t *last = &led_state[i];
+
+        // Compare field by field, padding bytes are undefined
+        if (state.state != last->state ||
+                state.brightness != last->brightness ||
+                state.red != last->red ||
+                state.green != last->green ||
+                state.blue != last->blue ||
+                state.effect != last->effect)
+        {
+            led_state[i] = state;
+            changed |= (KeypadMask_t)1 << i;
+        }
+    }
 
-KeypadButtonParams_t KeypadButtonEventQueueReceive()
-{
-    KeypadButtonParams_t params;
+    led_state_changed |= changed;
+    xSemaphoreGive(led_state_mutex);
 
-    if (xQueueReceive(button_event_queue, &params, portMAX_DELAY) != pdTRUE)
+    if (changed != 0)
     {
-        LogPrintFatal("button_event_queue receive failed\n");
-        Fault();
+        xSemaphoreGive(led_state_signal);
     }
 
-    return params;
+    return changed;
 }
 
 /*-----------------------------------------------------------*/
 
-static void KeypadLedEventQueueReceive(TickType_t ticks_to_wait)
+static void KeypadLedStateUpdate()
 {
-    KeypadLedParams_t params;
-    bool flush_needed = false;
-
-    while (1)
-    {
-        if (xQueueReceive(led_event_queue, &params, ticks_to_wait) == pdTRUE)
-        {
-            KeypadProcessLedEvent(&params);
-            flush_needed = true;
-            ticks_to_wait = 0; // Try to get more data from the queue if it exists,
-        }
-        else
-        {
-            // we timed out
-            break;
-        }
-    }
+    KeypadMask_t changed = KeypadLedStateCommit();
 
-    if (flush_needed)
+    if (KeypadRulesRun(changed, KEYPAD_RULE_TRIGGER_LED))
     {
         KeypadDriverFlush();
+        KeypadLedStateCommit();
     }
 }
 
 /*-----------------------------------------------------------*/
 
-static void KeypadProcessLedEvent(KeypadLedParams_t *params)
+static void KeypadProcessLedEvent(const KeypadLedParams_t *params)
 {
-    uint8_t key_index = KeypadIndexFromId(params->key_id);
+    uint8_t position = KeypadPositionFromId(params->key_id);
+    uint8_t key_index = KEYPAD_KEY_INDEX[position];
     LogPrintDebug("Setting LED parameters...\n");
-    LogPrintDebug("params->key_id: %c\n", params->key_id);
+    LogPrintDebug("params->key_id: %s\n", params->key_id);
     LogPrintDebug("params->brightness_set: %i\n", params->brightness_set);
     LogPrintDebug("params->colour_set: %i\n", params->colour_set);
     LogPrintDebug("params->effect_set: %i\n", params->effect_set);
@@ -282,6 +1208,8 @@ static void KeypadProcessLedEvent(KeypadLedParams_t *params)
     LogPrintDebug("params->blue: %u\n", params->blue);
     LogPrintDebug("params->state %i\n", params->state);
     LogPrintDebug("key_index: %u\n", key_index);
+    // A direct write takes the key out of any animation
+    KeypadAnimationRelease((KeypadMask_t)1 << position);
 
     // 1) Led state (ON/OFF)
     if (params->state_set)
@@ -296,159 +1224,434 @@ static void KeypadProcessLedEvent(KeypadLedParams_t *params)
         }
     }
 
-    // 2) Led colour (r,g,b)
+    // 2) Led effect (kept in the state model)
+    if (params->effect_set)
+    {
+        led_effect[position] = params->effect;
+    }
+
+    // 3) Led colour (r,g,b)
     if (params->colour_set)
     {
         KeypadDriverSetLedColour(key_index, params->red, params->green, params->blue);
     }
 
-    // 3) Led brightness
+    // 4) Led brightness
     if (params->brightness_set)
     {
-        float brightness = KeypadUint8ToBrightnessFloat(params->brightness);
-        KeypadDriverSetLedBrightness(key_index, brightness);
+        uint16_t level = KeypadUint8ToBrightnessLevel(params->brightness);
+        KeypadDriverSetLedBrightness(key_index, level);
     }
 }
 
 /*-----------------------------------------------------------*/
 
-static void KeypadButtonStatePoll()
+static void KeypadProcessFadeEvent(const KeypadLedFadeParams_t *params, uint32_t time_now)
 {
-    uint16_t driver_button_states = KeypadDriverGetButtonStates();
-    uint32_t time_now = GetTimeMs();
+    const KeypadLedParams_t *led = &params->led;
 
-    for (int key_index = 0; key_index < KEYPAD_KEYS; key_index++)
+    if (params->transition_ms == 0 || !(led->state_set || led->colour_set || led->brightness_set))
     {
-        bool is_pressed = (driver_button_states >> key_index) & 1; // Each bit represents the pressed/released state
-        KeyButtonState_t *last_state = &(last_button_state[key_index].last_state);
-        uint32_t *last_updated = &(last_button_state[key_index].last_updated);
+        KeypadProcessLedEvent(led);
+        return;
+    }
 
-        switch (*last_state)
-        {
-            case RELEASED:
-                if (is_pressed)
-                {
-                    *last_state = PRESSED;
-                    *last_updated = time_now;
-                }
-                else // !is_pressed
-                {
-                    // Button is just sittng happily idle
-                }
+    uint8_t position = KeypadPositionFromId(led->key_id);
 
-                break;
+    if (led->effect_set)
+    {
+        led_effect[position] = led->effect;
+    }
 
-            case PRESSED:
-                if (is_pressed)
-                {
-                    uint32_t pressed_time = GetElapsedMs(*last_updated, time_now);
+    // Turning ON needs no target of its own, an animated key is turned on and fades in from black
+    KeypadAnimationColour_t target =
+    {
+        .position = position,
+        .set = (led->colour_set ? KEYPAD_ANIMATION_SET_COLOUR : 0) |
+               (led->brightness_set ? KEYPAD_ANIMATION_SET_BRIGHTNESS : 0) |
+               (led->state_set && !led->state ? KEYPAD_ANIMATION_SET_OFF : 0),
+        .red = led->red,
+        .green = led->green,
+        .blue = led->blue,
+        .brightness = led->brightness,
+    };
+
+    KeypadAnimationFade(&target, params->transition_ms, time_now);
+}
 
-                    if (pressed_time >= KEYPAD_BUTTON_HOLD_DURATION)
-                    {
-                        *last_state = HELD;
-                        *last_updated = time_now;
-                        // Queue a hold event
-                        KeypadButtonParams_t params;
-                        params.key_id = KeypadIdFromIndex(key_index);
-                        params.event = HOLD;
-                        KeypadButtonEventQueueSend(&params);
-                    }
-                    else // pressed_time < KEYPAD_BUTTON_HOLD_DURATION
-                    {
-                        // Button is still being held down, but not long enough to be
-                        // considered a 'hold'... wait for its eventual release
-                    }
-                }
-                else // !is_pressed
-                {
-                    *last_state = RELEASED;
-                    *last_updated = time_now;
-                    // Queue a press event
-                    KeypadButtonParams_t params;
-                    params.key_id = KeypadIdFromIndex(key_index);
-                    params.event = PRESS;
-                    KeypadButtonEventQueueSend(&params);
-                }
+/*-----------------------------------------------------------*/
 
-                break;
+static void KeypadAnimationFrame(uint32_t time_now)
+{
+    uint32_t late = time_now - KeypadAnimationNextFrame();
+    poll_stats.frames++;
+    poll_stats.frame_misses += late >= KEYPAD_ANIMATION_FRAME_PERIOD;
+    bool settled = KeypadAnimationRender(time_now);
+    KeypadDriverFlush();
 
-            case HELD:
-                if (is_pressed)
-                {
-                    // Button is still being held down, but we've already sent an event
-                }
-                else // !is_pressed
-                {
-                    *last_state = RELEASED;
-                    *last_updated = time_now;
-                }
+    if (settled)
+    {
+        KeypadLedStateUpdate();
+    }
+}
 
-                break;
+/*-----------------------------------------------------------*/
 
-            default:
-                break;
-        }
+static bool KeypadProcessSceneEvent(KeypadSceneParams_t *params)
+{
+    switch (params->action)
+    {
+        case SCENE_RECALL:
+            LogPrintDebug("Recalling scene '%s'\n", params->name);
+
+            if (!KeypadSceneRecall(params->name))
+            {
+                return false;
+            }
+
+            // The scene replaces whatever was animating
+            KeypadAnimationStop();
+            return true;
+
+        case SCENE_RECORD:
+            LogPrintInfo("Recording scene '%s'\n", params->name);
+            KeypadSceneRecord(params->name);
+            return false;
+
+        case SCENE_DELETE:
+            LogPrintInfo("Deleting scene '%s'\n", params->name);
+            KeypadSceneDelete(params->name);
+            return false;
     }
+
+    return false;
 }
 
 /*-----------------------------------------------------------*/
 
-static void KeypadButtonEventQueueSend(KeypadButtonParams_t *params)
+static void KeypadProcessBindingEvent(KeypadBindingParams_t *params)
 {
-    if (xQueueSend(button_event_queue, params, portMAX_DELAY) != pdTRUE)
+    switch (params->action)
     {
-        LogPrintFatal("Failed to send to button_event_queue");
-        Fault();
+        case BINDING_SET:
+            LogPrintInfo("Binding key %s %u to led %s\n", params->key_id, params->event, params->led.key_id);
+            KeypadBindingSet(KeypadPositionFromId(params->key_id), params->event, &params->led);
+            break;
+
+        case BINDING_DELETE:
+            LogPrintInfo("Deleting bindings of key %s %u\n", params->key_id, params->event);
+            KeypadBindingDelete(KeypadPositionFromId(params->key_id), params->event);
+            break;
+
+        case BINDING_CLEAR:
+            LogPrintInfo("Clearing all bindings\n");
+            KeypadBindingClear();
+            break;
     }
 }
 
 /*-----------------------------------------------------------*/
 
-static uint8_t KeypadIndexFromId(char key_id)
+static bool KeypadButtonBindingsApply(KeypadMask_t keys, KeypadButtonEvent_t event)
 {
-    for (uint8_t i = 0; i < KEYPAD_KEYS; ++i)
+    // Cheap test first, nearly every poll has no bound event
+    KeypadMask_t positions = KeypadBindingKeys(event);
+
+    if (keys == 0 || positions == 0)
+    {
+        return false;
+    }
+
+    positions &= KeypadPositionsFromIndexes(keys);
+    bool applied = false;
+
+    while (positions != 0)
     {
-        if (KEYPAD_KEY_ID[i] == key_id)
+        uint8_t position = __builtin_ctzll(positions);
+        positions &= positions - 1;
+        uint8_t slot = 0;
+        const KeypadLedParams_t *led;
+
+        while ((led = KeypadBindingFind(position, event, &slot)) != NULL)
         {
-            return KEYPAD_KEY_INDEX[i];
+            KeypadProcessLedEvent(led);
+            applied = true;
         }
     }
 
-    LogPrintFatal("Invalid key id: %c", key_id);
-    Fault();
-    return 0;
+    return applied;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool KeypadRulesRun(KeypadMask_t positions, uint8_t trigger)
+{
+    static KeypadLedParams_t writes[KEYPAD_KEYS]; // Too large for the task stack
+    positions &= KeypadRuleKeys(trigger);
+
+    if (positions == 0)
+    {
+        return false;
+    }
+
+    // Rules see the state as last committed, their writes to the same key merge in rule order
+    memset(writes, 0, sizeof(writes));
+    KeypadMask_t written = 0;
+
+    while (positions != 0)
+    {
+        uint8_t position = __builtin_ctzll(positions);
+        positions &= positions - 1;
+        written |= KeypadRuleRun(trigger, position, led_state, writes);
+    }
+
+    bool applied = written != 0;
+
+    while (written != 0)
+    {
+        uint8_t position = __builtin_ctzll(written);
+        written &= written - 1;
+        KeypadProcessLedEvent(&writes[position]);
+    }
+
+    return applied;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t KeypadButtonStatePoll(uint32_t time_now, uint32_t period)
+{
+    KeypadButtonConfig_t config;
+    bool config_changed = false;
+    taskENTER_CRITICAL();
+
+    if (button_config_changed)
+    {
+        config = button_config;
+        button_config_changed = false;
+        config_changed = true;
+    }
+
+    taskEXIT_CRITICAL();
+
+    if (config_changed)
+    {
+        KeypadGestureConfigure(&config);
+    }
+
+    // Each bit of the driver mask represents the pressed/released state of a key index
+    KeypadButtonTimestamps_t timestamps;
+    memset(&timestamps, 0, sizeof(timestamps));
+    timestamps.polled_us = GetTimeUs();
+    KeypadMask_t buttons = KeypadDriverGetButtonStates();
+    KeypadGestureEvents_t events;
+    KeypadGestureUpdate(buttons, time_now, &events);
+    timestamps.detected_us = GetTimeUs();
+
+    // Local feedback first, the events still go to the broker as usual
+    bool applied = KeypadButtonBindingsApply(events.press, PRESS);
+    applied |= KeypadButtonBindingsApply(events.double_press, DOUBLE_PRESS);
+    applied |= KeypadButtonBindingsApply(events.triple_press, TRIPLE_PRESS);
+    applied |= KeypadButtonBindingsApply(events.hold, HOLD);
+    applied |= KeypadButtonBindingsApply(events.hold_repeat, HOLD_REPEAT);
+    applied |= KeypadButtonBindingsApply(events.hold_release, HOLD_RELEASE);
+    applied |= KeypadRulesRun(KeypadPositionsFromIndexes(events.press), PRESS);
+    applied |= KeypadRulesRun(KeypadPositionsFromIndexes(events.double_press), DOUBLE_PRESS);
+    applied |= KeypadRulesRun(KeypadPositionsFromIndexes(events.triple_press), TRIPLE_PRESS);
+    applied |= KeypadRulesRun(KeypadPositionsFromIndexes(events.hold), HOLD);
+    applied |= KeypadRulesRun(KeypadPositionsFromIndexes(events.hold_repeat), HOLD_REPEAT);
+    applied |= KeypadRulesRun(KeypadPositionsFromIndexes(events.hold_release), HOLD_RELEASE);
+
+    if (applied)
+    {
+        KeypadDriverFlush();
+        KeypadLedStateUpdate();
+    }
+
+    bool posted = KeypadButtonEventPostChord(events.chord, &timestamps);
+    posted |= KeypadButtonEventPostKeys(events.press, PRESS, &timestamps);
+    posted |= KeypadButtonEventPostKeys(events.double_press, DOUBLE_PRESS, &timestamps);
+    posted |= KeypadButtonEventPostKeys(events.triple_press, TRIPLE_PRESS, &timestamps);
+    posted |= KeypadButtonEventPostKeys(events.hold, HOLD, &timestamps);
+    posted |= KeypadButtonEventPostKeys(events.hold_repeat, HOLD_REPEAT, &timestamps);
+    posted |= KeypadButtonEventPostKeys(events.hold_release, HOLD_RELEASE, &timestamps);
+
+    if (posted)
+    {
+        xSemaphoreGive(button_event_signal);
+    }
+
+    // A press happened somewhere within the last poll period
+    KeypadMask_t pressed = buttons & ~poll_last_buttons;
+    poll_stats.polls++;
+    poll_stats.presses += __builtin_popcountll(pressed);
+    poll_stats.latency_total += __builtin_popcountll(pressed) * period;
+    poll_stats.latency_max = pressed != 0 && period > poll_stats.latency_max ? period : poll_stats.latency_max;
+    poll_stats.fast_time += period == KEYPAD_POLL_PERIOD_FAST ? period : 0;
+
+    // Poll fast while anything is happening and for a while after, so follow up presses are caught quickly
+    if (buttons != poll_last_buttons || !KeypadGestureIsIdle())
+    {
+        poll_last_active = time_now;
+    }
+
+    poll_last_buttons = buttons;
+    return GetElapsedMs(poll_last_active, time_now) < KEYPAD_POLL_ACTIVE_DURATION ?
+           KEYPAD_POLL_PERIOD_FAST : KEYPAD_POLL_PERIOD_SLOW;
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadPollStatsReport(uint32_t time_now)
+{
+    uint32_t elapsed = GetElapsedMs(poll_stats.since, time_now);
+
+    if (elapsed < KEYPAD_POLL_STATS_PERIOD)
+    {
+        return;
+    }
+
+    uint32_t polls_per_hour = (uint32_t)(((uint64_t)poll_stats.polls * 3600000) / elapsed);
+    uint32_t fast_percent = (uint32_t)(((uint64_t)poll_stats.fast_time * 100) / elapsed);
+    // The press lands uniformly within the poll period, so the average latency is half the period
+    uint32_t latency_average = poll_stats.presses > 0 ? poll_stats.latency_total / (2 * poll_stats.presses) : 0;
+    LogPrintInfo("Keypad polls: %lu scans/hour (%lu i2c reads), %lu%% fast, %lu presses, "
+                 "latency avg %lu ms max %lu ms\n",
+                 polls_per_hour, polls_per_hour * KEYPAD_DRIVER_BOARDS, fast_percent, poll_stats.presses,
+                 latency_average, poll_stats.latency_max);
+
+    LogPrintInfo("Keypad deadlines: polls %lu missed, max %lu ms late, led events %lu of %lu missed, max %lu ms late\n",
+                 poll_stats.poll_misses, poll_stats.poll_late_max, poll_stats.led_misses, poll_stats.led_events,
+                 poll_stats.led_late_max);
+
+    if (poll_stats.frames > 0)
+    {
+        LogPrintInfo("Keypad animation: %lu frames, %lu late\n", poll_stats.frames, poll_stats.frame_misses);
+    }
+
+    if (poll_stats.coalesced > 0 || poll_stats.dropped > 0)
+    {
+        LogPrintWarn("Button events backed up: %lu coalesced, %lu dropped\n", poll_stats.coalesced, poll_stats.dropped);
+    }
+
+    memset(&poll_stats, 0, sizeof(poll_stats));
+    poll_stats.since = time_now;
 }
 
 /*-----------------------------------------------------------*/
 
-static char KeypadIdFromIndex(uint8_t key_index)
+static bool KeypadButtonEventPostKeys(KeypadMask_t keys, KeypadButtonEvent_t event, const KeypadButtonTimestamps_t *timestamps)
 {
-    for (uint8_t i = 0; i < KEYPAD_KEYS; ++i)
+    if (keys == 0)
+    {
+        return false;
+    }
+
+    KeypadMask_t positions = KeypadPositionsFromIndexes(keys);
+    uint64_t queued_us = GetTimeUs();
+    taskENTER_CRITICAL();
+
+    while (positions != 0)
     {
-        if (KEYPAD_KEY_INDEX[i] == key_index)
+        uint8_t position = __builtin_ctzll(positions);
+        positions &= positions - 1;
+        KeypadButtonRun_t *runs = button_pending.runs[position];
+        uint8_t *runs_count = &button_pending.run_counts[position];
+
+        if (*runs_count == 0)
+        {
+            button_pending.timestamps[position] = *timestamps;
+            button_pending.timestamps[position].queued_us = queued_us;
+            button_pending.keys |= (KeypadMask_t)1 << position;
+        }
+
+        if (*runs_count > 0 && runs[*runs_count - 1].event == event)
+        {
+            runs[*runs_count - 1].count += runs[*runs_count - 1].count < UINT8_MAX;
+            poll_stats.coalesced++;
+        }
+        else if (*runs_count < KEYPAD_BUTTON_EVENTS_MAX)
         {
-            return KEYPAD_KEY_ID[i];
+            runs[*runs_count] = (KeypadButtonRun_t){.event = event, .count = 1};
+            (*runs_count)++;
+        }
+        else
+        {
+            // Merging into an earlier run would reorder the key's events, so the newest goes
+            poll_stats.dropped++;
         }
     }
 
-    LogPrintFatal("Invalid key index: %u", key_index);
-    Fault();
-    return 0;
+    taskEXIT_CRITICAL();
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool KeypadButtonEventPostChord(KeypadMask_t keys, const KeypadButtonTimestamps_t *timestamps)
+{
+    if (keys == 0)
+    {
+        return false;
+    }
+
+    bool posted = false;
+    KeypadMask_t positions = KeypadPositionsFromIndexes(keys);
+    uint64_t queued_us = GetTimeUs();
+    taskENTER_CRITICAL();
+
+    if (button_pending.chord_count < KEYPAD_BUTTON_CHORDS)
+    {
+        uint8_t slot = button_pending.chord_count++;
+        button_pending.chords[slot] = positions;
+        button_pending.chord_timestamps[slot] = *timestamps;
+        button_pending.chord_timestamps[slot].queued_us = queued_us;
+        posted = true;
+    }
+    else
+    {
+        poll_stats.dropped++;
+    }
+
+    taskEXIT_CRITICAL();
+    return posted;
 }
 
 /*-----------------------------------------------------------*/
 
-static float KeypadUint8ToBrightnessFloat(uint8_t in)
+static uint8_t KeypadPositionFromId(const char *key_id)
 {
-    if (in == 0)
+    uint8_t position;
+
+    if (KeypadKeyPosition(key_id, strlen(key_id), &position))
     {
-        return 0.0f; // No funny business on edge cases
+        return position;
     }
 
-    if (in == 255)
+    LogPrintFatal("Invalid key id: %s", key_id);
+    Fault();
+    return 0;
+}
+
+/*-----------------------------------------------------------*/
+
+static KeypadMask_t KeypadPositionsFromIndexes(KeypadMask_t indexes)
+{
+    KeypadMask_t positions = 0;
+
+    while (indexes != 0)
     {
-        return 1.0f; // No funny business on edge cases
+        positions |= (KeypadMask_t)1 << KEYPAD_KEY_POSITION[__builtin_ctzll(indexes)];
+        indexes &= indexes - 1;
     }
 
-    return ((float)in / (float)255);
+    return positions;
 }
+
+/*-----------------------------------------------------------*/
+
+static uint16_t KeypadUint8ToBrightnessLevel(uint8_t in)
+{
+    // 0 -> 0 and 255 -> 65535 exactly, so no funny business on edge cases
+    return (uint16_t)in * 257;
+}
\ No newline at end of file
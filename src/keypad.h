@@ -35,13 +35,62 @@
 // FreeRTOS-Kernel includes
 #include "FreeRTOS.h"
 
-#define KEYPAD_KEYS 16
+// alert-panel includes
+#include "keypad_driver.h"
+
+/**
+ * @brief Keys across all chained keypads
+ *
+ */
+#define KEYPAD_KEYS KEYPAD_DRIVER_KEYS
+
+/**
+ * @brief Maximum key id size, including the terminating '\0' ("0"-"f" on the first keypad, "10"-"3f" on the others)
+ *
+ */
+#define KEYPAD_KEY_ID_SIZE  3
+
+/**
+ * @brief One bit per key, bit n is KEYPAD_KEY_ID[n]
+ *
+ */
+typedef KeypadDriverMask_t KeypadMask_t;
+
+/**
+ * @brief Maximum scene name size, including the terminating '\0'
+ *
+ */
+#define KEYPAD_SCENE_NAME_SIZE  16
+
+/**
+ * @brief Maximum rule program size in bytes, see keypad_rule.h for the format
+ *
+ */
+#define KEYPAD_RULE_PROGRAM_SIZE    256
+
+/**
+ * @brief Most keyframes in an animation timeline
+ *
+ */
+#define KEYPAD_ANIMATION_KEYFRAMES  16
+
+/**
+ * @brief Most key colours across all keyframes of an animation timeline
+ *
+ */
+#define KEYPAD_ANIMATION_COLOURS    64
+
+/**
+ * @brief Most button events KeypadButtonEventReceive can return for a single key, runs of one type count as one
+ *
+ */
+#define KEYPAD_BUTTON_EVENTS_MAX    6
 
 /**
  * @brief
  *
  */
-extern const char KEYPAD_KEY_ID[];
+extern const char *const KEYPAD_KEY_ID[];
 
 /**
  * @brief
@@ -49,6 +98,12 @@ extern const char KEYPAD_KEY_ID[];
  */
 extern const uint8_t KEYPAD_KEY_INDEX[];
 
+/**
+ * @brief Inverse of KEYPAD_KEY_INDEX
+ *
+ */
+extern const uint8_t KEYPAD_KEY_POSITION[];
+
 typedef enum
 {
     NONE = 1,
@@ -63,7 +118,7 @@ KeypadLedEffect_t;
  */
 typedef struct
 {
-    char key_id;
+    char key_id[KEYPAD_KEY_ID_SIZE];
     bool brightness_set;
     bool colour_set;
     bool effect_set;
@@ -77,6 +132,44 @@ typedef struct
 }
 KeypadLedParams_t;
 
+/**
+ * @brief Applied state of a key's led, as actually written to the keypad
+ *
+ */
+typedef struct
+{
+    bool state;
+    uint8_t brightness;
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    KeypadLedEffect_t effect;
+}
+KeypadLedState_t;
+
+/**
+ * @brief
+ *
+ */
+typedef enum
+{
+    SCENE_RECALL = 1,
+    SCENE_RECORD = 2,
+    SCENE_DELETE = 3,
+}
+KeypadSceneAction_t;
+
+/**
+ * @brief Parameters used for recalling/recording/deleting a named led scene
+ *
+ */
+typedef struct
+{
+    KeypadSceneAction_t action;
+    char name[KEYPAD_SCENE_NAME_SIZE];
+}
+KeypadSceneParams_t;
+
 /**
  * @brief
  *
@@ -85,20 +178,184 @@ typedef enum
 {
     PRESS = 1,
     HOLD = 2,
+    DOUBLE_PRESS = 3,
+    TRIPLE_PRESS = 4,
+    HOLD_REPEAT = 5,
+    HOLD_RELEASE = 6,
+    CHORD = 7,
 }
 KeypadButtonEvent_t;
 
+/**
+ * @brief Time (us since start) a button event reached each stage on its way to the broker
+ *
+ */
+typedef struct
+{
+    uint64_t polled_us;     // button states read from the device
+    uint64_t detected_us;   // event recognised
+    uint64_t queued_us;     // sent to the button event queue
+    uint64_t received_us;   // taken off the button event queue
+    uint64_t formatted_us;  // topic and payload built
+    uint64_t submitted_us;  // handed to mqtt
+}
+KeypadButtonTimestamps_t;
+
 /**
  * @brief Parameters used for reading button state from a key
  *
  */
 typedef struct
 {
-    char key_id;
+    char key_id[KEYPAD_KEY_ID_SIZE];
     KeypadButtonEvent_t event;
+    KeypadMask_t keys; // CHORD only: bit set per position in KEYPAD_KEY_ID, key_id is the first of them
+    uint8_t count; // occurrences coalesced into this event while it waited (saturates at 255)
+    KeypadButtonTimestamps_t timestamps;
 }
 KeypadButtonParams_t;
 
+/**
+ * @brief Longest gesture timing (ms), the gesture timers are 12 bits
+ *
+ */
+#define KEYPAD_BUTTON_TIMING_MAX    4095
+
+/**
+ * @brief Gesture timings in ms up to KEYPAD_BUTTON_TIMING_MAX, a zero disables hold, repeat, multi-press (taps report
+ * immediately) or chords
+ *
+ */
+typedef struct
+{
+    uint16_t hold_ms;
+    uint16_t repeat_ms;
+    uint16_t multi_press_ms;
+    uint16_t chord_ms;
+}
+KeypadButtonConfig_t;
+
+/**
+ * @brief
+ *
+ */
+typedef enum
+{
+    BINDING_SET = 1,
+    BINDING_DELETE = 2,
+    BINDING_CLEAR = 3,
+}
+KeypadBindingAction_t;
+
+/**
+ * @brief Parameters used for setting/deleting a local binding from a button event to led parameters
+ * A binding is identified by key, event and led key; delete removes every binding of key and event, clear removes all
+ *
+ */
+typedef struct
+{
+    KeypadBindingAction_t action;
+    char key_id[KEYPAD_KEY_ID_SIZE];
+    KeypadButtonEvent_t event;
+    KeypadLedParams_t led;
+}
+KeypadBindingParams_t;
+
+/**
+ * @brief Compiled rule program
+ *
+ */
+typedef struct
+{
+    uint16_t length;
+    uint8_t code[KEYPAD_RULE_PROGRAM_SIZE];
+}
+KeypadRuleProgram_t;
+
+/**
+ * @brief Led parameters faded to over a transition time
+ *
+ */
+typedef struct
+{
+    KeypadLedParams_t led;
+    uint16_t transition_ms;
+}
+KeypadLedFadeParams_t;
+
+/**
+ * @brief How an animation keyframe moves from the previous settings to its own
+ *
+ */
+typedef enum
+{
+    EASE_LINEAR = 0,
+    EASE_IN = 1,
+    EASE_OUT = 2,
+    EASE_IN_OUT = 3,
+    EASE_STEP = 4, // holds the previous settings, then jumps at the end of the keyframe
+}
+KeypadAnimationEasing_t;
+
+/**
+ * @brief KeypadAnimationColour_t set bits
+ *
+ */
+#define KEYPAD_ANIMATION_SET_COLOUR     0x01
+#define KEYPAD_ANIMATION_SET_BRIGHTNESS 0x02
+#define KEYPAD_ANIMATION_SET_OFF        0x04 // fade to black then turn OFF, the brightness is kept for the next ON
+
+/**
+ * @brief Settings a key reaches by the end of a keyframe, anything not set carries over
+ *
+ */
+typedef struct
+{
+    uint8_t position;
+    uint8_t set;
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t brightness;
+}
+KeypadAnimationColour_t;
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    uint16_t duration_ms;
+    uint8_t easing;
+    uint8_t count; // colours of this keyframe, following those of the keyframes before it
+}
+KeypadAnimationKeyframe_t;
+
+/**
+ * @brief Keyframe timeline played back by the keypad, keyframe_count 0 stops the running one
+ *
+ */
+typedef struct
+{
+    uint8_t keyframe_count;
+    uint8_t repeat; // times the timeline is played, 0 loops until stopped
+    KeypadAnimationKeyframe_t keyframes[KEYPAD_ANIMATION_KEYFRAMES];
+    KeypadAnimationColour_t colours[KEYPAD_ANIMATION_COLOURS];
+}
+KeypadAnimationParams_t;
+
+/**
+ * @brief Finds a key id in KEYPAD_KEY_ID
+ *
+ * @param key_id need not be '\0' terminated
+ * @param length
+ * @param position
+ * @return true
+ * @return false if key_id is not a valid key id
+ */
+bool KeypadKeyPosition(const char *key_id, size_t length, uint8_t *position);
+
 /**
  * @brief
  *
@@ -122,10 +379,90 @@ void KeypadTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask);
 void KeypadLedEventQueueSend(KeypadLedParams_t *params);
 
 /**
- * @brief
+ * @brief Submits led parameters for several keys to be written to the keypad atomically (a single flush)
+ *
+ * @param params
+ * @param count number of params, at most KEYPAD_KEYS
+ */
+void KeypadLedEventQueueSendBatch(KeypadLedParams_t *params, uint8_t count);
+
+/**
+ * @brief Submits led parameters to be faded to over params->transition_ms, the keypad renders the frames
+ * Only colour, brightness and state are faded, a transition of 0 writes them at once
+ *
+ * @param params
+ */
+void KeypadLedEventQueueSendFade(KeypadLedFadeParams_t *params);
+
+/**
+ * @brief Submits an animation timeline to replace the running one, the keypad renders the frames
+ *
+ * @param params
+ */
+void KeypadAnimationEventQueueSend(KeypadAnimationParams_t *params);
+
+/**
+ * @brief Submits a scene action to be carried out on the keypad, a recall is written with a single flush
+ *
+ * @param params
+ */
+void KeypadSceneEventQueueSend(KeypadSceneParams_t *params);
+
+/**
+ * @brief Submits a binding action to be carried out on the keypad
+ *
+ * @param params
+ */
+void KeypadBindingEventQueueSend(KeypadBindingParams_t *params);
+
+/**
+ * @brief Submits a rule program to replace the running one, it is checked and stored by the keypad
+ *
+ * @param program
+ */
+void KeypadRuleEventQueueSend(KeypadRuleProgram_t *program);
+
+/**
+ * @brief Copies the applied led state of every key, indexed by position in KEYPAD_KEY_ID
+ * Has no side effects, changes still pending for KeypadLedStateChangeReceive are kept
+ *
+ * @param states array of KEYPAD_KEYS entries
+ */
+void KeypadLedStateGet(KeypadLedState_t *states);
+
+/**
+ * @brief Waits for the applied led state to change, then copies the led state of every key
+ *
+ * @param states array of KEYPAD_KEYS entries
+ * @return KeypadMask_t mask of the keys that changed since the last call (bit n is KEYPAD_KEY_ID[n])
+ */
+KeypadMask_t KeypadLedStateChangeReceive(KeypadLedState_t *states);
+
+/**
+ * @brief Waits for button events and takes those waiting, chords first then a key at a time in position order
+ * Events of a key that repeat its last waiting event before being taken are coalesced into one with a count, so the
+ * keypad never blocks on a slow consumer, and each key's events come out in the order they happened. A key with
+ * KEYPAD_BUTTON_EVENTS_MAX runs waiting drops further events. Timestamps are those of the first event waiting on the
+ * key
+ *
+ * @param params array of max entries, max must be at least KEYPAD_BUTTON_EVENTS_MAX
+ * @param max
+ * @return uint8_t number of events taken, events left over are taken by the next call
+ */
+uint8_t KeypadButtonEventReceive(KeypadButtonParams_t *params, uint8_t max);
+
+/**
+ * @brief Gets the gesture timings
+ *
+ * @param config
+ */
+void KeypadButtonConfigGet(KeypadButtonConfig_t *config);
+
+/**
+ * @brief Sets the gesture timings, applied on the next button poll
  *
- * @return KeypadButtonParams_t
+ * @param config
  */
-KeypadButtonParams_t KeypadButtonEventQueueReceive();
+void KeypadButtonConfigSet(const KeypadButtonConfig_t *config);
 
 #endif //_KEYPAD_H
@@ -0,0 +1,547 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_animation.c
+* @brief
+*/
+#include "keypad_animation.h"
+
+// standard includes
+#include <string.h>
+
+// alert-panel includes
+#include "keypad_driver.h"
+#include "log.h"
+
+/**
+ * @brief Fixed point scale of keyframe progress, 0 is the start and KEYPAD_ANIMATION_ONE the end
+ *
+ */
+#define KEYPAD_ANIMATION_ONE    256
+
+/**
+ * @brief Led settings an animation moves between
+ *
+ */
+typedef struct
+{
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t brightness;
+}
+KeypadAnimationValue_t;
+
+/**
+ * @brief Motion of a single key, indexed by position in KEYPAD_KEY_ID
+ *
+ */
+typedef struct
+{
+    KeypadAnimationValue_t from;
+    KeypadAnimationValue_t to;
+    uint8_t kept_brightness;    // restored once a fade to OFF has finished
+    uint16_t duration_ms;       // fades only, timeline keys follow the keyframe timing
+    uint32_t start;
+}
+KeypadAnimationKey_t;
+
+/**
+ * @brief Running timeline
+ *
+ */
+static KeypadAnimationParams_t timeline;
+
+/**
+ * @brief Keys following the timeline
+ *
+ */
+static KeypadMask_t timeline_keys;
+
+/**
+ * @brief Current keyframe and its first entry in timeline.colours
+ *
+ */
+static uint8_t timeline_keyframe;
+static uint8_t timeline_colour;
+
+/**
+ * @brief Plays of the timeline left, including the current one, 0 loops until stopped
+ *
+ */
+static uint8_t timeline_rounds;
+
+/**
+ * @brief Time (ms) the current keyframe started
+ *
+ */
+static uint32_t timeline_start;
+
+/**
+ * @brief Keys fading on their own timing
+ *
+ */
+static KeypadMask_t fade_keys;
+
+/**
+ * @brief Keys turned OFF when their current keyframe or fade ends
+ *
+ */
+static KeypadMask_t off_keys;
+
+/**
+ * @brief
+ *
+ */
+static KeypadAnimationKey_t keys[KEYPAD_KEYS];
+
+/**
+ * @brief Time (ms) the next frame is due
+ *
+ */
+static uint32_t next_frame;
+
+/**
+ * @brief Driver led settings, indexed by led index
+ *
+ */
+static KeypadDriverLed_t leds[KEYPAD_KEYS];
+
+/**
+ * @brief Starts a key's motion from what its led shows now (leds must be current), an OFF led is turned on at black
+ *
+ * @param position
+ */
+static void KeypadAnimationTake(uint8_t position);
+
+/**
+ * @brief Moves a key's end settings to those of a keyframe colour, anything not set carries over
+ *
+ * @param colour
+ */
+static void KeypadAnimationTarget(const KeypadAnimationColour_t *colour);
+
+/**
+ * @brief Writes a key's settings at some progress between its start and end settings to the driver
+ *
+ * @param position
+ * @param progress 0-KEYPAD_ANIMATION_ONE
+ */
+static void KeypadAnimationWrite(uint8_t position, uint32_t progress);
+
+/**
+ * @brief Writes a key's end settings, turning it OFF if it faded out
+ *
+ * @param position
+ * @return true if the key was turned OFF, its motion is over
+ * @return false
+ */
+static bool KeypadAnimationFinish(uint8_t position);
+
+/**
+ * @brief
+ *
+ * @param easing
+ * @param elapsed
+ * @param duration
+ * @return uint32_t progress 0-KEYPAD_ANIMATION_ONE
+ */
+static uint32_t KeypadAnimationEase(uint8_t easing, uint32_t elapsed, uint32_t duration);
+
+/**
+ * @brief Makes a keyframe current, its colours become the targets of the timeline keys
+ *
+ * @param keyframe
+ * @param start
+ */
+static void KeypadAnimationKeyframeBegin(uint8_t keyframe, uint32_t start);
+
+/**
+ * @brief Renders the timeline, moving on through any keyframes that ended since the last frame
+ *
+ * @param time_now
+ * @return true if the timeline ended or keys left it
+ * @return false
+ */
+static bool KeypadAnimationTimelineRender(uint32_t time_now);
+
+/*-----------------------------------------------------------*/
+
+void KeypadAnimationStart(const KeypadAnimationParams_t *params, uint32_t time_now)
+{
+    // Keys of the timeline being replaced stay where they are
+    off_keys &= ~timeline_keys;
+    timeline_keys = 0;
+
+    if (params->keyframe_count == 0)
+    {
+        return;
+    }
+
+    if (params->keyframe_count > KEYPAD_ANIMATION_KEYFRAMES)
+    {
+        LogPrintWarn("Animation has %u keyframes, at most %u are supported\n", params->keyframe_count, KEYPAD_ANIMATION_KEYFRAMES);
+        return;
+    }
+
+    uint16_t colours = 0;
+    uint32_t duration = 0;
+
+    for (uint8_t i = 0; i < params->keyframe_count; i++)
+    {
+        colours += params->keyframes[i].count;
+        duration += params->keyframes[i].duration_ms;
+    }
+
+    if (colours > KEYPAD_ANIMATION_COLOURS)
+    {
+        LogPrintWarn("Animation has %u colours, at most %u are supported\n", colours, KEYPAD_ANIMATION_COLOURS);
+        return;
+    }
+
+    KeypadMask_t positions = 0;
+
+    for (uint8_t i = 0; i < colours; i++)
+    {
+        if (params->colours[i].position >= KEYPAD_KEYS)
+        {
+            LogPrintWarn("Animation colour %u has an invalid key position %u\n", i, params->colours[i].position);
+            return;
+        }
+
+        positions |= (KeypadMask_t)1 << params->colours[i].position;
+    }
+
+    if (KeypadAnimationKeys() == 0)
+    {
+        next_frame = time_now;
+    }
+
+    timeline = *params;
+    // A timeline that takes no time cannot loop
+    timeline_rounds = duration > 0 ? params->repeat : 1;
+    KeypadDriverGetLeds(leds, KEYPAD_KEYS);
+    fade_keys &= ~positions;
+    timeline_keys = positions;
+
+    while (positions != 0)
+    {
+        uint8_t position = __builtin_ctzll(positions);
+        positions &= positions - 1;
+        KeypadAnimationTake(position);
+    }
+
+    timeline_colour = 0;
+    KeypadAnimationKeyframeBegin(0, time_now);
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadAnimationFade(const KeypadAnimationColour_t *target, uint16_t duration_ms, uint32_t time_now)
+{
+    KeypadMask_t key = (KeypadMask_t)1 << target->position;
+
+    if (KeypadAnimationKeys() == 0)
+    {
+        next_frame = time_now;
+    }
+
+    KeypadDriverGetLeds(leds, KEYPAD_KEYS);
+    timeline_keys &= ~key;
+    KeypadAnimationTake(target->position);
+    KeypadAnimationTarget(target);
+    keys[target->position].start = time_now;
+    keys[target->position].duration_ms = duration_ms;
+    fade_keys |= key;
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadAnimationStop(void)
+{
+    timeline_keys = 0;
+    fade_keys = 0;
+    off_keys = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadAnimationRelease(KeypadMask_t positions)
+{
+    timeline_keys &= ~positions;
+    fade_keys &= ~positions;
+    off_keys &= ~positions;
+}
+
+/*-----------------------------------------------------------*/
+
+KeypadMask_t KeypadAnimationKeys(void)
+{
+    return timeline_keys | fade_keys;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t KeypadAnimationNextFrame(void)
+{
+    return next_frame;
+}
+
+/*-----------------------------------------------------------*/
+
+bool KeypadAnimationRender(uint32_t time_now)
+{
+    bool settled = false;
+    KeypadMask_t positions = fade_keys;
+
+    while (positions != 0)
+    {
+        uint8_t position = __builtin_ctzll(positions);
+        positions &= positions - 1;
+        KeypadAnimationKey_t *key = &keys[position];
+        uint32_t elapsed = time_now - key->start;
+
+        if (elapsed >= key->duration_ms)
+        {
+            KeypadAnimationFinish(position);
+            fade_keys &= ~((KeypadMask_t)1 << position);
+            settled = true;
+        }
+        else
+        {
+            KeypadAnimationWrite(position, KeypadAnimationEase(EASE_LINEAR, elapsed, key->duration_ms));
+        }
+    }
+
+    if (timeline_keys != 0)
+    {
+        settled |= KeypadAnimationTimelineRender(time_now);
+    }
+
+    // Frames missed by a late render are skipped, not caught up
+    next_frame += KEYPAD_ANIMATION_FRAME_PERIOD;
+
+    if ((int32_t)(next_frame - time_now) <= 0)
+    {
+        next_frame = time_now + KEYPAD_ANIMATION_FRAME_PERIOD;
+    }
+
+    return settled;
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadAnimationTake(uint8_t position)
+{
+    uint8_t key_index = KEYPAD_KEY_INDEX[position];
+    KeypadDriverLed_t *led = &leds[key_index];
+    KeypadAnimationKey_t *key = &keys[position];
+    uint8_t brightness = (uint8_t)((led->level + 128) / 257);
+    key->from.red = led->red;
+    key->from.green = led->green;
+    key->from.blue = led->blue;
+    key->from.brightness = led->on ? brightness : 0;
+    key->to = key->from;
+    key->to.brightness = brightness;
+    off_keys &= ~((KeypadMask_t)1 << position);
+
+    if (!led->on)
+    {
+        KeypadDriverSetLedBrightness(key_index, 0);
+        KeypadDriverSetLedOn(key_index);
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadAnimationTarget(const KeypadAnimationColour_t *colour)
+{
+    KeypadAnimationKey_t *key = &keys[colour->position];
+
+    if (colour->set & KEYPAD_ANIMATION_SET_COLOUR)
+    {
+        key->to.red = colour->red;
+        key->to.green = colour->green;
+        key->to.blue = colour->blue;
+    }
+
+    if (colour->set & KEYPAD_ANIMATION_SET_BRIGHTNESS)
+    {
+        key->to.brightness = colour->brightness;
+    }
+
+    if (colour->set & KEYPAD_ANIMATION_SET_OFF)
+    {
+        key->kept_brightness = key->to.brightness;
+        key->to.brightness = 0;
+        off_keys |= (KeypadMask_t)1 << colour->position;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadAnimationWrite(uint8_t position, uint32_t progress)
+{
+    KeypadAnimationKey_t *key = &keys[position];
+    int32_t p = (int32_t)progress;
+    uint8_t red = (uint8_t)(key->from.red + (((key->to.red - key->from.red) * p) / KEYPAD_ANIMATION_ONE));
+    uint8_t green = (uint8_t)(key->from.green + (((key->to.green - key->from.green) * p) / KEYPAD_ANIMATION_ONE));
+    uint8_t blue = (uint8_t)(key->from.blue + (((key->to.blue - key->from.blue) * p) / KEYPAD_ANIMATION_ONE));
+    // Brightness is blended at the driver's 16 bit level, so slow fades are smooth at the dim end
+    int32_t from_level = (int32_t)key->from.brightness * 257;
+    int32_t to_level = (int32_t)key->to.brightness * 257;
+    uint16_t level = (uint16_t)(from_level + (((to_level - from_level) * p) / KEYPAD_ANIMATION_ONE));
+    uint8_t key_index = KEYPAD_KEY_INDEX[position];
+    KeypadDriverSetLedColour(key_index, red, green, blue);
+    KeypadDriverSetLedBrightness(key_index, level);
+}
+
+/*-----------------------------------------------------------*/
+
+static bool KeypadAnimationFinish(uint8_t position)
+{
+    KeypadMask_t key = (KeypadMask_t)1 << position;
+    KeypadAnimationWrite(position, KEYPAD_ANIMATION_ONE);
+    keys[position].from = keys[position].to;
+
+    if ((off_keys & key) == 0)
+    {
+        return false;
+    }
+
+    uint8_t key_index = KEYPAD_KEY_INDEX[position];
+    KeypadDriverSetLedOff(key_index);
+    KeypadDriverSetLedBrightness(key_index, (uint16_t)keys[position].kept_brightness * 257);
+    off_keys &= ~key;
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t KeypadAnimationEase(uint8_t easing, uint32_t elapsed, uint32_t duration)
+{
+    if (elapsed >= duration)
+    {
+        return KEYPAD_ANIMATION_ONE;
+    }
+
+    uint32_t t = (elapsed * KEYPAD_ANIMATION_ONE) / duration;
+    uint32_t r = KEYPAD_ANIMATION_ONE - t;
+
+    switch (easing)
+    {
+        case EASE_IN:
+            return (t * t) / KEYPAD_ANIMATION_ONE;
+
+        case EASE_OUT:
+            return KEYPAD_ANIMATION_ONE - ((r * r) / KEYPAD_ANIMATION_ONE);
+
+        case EASE_IN_OUT:
+            // Smoothstep, 3t^2 - 2t^3
+            return (t * t * ((3 * KEYPAD_ANIMATION_ONE) - (2 * t))) / (KEYPAD_ANIMATION_ONE * KEYPAD_ANIMATION_ONE);
+
+        case EASE_STEP:
+            return 0;
+
+        default:
+            return t;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadAnimationKeyframeBegin(uint8_t keyframe, uint32_t start)
+{
+    const KeypadAnimationKeyframe_t *frame = &timeline.keyframes[keyframe];
+    timeline_keyframe = keyframe;
+    timeline_start = start;
+
+    for (uint8_t i = timeline_colour; i < timeline_colour + frame->count; i++)
+    {
+        // Keys written directly since the timeline started are left alone
+        if (timeline_keys & ((KeypadMask_t)1 << timeline.colours[i].position))
+        {
+            KeypadAnimationTarget(&timeline.colours[i]);
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static bool KeypadAnimationTimelineRender(uint32_t time_now)
+{
+    bool settled = false;
+    const KeypadAnimationKeyframe_t *frame = &timeline.keyframes[timeline_keyframe];
+    uint32_t elapsed = time_now - timeline_start;
+
+    // Keep to the timeline's own clock, a late frame jumps ahead rather than stretching the timeline
+    while (elapsed >= frame->duration_ms)
+    {
+        KeypadMask_t positions = timeline_keys;
+
+        while (positions != 0)
+        {
+            uint8_t position = __builtin_ctzll(positions);
+            positions &= positions - 1;
+
+            if (KeypadAnimationFinish(position))
+            {
+                timeline_keys &= ~((KeypadMask_t)1 << position);
+                settled = true;
+            }
+        }
+
+        elapsed -= frame->duration_ms;
+        uint8_t keyframe = timeline_keyframe + 1;
+        timeline_colour += frame->count;
+
+        if (keyframe == timeline.keyframe_count)
+        {
+            if (timeline_rounds == 1 || timeline_keys == 0)
+            {
+                timeline_keys = 0;
+                return true;
+            }
+
+            timeline_rounds -= timeline_rounds > 1;
+            keyframe = 0;
+            timeline_colour = 0;
+        }
+
+        KeypadAnimationKeyframeBegin(keyframe, timeline_start + frame->duration_ms);
+        frame = &timeline.keyframes[keyframe];
+    }
+
+    uint32_t progress = KeypadAnimationEase(frame->easing, elapsed, frame->duration_ms);
+    KeypadMask_t positions = timeline_keys;
+
+    while (positions != 0)
+    {
+        uint8_t position = __builtin_ctzll(positions);
+        positions &= positions - 1;
+        KeypadAnimationWrite(position, progress);
+    }
+
+    return settled;
+}
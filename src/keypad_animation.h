@@ -0,0 +1,102 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_animation.h
+* @brief Local led animation, a keyframe timeline and per key fades interpolated at a fixed frame rate
+* Public functions in this module file are NOT thread-safe (only call from the task that owns the keypad driver)
+*
+* One timeline runs at a time, starting a timeline replaces it. Fades (transitions of a single key) run alongside it.
+* A key follows at most one of them, whichever was started last, and leaves both when written directly.
+* Animated keys are turned on at their current colour, fading in from 0 if they were off.
+*/
+#ifndef _KEYPAD_ANIMATION_H
+#define _KEYPAD_ANIMATION_H
+
+// standard includes
+#include <stdbool.h>
+#include <stdint.h>
+
+// alert-panel includes
+#include "keypad.h"
+
+/**
+ * @brief Time (ms) between animation frames
+ *
+ */
+#define KEYPAD_ANIMATION_FRAME_PERIOD   20
+
+/**
+ * @brief Starts a timeline, replacing the running one, a timeline with no keyframes just stops it
+ *
+ * @param params
+ * @param time_now
+ */
+void KeypadAnimationStart(const KeypadAnimationParams_t *params, uint32_t time_now);
+
+/**
+ * @brief Fades a key from its current settings to target
+ *
+ * @param target
+ * @param duration_ms
+ * @param time_now
+ */
+void KeypadAnimationFade(const KeypadAnimationColour_t *target, uint16_t duration_ms, uint32_t time_now);
+
+/**
+ * @brief Stops the timeline and every fade, leds keep their current settings
+ *
+ */
+void KeypadAnimationStop(void);
+
+/**
+ * @brief Takes keys out of the timeline and fades, e.g. because they were written directly
+ *
+ * @param positions
+ */
+void KeypadAnimationRelease(KeypadMask_t positions);
+
+/**
+ * @brief
+ *
+ * @return KeypadMask_t positions currently animated, their led settings are in flux
+ */
+KeypadMask_t KeypadAnimationKeys(void);
+
+/**
+ * @brief
+ *
+ * @return uint32_t time (ms) the next frame is due, only meaningful while keys are animated
+ */
+uint32_t KeypadAnimationNextFrame(void);
+
+/**
+ * @brief Writes the next frame to the keypad driver, the caller flushes it
+ *
+ * @param time_now
+ * @return true if the timeline or a fade finished, so the applied led state should be committed
+ * @return false
+ */
+bool KeypadAnimationRender(uint32_t time_now);
+
+#endif //_KEYPAD_ANIMATION_H
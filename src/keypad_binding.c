@@ -0,0 +1,216 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_binding.c
+* @brief
+*/
+#include "keypad_binding.h"
+
+// standard includes
+#include <string.h>
+
+// alert-panel includes
+#include "storage.h"
+#include "log.h"
+
+/**
+ * @brief
+ *
+ */
+#define KEYPAD_BINDINGS     32
+
+/**
+ * @brief Stored form of a binding, a zero event marks a free slot
+ *
+ */
+typedef struct
+{
+    uint8_t position;
+    uint8_t event;
+    KeypadLedParams_t led;
+}
+KeypadBinding_t;
+
+/**
+ * @brief RAM copy of the bindings sector, so applying a binding never touches flash
+ *
+ */
+static KeypadBinding_t bindings[KEYPAD_BINDINGS];
+
+_Static_assert(sizeof(bindings) <= STORAGE_RECORD_MAX_SIZE, "Bindings must fit in one storage sector");
+
+/**
+ * @brief Keys with a binding per event, rebuilt whenever the bindings change
+ *
+ */
+static KeypadMask_t bound_keys[CHORD + 1];
+
+/**
+ * @brief
+ *
+ */
+static void KeypadBindingIndex(void);
+
+/**
+ * @brief
+ *
+ * @return true
+ * @return false
+ */
+static bool KeypadBindingStore(void);
+
+/*-----------------------------------------------------------*/
+
+void KeypadBindingInit(void)
+{
+    if (!StorageRead(STORAGE_SECTOR_BINDINGS, bindings, sizeof(bindings)))
+    {
+        LogPrintInfo("No stored bindings found\n");
+        memset(bindings, 0, sizeof(bindings));
+    }
+
+    KeypadBindingIndex();
+}
+
+/*-----------------------------------------------------------*/
+
+bool KeypadBindingSet(uint8_t position, KeypadButtonEvent_t event, const KeypadLedParams_t *led)
+{
+    KeypadBinding_t *binding = NULL;
+
+    for (uint8_t i = 0; i < KEYPAD_BINDINGS; i++)
+    {
+        if (bindings[i].event == event &&
+                bindings[i].position == position &&
+                strncmp(bindings[i].led.key_id, led->key_id, KEYPAD_KEY_ID_SIZE) == 0)
+        {
+            binding = &bindings[i];
+            break;
+        }
+
+        if (binding == NULL && bindings[i].event == 0)
+        {
+            binding = &bindings[i]; // First free slot, unless the binding already exists further on
+        }
+    }
+
+    if (binding == NULL)
+    {
+        LogPrintError("No free binding slot for key %s\n", KEYPAD_KEY_ID[position]);
+        return false;
+    }
+
+    binding->position = position;
+    binding->event = event;
+    binding->led = *led;
+    return KeypadBindingStore();
+}
+
+/*-----------------------------------------------------------*/
+
+bool KeypadBindingDelete(uint8_t position, KeypadButtonEvent_t event)
+{
+    bool found = false;
+
+    for (uint8_t i = 0; i < KEYPAD_BINDINGS; i++)
+    {
+        if (bindings[i].event == event && bindings[i].position == position)
+        {
+            memset(&bindings[i], 0, sizeof(KeypadBinding_t));
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        LogPrintWarn("No binding for key %s\n", KEYPAD_KEY_ID[position]);
+        return false;
+    }
+
+    return KeypadBindingStore();
+}
+
+/*-----------------------------------------------------------*/
+
+bool KeypadBindingClear(void)
+{
+    memset(bindings, 0, sizeof(bindings));
+    return KeypadBindingStore();
+}
+
+/*-----------------------------------------------------------*/
+
+KeypadMask_t KeypadBindingKeys(KeypadButtonEvent_t event)
+{
+    return event <= CHORD ? bound_keys[event] : 0;
+}
+
+/*-----------------------------------------------------------*/
+
+const KeypadLedParams_t *KeypadBindingFind(uint8_t position, KeypadButtonEvent_t event, uint8_t *slot)
+{
+    while (*slot < KEYPAD_BINDINGS)
+    {
+        KeypadBinding_t *binding = &bindings[(*slot)++];
+
+        if (binding->event == event && binding->position == position)
+        {
+            return &binding->led;
+        }
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadBindingIndex(void)
+{
+    memset(bound_keys, 0, sizeof(bound_keys));
+
+    for (uint8_t i = 0; i < KEYPAD_BINDINGS; i++)
+    {
+        // Guard against a record written by a build with more keys or events
+        KeypadBinding_t *binding = &bindings[i];
+        uint8_t led_position;
+
+        if (binding->event != 0 && binding->event <= CHORD && binding->position < KEYPAD_KEYS &&
+                KeypadKeyPosition(binding->led.key_id, strnlen(binding->led.key_id, KEYPAD_KEY_ID_SIZE), &led_position))
+        {
+            bound_keys[binding->event] |= (KeypadMask_t)1 << binding->position;
+        }
+        else
+        {
+            binding->event = 0;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static bool KeypadBindingStore(void)
+{
+    KeypadBindingIndex();
+    return StorageWriteQueueSend(STORAGE_SECTOR_BINDINGS, bindings, sizeof(bindings));
+}
@@ -0,0 +1,92 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_binding.h
+* @brief Local button event to led bindings kept in flash, applied by the keypad task as soon as the event is seen
+* Public functions in this module file are NOT thread-safe (only call from the task that owns the keypad driver)
+*/
+#ifndef _KEYPAD_BINDING_H
+#define _KEYPAD_BINDING_H
+
+// standard includes
+#include <stdbool.h>
+#include <stdint.h>
+
+// alert-panel includes
+#include "keypad.h"
+
+/**
+ * @brief Loads stored bindings from flash
+ *
+ */
+void KeypadBindingInit(void);
+
+/**
+ * @brief Binds led parameters to a button event of a key, replacing any binding of the same key, event and led key
+ *
+ * @param position key position in KEYPAD_KEY_ID
+ * @param event
+ * @param led led parameters, key_id is the led to write
+ * @return true
+ * @return false if there is no free binding slot or the record could not be queued for storage
+ */
+bool KeypadBindingSet(uint8_t position, KeypadButtonEvent_t event, const KeypadLedParams_t *led);
+
+/**
+ * @brief Deletes every binding of a key's button event
+ *
+ * @param position
+ * @param event
+ * @return true
+ * @return false if nothing was bound or the record could not be queued for storage
+ */
+bool KeypadBindingDelete(uint8_t position, KeypadButtonEvent_t event);
+
+/**
+ * @brief Deletes every binding
+ *
+ * @return true
+ * @return false if the record could not be queued for storage
+ */
+bool KeypadBindingClear(void);
+
+/**
+ * @brief Gets the keys that have any binding for an event
+ *
+ * @param event
+ * @return KeypadMask_t bit set per position in KEYPAD_KEY_ID
+ */
+KeypadMask_t KeypadBindingKeys(KeypadButtonEvent_t event);
+
+/**
+ * @brief Finds the next binding of a key's button event
+ *
+ * @param position
+ * @param event
+ * @param slot where to continue the search, start at 0
+ * @return const KeypadLedParams_t* led parameters to write, NULL when there are no more
+ */
+const KeypadLedParams_t *KeypadBindingFind(uint8_t position, KeypadButtonEvent_t event, uint8_t *slot);
+
+#endif //_KEYPAD_BINDING_H
@@ -32,41 +32,107 @@
 #include <math.h>
 #include <string.h>
 
+#ifdef KEYPAD_DRIVER_VIRTUAL
+// alert-panel includes
+#include "keypad_driver_virtual.h"
+#else
 // pico-sdk includes
 #include "pico/stdlib.h"
 #include "hardware/i2c.h"
 #include "hardware/spi.h"
+#endif
 
 // keypad properties
-#define KEYPAD_ADDRESS  0x20
-#define WIDTH           4
-#define HEIGHT          5
-#define NUM_PADS        (WIDTH * HEIGHT)
-
-// gpio pins
-#define SDA     4
-#define SCL     5
+#define NUM_PADS        KEYPAD_DRIVER_KEYS
+
+#ifndef KEYPAD_DRIVER_VIRTUAL
+// gpio pins (led chain, i2c pins are per board)
 #define CS      17
 #define SCK     18
 #define MOSI    19
 
+// TCA9555 input port 0 register, port 1 follows and reads toggle between the pair
+#define INPUT_PORT_REG  0
+
+/**
+ * @brief I2C location of a board's button expander
+ *
+ */
+typedef struct
+{
+    i2c_inst_t *i2c;
+    uint8_t address;
+    uint8_t sda;
+    uint8_t scl;
+}
+KeypadDriverBoard_t;
+
 /**
- * @brief Brightness information for each led, used for restoration on state = ON
+ * @brief One entry per board, in led chain order
  *
  */
-static float led_restore_brightness[NUM_PADS];
+static const KeypadDriverBoard_t KEYPAD_DRIVER_BOARD_TABLE[] =
+{
+    {i2c0, 0x20, 4, 5},
+};
+
+_Static_assert(sizeof(KEYPAD_DRIVER_BOARD_TABLE) / sizeof(KEYPAD_DRIVER_BOARD_TABLE[0]) == KEYPAD_DRIVER_BOARDS,
+               "KEYPAD_DRIVER_BOARD_TABLE needs one entry per board");
+#endif
+
+/**
+ * @brief Gamma applied when mapping perceptual levels onto linear led output
+ *
+ */
+#define GAMMA               2.2f
 
 /**
- * @brief ON/OFF information for each led
+ * @brief Number of gamma table segments, the table holds one extra entry for interpolation
  *
  */
-static bool led_state[NUM_PADS];
+#define GAMMA_TABLE_SIZE    256
+
+/**
+ * @brief Maximum value of the APA102 5-bit global brightness field
+ *
+ */
+#define GLOBAL_MAX          0b11111
+
+/**
+ * @brief Requested settings for each led, kept so levels are restored on state = ON
+ *
+ */
+static KeypadDriverLed_t led_settings[NUM_PADS];
+
+/**
+ * @brief Perceptual (16-bit level) to linear (16-bit output) lookup table
+ *
+ */
+static uint16_t gamma_table[GAMMA_TABLE_SIZE + 1];
+
+/**
+ * @brief Rendered 8.8 fixed point pwm value for each led colour channel (b, g, r order as on the wire)
+ *
+ */
+static uint16_t led_pwm[NUM_PADS][3];
+
+/**
+ * @brief Fractional pwm accumulators for each led colour channel, used for temporal dithering
+ *
+ */
+static uint8_t led_dither[NUM_PADS][3];
+
+/**
+ * @brief Temporal dithering of the fractional pwm bits on each flush
+ *
+ */
+static bool dithering_enabled;
 
 /**
  * @brief Full led_buffer to be written to device
  *
  */
-static uint8_t led_buffer[(NUM_PADS * 4) + 8];
+static uint8_t led_buffer[KEYPAD_DRIVER_FRAME_SIZE];
 
 /**
  * @brief Pointer to start of led colour/brightness information in led_buffer
@@ -74,12 +140,37 @@ static uint8_t led_buffer[(NUM_PADS * 4) + 8];
  */
 static uint8_t *led_data;
 
+/**
+ * @brief Fills gamma_table, done once so rendering is integer only
+ *
+ */
+static void KeypadDriverGammaInit(void);
+
+/**
+ * @brief Maps a 16-bit perceptual level to a 16-bit linear output, interpolating between table entries
+ *
+ * @param level
+ * @return uint16_t
+ */
+static uint16_t KeypadDriverGamma(uint16_t level);
+
+/**
+ * @brief Splits the led settings across the 5-bit global field and the 8-bit colour channels
+ *
+ * @param i
+ */
+static void KeypadDriverRenderLed(uint8_t i);
+
 /*-----------------------------------------------------------*/
 
 void KeypadDriverInit(void)
 {
     memset(led_buffer, 0, sizeof(led_buffer));
+    memset(led_settings, 0, sizeof(led_settings));
+    memset(led_dither, 0, sizeof(led_dither));
     led_data = led_buffer + 4;
+    dithering_enabled = false;
+    KeypadDriverGammaInit();
 
     // Strange behavior here. If we don't initialise the brightness/color(?)
     // data before initialising the keypad, it doesn't work properly.
@@ -87,31 +178,44 @@ void KeypadDriverInit(void)
     // after the keypad has been initialised
     for (uint16_t i = 0; i < NUM_PADS; i++)
     {
-        led_restore_brightness[i] = 0.5f;
-        led_state[i] = true;
-        KeypadDriverSetLedBrightness(i, 0.5f);
+        KeypadDriverSetLedOn(i);
+        KeypadDriverSetLedBrightness(i, 0x8000);
         KeypadDriverSetLedColour(i, 255, 255, 255);
     }
 
-    // Init keypad
-    i2c_init(i2c0, 400000);
-    gpio_set_function(SDA, GPIO_FUNC_I2C);
-    gpio_pull_up(SDA);
-    gpio_set_function(SCL, GPIO_FUNC_I2C);
-    gpio_pull_up(SCL);
+#ifndef KEYPAD_DRIVER_VIRTUAL
+    // Init keypads
+    for (uint8_t board = 0; board < KEYPAD_DRIVER_BOARDS; board++)
+    {
+        const KeypadDriverBoard_t *config = &KEYPAD_DRIVER_BOARD_TABLE[board];
+        i2c_init(config->i2c, 400000);
+        gpio_set_function(config->sda, GPIO_FUNC_I2C);
+        gpio_pull_up(config->sda);
+        gpio_set_function(config->scl, GPIO_FUNC_I2C);
+        gpio_pull_up(config->scl);
+    }
+
+    // Point each expander at its input ports once, every poll after that is a single read
+    for (uint8_t board = 0; board < KEYPAD_DRIVER_BOARDS; board++)
+    {
+        uint8_t reg = INPUT_PORT_REG;
+        i2c_write_blocking(KEYPAD_DRIVER_BOARD_TABLE[board].i2c, KEYPAD_DRIVER_BOARD_TABLE[board].address, &reg, 1, false);
+    }
+
     spi_init(spi0, 4 * 1024 * 1024);
     gpio_set_function(CS, GPIO_FUNC_SIO);
     gpio_set_dir(CS, GPIO_OUT);
     gpio_put(CS, 1);
     gpio_set_function(SCK, GPIO_FUNC_SPI);
     gpio_set_function(MOSI, GPIO_FUNC_SPI);
+#endif
     KeypadDriverFlush();
 
     // Set back to zeros
     for (uint16_t i = 0; i < NUM_PADS; i++)
     {
         KeypadDriverSetLedOff(i);
-        KeypadDriverSetLedBrightness(i, 0.0f);
+        KeypadDriverSetLedBrightness(i, 0);
         KeypadDriverSetLedColour(i, 0, 0, 0);
     }
 
@@ -120,25 +224,16 @@ void KeypadDriverInit(void)
 
 /*-----------------------------------------------------------*/
 
-void KeypadDriverSetLedBrightness(uint8_t i, float brightness)
+void KeypadDriverSetLedBrightness(uint8_t i, uint16_t level)
 {
     if (i < 0 || i >= NUM_PADS)
     {
         return;
     }
 
-    if (brightness < 0.0f || brightness > 1.0f)
-    {
-        return;
-    }
-
-    // Set restore value in case we're OFF
-    led_restore_brightness[i] = brightness;
-
-    if (led_state[i]) // if we're ON, set brightness on device
-    {
-        led_data[i * 4] = 0b11100000 | (uint8_t)(brightness * (float)0b11111);
-    }
+    // Kept even if we're OFF, so it is restored on state = ON
+    led_settings[i].level = level;
+    KeypadDriverRenderLed(i);
 }
 
 /*-----------------------------------------------------------*/
@@ -150,10 +245,10 @@ void KeypadDriverSetLedColour(uint8_t i, uint8_t r, uint8_t g, uint8_t b)
         return;
     }
 
-    uint16_t offset = i * 4;
-    led_data[offset + 1] = b;
-    led_data[offset + 2] = g;
-    led_data[offset + 3] = r;
+    led_settings[i].red = r;
+    led_settings[i].green = g;
+    led_settings[i].blue = b;
+    KeypadDriverRenderLed(i);
 }
 
 /*-----------------------------------------------------------*/
@@ -165,10 +260,9 @@ void KeypadDriverSetLedOn(uint8_t i)
         return;
     }
 
-    // Note we're now ON
-    led_state[i] = true;
-    // Set brightness to restore value
-    led_data[i * 4] = 0b11100000 | (uint8_t)(led_restore_brightness[i] * (float)0b11111);
+    // Note we're now ON, render restores the stored level
+    led_settings[i].on = true;
+    KeypadDriverRenderLed(i);
 }
 
 /*-----------------------------------------------------------*/
@@ -181,27 +275,156 @@ void KeypadDriverSetLedOff(uint8_t i)
     }
 
     // Note we're now OFF
-    led_state[i] = false;
-    // Set brightness to 0.0f
-    led_data[i * 4] = 0b11100000 | (uint8_t)(0.0f * (float)0b11111);
+    led_settings[i].on = false;
+    KeypadDriverRenderLed(i);
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadDriverGetLeds(KeypadDriverLed_t *leds, uint8_t count)
+{
+    if (count > NUM_PADS)
+    {
+        count = NUM_PADS;
+    }
+
+    memcpy(leds, led_settings, count * sizeof(KeypadDriverLed_t));
 }
 
 /*-----------------------------------------------------------*/
 
-uint16_t KeypadDriverGetButtonStates(void)
+void KeypadDriverSetLeds(const KeypadDriverLed_t *leds, uint8_t count)
 {
-    uint8_t i2c_read_buffer[2];
-    uint8_t reg = 0;
-    i2c_write_blocking(i2c0, KEYPAD_ADDRESS, &reg, 1, true);
-    i2c_read_blocking(i2c0, KEYPAD_ADDRESS, i2c_read_buffer, 2, false);
-    return ~((i2c_read_buffer[0]) | (i2c_read_buffer[1] << 8));
+    if (count > NUM_PADS)
+    {
+        count = NUM_PADS;
+    }
+
+    memcpy(led_settings, leds, count * sizeof(KeypadDriverLed_t));
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        KeypadDriverRenderLed(i);
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadDriverSetDithering(bool enabled)
+{
+    dithering_enabled = enabled;
+
+    if (!enabled)
+    {
+        // Drop back to the truncated pwm values
+        for (uint8_t i = 0; i < NUM_PADS; i++)
+        {
+            KeypadDriverRenderLed(i);
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+KeypadDriverMask_t KeypadDriverGetButtonStates(void)
+{
+#ifdef KEYPAD_DRIVER_VIRTUAL
+    return KeypadDriverVirtualReadButtons();
+#else
+    KeypadDriverMask_t states = 0;
+
+    for (uint8_t board = 0; board < KEYPAD_DRIVER_BOARDS; board++)
+    {
+        uint8_t i2c_read_buffer[2];
+        i2c_read_blocking(KEYPAD_DRIVER_BOARD_TABLE[board].i2c, KEYPAD_DRIVER_BOARD_TABLE[board].address, i2c_read_buffer, 2, false);
+        uint16_t board_states = ~((i2c_read_buffer[0]) | (i2c_read_buffer[1] << 8));
+        states |= (KeypadDriverMask_t)board_states << (board * KEYPAD_DRIVER_BOARD_KEYS);
+    }
+
+    return states;
+#endif
 }
 
 /*-----------------------------------------------------------*/
 
 void KeypadDriverFlush(void)
 {
+    if (dithering_enabled)
+    {
+        // Carry the fractional pwm bits over successive frames so their average hits the
+        // requested output, only the colour bytes change here, the global field is fixed
+        for (uint8_t i = 0; i < NUM_PADS; i++)
+        {
+            for (uint8_t c = 0; c < 3; c++)
+            {
+                uint16_t acc = led_dither[i][c] + (led_pwm[i][c] & 0xFF);
+                uint16_t pwm = (led_pwm[i][c] >> 8) + (acc >> 8);
+                led_dither[i][c] = acc & 0xFF;
+                led_data[(i * 4) + 1 + c] = pwm > 0xFF ? 0xFF : pwm;
+            }
+        }
+    }
+
+#ifdef KEYPAD_DRIVER_VIRTUAL
+    KeypadDriverVirtualWrite(led_buffer, sizeof(led_buffer));
+#else
     gpio_put(CS, 0);
     spi_write_blocking(spi0, led_buffer, sizeof(led_buffer));
     gpio_put(CS, 1);
+#endif
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadDriverGammaInit(void)
+{
+    for (uint16_t i = 0; i <= GAMMA_TABLE_SIZE; i++)
+    {
+        float normalised = (float)i / (float)GAMMA_TABLE_SIZE;
+        gamma_table[i] = (uint16_t)((powf(normalised, GAMMA) * (float)UINT16_MAX) + 0.5f);
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t KeypadDriverGamma(uint16_t level)
+{
+    uint16_t index = level >> 8;
+    uint32_t fraction = level & 0xFF;
+    uint32_t lower = gamma_table[index];
+    uint32_t upper = gamma_table[index + 1];
+    return (uint16_t)(lower + (((upper - lower) * fraction) >> 8));
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadDriverRenderLed(uint8_t i)
+{
+    KeypadDriverLed_t *led = &led_settings[i];
+    uint8_t *frame = &led_data[i * 4];
+    uint32_t linear = led->on ? KeypadDriverGamma(led->level) : 0;
+
+    if (linear == 0)
+    {
+        memset(led_pwm[i], 0, sizeof(led_pwm[i]));
+        frame[0] = 0b11100000;
+        frame[1] = 0;
+        frame[2] = 0;
+        frame[3] = 0;
+        return;
+    }
+
+    // Use the smallest global current that can still reach the requested output, so the
+    // 8-bit colour channels keep their full resolution even at very low levels
+    uint32_t global = ((linear * GLOBAL_MAX) + UINT16_MAX - 1) / UINT16_MAX;
+    // Remaining scale factor for the colour channels in 8.8 fixed point, always <= 1.0
+    uint32_t scale = (linear * GLOBAL_MAX * 256) / global;
+    uint8_t colour[3] = {led->blue, led->green, led->red};
+    frame[0] = 0b11100000 | (uint8_t)global;
+
+    for (uint8_t c = 0; c < 3; c++)
+    {
+        led_pwm[i][c] = (uint16_t)((colour[c] * scale) / UINT16_MAX);
+        frame[1 + c] = led_pwm[i][c] >> 8;
+    }
 }
@@ -32,6 +32,66 @@
 
 // standard includes
 #include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Number of chained keypads, each on its own i2c address/bus (see the board table in keypad_driver.c)
+ * with their leds on one APA102 chain, board 0 first
+ *
+ */
+#define KEYPAD_DRIVER_BOARDS        1
+
+/**
+ * @brief
+ *
+ */
+#define KEYPAD_DRIVER_BOARD_KEYS    16
+
+/**
+ * @brief Keys (and leds) across all boards, key i is key (i % 16) of board (i / 16)
+ *
+ */
+#define KEYPAD_DRIVER_KEYS          (KEYPAD_DRIVER_BOARDS * KEYPAD_DRIVER_BOARD_KEYS)
+
+/**
+ * @brief APA102 end frame, at least one clock edge for every two leds, and never less than 4 bytes
+ *
+ */
+#define KEYPAD_DRIVER_END_FRAME_SIZE    (((KEYPAD_DRIVER_KEYS + 15) / 16) > 4 ? ((KEYPAD_DRIVER_KEYS + 15) / 16) : 4)
+
+/**
+ * @brief Bytes written to the led chain per flush: start frame, 4 bytes per led, end frame
+ *
+ */
+#define KEYPAD_DRIVER_FRAME_SIZE    (4 + (KEYPAD_DRIVER_KEYS * 4) + KEYPAD_DRIVER_END_FRAME_SIZE)
+
+/**
+ * @brief One bit per key, wide enough for every board
+ *
+ */
+#if KEYPAD_DRIVER_KEYS <= 16
+typedef uint16_t KeypadDriverMask_t;
+#elif KEYPAD_DRIVER_KEYS <= 32
+typedef uint32_t KeypadDriverMask_t;
+#elif KEYPAD_DRIVER_KEYS <= 64
+typedef uint64_t KeypadDriverMask_t;
+#else
+#error "KEYPAD_DRIVER_BOARDS supports at most 4 boards"
+#endif
+
+/**
+ * @brief Colour, level and ON/OFF settings of a single led (6 bytes, also used as a compact stored form)
+ *
+ */
+typedef struct
+{
+    uint16_t level;
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    bool on;
+}
+KeypadDriverLed_t;
 
 /**
  * @brief Initialise keypad driver
@@ -41,11 +101,13 @@ void KeypadDriverInit(void);
 
 /**
  * @brief Set the led brightness for an individual button
+ * The perceptual level is gamma corrected and split across the 5-bit global
+ * current and the 8-bit colour channels, giving smooth steps at low levels
  *
  * @param i
- * @param brightness
+ * @param level 0 (off) to 65535 (full)
  */
-void KeypadDriverSetLedBrightness(uint8_t i, float brightness);
+void KeypadDriverSetLedBrightness(uint8_t i, uint16_t level);
 
 /**
  * @brief Set the led colour for an individual button
@@ -72,11 +134,35 @@ void KeypadDriverSetLedOn(uint8_t i);
 void KeypadDriverSetLedOff(uint8_t i);
 
 /**
- * @brief Get all current button states
+ * @brief Copies the current settings of the first count leds
+ *
+ * @param leds
+ * @param count
+ */
+void KeypadDriverGetLeds(KeypadDriverLed_t *leds, uint8_t count);
+
+/**
+ * @brief Replaces the settings of the first count leds in one go, call KeypadDriverFlush to write them
+ *
+ * @param leds
+ * @param count
+ */
+void KeypadDriverSetLeds(const KeypadDriverLed_t *leds, uint8_t count);
+
+/**
+ * @brief Enable/disable temporal dithering of the fractional colour bits
+ * Only has a visible effect if KeypadDriverFlush is called periodically
+ *
+ * @param enabled
+ */
+void KeypadDriverSetDithering(bool enabled);
+
+/**
+ * @brief Get all current button states, one read per board
  *
- * @return uint16_t
+ * @return KeypadDriverMask_t bit n is driver key index n
  */
-uint16_t KeypadDriverGetButtonStates(void);
+KeypadDriverMask_t KeypadDriverGetButtonStates(void);
 
 /**
  * @brief Write changed led values to the device
@@ -0,0 +1,156 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_driver_virtual.c
+* @brief
+*/
+#include "keypad_driver_virtual.h"
+
+// standard includes
+#include <string.h>
+
+// alert-panel includes
+#include "util.h"
+
+/**
+ * @brief
+ *
+ */
+static const KeypadDriverVirtualStep_t *script_steps;
+
+/**
+ * @brief
+ *
+ */
+static size_t script_count;
+
+/**
+ * @brief Next step to apply
+ *
+ */
+static size_t script_next;
+
+/**
+ * @brief
+ *
+ */
+static uint64_t script_start_us;
+
+/**
+ * @brief
+ *
+ */
+static KeypadDriverMask_t buttons;
+
+/**
+ * @brief Ring of the most recent frames
+ *
+ */
+static KeypadDriverVirtualFrame_t frames_ring[KEYPAD_DRIVER_VIRTUAL_FRAMES];
+
+/**
+ * @brief Frames in frames_ring not yet taken
+ *
+ */
+static size_t frames_held;
+
+/**
+ * @brief
+ *
+ */
+static uint32_t frame_count;
+
+/**
+ * @brief
+ *
+ */
+static uint32_t read_count;
+
+/*-----------------------------------------------------------*/
+
+void KeypadDriverVirtualScript(const KeypadDriverVirtualStep_t *steps, size_t count)
+{
+    script_steps = steps;
+    script_count = count;
+    script_next = 0;
+    script_start_us = GetTimeUs();
+    buttons = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t KeypadDriverVirtualFramesTake(KeypadDriverVirtualFrame_t *frames, size_t max)
+{
+    size_t count = frames_held < max ? frames_held : max;
+    // Oldest held frame, the ring's write position is frame_count
+    size_t first = (frame_count - frames_held) % KEYPAD_DRIVER_VIRTUAL_FRAMES;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        frames[i] = frames_ring[(first + i) % KEYPAD_DRIVER_VIRTUAL_FRAMES];
+    }
+
+    frames_held -= count;
+    return count;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t KeypadDriverVirtualFrameCount(void)
+{
+    return frame_count;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t KeypadDriverVirtualReadCount(void)
+{
+    return read_count;
+}
+
+/*-----------------------------------------------------------*/
+
+KeypadDriverMask_t KeypadDriverVirtualReadButtons(void)
+{
+    uint64_t elapsed_ms = (GetTimeUs() - script_start_us) / 1000;
+
+    while (script_next < script_count && script_steps[script_next].at_ms <= elapsed_ms)
+    {
+        buttons = script_steps[script_next++].buttons;
+    }
+
+    read_count++;
+    return buttons;
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadDriverVirtualWrite(const uint8_t *data, size_t length)
+{
+    KeypadDriverVirtualFrame_t *frame = &frames_ring[frame_count % KEYPAD_DRIVER_VIRTUAL_FRAMES];
+    frame->time_us = GetTimeUs();
+    memcpy(frame->data, data, length < KEYPAD_DRIVER_FRAME_SIZE ? length : KEYPAD_DRIVER_FRAME_SIZE);
+    frame_count++;
+    frames_held += frames_held < KEYPAD_DRIVER_VIRTUAL_FRAMES;
+}
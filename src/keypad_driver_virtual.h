@@ -0,0 +1,117 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_driver_virtual.h
+* @brief Stands in for the keypad hardware when built with KEYPAD_DRIVER_VIRTUAL (cmake -DKEYPAD_VIRTUAL=ON)
+* Buttons follow a script of timed masks and every flushed APA102 frame is recorded with its time, so the layers above
+* keypad_driver can be exercised and profiled without a keypad. Time comes from GetTimeUs (util.h).
+* Public functions in this module file are NOT thread-safe (call them from the task that owns the keypad driver,
+* or before it starts)
+*/
+#ifndef _KEYPAD_DRIVER_VIRTUAL_H
+#define _KEYPAD_DRIVER_VIRTUAL_H
+
+// standard includes
+#include <stddef.h>
+#include <stdint.h>
+
+// alert-panel includes
+#include "keypad_driver.h"
+
+/**
+ * @brief Frames kept, older frames are overwritten once full
+ *
+ */
+#define KEYPAD_DRIVER_VIRTUAL_FRAMES    64
+
+/**
+ * @brief Button states from at_ms (since the script started) until the next step
+ *
+ */
+typedef struct
+{
+    uint32_t at_ms;
+    KeypadDriverMask_t buttons;
+}
+KeypadDriverVirtualStep_t;
+
+/**
+ * @brief A flushed frame, as it would have been written to the led chain
+ *
+ */
+typedef struct
+{
+    uint64_t time_us;
+    uint8_t data[KEYPAD_DRIVER_FRAME_SIZE];
+}
+KeypadDriverVirtualFrame_t;
+
+/**
+ * @brief Starts a button script, replacing any running one, buttons read as released before the first step
+ * and keep the last step's state after the script ends
+ *
+ * @param steps in at_ms order, must stay valid while the script runs
+ * @param count
+ */
+void KeypadDriverVirtualScript(const KeypadDriverVirtualStep_t *steps, size_t count);
+
+/**
+ * @brief Takes up to max recorded frames, oldest first, any left are kept for the next call
+ *
+ * @param frames
+ * @param max
+ * @return size_t number of frames copied
+ */
+size_t KeypadDriverVirtualFramesTake(KeypadDriverVirtualFrame_t *frames, size_t max);
+
+/**
+ * @brief
+ *
+ * @return uint32_t frames flushed since start, including any overwritten before being taken
+ */
+uint32_t KeypadDriverVirtualFrameCount(void);
+
+/**
+ * @brief
+ *
+ * @return uint32_t button reads since start
+ */
+uint32_t KeypadDriverVirtualReadCount(void);
+
+/**
+ * @brief Used by keypad_driver in place of the i2c read
+ *
+ * @return KeypadDriverMask_t bit n is driver key index n
+ */
+KeypadDriverMask_t KeypadDriverVirtualReadButtons(void);
+
+/**
+ * @brief Used by keypad_driver in place of the spi write
+ *
+ * @param data
+ * @param length KEYPAD_DRIVER_FRAME_SIZE
+ */
+void KeypadDriverVirtualWrite(const uint8_t *data, size_t length);
+
+#endif //_KEYPAD_DRIVER_VIRTUAL_H
@@ -0,0 +1,348 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_gesture.c
+* @brief Every per key quantity is held as KeypadMask_t masks, one bit per key. Times since the last edge of each key are
+* bit-sliced counters (plane n holds bit n of every key's counter) so adding elapsed time and comparing against a threshold
+* costs the same for 1 or 64 keys, and nothing is looped over per key.
+*/
+#include "keypad_gesture.h"
+
+// standard includes
+#include <string.h>
+
+// alert-panel includes
+#include "util.h"
+
+/**
+ * @brief Bits per key timer, timers saturate at (1 << KEYPAD_GESTURE_TIMER_BITS) - 1 ms
+ *
+ */
+#define KEYPAD_GESTURE_TIMER_BITS   12
+
+/**
+ * @brief
+ *
+ */
+#define KEYPAD_GESTURE_TIMER_MAX    ((1u << KEYPAD_GESTURE_TIMER_BITS) - 1)
+
+_Static_assert(KEYPAD_GESTURE_TIMER_MAX == KEYPAD_BUTTON_TIMING_MAX, "KEYPAD_BUTTON_TIMING_MAX must match the timers");
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    uint16_t hold_ms;
+    uint16_t repeat_ms;
+    uint16_t multi_press_ms;
+    uint16_t chord_ms;
+}
+KeypadGestureTimings_t;
+
+/**
+ * @brief
+ *
+ */
+static KeypadGestureTimings_t timings;
+
+/**
+ * @brief Bit-sliced ms since the last press/release/hold/repeat of each key
+ *
+ */
+static KeypadMask_t timer[KEYPAD_GESTURE_TIMER_BITS];
+
+/**
+ * @brief Buttons pressed on the previous update
+ *
+ */
+static KeypadMask_t last_buttons;
+
+/**
+ * @brief Keys that have passed the hold time in their current press
+ *
+ */
+static KeypadMask_t held;
+
+/**
+ * @brief Two bit tap counter per key (tap_count_lo + 2 * tap_count_hi), saturating at 3
+ *
+ */
+static KeypadMask_t tap_count_lo;
+
+/**
+ * @brief
+ *
+ */
+static KeypadMask_t tap_count_hi;
+
+/**
+ * @brief Keys with counted taps waiting for the multi-press window to close
+ *
+ */
+static KeypadMask_t pending;
+
+/**
+ * @brief Keys pressed inside the currently open chord window
+ *
+ */
+static KeypadMask_t chord_candidates;
+
+/**
+ * @brief ms since the chord window opened
+ *
+ */
+static uint32_t chord_elapsed;
+
+/**
+ * @brief Keys that formed a chord, ignored until they are released
+ *
+ */
+static KeypadMask_t suppressed;
+
+/**
+ * @brief
+ *
+ */
+static uint32_t last_time;
+
+/**
+ * @brief Adds the same value to every key timer, saturating
+ *
+ * @param value
+ */
+static void KeypadGestureTimerAdd(uint32_t value);
+
+/**
+ * @brief Zeroes the timers of the given keys
+ *
+ * @param keys
+ */
+static void KeypadGestureTimerReset(KeypadMask_t keys);
+
+/**
+ * @brief Compares every key timer against the same threshold
+ *
+ * @param threshold
+ * @return KeypadMask_t bit set for each key whose timer >= threshold
+ */
+static KeypadMask_t KeypadGestureTimerAtLeast(uint32_t threshold);
+
+/**
+ * @brief Clamps a ms value to what the timers can count to
+ *
+ * @param ms
+ * @return uint16_t
+ */
+static uint16_t KeypadGestureClamp(uint32_t ms);
+
+/*-----------------------------------------------------------*/
+
+void KeypadGestureInit(const KeypadButtonConfig_t *config, uint32_t time_now)
+{
+    memset(timer, 0, sizeof(timer));
+    last_buttons = 0;
+    held = 0;
+    tap_count_lo = 0;
+    tap_count_hi = 0;
+    pending = 0;
+    chord_candidates = 0;
+    chord_elapsed = 0;
+    suppressed = 0;
+    last_time = time_now;
+    KeypadGestureConfigure(config);
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadGestureConfigure(const KeypadButtonConfig_t *config)
+{
+    timings.hold_ms = KeypadGestureClamp(config->hold_ms);
+    timings.repeat_ms = KeypadGestureClamp(config->repeat_ms);
+    timings.multi_press_ms = KeypadGestureClamp(config->multi_press_ms);
+    timings.chord_ms = KeypadGestureClamp(config->chord_ms);
+}
+
+/*-----------------------------------------------------------*/
+
+void KeypadGestureUpdate(KeypadMask_t buttons, uint32_t time_now, KeypadGestureEvents_t *events)
+{
+    memset(events, 0, sizeof(KeypadGestureEvents_t));
+    uint32_t elapsed = GetElapsedMs(last_time, time_now);
+    last_time = time_now;
+
+    // 1) Advance every timer, then restart the timers of keys that changed
+    KeypadMask_t pressed = buttons & ~last_buttons;
+    KeypadMask_t released = last_buttons & ~buttons;
+    last_buttons = buttons;
+    KeypadGestureTimerAdd(elapsed);
+    KeypadGestureTimerReset(pressed | released);
+
+    // 2) Chords, keys pressed within chord_ms of the first key of the window
+    if (timings.chord_ms > 0)
+    {
+        if (chord_candidates == 0)
+        {
+            chord_candidates = pressed;
+            chord_elapsed = 0;
+        }
+        else
+        {
+            chord_elapsed += elapsed;
+            chord_candidates |= chord_elapsed <= timings.chord_ms ? pressed : 0;
+        }
+
+        if (chord_candidates != 0 && chord_elapsed >= timings.chord_ms)
+        {
+            if ((chord_candidates & (chord_candidates - 1)) != 0) // More than one key
+            {
+                events->chord = chord_candidates;
+                suppressed |= chord_candidates & buttons;
+                pending &= ~chord_candidates;
+                held &= ~chord_candidates;
+                tap_count_lo &= ~chord_candidates;
+                tap_count_hi &= ~chord_candidates;
+                released &= ~chord_candidates;
+            }
+
+            chord_candidates = 0;
+        }
+    }
+
+    // 3) Chord keys raise nothing else until released
+    KeypadMask_t active = ~suppressed;
+    suppressed &= buttons;
+    released &= active;
+
+    // 4) Releases end a hold, or count as a tap
+    events->hold_release = released & held;
+    held &= ~released;
+    KeypadMask_t taps = released & ~events->hold_release;
+    KeypadMask_t increment = taps & ~(tap_count_lo & tap_count_hi);
+    tap_count_hi |= tap_count_lo & increment;
+    tap_count_lo ^= increment;
+    pending |= taps;
+
+    // 5) Holds, keys that have been down for hold_ms (not while they may still become a chord)
+    KeypadMask_t hold = 0;
+
+    if (timings.hold_ms > 0)
+    {
+        hold = buttons & active & ~held & ~chord_candidates & KeypadGestureTimerAtLeast(timings.hold_ms);
+    }
+
+    events->hold = hold;
+    held |= hold;
+
+    // 6) Repeats, keys still held repeat_ms after the hold or the last repeat
+    if (timings.repeat_ms > 0)
+    {
+        events->hold_repeat = buttons & active & held & ~hold & KeypadGestureTimerAtLeast(timings.repeat_ms);
+    }
+
+    KeypadGestureTimerReset(hold | events->hold_repeat);
+
+    // 7) Taps are reported once the multi-press window closes, at the third tap, or when the key is held
+    KeypadMask_t tapped = pending & ~buttons & ~chord_candidates &
+                      (KeypadGestureTimerAtLeast(timings.multi_press_ms) | (tap_count_lo & tap_count_hi));
+    tapped |= pending & hold;
+    events->press = tapped & tap_count_lo & ~tap_count_hi;
+    events->double_press = tapped & ~tap_count_lo & tap_count_hi;
+    events->triple_press = tapped & tap_count_lo & tap_count_hi;
+    pending &= ~tapped;
+    tap_count_lo &= ~tapped;
+    tap_count_hi &= ~tapped;
+}
+
+/*-----------------------------------------------------------*/
+
+bool KeypadGestureIsIdle(void)
+{
+    return (last_buttons | pending | chord_candidates) == 0;
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadGestureTimerAdd(uint32_t value)
+{
+    value = KeypadGestureClamp(value);
+    KeypadMask_t carry = 0;
+
+    // Ripple carry adder across the bit planes, each plane adds the same bit of value to all 16 timers
+    for (uint8_t bit = 0; bit < KEYPAD_GESTURE_TIMER_BITS; bit++)
+    {
+        KeypadMask_t addend = (value >> bit) & 1 ? (KeypadMask_t)~0 : 0;
+        KeypadMask_t sum = timer[bit] ^ addend ^ carry;
+        carry = (timer[bit] & addend) | (carry & (timer[bit] ^ addend));
+        timer[bit] = sum;
+    }
+
+    // Timers that overflowed stick at the maximum
+    for (uint8_t bit = 0; bit < KEYPAD_GESTURE_TIMER_BITS; bit++)
+    {
+        timer[bit] |= carry;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadGestureTimerReset(KeypadMask_t keys)
+{
+    for (uint8_t bit = 0; bit < KEYPAD_GESTURE_TIMER_BITS; bit++)
+    {
+        timer[bit] &= ~keys;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static KeypadMask_t KeypadGestureTimerAtLeast(uint32_t threshold)
+{
+    KeypadMask_t greater = 0;
+    KeypadMask_t equal = (KeypadMask_t)~0;
+
+    // Compare from the most significant plane down, a key is decided at the first bit that differs
+    for (int8_t bit = KEYPAD_GESTURE_TIMER_BITS - 1; bit >= 0; bit--)
+    {
+        if ((threshold >> bit) & 1)
+        {
+            equal &= timer[bit];
+        }
+        else
+        {
+            greater |= equal & timer[bit];
+            equal &= ~timer[bit];
+        }
+    }
+
+    return greater | equal;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t KeypadGestureClamp(uint32_t ms)
+{
+    return ms > KEYPAD_GESTURE_TIMER_MAX ? KEYPAD_GESTURE_TIMER_MAX : ms;
+}
@@ -0,0 +1,86 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_gesture.h
+* @brief Gesture recogniser working on whole button masks, all keys are tracked in parallel with bitwise operations
+* Public functions in this module file are NOT thread-safe (only call from the task that polls the buttons)
+*/
+#ifndef _KEYPAD_GESTURE_H
+#define _KEYPAD_GESTURE_H
+
+// standard includes
+#include <stdbool.h>
+
+// alert-panel includes
+#include "keypad.h"
+
+/**
+ * @brief Keys (one bit each, same bit order as the button mask) that raised each gesture during an update
+ *
+ */
+typedef struct
+{
+    KeypadMask_t press;
+    KeypadMask_t double_press;
+    KeypadMask_t triple_press;
+    KeypadMask_t hold;
+    KeypadMask_t hold_repeat;
+    KeypadMask_t hold_release;
+    KeypadMask_t chord;
+}
+KeypadGestureEvents_t;
+
+/**
+ * @brief Resets all gesture state and applies the given timings
+ *
+ * @param config
+ * @param time_now ms
+ */
+void KeypadGestureInit(const KeypadButtonConfig_t *config, uint32_t time_now);
+
+/**
+ * @brief Replaces the gesture timings, gestures in progress carry on with the new timings
+ *
+ * @param config
+ */
+void KeypadGestureConfigure(const KeypadButtonConfig_t *config);
+
+/**
+ * @brief Feeds the latest button mask through the recogniser
+ *
+ * @param buttons bit set for each pressed button
+ * @param time_now ms
+ * @param events gestures completed by this update
+ */
+void KeypadGestureUpdate(KeypadMask_t buttons, uint32_t time_now, KeypadGestureEvents_t *events);
+
+/**
+ * @brief
+ *
+ * @return true if no button is down and no gesture is waiting on a timer
+ * @return false
+ */
+bool KeypadGestureIsIdle(void);
+
+#endif //_KEYPAD_GESTURE_H
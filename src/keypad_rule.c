@@ -0,0 +1,602 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_rule.c
+* @brief
+*/
+#include "keypad_rule.h"
+
+// standard includes
+#include <string.h>
+
+// alert-panel includes
+#include "storage.h"
+#include "log.h"
+
+/**
+ * @brief Rule header: trigger, key, body length
+ *
+ */
+#define KEYPAD_RULE_HEADER_SIZE     3
+
+/**
+ * @brief Deepest stack a rule body may reach, checked on load
+ *
+ */
+#define KEYPAD_RULE_STACK_SIZE      8
+
+/**
+ * @brief Marks a body offset no instruction or jump reaches
+ *
+ */
+#define KEYPAD_RULE_DEPTH_UNREACHED 0xff
+
+/**
+ * @brief Operand count and stack effect of an opcode
+ *
+ */
+typedef struct
+{
+    bool valid;
+    uint8_t operands;
+    uint8_t pops;
+    uint8_t pushes;
+}
+KeypadRuleOpInfo_t;
+
+/**
+ * @brief Indexed by opcode
+ *
+ */
+static const KeypadRuleOpInfo_t KEYPAD_RULE_OP_INFO[] =
+{
+    [KEYPAD_RULE_OP_END] = {true, 0, 0, 0},
+    [KEYPAD_RULE_OP_PUSH] = {true, 1, 0, 1},
+    [KEYPAD_RULE_OP_KEY] = {true, 0, 0, 1},
+    [KEYPAD_RULE_OP_GET_ON] = {true, 1, 0, 1},
+    [KEYPAD_RULE_OP_GET_BRIGHTNESS] = {true, 1, 0, 1},
+    [KEYPAD_RULE_OP_GET_RED] = {true, 1, 0, 1},
+    [KEYPAD_RULE_OP_GET_GREEN] = {true, 1, 0, 1},
+    [KEYPAD_RULE_OP_GET_BLUE] = {true, 1, 0, 1},
+    [KEYPAD_RULE_OP_GET_EFFECT] = {true, 1, 0, 1},
+    [KEYPAD_RULE_OP_EQ] = {true, 0, 2, 1},
+    [KEYPAD_RULE_OP_LT] = {true, 0, 2, 1},
+    [KEYPAD_RULE_OP_AND] = {true, 0, 2, 1},
+    [KEYPAD_RULE_OP_OR] = {true, 0, 2, 1},
+    [KEYPAD_RULE_OP_NOT] = {true, 0, 1, 1},
+    [KEYPAD_RULE_OP_JZ] = {true, 1, 1, 0},
+    [KEYPAD_RULE_OP_JMP] = {true, 1, 0, 0},
+    [KEYPAD_RULE_OP_SET_ON] = {true, 1, 0, 0},
+    [KEYPAD_RULE_OP_SET_OFF] = {true, 1, 0, 0},
+    [KEYPAD_RULE_OP_SET_BRIGHTNESS] = {true, 2, 0, 0},
+    [KEYPAD_RULE_OP_SET_COLOUR] = {true, 4, 0, 0},
+    [KEYPAD_RULE_OP_SET_EFFECT] = {true, 2, 0, 0},
+};
+
+#define KEYPAD_RULE_OP_COUNT    (sizeof(KEYPAD_RULE_OP_INFO) / sizeof(KEYPAD_RULE_OP_INFO[0]))
+
+/**
+ * @brief Stack depths an offset in a body can be reached with
+ *
+ */
+typedef struct
+{
+    uint8_t min;
+    uint8_t max;
+}
+KeypadRuleDepth_t;
+
+/**
+ * @brief RAM copy of the rules sector
+ *
+ */
+static KeypadRuleProgram_t program;
+
+_Static_assert(sizeof(program) <= STORAGE_RECORD_MAX_SIZE, "Rule program must fit in one storage sector");
+
+/**
+ * @brief Keys with a rule per trigger, rebuilt whenever the program changes
+ *
+ */
+static KeypadMask_t rule_keys[KEYPAD_RULE_TRIGGER_LED + 1];
+
+/**
+ * @brief Checks every rule header and body
+ *
+ * @param candidate
+ * @return true
+ * @return false
+ */
+static bool KeypadRuleCheck(const KeypadRuleProgram_t *candidate);
+
+/**
+ * @brief Checks opcodes, operands, jump targets and the stack depth on every path through a rule body
+ *
+ * @param body
+ * @param length
+ * @return true
+ * @return false
+ */
+static bool KeypadRuleCheckBody(const uint8_t *body, uint8_t length);
+
+/**
+ * @brief Merges the stack depths of one path into those an offset is reached with
+ *
+ * @param depth
+ * @param min
+ * @param max
+ */
+static void KeypadRuleDepthMerge(KeypadRuleDepth_t *depth, uint8_t min, uint8_t max);
+
+/**
+ * @brief
+ *
+ * @param key
+ * @param all_allowed
+ * @return true
+ * @return false
+ */
+static bool KeypadRuleKeyValid(uint8_t key, bool all_allowed);
+
+/**
+ * @brief Rebuilds rule_keys from program
+ *
+ */
+static void KeypadRuleIndex(void);
+
+/**
+ * @brief Runs one rule body
+ *
+ * @param body
+ * @param length
+ * @param position key that triggered the rule
+ * @param states
+ * @param writes
+ * @return KeypadMask_t positions written
+ */
+static KeypadMask_t KeypadRuleExecute(const uint8_t *body, uint8_t length, uint8_t position, const KeypadLedState_t *states,
+                                      KeypadLedParams_t *writes);
+
+/**
+ * @brief Applies a set opcode to writes
+ *
+ * @param op
+ * @param operands
+ * @param position key that triggered the rule
+ * @param writes
+ * @return KeypadMask_t positions written
+ */
+static KeypadMask_t KeypadRuleSet(uint8_t op, const uint8_t *operands, uint8_t position, KeypadLedParams_t *writes);
+
+/*-----------------------------------------------------------*/
+
+void KeypadRuleInit(void)
+{
+    if (!StorageRead(STORAGE_SECTOR_RULES, &program, sizeof(program)) || !KeypadRuleCheck(&program))
+    {
+        LogPrintInfo("No stored rules found\n");
+        memset(&program, 0, sizeof(program));
+    }
+
+    KeypadRuleIndex();
+}
+
+/*-----------------------------------------------------------*/
+
+bool KeypadRuleLoad(const KeypadRuleProgram_t *candidate)
+{
+    if (!KeypadRuleCheck(candidate))
+    {
+        return false;
+    }
+
+    program = *candidate;
+    memset(&program.code[program.length], 0, KEYPAD_RULE_PROGRAM_SIZE - program.length);
+    KeypadRuleIndex();
+    LogPrintInfo("Loaded %u byte rule program\n", program.length);
+    return StorageWriteQueueSend(STORAGE_SECTOR_RULES, &program, sizeof(program));
+}
+
+/*-----------------------------------------------------------*/
+
+KeypadMask_t KeypadRuleKeys(uint8_t trigger)
+{
+    return trigger <= KEYPAD_RULE_TRIGGER_LED ? rule_keys[trigger] : 0;
+}
+
+/*-----------------------------------------------------------*/
+
+KeypadMask_t KeypadRuleRun(uint8_t trigger, uint8_t position, const KeypadLedState_t *states, KeypadLedParams_t *writes)
+{
+    KeypadMask_t written = 0;
+
+    for (uint16_t pc = 0; pc < program.length; pc += KEYPAD_RULE_HEADER_SIZE + program.code[pc + 2])
+    {
+        const uint8_t *header = &program.code[pc];
+
+        if (header[0] == trigger && (header[1] == position || header[1] == KEYPAD_RULE_KEY_ANY))
+        {
+            written |= KeypadRuleExecute(&header[KEYPAD_RULE_HEADER_SIZE], header[2], position, states, writes);
+        }
+    }
+
+    return written;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool KeypadRuleCheck(const KeypadRuleProgram_t *candidate)
+{
+    if (candidate->length > KEYPAD_RULE_PROGRAM_SIZE)
+    {
+        LogPrintError("Rule program is longer than %u bytes\n", KEYPAD_RULE_PROGRAM_SIZE);
+        return false;
+    }
+
+    for (uint16_t pc = 0; pc < candidate->length;)
+    {
+        const uint8_t *header = &candidate->code[pc];
+
+        if (pc + KEYPAD_RULE_HEADER_SIZE > candidate->length ||
+                pc + KEYPAD_RULE_HEADER_SIZE + header[2] > candidate->length)
+        {
+            LogPrintError("Rule at %u overruns the program\n", pc);
+            return false;
+        }
+
+        bool trigger_valid = (header[0] >= PRESS && header[0] < CHORD) || header[0] == KEYPAD_RULE_TRIGGER_LED;
+
+        if (!trigger_valid || (header[1] != KEYPAD_RULE_KEY_ANY && header[1] >= KEYPAD_KEYS))
+        {
+            LogPrintError("Rule at %u has an invalid trigger or key\n", pc);
+            return false;
+        }
+
+        if (!KeypadRuleCheckBody(&header[KEYPAD_RULE_HEADER_SIZE], header[2]))
+        {
+            LogPrintError("Rule at %u has an invalid body\n", pc);
+            return false;
+        }
+
+        pc += KEYPAD_RULE_HEADER_SIZE + header[2];
+    }
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool KeypadRuleCheckBody(const uint8_t *body, uint8_t length)
+{
+    // Jumps only go forward, so one pass in order sees every path into an offset before reaching it
+    static KeypadRuleDepth_t depths[UINT8_MAX + 1]; // Too large for the task stack
+    static bool starts[UINT8_MAX + 1]; // Too large for the task stack
+    memset(depths, KEYPAD_RULE_DEPTH_UNREACHED, sizeof(depths));
+    memset(starts, 0, sizeof(starts));
+    depths[0].min = 0;
+    depths[0].max = 0;
+
+    for (uint16_t pc = 0; pc < length;)
+    {
+        uint8_t op = body[pc];
+
+        if (op >= KEYPAD_RULE_OP_COUNT || !KEYPAD_RULE_OP_INFO[op].valid)
+        {
+            return false;
+        }
+
+        const KeypadRuleOpInfo_t *info = &KEYPAD_RULE_OP_INFO[op];
+        const KeypadRuleDepth_t depth = depths[pc];
+        const uint8_t *operands = &body[pc + 1];
+        uint16_t start = pc;
+        starts[start] = true;
+        pc += 1 + info->operands;
+
+        if (pc > length)
+        {
+            return false;
+        }
+
+        switch (op)
+        {
+            case KEYPAD_RULE_OP_GET_ON:
+            case KEYPAD_RULE_OP_GET_BRIGHTNESS:
+            case KEYPAD_RULE_OP_GET_RED:
+            case KEYPAD_RULE_OP_GET_GREEN:
+            case KEYPAD_RULE_OP_GET_BLUE:
+            case KEYPAD_RULE_OP_GET_EFFECT:
+                if (!KeypadRuleKeyValid(operands[0], false))
+                {
+                    return false;
+                }
+
+                break;
+
+            case KEYPAD_RULE_OP_SET_ON:
+            case KEYPAD_RULE_OP_SET_OFF:
+            case KEYPAD_RULE_OP_SET_BRIGHTNESS:
+            case KEYPAD_RULE_OP_SET_COLOUR:
+                if (!KeypadRuleKeyValid(operands[0], true))
+                {
+                    return false;
+                }
+
+                break;
+
+            case KEYPAD_RULE_OP_SET_EFFECT:
+                if (!KeypadRuleKeyValid(operands[0], true) || operands[1] < NONE || operands[1] > PULSE)
+                {
+                    return false;
+                }
+
+                break;
+
+            case KEYPAD_RULE_OP_JZ:
+            case KEYPAD_RULE_OP_JMP:
+                // Forward only, which is what bounds the run time
+                if (pc + operands[0] > length)
+                {
+                    return false;
+                }
+
+                break;
+        }
+
+        // Code nothing reaches is never run, code only reached through operands is rejected below
+        if (depth.min == KEYPAD_RULE_DEPTH_UNREACHED)
+        {
+            continue;
+        }
+
+        if (depth.min < info->pops || depth.max - info->pops + info->pushes > KEYPAD_RULE_STACK_SIZE)
+        {
+            LogPrintError("Rule stack %s at %u\n", depth.min < info->pops ? "underflow" : "overflow", start);
+            return false;
+        }
+
+        uint8_t min = depth.min - info->pops + info->pushes;
+        uint8_t max = depth.max - info->pops + info->pushes;
+
+        if (op == KEYPAD_RULE_OP_JZ || op == KEYPAD_RULE_OP_JMP)
+        {
+            KeypadRuleDepthMerge(&depths[pc + operands[0]], min, max);
+        }
+
+        if (op != KEYPAD_RULE_OP_END && op != KEYPAD_RULE_OP_JMP)
+        {
+            KeypadRuleDepthMerge(&depths[pc], min, max);
+        }
+    }
+
+    // Every jump must land on an instruction or the end of the body
+    for (uint16_t pc = 0; pc < length; pc++)
+    {
+        if (depths[pc].min != KEYPAD_RULE_DEPTH_UNREACHED && !starts[pc])
+        {
+            LogPrintError("Rule jump into the operands at %u\n", pc);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadRuleDepthMerge(KeypadRuleDepth_t *depth, uint8_t min, uint8_t max)
+{
+    if (depth->min == KEYPAD_RULE_DEPTH_UNREACHED)
+    {
+        depth->min = min;
+        depth->max = max;
+        return;
+    }
+
+    depth->min = min < depth->min ? min : depth->min;
+    depth->max = max > depth->max ? max : depth->max;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool KeypadRuleKeyValid(uint8_t key, bool all_allowed)
+{
+    return key < KEYPAD_KEYS || key == KEYPAD_RULE_KEY_TRIGGER || (all_allowed && key == KEYPAD_RULE_KEY_ALL);
+}
+
+/*-----------------------------------------------------------*/
+
+static void KeypadRuleIndex(void)
+{
+    memset(rule_keys, 0, sizeof(rule_keys));
+
+    for (uint16_t pc = 0; pc < program.length; pc += KEYPAD_RULE_HEADER_SIZE + program.code[pc + 2])
+    {
+        const uint8_t *header = &program.code[pc];
+
+        for (uint8_t i = 0; i < KEYPAD_KEYS; i++)
+        {
+            if (header[1] == i || header[1] == KEYPAD_RULE_KEY_ANY)
+            {
+                rule_keys[header[0]] |= (KeypadMask_t)1 << i;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static KeypadMask_t KeypadRuleExecute(const uint8_t *body, uint8_t length, uint8_t position, const KeypadLedState_t *states,
+                                      KeypadLedParams_t *writes)
+{
+    int16_t stack[KEYPAD_RULE_STACK_SIZE];
+    uint8_t depth = 0;
+    KeypadMask_t written = 0;
+
+    for (uint16_t pc = 0; pc < length;)
+    {
+        uint8_t op = body[pc];
+        const uint8_t *operands = &body[pc + 1];
+        const KeypadRuleOpInfo_t *info = &KEYPAD_RULE_OP_INFO[op];
+        pc += 1 + info->operands;
+
+        // Checked on load for every path, kept as a guard since a bad depth would overrun the stack
+        if (depth < info->pops || depth - info->pops + info->pushes > KEYPAD_RULE_STACK_SIZE)
+        {
+            LogPrintWarn("Rule stack %s, rule stopped\n", depth < info->pops ? "underflow" : "overflow");
+            return written;
+        }
+
+        const KeypadLedState_t *state = NULL;
+
+        if (op >= KEYPAD_RULE_OP_GET_ON && op <= KEYPAD_RULE_OP_GET_EFFECT)
+        {
+            state = &states[operands[0] == KEYPAD_RULE_KEY_TRIGGER ? position : operands[0]];
+        }
+
+        int16_t a = depth >= 2 ? stack[depth - 2] : 0;
+        int16_t b = depth >= 1 ? stack[depth - 1] : 0;
+        depth -= info->pops;
+
+        switch (op)
+        {
+            case KEYPAD_RULE_OP_END:
+                return written;
+
+            case KEYPAD_RULE_OP_PUSH:
+                stack[depth++] = operands[0];
+                break;
+
+            case KEYPAD_RULE_OP_KEY:
+                stack[depth++] = position;
+                break;
+
+            case KEYPAD_RULE_OP_GET_ON:
+                stack[depth++] = state->state;
+                break;
+
+            case KEYPAD_RULE_OP_GET_BRIGHTNESS:
+                stack[depth++] = state->brightness;
+                break;
+
+            case KEYPAD_RULE_OP_GET_RED:
+                stack[depth++] = state->red;
+                break;
+
+            case KEYPAD_RULE_OP_GET_GREEN:
+                stack[depth++] = state->green;
+                break;
+
+            case KEYPAD_RULE_OP_GET_BLUE:
+                stack[depth++] = state->blue;
+                break;
+
+            case KEYPAD_RULE_OP_GET_EFFECT:
+                stack[depth++] = state->effect;
+                break;
+
+            case KEYPAD_RULE_OP_EQ:
+                stack[depth++] = a == b;
+                break;
+
+            case KEYPAD_RULE_OP_LT:
+                stack[depth++] = a < b;
+                break;
+
+            case KEYPAD_RULE_OP_AND:
+                stack[depth++] = a && b;
+                break;
+
+            case KEYPAD_RULE_OP_OR:
+                stack[depth++] = a || b;
+                break;
+
+            case KEYPAD_RULE_OP_NOT:
+                stack[depth++] = !b;
+                break;
+
+            case KEYPAD_RULE_OP_JZ:
+                pc += b == 0 ? operands[0] : 0;
+                break;
+
+            case KEYPAD_RULE_OP_JMP:
+                pc += operands[0];
+                break;
+
+            default:
+                written |= KeypadRuleSet(op, operands, position, writes);
+                break;
+        }
+    }
+
+    return written;
+}
+
+/*-----------------------------------------------------------*/
+
+static KeypadMask_t KeypadRuleSet(uint8_t op, const uint8_t *operands, uint8_t position, KeypadLedParams_t *writes)
+{
+    KeypadMask_t written = 0;
+    uint8_t key = operands[0] == KEYPAD_RULE_KEY_TRIGGER ? position : operands[0];
+
+    for (uint8_t i = 0; i < KEYPAD_KEYS; i++)
+    {
+        if (key != i && key != KEYPAD_RULE_KEY_ALL)
+        {
+            continue;
+        }
+
+        KeypadLedParams_t *params = &writes[i];
+        strncpy(params->key_id, KEYPAD_KEY_ID[i], KEYPAD_KEY_ID_SIZE);
+
+        switch (op)
+        {
+            case KEYPAD_RULE_OP_SET_ON:
+            case KEYPAD_RULE_OP_SET_OFF:
+                params->state = op == KEYPAD_RULE_OP_SET_ON;
+                params->state_set = true;
+                break;
+
+            case KEYPAD_RULE_OP_SET_BRIGHTNESS:
+                params->brightness = operands[1];
+                params->brightness_set = true;
+                break;
+
+            case KEYPAD_RULE_OP_SET_COLOUR:
+                params->red = operands[1];
+                params->green = operands[2];
+                params->blue = operands[3];
+                params->colour_set = true;
+                break;
+
+            case KEYPAD_RULE_OP_SET_EFFECT:
+                params->effect = (KeypadLedEffect_t)operands[1];
+                params->effect_set = true;
+                break;
+        }
+
+        written |= (KeypadMask_t)1 << i;
+    }
+
+    return written;
+}
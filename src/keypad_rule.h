@@ -0,0 +1,128 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_rule.h
+* @brief Small bytecode rule engine run by the keypad task on button events and led state changes
+* Public functions in this module file are NOT thread-safe (only call from the task that owns the keypad driver)
+*
+* A program is a sequence of rules, each a 3 byte header (trigger, key, body length) followed by its body.
+* The trigger is a KeypadButtonEvent_t (not CHORD) or KEYPAD_RULE_TRIGGER_LED, the key a position in KEYPAD_KEY_ID or
+* KEYPAD_RULE_KEY_ANY. Bodies run on a small stack machine, see the KEYPAD_RULE_OP_* opcodes. Jumps only go forward,
+* so a body runs at most one instruction per byte and an event costs at most KEYPAD_RULE_PROGRAM_SIZE instructions.
+* Programs are checked when loaded, a program that fails the checks is rejected as a whole.
+*/
+#ifndef _KEYPAD_RULE_H
+#define _KEYPAD_RULE_H
+
+// standard includes
+#include <stdbool.h>
+#include <stdint.h>
+
+// alert-panel includes
+#include "keypad.h"
+
+/**
+ * @brief Trigger of rules run when a key's applied led state changes
+ *
+ */
+#define KEYPAD_RULE_TRIGGER_LED     0x10
+
+/**
+ * @brief Trigger key matching every key
+ *
+ */
+#define KEYPAD_RULE_KEY_ANY         0xff
+
+/**
+ * @brief Key operands, a position in KEYPAD_KEY_ID or one of these
+ *
+ */
+#define KEYPAD_RULE_KEY_TRIGGER     0xfe    // the key that triggered the rule
+#define KEYPAD_RULE_KEY_ALL         0xff    // every key, set operations only
+
+/**
+ * @brief Opcodes, operands follow the opcode byte
+ *
+ */
+typedef enum
+{
+    KEYPAD_RULE_OP_END = 0x00,              // stop the rule
+    KEYPAD_RULE_OP_PUSH = 0x01,             // value: push value
+    KEYPAD_RULE_OP_KEY = 0x02,              // push the position of the key that triggered the rule
+    KEYPAD_RULE_OP_GET_ON = 0x03,           // key: push 1 if the led is on else 0
+    KEYPAD_RULE_OP_GET_BRIGHTNESS = 0x04,   // key: push led brightness
+    KEYPAD_RULE_OP_GET_RED = 0x05,          // key: push led red
+    KEYPAD_RULE_OP_GET_GREEN = 0x06,        // key: push led green
+    KEYPAD_RULE_OP_GET_BLUE = 0x07,         // key: push led blue
+    KEYPAD_RULE_OP_GET_EFFECT = 0x08,       // key: push led effect
+    KEYPAD_RULE_OP_EQ = 0x10,               // pop b, a: push a == b
+    KEYPAD_RULE_OP_LT = 0x11,               // pop b, a: push a < b
+    KEYPAD_RULE_OP_AND = 0x12,              // pop b, a: push a && b
+    KEYPAD_RULE_OP_OR = 0x13,               // pop b, a: push a || b
+    KEYPAD_RULE_OP_NOT = 0x14,              // pop a: push !a
+    KEYPAD_RULE_OP_JZ = 0x18,               // offset: pop a, skip offset bytes if a is 0
+    KEYPAD_RULE_OP_JMP = 0x19,              // offset: skip offset bytes
+    KEYPAD_RULE_OP_SET_ON = 0x20,           // key: turn led on
+    KEYPAD_RULE_OP_SET_OFF = 0x21,          // key: turn led off
+    KEYPAD_RULE_OP_SET_BRIGHTNESS = 0x22,   // key, brightness
+    KEYPAD_RULE_OP_SET_COLOUR = 0x23,       // key, red, green, blue
+    KEYPAD_RULE_OP_SET_EFFECT = 0x24,       // key, effect (KeypadLedEffect_t)
+}
+KeypadRuleOp_t;
+
+/**
+ * @brief Loads the stored program from flash
+ *
+ */
+void KeypadRuleInit(void);
+
+/**
+ * @brief Checks a program and replaces the running and stored program with it, a 0 length program removes every rule
+ *
+ * @param program
+ * @return true
+ * @return false if the program is malformed or the record could not be queued for storage
+ */
+bool KeypadRuleLoad(const KeypadRuleProgram_t *program);
+
+/**
+ * @brief Gets the keys that have any rule for a trigger
+ *
+ * @param trigger
+ * @return KeypadMask_t bit set per position in KEYPAD_KEY_ID
+ */
+KeypadMask_t KeypadRuleKeys(uint8_t trigger);
+
+/**
+ * @brief Runs every rule matching a trigger and key, merging the led writes they make into writes
+ *
+ * @param trigger
+ * @param position key position in KEYPAD_KEY_ID
+ * @param states applied led state of every key, indexed by position
+ * @param writes led parameters per position, only written positions are touched
+ * @return KeypadMask_t positions written
+ */
+KeypadMask_t KeypadRuleRun(uint8_t trigger, uint8_t position, const KeypadLedState_t *states, KeypadLedParams_t *writes);
+
+#endif //_KEYPAD_RULE_H
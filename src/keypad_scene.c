@@ -0,0 +1,151 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_scene.c
+* @brief
+*/
+#include "keypad_scene.h"
+
+// standard includes
+#include <string.h>
+
+// alert-panel includes
+#include "keypad_driver.h"
+#include "storage.h"
+#include "log.h"
+
+/**
+ * @brief
+ *
+ */
+#define KEYPAD_SCENES   8
+
+/**
+ * @brief Compact stored form of a scene, an empty name marks a free slot
+ *
+ */
+typedef struct
+{
+    char name[KEYPAD_SCENE_NAME_SIZE];
+    KeypadDriverLed_t leds[KEYPAD_KEYS];
+}
+KeypadScene_t;
+
+/**
+ * @brief RAM copy of the scenes sector, so recall never touches flash
+ *
+ */
+static KeypadScene_t scenes[KEYPAD_SCENES];
+
+_Static_assert(sizeof(scenes) <= STORAGE_RECORD_MAX_SIZE, "Scenes for every key must fit in one storage sector");
+
+/**
+ * @brief
+ *
+ * @param name
+ * @return KeypadScene_t* NULL if no scene has that name
+ */
+static KeypadScene_t *KeypadSceneFind(const char *name);
+
+/*-----------------------------------------------------------*/
+
+void KeypadSceneInit(void)
+{
+    if (!StorageRead(STORAGE_SECTOR_SCENES, scenes, sizeof(scenes)))
+    {
+        LogPrintInfo("No stored scenes found\n");
+        memset(scenes, 0, sizeof(scenes));
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+bool KeypadSceneRecord(const char *name)
+{
+    KeypadScene_t *scene = KeypadSceneFind(name);
+
+    if (scene == NULL)
+    {
+        // Not recorded before, take a free slot
+        scene = KeypadSceneFind("");
+
+        if (scene == NULL)
+        {
+            LogPrintError("No free scene slot for '%s'\n", name);
+            return false;
+        }
+    }
+
+    memset(scene->name, 0, sizeof(scene->name));
+    strncpy(scene->name, name, KEYPAD_SCENE_NAME_SIZE - 1);
+    KeypadDriverGetLeds(scene->leds, KEYPAD_KEYS);
+    return StorageWriteQueueSend(STORAGE_SECTOR_SCENES, scenes, sizeof(scenes));
+}
+
+/*-----------------------------------------------------------*/
+
+bool KeypadSceneRecall(const char *name)
+{
+    KeypadScene_t *scene = KeypadSceneFind(name);
+
+    if (scene == NULL)
+    {
+        LogPrintWarn("No scene named '%s'\n", name);
+        return false;
+    }
+
+    KeypadDriverSetLeds(scene->leds, KEYPAD_KEYS);
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+bool KeypadSceneDelete(const char *name)
+{
+    KeypadScene_t *scene = KeypadSceneFind(name);
+
+    if (scene == NULL)
+    {
+        LogPrintWarn("No scene named '%s'\n", name);
+        return false;
+    }
+
+    memset(scene, 0, sizeof(KeypadScene_t));
+    return StorageWriteQueueSend(STORAGE_SECTOR_SCENES, scenes, sizeof(scenes));
+}
+
+/*-----------------------------------------------------------*/
+
+static KeypadScene_t *KeypadSceneFind(const char *name)
+{
+    for (uint8_t i = 0; i < KEYPAD_SCENES; i++)
+    {
+        if (strncmp(scenes[i].name, name, KEYPAD_SCENE_NAME_SIZE) == 0)
+        {
+            return &scenes[i];
+        }
+    }
+
+    return NULL;
+}
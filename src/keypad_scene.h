@@ -0,0 +1,74 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file keypad_scene.h
+* @brief Named led scenes kept in flash, recorded from and recalled into the keypad driver
+* Public functions in this module file are NOT thread-safe (only call from the task that owns the keypad driver)
+*
+* A scene is the driver's colour, brightness and on/off state of every key. Led effects live in keypad.c's state model,
+* not the driver, so they are not part of a scene and a recall leaves them unchanged.
+*/
+#ifndef _KEYPAD_SCENE_H
+#define _KEYPAD_SCENE_H
+
+// standard includes
+#include <stdbool.h>
+
+// alert-panel includes
+#include "keypad.h"
+
+/**
+ * @brief Loads stored scenes from flash
+ *
+ */
+void KeypadSceneInit(void);
+
+/**
+ * @brief Records the current keypad driver led settings as a named scene, replacing any scene of the same name
+ *
+ * @param name
+ * @return true
+ * @return false if there is no free scene slot or the record could not be queued for storage
+ */
+bool KeypadSceneRecord(const char *name);
+
+/**
+ * @brief Copies a named scene into the keypad driver, the caller flushes it to the device
+ *
+ * @param name
+ * @return true
+ * @return false if no scene has that name
+ */
+bool KeypadSceneRecall(const char *name);
+
+/**
+ * @brief Deletes a named scene
+ *
+ * @param name
+ * @return true
+ * @return false if no scene has that name or the record could not be queued for storage
+ */
+bool KeypadSceneDelete(const char *name);
+
+#endif //_KEYPAD_SCENE_H
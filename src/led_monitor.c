@@ -33,11 +33,15 @@
 
 // FreeRTOS-Kernel includes
 #include "FreeRTOS.h"
+#include "task.h"
 
 // alert-panel includes
 #include "activity_led.h"
 #include "keypad.h"
+#include "button_msg.h"
 #include "led_msg.h"
+#include "log_msg.h"
+#include "rtos_manifest.h"
 #include "system.h"
 #include "mqtt.h"
 #include "log.h"
@@ -61,6 +65,66 @@ static char payload_buffer[MQTT_PAYLOAD_BUFFER_SIZE];
  */
 static char topic_buffer[MQTT_TOPIC_BUFFER_SIZE];
 
+/**
+ * @brief Parsed panel cmd parameters (too large for the task stack)
+ *
+ */
+static KeypadLedParams_t panel_params[KEYPAD_KEYS];
+
+/**
+ * @brief Separate buffers for the state publisher, which runs concurrently with the cmd handling
+ *
+ */
+static char state_payload_buffer[MQTT_PAYLOAD_BUFFER_SIZE];
+
+/**
+ * @brief
+ *
+ */
+static char state_topic_buffer[MQTT_TOPIC_BUFFER_SIZE];
+
+/**
+ * @brief Applied led states as read back from the keypad, and the matching publish parameters
+ *
+ */
+static KeypadLedState_t led_states[KEYPAD_KEYS];
+
+/**
+ * @brief
+ *
+ */
+static KeypadLedParams_t state_params[KEYPAD_KEYS];
+
+/**
+ * @brief Handle of the state publisher, notified once mqtt is connected
+ *
+ */
+static TaskHandle_t led_state_task_handle = NULL;
+
+/**
+ * @brief
+ *
+ */
+static StackType_t led_monitor_task_stack[LED_MONITOR_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t led_monitor_task_buffer;
+
+/**
+ * @brief
+ *
+ */
+static StackType_t led_state_task_stack[LED_STATE_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t led_state_task_buffer;
+
 /**
  * @brief Monitors mqtt for keypad led state change messages and sets them accordingly
  *
@@ -75,10 +139,18 @@ static void LedMonitorTask(void *params);
 static void LedMonitorConnect();
 
 /**
- * @brief
+ * @brief Publishes led state, only for keys whose applied state actually changed
+ *
+ * @param params
+ */
+static void LedStateTask(void *params);
+
+/**
+ * @brief Publishes the per key state topics in changed_mask and the aggregated panel state
  *
+ * @param changed_mask bit set per position in KEYPAD_KEY_ID
  */
-static void LedMonitorPublishInitialStates();
+static void LedStatePublish(KeypadMask_t changed_mask);
 
 /**
  * @brief
@@ -86,12 +158,69 @@ static void LedMonitorPublishInitialStates();
  */
 static void LedMonitorCommandReceive();
 
+/**
+ * @brief Handles a single led cmd message
+ *
+ */
+static void LedMonitorLedCommand();
+
+/**
+ * @brief Handles a panel cmd message, settings for many leds applied with a single flush
+ *
+ */
+static void LedMonitorPanelCommand();
+
+/**
+ * @brief Handles a scene cmd message
+ *
+ */
+static void LedMonitorSceneCommand();
+
+/**
+ * @brief Handles a binding cmd message
+ *
+ */
+static void LedMonitorBindingCommand();
+
+/**
+ * @brief Handles a rule cmd message
+ *
+ */
+static void LedMonitorRuleCommand();
+
+/**
+ * @brief Handles an animation cmd message
+ *
+ */
+static void LedMonitorAnimationCommand();
+
+/**
+ * @brief Handles a panel get message, publishes the full current panel state
+ *
+ */
+static void LedMonitorPanelGet();
+
+/**
+ * @brief Handles a button config message, gesture timings are applied by the keypad
+ *
+ */
+static void LedMonitorButtonConfig();
+
+/**
+ * @brief
+ *
+ */
+static void LedMonitorLogLevel();
+
 /*-----------------------------------------------------------*/
 
 void LedMonitorTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask)
 {
-    xTaskCreatePinnedToCore(LedMonitorTask, "LedMonitorTask", configMINIMAL_STACK_SIZE, &core_affinity_mask, priority, NULL,
-                            core_affinity_mask);
+    xTaskCreateStaticPinnedToCore(LedMonitorTask, "LedMonitorTask", LED_MONITOR_TASK_STACK_DEPTH, &core_affinity_mask,
+                                  priority, led_monitor_task_stack, &led_monitor_task_buffer, NULL, core_affinity_mask);
+    xTaskCreateStaticPinnedToCore(LedStateTask, "LedStateTask", LED_STATE_TASK_STACK_DEPTH, &core_affinity_mask,
+                                  priority, led_state_task_stack, &led_state_task_buffer, &led_state_task_handle,
+                                  core_affinity_mask);
 }
 
 /*-----------------------------------------------------------*/
@@ -100,7 +229,8 @@ static void LedMonitorTask(void *params)
 {
     LogPrintInfo("LedMonitorTask running...\n");
     LedMonitorConnect();
-    LedMonitorPublishInitialStates();
+    // States are published only once connected, the first changes cover every key
+    xTaskNotifyGive(led_state_task_handle);
     ActivityLedSetOn();
 
     while (1)
@@ -134,70 +264,273 @@ static void LedMonitorConnect()
     // 3) Register subscription
     LedMsgBuildCmdTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
     MqttSubmitSubscribe(topic_buffer, strlen(topic_buffer), MQTTQoS2);
+    LedMsgBuildPanelCmdTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    MqttSubmitSubscribe(topic_buffer, strlen(topic_buffer), MQTTQoS2);
+    LedMsgBuildSceneCmdTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    MqttSubmitSubscribe(topic_buffer, strlen(topic_buffer), MQTTQoS2);
+    LedMsgBuildBindingCmdTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    MqttSubmitSubscribe(topic_buffer, strlen(topic_buffer), MQTTQoS2);
+    LedMsgBuildRuleCmdTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    MqttSubmitSubscribe(topic_buffer, strlen(topic_buffer), MQTTQoS2);
+    LedMsgBuildAnimationCmdTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    MqttSubmitSubscribe(topic_buffer, strlen(topic_buffer), MQTTQoS2);
+    LedMsgBuildPanelGetTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    MqttSubmitSubscribe(topic_buffer, strlen(topic_buffer), MQTTQoS2);
+    ButtonMsgBuildConfigTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    MqttSubmitSubscribe(topic_buffer, strlen(topic_buffer), MQTTQoS2);
+    LogMsgBuildLevelTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    MqttSubmitSubscribe(topic_buffer, strlen(topic_buffer), MQTTQoS2);
     // 4) Publish online message
     LedMsgBuildAvailableTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
     LedMsgBuildAvailablePayload(true, payload_buffer, MQTT_PAYLOAD_BUFFER_SIZE);
     MqttSubmitPublish(topic_buffer, strlen(topic_buffer), payload_buffer, strlen(payload_buffer), MQTTQoS2, true);
+    // 5) Publish why the last run ended, retained so it can be read at any time, a clean boot clears it
+    static CrashRecord_t crash_record; // Too large for the task stack
+    LogMsgBuildCrashTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    payload_buffer[0] = '\0';
+
+    if (CrashLastGet(&crash_record))
+    {
+        LogPrintWarn("Last run ended with %s in %s after %lu ms\n", CrashReasonName(crash_record.reason), crash_record.task,
+                     crash_record.uptime_ms);
+        LogMsgBuildCrashPayload(&crash_record, payload_buffer, MQTT_PAYLOAD_BUFFER_SIZE);
+    }
+
+    MqttSubmitPublish(topic_buffer, strlen(topic_buffer), payload_buffer, strlen(payload_buffer), MQTTQoS2, true);
 }
 
 /*-----------------------------------------------------------*/
 
-static void LedMonitorPublishInitialStates()
+static void LedStateTask(void *params)
 {
-    // 1) Set up base parameter to send for all leds
-    KeypadLedParams_t params;
-    memset(&params, 0, sizeof(KeypadLedParams_t));
-    params.brightness_set = true;
-    params.brightness = 0;
-    params.colour_set = true;
-    params.red = 0;
-    params.green = 0;
-    params.blue = 0;
-    params.state_set = true;
-    params.state = false;
-    // 2) Build payload to send for all leds
-    LedMsgBuildStatePayload(&params, payload_buffer, MQTT_PAYLOAD_BUFFER_SIZE);
-
-    // 3) Submit for each led
-    for (int index = 0; KEYPAD_KEYS < 16; index++)
-    {
-        params.key_id = KEYPAD_KEY_ID[index];
-        LedMsgBuildStateTopic(&params, topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
-        MqttSubmitPublish(topic_buffer, strlen(topic_buffer), payload_buffer, strlen(payload_buffer), MQTTQoS2, true);
+    LogPrintInfo("LedStateTask running...\n");
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    while (1)
+    {
+        LedStatePublish(KeypadLedStateChangeReceive(led_states));
     }
 }
 
 /*-----------------------------------------------------------*/
 
+static void LedStatePublish(KeypadMask_t changed_mask)
+{
+    if (changed_mask == 0)
+    {
+        return;
+    }
+
+    // 1) Publish per key state only for keys that changed
+    for (uint8_t index = 0; index < KEYPAD_KEYS; index++)
+    {
+        LedMsgParamsFromState(KEYPAD_KEY_ID[index], &led_states[index], &state_params[index]);
+
+        if ((changed_mask & ((KeypadMask_t)1 << index)) == 0)
+        {
+            continue;
+        }
+
+        LedMsgBuildStateTopic(&state_params[index], state_topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+        LedMsgBuildStatePayload(&state_params[index], state_payload_buffer, MQTT_PAYLOAD_BUFFER_SIZE);
+        MqttSubmitPublish(state_topic_buffer,
+                          strlen(state_topic_buffer),
+                          state_payload_buffer,
+                          strlen(state_payload_buffer),
+                          MQTTQoS2,
+                          true);
+    }
+
+    // 2) Publish the aggregated panel state, always the whole panel so the retained message is complete
+    LedMsgBuildPanelStateTopic(state_topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    LedMsgBuildPanelStatePayload(state_params, KEYPAD_KEYS, state_payload_buffer, MQTT_PAYLOAD_BUFFER_SIZE);
+    MqttSubmitPublish(state_topic_buffer,
+                      strlen(state_topic_buffer),
+                      state_payload_buffer,
+                      strlen(state_payload_buffer),
+                      MQTTQoS2,
+                      true);
+}
+
+/*-----------------------------------------------------------*/
+
 static void LedMonitorCommandReceive()
 {
-    // 1) Wait for mqtt message
+    // Wait for mqtt message
     message = MqttSubscriptionReceive();
-    // 2) Clear parameters
-    KeypadLedParams_t params;
-    memset(&params, 0, sizeof(KeypadLedParams_t));
 
-    // 3) Parse topic
-    if (!LedMsgParseCmdTopic(&params, message.topic.data, message.topic.length))
+    if (LedMsgIsPanelCmdTopic(message.topic.data, message.topic.length))
+    {
+        LedMonitorPanelCommand();
+    }
+    else if (LedMsgIsSceneCmdTopic(message.topic.data, message.topic.length))
+    {
+        LedMonitorSceneCommand();
+    }
+    else if (LedMsgIsBindingCmdTopic(message.topic.data, message.topic.length))
+    {
+        LedMonitorBindingCommand();
+    }
+    else if (LedMsgIsRuleCmdTopic(message.topic.data, message.topic.length))
+    {
+        LedMonitorRuleCommand();
+    }
+    else if (LedMsgIsAnimationCmdTopic(message.topic.data, message.topic.length))
+    {
+        LedMonitorAnimationCommand();
+    }
+    else if (LedMsgIsPanelGetTopic(message.topic.data, message.topic.length))
+    {
+        LedMonitorPanelGet();
+    }
+    else if (ButtonMsgIsConfigTopic(message.topic.data, message.topic.length))
+    {
+        LedMonitorButtonConfig();
+    }
+    else if (LogMsgIsLevelTopic(message.topic.data, message.topic.length))
+    {
+        LedMonitorLogLevel();
+    }
+    else
+    {
+        LedMonitorLedCommand();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void LedMonitorLedCommand()
+{
+    // 1) Clear parameters
+    KeypadLedFadeParams_t params;
+    memset(&params, 0, sizeof(KeypadLedFadeParams_t));
+
+    // 2) Parse topic
+    if (!LedMsgParseCmdTopic(&params.led, message.topic.data, message.topic.length))
     {
         LogPrintWarn("Failed to parse led cmd topic, ignoring message\n");
         return;
     }
 
-    // 4) Parse payload
+    // 3) Parse payload
     if (!LedMsgParseCmdPayload(&params, message.payload.data, message.payload.length))
     {
         LogPrintWarn("Failed to parse led cmd payload, ignoring message\n");
         return;
     }
 
-    // 5) Send parameters to be written to the keypad
-    KeypadLedEventQueueSend(&params);
-    // 6) Build led state topic
-    LedMsgBuildStateTopic(&params, topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
-    // 7) Build led state PAYLOAD
-    LedMsgBuildStatePayload(&params, payload_buffer, MQTT_PAYLOAD_BUFFER_SIZE);
-    // 8) Publish updated state
+    // 4) Send parameters to be written (or faded to) by the keypad, state is published by LedStateTask once applied
+    if (params.transition_ms > 0)
+    {
+        KeypadLedEventQueueSendFade(&params);
+    }
+    else
+    {
+        KeypadLedEventQueueSend(&params.led);
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void LedMonitorPanelCommand()
+{
+    // 1) Clear parameters
+    uint8_t count = 0;
+    memset(panel_params, 0, sizeof(panel_params));
+
+    // 2) Parse payload, all keys in one pass
+    if (!LedMsgParsePanelCmdPayload(panel_params, &count, message.payload.data, message.payload.length))
+    {
+        LogPrintWarn("Failed to parse panel cmd payload, ignoring message\n");
+        return;
+    }
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    // 3) Send parameters to be written to the keypad with a single flush, state is published by LedStateTask
+    KeypadLedEventQueueSendBatch(panel_params, count);
+}
+
+/*-----------------------------------------------------------*/
+
+static void LedMonitorSceneCommand()
+{
+    KeypadSceneParams_t params;
+    memset(&params, 0, sizeof(KeypadSceneParams_t));
+
+    if (!LedMsgParseSceneCmdPayload(&params, message.payload.data, message.payload.length))
+    {
+        LogPrintWarn("Failed to parse scene cmd payload, ignoring message\n");
+        return;
+    }
+
+    KeypadSceneEventQueueSend(&params);
+}
+
+/*-----------------------------------------------------------*/
+
+static void LedMonitorBindingCommand()
+{
+    KeypadBindingParams_t params;
+    memset(&params, 0, sizeof(KeypadBindingParams_t));
+
+    if (!LedMsgParseBindingCmdPayload(&params, message.payload.data, message.payload.length))
+    {
+        LogPrintWarn("Failed to parse binding cmd payload, ignoring message\n");
+        return;
+    }
+
+    KeypadBindingEventQueueSend(&params);
+}
+
+/*-----------------------------------------------------------*/
+
+static void LedMonitorRuleCommand()
+{
+    static KeypadRuleProgram_t program; // Too large for the task stack
+
+    if (!LedMsgParseRuleCmdPayload(&program, message.payload.data, message.payload.length))
+    {
+        LogPrintWarn("Failed to parse rule cmd payload, ignoring message\n");
+        return;
+    }
+
+    KeypadRuleEventQueueSend(&program);
+}
+
+/*-----------------------------------------------------------*/
+
+static void LedMonitorAnimationCommand()
+{
+    static KeypadAnimationParams_t params; // Too large for the task stack
+    memset(&params, 0, sizeof(KeypadAnimationParams_t));
+
+    if (!LedMsgParseAnimationCmdPayload(&params, message.payload.data, message.payload.length))
+    {
+        LogPrintWarn("Failed to parse animation cmd payload, ignoring message\n");
+        return;
+    }
+
+    KeypadAnimationEventQueueSend(&params);
+}
+
+/*-----------------------------------------------------------*/
+
+static void LedMonitorPanelGet()
+{
+    static KeypadLedState_t states[KEYPAD_KEYS]; // Too large for the task stack
+    KeypadLedStateGet(states);
+
+    for (uint8_t index = 0; index < KEYPAD_KEYS; index++)
+    {
+        LedMsgParamsFromState(KEYPAD_KEY_ID[index], &states[index], &panel_params[index]);
+    }
+
+    LedMsgBuildPanelStateTopic(topic_buffer, MQTT_TOPIC_BUFFER_SIZE);
+    LedMsgBuildPanelStatePayload(panel_params, KEYPAD_KEYS, payload_buffer, MQTT_PAYLOAD_BUFFER_SIZE);
     MqttSubmitPublish(topic_buffer,
                       strlen(topic_buffer),
                       payload_buffer,
@@ -205,3 +538,46 @@ static void LedMonitorCommandReceive()
                       MQTTQoS2,
                       true);
 }
+
+/*-----------------------------------------------------------*/
+
+static void LedMonitorButtonConfig()
+{
+    KeypadButtonConfig_t config;
+    KeypadButtonConfigGet(&config);
+
+    if (!ButtonMsgParseConfigPayload(&config, message.payload.data, message.payload.length))
+    {
+        LogPrintWarn("Failed to parse button config payload, ignoring message\n");
+        return;
+    }
+
+    LogPrintInfo("Button config hold:%u repeat:%u multi_press:%u chord:%u\n",
+                 config.hold_ms, config.repeat_ms, config.multi_press_ms, config.chord_ms);
+    KeypadButtonConfigSet(&config);
+}
+
+/*-----------------------------------------------------------*/
+
+static void LedMonitorLogLevel()
+{
+    static LogMsgLevelParams_t params[LOG_MSG_LEVELS]; // Too large for the task stack
+    uint8_t count;
+
+    if (!LogMsgParseLevelPayload(params, &count, message.payload.data, message.payload.length))
+    {
+        LogPrintWarn("Failed to parse log level payload, ignoring message\n");
+        return;
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (!LogLevelSet(params[i].module, params[i].level))
+        {
+            LogPrintWarn("No room to keep the log level of %s\n", params[i].module);
+            continue;
+        }
+
+        LogPrintInfo("Log level of %s set to %u\n", params[i].module, params[i].level);
+    }
+}
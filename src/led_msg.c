@@ -35,6 +35,7 @@
 #include "tiny-json.h"
 
 // alert-panel includes
+#include "button_msg.h"
 #include "log.h"
 #include "alert_panel_config.h"
 
@@ -47,7 +48,35 @@
 #define LED_CMD_TOPIC               MQTT_CLIENT_ID "/led/cmd/#"
 
 // led states: from alert-panel to broker (publish)
-#define LED_STATE_TOPIC_FMT         MQTT_CLIENT_ID "/led/state/%c"
+#define LED_STATE_TOPIC_FMT         MQTT_CLIENT_ID "/led/state/%s"
+
+// panel commands: from broker to alert-panel (subscription), settings for many leds in one message
+#define PANEL_CMD_TOPIC             MQTT_CLIENT_ID "/panel/cmd"
+#define PANEL_ALL_KEYS              "all"
+
+// panel states: from alert-panel to broker (publish)
+#define PANEL_STATE_TOPIC           MQTT_CLIENT_ID "/panel/state"
+
+// panel state requests: from broker to alert-panel (subscription), answered on the panel state topic
+#define PANEL_GET_TOPIC             MQTT_CLIENT_ID "/panel/get"
+
+// scene commands: from broker to alert-panel (subscription), {"recall"|"record"|"delete":"<name>"}
+#define SCENE_CMD_TOPIC             MQTT_CLIENT_ID "/scene/cmd"
+
+// binding commands: from broker to alert-panel (subscription), button event to led settings applied locally
+#define BINDING_CMD_TOPIC           MQTT_CLIENT_ID "/binding/cmd"
+
+// rule commands: from broker to alert-panel (subscription), binary payload of compiled rules
+#define RULE_CMD_TOPIC              MQTT_CLIENT_ID "/rule/cmd"
+
+// animation commands: from broker to alert-panel (subscription), keyframe timeline played back locally
+#define ANIMATION_CMD_TOPIC         MQTT_CLIENT_ID "/animation/cmd"
+
+// animation keyframe array: [duration ms, easing, {<key id>|all: [state, brightness, r, g, b]}]
+#define ANIMATION_KEYFRAME_LENGTH   3
+
+// compact panel led array: [state, brightness, r, g, b]
+#define PANEL_ARRAY_LENGTH          5
 
 /**
  * @brief
@@ -55,71 +84,703 @@
  */
 static char json_str[MQTT_PAYLOAD_BUFFER_SIZE];
 
-/**
- * @brief
- *
- */
-static json_t pool[10]; // number of json attributes
+/**
+ * @brief
+ *
+ */
+static json_t pool[MQTT_PAYLOAD_BUFFER_SIZE / 2]; // every json value takes at least 2 characters, enough for any payload
+
+/**
+ * @brief Per key panel cmd entries (too large for the caller's stack with several keypads)
+ *
+ */
+static KeypadLedParams_t panel_key_params[KEYPAD_KEYS];
+
+// Longest panel state entry is ,"1a":[1,255,255,255,255]
+_Static_assert(MQTT_PAYLOAD_BUFFER_SIZE >= (KEYPAD_KEYS * 25) + 3,
+               "MQTT_PAYLOAD_BUFFER_SIZE is too small for the panel state of every key");
+
+/**
+ * @brief Parses a single led command json object, setting the *_set flags of the fields found
+ *
+ * @param params
+ * @param json_obj
+ */
+static void LedMsgParseCmdObject(KeypadLedParams_t *params, json_t const *json_obj);
+
+/**
+ * @brief Parses a compact panel led array [state, brightness, r, g, b], null entries are left unset
+ *
+ * @param params
+ * @param json_array
+ * @return true
+ * @return false
+ */
+static bool LedMsgParseCmdArray(KeypadLedParams_t *params, json_t const *json_array);
+
+/**
+ * @brief Parses one keyframe array of an animation cmd, appending its colours to params
+ *
+ * @param params
+ * @param colours colours in params so far, updated
+ * @param json_array
+ * @return true
+ * @return false
+ */
+static bool LedMsgParseKeyframe(KeypadAnimationParams_t *params, uint8_t *colours, json_t const *json_array);
+
+/**
+ * @brief Appends a keyframe colour for a key from compact led array parameters
+ *
+ * @param params
+ * @param colours colours in params so far, updated
+ * @param position
+ * @param led
+ * @return true
+ * @return false if there is no room for it
+ */
+static bool LedMsgAddKeyframeColour(KeypadAnimationParams_t *params, uint8_t *colours, uint8_t position,
+                                    const KeypadLedParams_t *led);
+
+/**
+ * @brief Copies the fields set in src over dst
+ *
+ * @param dst
+ * @param src
+ */
+static void LedMsgMergeParams(KeypadLedParams_t *dst, const KeypadLedParams_t *src);
+
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildAvailableTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, AVAILABLE_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildAvailablePayload(bool online, char *payload_buffer, size_t buffer_size)
+{
+    snprintf(payload_buffer, buffer_size, online ? AVAILABLE_PAYLOAD_ONLINE : AVAILABLE_PAYLOAD_OFFLINE);
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildCmdTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, LED_CMD_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgParseCmdTopic(KeypadLedParams_t *params, char *topic, size_t topic_length)
+{
+    if (topic_length <= 0)
+    {
+        LogPrintError("Received led cmd message topic is 0 length\n");
+        return false;
+    }
+
+    // Ensure this is topic meant for us, the '#' in LED_CMD_TOPIC stands for the key id
+    size_t prefix_length = strlen(LED_CMD_TOPIC) - 1;
+
+    if (topic_length <= prefix_length || topic_length >= prefix_length + KEYPAD_KEY_ID_SIZE)
+    {
+        LogPrintError("Received led cmd message topic is unexpected length\n");
+        return false;
+    }
+
+    if (strncmp(topic, LED_CMD_TOPIC, prefix_length) != 0)
+    {
+        LogPrintError("Received led cmd message topic is not in expected form\n");
+        return false;
+    }
+
+    // get the trailing key id
+    uint8_t position;
+
+    if (!KeypadKeyPosition(&topic[prefix_length], topic_length - prefix_length, &position))
+    {
+        LogPrintError("Received led cmd message topic has an unknown key id\n");
+        return false;
+    }
+
+    strncpy(params->key_id, KEYPAD_KEY_ID[position], KEYPAD_KEY_ID_SIZE);
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgParseCmdPayload(KeypadLedFadeParams_t *params, const char *payload, size_t payload_length)
+{
+    json_t const *json_obj = LedMsgJsonCreate(payload, payload_length);
+
+    if (!json_obj)
+    {
+        return false;
+    }
+
+    LedMsgParseCmdObject(&params->led, json_obj);
+
+    // Parse transition (seconds, as sent by home assistant)
+    json_t const *transition_prop = json_getProperty(json_obj, "transition");
+    double transition = 0;
+
+    if (transition_prop && json_getType(transition_prop) == JSON_INTEGER)
+    {
+        transition = (double)json_getInteger(transition_prop);
+    }
+    else if (transition_prop && json_getType(transition_prop) == JSON_REAL)
+    {
+        transition = json_getReal(transition_prop);
+    }
+
+    transition = transition < 0 ? 0 : transition > 65.535 ? 65.535 : transition;
+    params->transition_ms = (uint16_t)((transition * 1000) + 0.5);
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildPanelCmdTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, PANEL_CMD_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgIsPanelCmdTopic(const char *topic, size_t topic_length)
+{
+    return topic_length == strlen(PANEL_CMD_TOPIC) &&
+           strncmp(topic, PANEL_CMD_TOPIC, topic_length) == 0;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgParsePanelCmdPayload(KeypadLedParams_t *params, uint8_t *count, const char *payload, size_t payload_length)
+{
+    json_t const *json_obj = LedMsgJsonCreate(payload, payload_length);
+
+    if (!json_obj)
+    {
+        return false;
+    }
+
+    if (json_getType(json_obj) != JSON_OBJ)
+    {
+        LogPrintError("Panel cmd payload is not a json object\n");
+        return false;
+    }
+
+    // 1) Single pass over the payload, 'all' fills the defaults, everything else is a key id
+    KeypadLedParams_t all_params;
+    KeypadLedParams_t *key_params = panel_key_params;
+    bool key_present[KEYPAD_KEYS];
+    bool all_present = false;
+    memset(&all_params, 0, sizeof(all_params));
+    memset(panel_key_params, 0, sizeof(panel_key_params));
+    memset(key_present, 0, sizeof(key_present));
+
+    for (json_t const *prop = json_getChild(json_obj); prop != NULL; prop = json_getSibling(prop))
+    {
+        const char *name = json_getName(prop);
+        KeypadLedParams_t *target;
+        uint8_t position;
+
+        if (strcmp(name, PANEL_ALL_KEYS) == 0)
+        {
+            target = &all_params;
+            all_present = true;
+        }
+        else if (KeypadKeyPosition(name, strlen(name), &position))
+        {
+            target = &key_params[position];
+            key_present[position] = true;
+        }
+        else
+        {
+            LogPrintWarn("Panel cmd contains unknown key '%s', ignoring it\n", name);
+            continue;
+        }
+
+        if (json_getType(prop) == JSON_OBJ)
+        {
+            LedMsgParseCmdObject(target, prop);
+        }
+        else if (json_getType(prop) != JSON_ARRAY || !LedMsgParseCmdArray(target, prop))
+        {
+            LogPrintError("Panel cmd entry '%s' is not an object or [state, brightness, r, g, b] array\n", name);
+            return false;
+        }
+    }
+
+    // 2) Merge keys over the defaults
+    *count = 0;
+
+    for (uint8_t i = 0; i < KEYPAD_KEYS; i++)
+    {
+        if (!all_present && !key_present[i])
+        {
+            continue;
+        }
+
+        KeypadLedParams_t *out = &params[*count];
+        *out = all_params;
+        strncpy(out->key_id, KEYPAD_KEY_ID[i], KEYPAD_KEY_ID_SIZE);
+
+        if (key_present[i])
+        {
+            LedMsgMergeParams(out, &key_params[i]);
+        }
+
+        (*count)++;
+    }
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildStateTopic(KeypadLedParams_t *params, char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer,
+             buffer_size,
+             LED_STATE_TOPIC_FMT,
+             params->key_id);
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildStatePayload(KeypadLedParams_t *params, char *payload_buffer, size_t buffer_size)
+{
+    // 1) Start json
+    snprintf(payload_buffer, buffer_size, "{");
+    bool comma_needed = false;
+
+    // 2) Add state if state_set
+    if (params->state_set)
+    {
+        snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
+                 "\"state\":\"%s\"", params->state ? "ON" : "OFF");
+        comma_needed = true;
+    }
+
+    // 3) Add brightness if brightness_set
+    if (params->brightness_set)
+    {
+        if (comma_needed)
+        {
+            strncat(payload_buffer, ",", buffer_size - strlen(payload_buffer) - 1);
+        }
+
+        snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
+                 "\"brightness\":%d", params->brightness);
+        comma_needed = true;
+    }
+
+    // 4) Add color field if colour_set
+    if (params->colour_set)
+    {
+        if (comma_needed)
+        {
+            strncat(payload_buffer, ",", buffer_size - strlen(payload_buffer) - 1);
+        }
+
+        snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
+                 "\"color\":{\"r\":%d,\"g\":%d,\"b\":%d}",
+                 params->red, params->green, params->blue);
+        comma_needed = true;
+    }
+
+    // 5) Add color_mode (required for home assistant) if colour_set
+    if (params->colour_set)
+    {
+        if (comma_needed)
+        {
+            strncat(payload_buffer, ",", buffer_size - strlen(payload_buffer) - 1);
+        }
+
+        strncat(payload_buffer, "\"color_mode\":\"rgb\"", buffer_size - strlen(payload_buffer) - 1);
+        comma_needed = true;
+    }
+
+    // 6) Add effect if effect_set
+    if (params->effect_set)
+    {
+        if (comma_needed)
+        {
+            strncat(payload_buffer, ",", buffer_size - strlen(payload_buffer) - 1);
+        }
+
+        snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
+                 "\"effect\":\"%s\"", params->effect == FLASH ? "flash" : params->effect == PULSE ? "pulse" : "none");
+    }
+
+    // 7) End json
+    strncat(payload_buffer, "}", buffer_size - strlen(payload_buffer) - 1);
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgParamsFromState(const char *key_id, const KeypadLedState_t *state, KeypadLedParams_t *params)
+{
+    memset(params, 0, sizeof(KeypadLedParams_t));
+    strncpy(params->key_id, key_id, KEYPAD_KEY_ID_SIZE);
+    params->state = state->state;
+    params->state_set = true;
+    params->brightness = state->brightness;
+    params->brightness_set = true;
+    params->red = state->red;
+    params->green = state->green;
+    params->blue = state->blue;
+    params->colour_set = true;
+    params->effect = state->effect;
+    params->effect_set = true;
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildPanelGetTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, PANEL_GET_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgIsPanelGetTopic(const char *topic, size_t topic_length)
+{
+    return topic_length == strlen(PANEL_GET_TOPIC) &&
+           strncmp(topic, PANEL_GET_TOPIC, topic_length) == 0;
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildPanelStateTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, PANEL_STATE_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildPanelStatePayload(KeypadLedParams_t *params, uint8_t count, char *payload_buffer, size_t buffer_size)
+{
+    // 1) Start json
+    snprintf(payload_buffer, buffer_size, "{");
+
+    // 2) Add compact [state, brightness, r, g, b] array for each led, null for fields not set
+    for (uint8_t i = 0; i < count; i++)
+    {
+        char state[5] = "null";
+        char brightness[5] = "null";
+        char colour[16] = "null,null,null";
+
+        if (params[i].state_set)
+        {
+            snprintf(state, sizeof(state), "%d", params[i].state ? 1 : 0);
+        }
+
+        if (params[i].brightness_set)
+        {
+            snprintf(brightness, sizeof(brightness), "%d", params[i].brightness);
+        }
+
+        if (params[i].colour_set)
+        {
+            snprintf(colour, sizeof(colour), "%d,%d,%d", params[i].red, params[i].green, params[i].blue);
+        }
+
+        snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
+                 "%s\"%s\":[%s,%s,%s]", i > 0 ? "," : "", params[i].key_id, state, brightness, colour);
+    }
+
+    // 3) End json
+    strncat(payload_buffer, "}", buffer_size - strlen(payload_buffer) - 1);
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildSceneCmdTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, SCENE_CMD_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgIsSceneCmdTopic(const char *topic, size_t topic_length)
+{
+    return topic_length == strlen(SCENE_CMD_TOPIC) &&
+           strncmp(topic, SCENE_CMD_TOPIC, topic_length) == 0;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgParseSceneCmdPayload(KeypadSceneParams_t *params, const char *payload, size_t payload_length)
+{
+    json_t const *json_obj = LedMsgJsonCreate(payload, payload_length);
+
+    if (!json_obj)
+    {
+        return false;
+    }
+
+    static const struct
+    {
+        const char *name;
+        KeypadSceneAction_t action;
+    }
+    actions[] =
+    {
+        {"recall", SCENE_RECALL},
+        {"record", SCENE_RECORD},
+        {"delete", SCENE_DELETE},
+    };
+
+    for (uint8_t i = 0; i < sizeof(actions) / sizeof(actions[0]); i++)
+    {
+        json_t const *name_prop = json_getProperty(json_obj, actions[i].name);
+
+        if (!name_prop || json_getType(name_prop) != JSON_TEXT)
+        {
+            continue;
+        }
+
+        const char *name = json_getValue(name_prop);
+
+        if (strlen(name) == 0 || strlen(name) >= KEYPAD_SCENE_NAME_SIZE)
+        {
+            LogPrintError("Scene name must be 1-%u characters\n", KEYPAD_SCENE_NAME_SIZE - 1);
+            return false;
+        }
+
+        params->action = actions[i].action;
+        strncpy(params->name, name, KEYPAD_SCENE_NAME_SIZE);
+        return true;
+    }
+
+    LogPrintError("Scene cmd has no recall, record or delete property\n");
+    return false;
+}
 
 /*-----------------------------------------------------------*/
 
-void LedMsgBuildAvailableTopic(char *topic_buffer, size_t buffer_size)
+void LedMsgBuildBindingCmdTopic(char *topic_buffer, size_t buffer_size)
 {
-    snprintf(topic_buffer, buffer_size, AVAILABLE_TOPIC);
+    snprintf(topic_buffer, buffer_size, BINDING_CMD_TOPIC);
 }
 
 /*-----------------------------------------------------------*/
 
-void LedMsgBuildAvailablePayload(bool online, char *payload_buffer, size_t buffer_size)
+bool LedMsgIsBindingCmdTopic(const char *topic, size_t topic_length)
 {
-    snprintf(payload_buffer, buffer_size, online ? AVAILABLE_PAYLOAD_ONLINE : AVAILABLE_PAYLOAD_OFFLINE);
+    return topic_length == strlen(BINDING_CMD_TOPIC) &&
+           strncmp(topic, BINDING_CMD_TOPIC, topic_length) == 0;
 }
 
 /*-----------------------------------------------------------*/
 
-void LedMsgBuildCmdTopic(char *topic_buffer, size_t buffer_size)
+bool LedMsgParseBindingCmdPayload(KeypadBindingParams_t *params, const char *payload, size_t payload_length)
 {
-    snprintf(topic_buffer, buffer_size, LED_CMD_TOPIC);
+    json_t const *json_obj = LedMsgJsonCreate(payload, payload_length);
+
+    if (!json_obj)
+    {
+        return false;
+    }
+
+    // 1) Clear everything
+    json_t const *clear_prop = json_getProperty(json_obj, "clear");
+
+    if (clear_prop && json_getType(clear_prop) == JSON_BOOLEAN && json_getBoolean(clear_prop))
+    {
+        params->action = BINDING_CLEAR;
+        return true;
+    }
+
+    // 2) Key and event being bound
+    json_t const *key_prop = json_getProperty(json_obj, "key");
+    json_t const *event_prop = json_getProperty(json_obj, "event");
+    uint8_t position;
+
+    if (!key_prop || json_getType(key_prop) != JSON_TEXT ||
+            !KeypadKeyPosition(json_getValue(key_prop), strlen(json_getValue(key_prop)), &position))
+    {
+        LogPrintError("Binding cmd has no valid key property\n");
+        return false;
+    }
+
+    // Chords are reported once for several keys, so only per key events can be bound
+    if (!event_prop || json_getType(event_prop) != JSON_TEXT ||
+            !ButtonMsgEventFromName(json_getValue(event_prop), &params->event) || params->event == CHORD)
+    {
+        LogPrintError("Binding cmd has no valid event property\n");
+        return false;
+    }
+
+    strncpy(params->key_id, KEYPAD_KEY_ID[position], KEYPAD_KEY_ID_SIZE);
+    json_t const *delete_prop = json_getProperty(json_obj, "delete");
+
+    if (delete_prop && json_getType(delete_prop) == JSON_BOOLEAN && json_getBoolean(delete_prop))
+    {
+        params->action = BINDING_DELETE;
+        return true;
+    }
+
+    // 3) Led to write, the pressed key's own led unless given
+    json_t const *led_prop = json_getProperty(json_obj, "led");
+
+    if (led_prop)
+    {
+        if (json_getType(led_prop) != JSON_TEXT ||
+                !KeypadKeyPosition(json_getValue(led_prop), strlen(json_getValue(led_prop)), &position))
+        {
+            LogPrintError("Binding cmd led property is not a valid key\n");
+            return false;
+        }
+    }
+
+    strncpy(params->led.key_id, KEYPAD_KEY_ID[position], KEYPAD_KEY_ID_SIZE);
+    LedMsgParseCmdObject(&params->led, json_obj);
+
+    if (!params->led.state_set && !params->led.brightness_set && !params->led.colour_set && !params->led.effect_set)
+    {
+        LogPrintError("Binding cmd sets no led fields\n");
+        return false;
+    }
+
+    params->action = BINDING_SET;
+    return true;
 }
 
 /*-----------------------------------------------------------*/
 
-bool LedMsgParseCmdTopic(KeypadLedParams_t *params, char *topic, size_t topic_length)
+void LedMsgBuildRuleCmdTopic(char *topic_buffer, size_t buffer_size)
 {
-    if (topic_length <= 0)
+    snprintf(topic_buffer, buffer_size, RULE_CMD_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgIsRuleCmdTopic(const char *topic, size_t topic_length)
+{
+    return topic_length == strlen(RULE_CMD_TOPIC) &&
+           strncmp(topic, RULE_CMD_TOPIC, topic_length) == 0;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgParseRuleCmdPayload(KeypadRuleProgram_t *program, const char *payload, size_t payload_length)
+{
+    if (payload_length > KEYPAD_RULE_PROGRAM_SIZE)
+    {
+        LogPrintError("Rule program is longer than %u bytes\n", KEYPAD_RULE_PROGRAM_SIZE);
+        return false;
+    }
+
+    // Checked by the keypad when loaded
+    program->length = (uint16_t)payload_length;
+    memcpy(program->code, payload, payload_length);
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+void LedMsgBuildAnimationCmdTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, ANIMATION_CMD_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgIsAnimationCmdTopic(const char *topic, size_t topic_length)
+{
+    return topic_length == strlen(ANIMATION_CMD_TOPIC) &&
+           strncmp(topic, ANIMATION_CMD_TOPIC, topic_length) == 0;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LedMsgParseAnimationCmdPayload(KeypadAnimationParams_t *params, const char *payload, size_t payload_length)
+{
+    json_t const *json_obj = LedMsgJsonCreate(payload, payload_length);
+
+    if (!json_obj)
     {
-        LogPrintError("Received led cmd message topic is 0 length\n");
         return false;
     }
 
-    // Ensure this is topic meant for us
-    int expected_topic_length = strlen(LED_CMD_TOPIC); // This includes the '#' char, which in this case will be 0-f, so the size is still valid
+    // 1) Stop, an animation without keyframes
+    json_t const *stop_prop = json_getProperty(json_obj, "stop");
 
-    if (topic_length != expected_topic_length)
+    if (stop_prop && json_getType(stop_prop) == JSON_BOOLEAN && json_getBoolean(stop_prop))
     {
-        LogPrintError("Received led cmd message topic is unexpected length\n");
+        params->keyframe_count = 0;
+        return true;
+    }
+
+    // 2) Times to play, looping until stopped unless given
+    json_t const *repeat_prop = json_getProperty(json_obj, "repeat");
+    params->repeat = 0;
+
+    if (repeat_prop)
+    {
+        if (json_getType(repeat_prop) != JSON_INTEGER ||
+                json_getInteger(repeat_prop) < 0 || json_getInteger(repeat_prop) > UINT8_MAX)
+        {
+            LogPrintError("Animation cmd repeat must be 0-%u\n", UINT8_MAX);
+            return false;
+        }
+
+        params->repeat = (uint8_t)json_getInteger(repeat_prop);
+    }
+
+    // 3) Keyframes
+    json_t const *frames_prop = json_getProperty(json_obj, "frames");
+
+    if (!frames_prop || json_getType(frames_prop) != JSON_ARRAY)
+    {
+        LogPrintError("Animation cmd has no frames array\n");
         return false;
     }
 
-    if (strncmp(topic, LED_CMD_TOPIC, (topic_length - 1)) != 0)
+    uint8_t colours = 0;
+    params->keyframe_count = 0;
+
+    for (json_t const *frame = json_getChild(frames_prop); frame != NULL; frame = json_getSibling(frame))
     {
-        LogPrintError("Received led cmd message topic is not in expected form\n");
+        if (params->keyframe_count == KEYPAD_ANIMATION_KEYFRAMES)
+        {
+            LogPrintError("Animation cmd has more than %u frames\n", KEYPAD_ANIMATION_KEYFRAMES);
+            return false;
+        }
+
+        if (!LedMsgParseKeyframe(params, &colours, frame))
+        {
+            LogPrintError("Animation cmd frame %u is not a valid [ms, easing, {keys}] array\n", params->keyframe_count);
+            return false;
+        }
+
+        params->keyframe_count++;
+    }
+
+    if (params->keyframe_count == 0)
+    {
+        LogPrintError("Animation cmd has no frames\n");
         return false;
     }
 
-    params->key_id = topic[topic_length - 1]; // get the last character (key_id)
     return true;
 }
 
 /*-----------------------------------------------------------*/
 
-bool LedMsgParseCmdPayload(KeypadLedParams_t *params, const char *payload, size_t payload_length)
+json_t const *LedMsgJsonCreate(const char *payload, size_t payload_length)
 {
     // Sanity check
     if (payload_length > MQTT_PAYLOAD_BUFFER_SIZE)
     {
         LogPrintError("payload_length > MQTT_PAYLOAD_BUFFER_SIZE\n");
-        return false;
+        return NULL;
     }
 
     // Safe to memcpy now, copy payload into json_string as this will be modified
@@ -140,9 +801,15 @@ bool LedMsgParseCmdPayload(KeypadLedParams_t *params, const char *payload, size_
     if (!json_obj)
     {
         LogPrintError("Error parsing received mqtt message to json\n");
-        return false;
     }
 
+    return json_obj;
+}
+
+/*-----------------------------------------------------------*/
+
+static void LedMsgParseCmdObject(KeypadLedParams_t *params, json_t const *json_obj)
+{
     // Parse brightness
     json_t const *brightness_prop = json_getProperty(json_obj, "brightness");
 
@@ -215,74 +882,237 @@ bool LedMsgParseCmdPayload(KeypadLedParams_t *params, const char *payload, size_
             params->state_set = true;
         }
     }
-
-    return true;
 }
 
 /*-----------------------------------------------------------*/
 
-void LedMsgBuildStateTopic(KeypadLedParams_t *params, char *topic_buffer, size_t buffer_size)
+static bool LedMsgParseCmdArray(KeypadLedParams_t *params, json_t const *json_array)
 {
-    snprintf(topic_buffer,
-             buffer_size,
-             LED_STATE_TOPIC_FMT,
-             params->key_id);
+    json_t const *values[PANEL_ARRAY_LENGTH];
+    uint8_t length = 0;
+
+    for (json_t const *value = json_getChild(json_array); value != NULL; value = json_getSibling(value))
+    {
+        if (length == PANEL_ARRAY_LENGTH)
+        {
+            return false;
+        }
+
+        if (json_getType(value) != JSON_INTEGER && json_getType(value) != JSON_NULL)
+        {
+            return false;
+        }
+
+        values[length++] = value;
+    }
+
+    if (length != PANEL_ARRAY_LENGTH)
+    {
+        return false;
+    }
+
+    if (json_getType(values[0]) == JSON_INTEGER)
+    {
+        params->state = json_getInteger(values[0]) != 0;
+        params->state_set = true;
+    }
+
+    if (json_getType(values[1]) == JSON_INTEGER)
+    {
+        params->brightness = (uint8_t)json_getInteger(values[1]);
+        params->brightness_set = true;
+    }
+
+    if (json_getType(values[2]) == JSON_INTEGER &&
+            json_getType(values[3]) == JSON_INTEGER &&
+            json_getType(values[4]) == JSON_INTEGER)
+    {
+        params->red = (uint8_t)json_getInteger(values[2]);
+        params->green = (uint8_t)json_getInteger(values[3]);
+        params->blue = (uint8_t)json_getInteger(values[4]);
+        params->colour_set = true;
+    }
+
+    return true;
 }
 
 /*-----------------------------------------------------------*/
 
-void LedMsgBuildStatePayload(KeypadLedParams_t *params, char *payload_buffer, size_t buffer_size)
+static bool LedMsgParseKeyframe(KeypadAnimationParams_t *params, uint8_t *colours, json_t const *json_array)
 {
-    // 1) Start json
-    snprintf(payload_buffer, buffer_size, "{");
-    bool comma_needed = false;
+    static const struct
+    {
+        const char *name;
+        KeypadAnimationEasing_t easing;
+    }
+    easings[] =
+    {
+        {"linear", EASE_LINEAR},
+        {"in", EASE_IN},
+        {"out", EASE_OUT},
+        {"in_out", EASE_IN_OUT},
+        {"step", EASE_STEP},
+    };
 
-    // 2) Add state if state_set
-    if (params->state_set)
+    json_t const *values[ANIMATION_KEYFRAME_LENGTH];
+    uint8_t length = 0;
+
+    if (json_getType(json_array) != JSON_ARRAY)
     {
-        snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
-                 "\"state\":\"%s\"", params->state ? "ON" : "OFF");
-        comma_needed = true;
+        return false;
     }
 
-    // 3) Add brightness if brightness_set
-    if (params->brightness_set)
+    for (json_t const *value = json_getChild(json_array); value != NULL; value = json_getSibling(value))
     {
-        if (comma_needed)
+        if (length == ANIMATION_KEYFRAME_LENGTH)
         {
-            strncat(payload_buffer, ",", buffer_size - strlen(payload_buffer) - 1);
+            return false;
         }
 
-        snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
-                 "\"brightness\":%d", params->brightness);
-        comma_needed = true;
+        values[length++] = value;
     }
 
-    // 4) Add color field if colour_set
-    if (params->colour_set)
+    if (length != ANIMATION_KEYFRAME_LENGTH ||
+            json_getType(values[0]) != JSON_INTEGER ||
+            json_getType(values[1]) != JSON_TEXT ||
+            json_getType(values[2]) != JSON_OBJ)
     {
-        if (comma_needed)
+        return false;
+    }
+
+    // 1) Duration and easing
+    KeypadAnimationKeyframe_t *keyframe = &params->keyframes[params->keyframe_count];
+    int64_t duration = json_getInteger(values[0]);
+
+    if (duration < 0 || duration > UINT16_MAX)
+    {
+        return false;
+    }
+
+    keyframe->duration_ms = (uint16_t)duration;
+    keyframe->count = 0;
+    uint8_t i = 0;
+
+    while (i < sizeof(easings) / sizeof(easings[0]) && strcmp(json_getValue(values[1]), easings[i].name) != 0)
+    {
+        i++;
+    }
+
+    if (i == sizeof(easings) / sizeof(easings[0]))
+    {
+        return false;
+    }
+
+    keyframe->easing = easings[i].easing;
+
+    // 2) Key colours, 'all' covers every key not named in the same keyframe
+    KeypadLedParams_t all_params;
+    json_t const *all_prop = NULL;
+    KeypadMask_t named = 0;
+    uint8_t first = *colours;
+
+    for (json_t const *prop = json_getChild(values[2]); prop != NULL; prop = json_getSibling(prop))
+    {
+        KeypadLedParams_t key_params;
+        const char *name = json_getName(prop);
+        uint8_t position;
+        memset(&key_params, 0, sizeof(key_params));
+
+        if (strcmp(name, PANEL_ALL_KEYS) == 0)
         {
-            strncat(payload_buffer, ",", buffer_size - strlen(payload_buffer) - 1);
+            all_prop = prop;
+            continue;
         }
 
-        snprintf(payload_buffer + strlen(payload_buffer), buffer_size - strlen(payload_buffer),
-                 "\"color\":{\"r\":%d,\"g\":%d,\"b\":%d}",
-                 params->red, params->green, params->blue);
-        comma_needed = true;
+        if (!KeypadKeyPosition(name, strlen(name), &position))
+        {
+            LogPrintWarn("Animation cmd contains unknown key '%s', ignoring it\n", name);
+            continue;
+        }
+
+        if (json_getType(prop) != JSON_ARRAY || !LedMsgParseCmdArray(&key_params, prop) ||
+                !LedMsgAddKeyframeColour(params, colours, position, &key_params))
+        {
+            return false;
+        }
+
+        named |= (KeypadMask_t)1 << position;
     }
 
-    // 5) Add color_mode (required for home assistant) if colour_set
-    if (params->colour_set)
+    if (all_prop)
     {
-        if (comma_needed)
+        memset(&all_params, 0, sizeof(all_params));
+
+        if (json_getType(all_prop) != JSON_ARRAY || !LedMsgParseCmdArray(&all_params, all_prop))
         {
-            strncat(payload_buffer, ",", buffer_size - strlen(payload_buffer) - 1);
+            return false;
         }
 
-        strncat(payload_buffer, "\"color_mode\":\"rgb\"", buffer_size - strlen(payload_buffer) - 1);
+        for (uint8_t position = 0; position < KEYPAD_KEYS; position++)
+        {
+            if ((named & ((KeypadMask_t)1 << position)) == 0 &&
+                    !LedMsgAddKeyframeColour(params, colours, position, &all_params))
+            {
+                return false;
+            }
+        }
     }
 
-    // 6) End json
-    strncat(payload_buffer, "}", buffer_size - strlen(payload_buffer) - 1);
+    keyframe->count = *colours - first;
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool LedMsgAddKeyframeColour(KeypadAnimationParams_t *params, uint8_t *colours, uint8_t position,
+                                    const KeypadLedParams_t *led)
+{
+    if (*colours == KEYPAD_ANIMATION_COLOURS)
+    {
+        LogPrintError("Animation cmd has more than %u key colours\n", KEYPAD_ANIMATION_COLOURS);
+        return false;
+    }
+
+    // Animated keys are turned ON anyway, so only a state of 0 (fade out) means anything
+    KeypadAnimationColour_t *colour = &params->colours[(*colours)++];
+    colour->position = position;
+    colour->set = (led->colour_set ? KEYPAD_ANIMATION_SET_COLOUR : 0) |
+                  (led->brightness_set ? KEYPAD_ANIMATION_SET_BRIGHTNESS : 0) |
+                  (led->state_set && !led->state ? KEYPAD_ANIMATION_SET_OFF : 0);
+    colour->red = led->red;
+    colour->green = led->green;
+    colour->blue = led->blue;
+    colour->brightness = led->brightness;
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static void LedMsgMergeParams(KeypadLedParams_t *dst, const KeypadLedParams_t *src)
+{
+    if (src->state_set)
+    {
+        dst->state = src->state;
+        dst->state_set = true;
+    }
+
+    if (src->brightness_set)
+    {
+        dst->brightness = src->brightness;
+        dst->brightness_set = true;
+    }
+
+    if (src->colour_set)
+    {
+        dst->red = src->red;
+        dst->green = src->green;
+        dst->blue = src->blue;
+        dst->colour_set = true;
+    }
+
+    if (src->effect_set)
+    {
+        dst->effect = src->effect;
+        dst->effect_set = true;
+    }
 }
@@ -31,6 +31,9 @@
 // standard includes
 #include <stdint.h>
 
+// tiny-json includes
+#include "tiny-json.h"
+
 // alert-panel includes
 #include "keypad.h"
 
@@ -69,7 +72,7 @@ void LedMsgBuildCmdTopic(char *topic_buffer, size_t buffer_size);
 bool LedMsgParseCmdTopic(KeypadLedParams_t *params, char *topic, size_t topic_length);
 
 /**
- * @brief
+ * @brief Parses a led cmd payload, an optional 'transition' (seconds) fades to the new settings
  *
  * @param params
  * @param payload
@@ -77,7 +80,7 @@ bool LedMsgParseCmdTopic(KeypadLedParams_t *params, char *topic, size_t topic_le
  * @return true
  * @return false
  */
-bool LedMsgParseCmdPayload(KeypadLedParams_t *params, const char *payload, size_t payload_length);
+bool LedMsgParseCmdPayload(KeypadLedFadeParams_t *params, const char *payload, size_t payload_length);
 
 /**
  * @brief
@@ -97,4 +100,210 @@ void LedMsgBuildStateTopic(KeypadLedParams_t *params, char *topic_buffer, size_t
  */
 void LedMsgBuildStatePayload(KeypadLedParams_t *params, char *payload_buffer, size_t buffer_size);
 
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void LedMsgBuildPanelCmdTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic
+ * @param topic_length
+ * @return true if topic is the panel cmd topic
+ * @return false
+ */
+bool LedMsgIsPanelCmdTopic(const char *topic, size_t topic_length);
+
+/**
+ * @brief Parses a panel cmd payload in one pass into per-key led parameters
+ * The payload is a json object keyed by key id (or 'all' for every key), each value is either
+ * a led cmd object or a compact [state, brightness, r, g, b] array (null leaves a field unset)
+ *
+ * @param params array of at least KEYPAD_KEYS entries
+ * @param count number of params filled
+ * @param payload
+ * @param payload_length
+ * @return true
+ * @return false
+ */
+bool LedMsgParsePanelCmdPayload(KeypadLedParams_t *params, uint8_t *count, const char *payload, size_t payload_length);
+
+/**
+ * @brief Fills led parameters (every field set) from a key's applied led state, for building state payloads
+ *
+ * @param key_id
+ * @param state
+ * @param params
+ */
+void LedMsgParamsFromState(const char *key_id, const KeypadLedState_t *state, KeypadLedParams_t *params);
+
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void LedMsgBuildPanelGetTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic
+ * @param topic_length
+ * @return true if topic is the panel get topic
+ * @return false
+ */
+bool LedMsgIsPanelGetTopic(const char *topic, size_t topic_length);
+
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void LedMsgBuildPanelStateTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief Builds a single aggregated state payload for several leds, in the compact panel array form
+ *
+ * @param params
+ * @param count
+ * @param payload_buffer
+ * @param buffer_size
+ */
+void LedMsgBuildPanelStatePayload(KeypadLedParams_t *params, uint8_t count, char *payload_buffer, size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void LedMsgBuildSceneCmdTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic
+ * @param topic_length
+ * @return true if topic is the scene cmd topic
+ * @return false
+ */
+bool LedMsgIsSceneCmdTopic(const char *topic, size_t topic_length);
+
+/**
+ * @brief Parses a scene cmd payload, {"recall":"<name>"}, {"record":"<name>"} or {"delete":"<name>"}
+ *
+ * @param params
+ * @param payload
+ * @param payload_length
+ * @return true
+ * @return false
+ */
+bool LedMsgParseSceneCmdPayload(KeypadSceneParams_t *params, const char *payload, size_t payload_length);
+
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void LedMsgBuildBindingCmdTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic
+ * @param topic_length
+ * @return true if topic is the binding cmd topic
+ * @return false
+ */
+bool LedMsgIsBindingCmdTopic(const char *topic, size_t topic_length);
+
+/**
+ * @brief Parses a binding cmd payload, {"key":"<key>","event":"<event>","led":"<key>",<led cmd fields>} binds,
+ * {"key":"<key>","event":"<event>","delete":true} unbinds and {"clear":true} removes every binding
+ *
+ * @param params
+ * @param payload
+ * @param payload_length
+ * @return true
+ * @return false
+ */
+bool LedMsgParseBindingCmdPayload(KeypadBindingParams_t *params, const char *payload, size_t payload_length);
+
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void LedMsgBuildRuleCmdTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic
+ * @param topic_length
+ * @return true if topic is the rule cmd topic
+ * @return false
+ */
+bool LedMsgIsRuleCmdTopic(const char *topic, size_t topic_length);
+
+/**
+ * @brief Parses a rule cmd payload, the raw compiled program (see scripts/rule_compile.py), empty to remove every rule
+ *
+ * @param program
+ * @param payload
+ * @param payload_length
+ * @return true
+ * @return false
+ */
+bool LedMsgParseRuleCmdPayload(KeypadRuleProgram_t *program, const char *payload, size_t payload_length);
+
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void LedMsgBuildAnimationCmdTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic
+ * @param topic_length
+ * @return true if topic is the animation cmd topic
+ * @return false
+ */
+bool LedMsgIsAnimationCmdTopic(const char *topic, size_t topic_length);
+
+/**
+ * @brief Parses an animation cmd payload, {"stop":true} or {"repeat":<n>,"frames":[[<ms>,"<easing>",{<keys>}],...]}
+ * Keys are named as in a panel cmd, each with a compact [state, brightness, r, g, b] array, a state of 0 fades out.
+ * Easing is linear, in, out, in_out or step, repeat is the times to play (0, the default, loops until stopped)
+ *
+ * @param params
+ * @param payload
+ * @param payload_length
+ * @return true
+ * @return false
+ */
+bool LedMsgParseAnimationCmdPayload(KeypadAnimationParams_t *params, const char *payload, size_t payload_length);
+
+/**
+ * @brief Copies payload into the json buffer and parses it, the buffer is shared by every command parsed on the led
+ * monitor task (log levels included), so the result is only valid until the next call
+ *
+ * @param payload
+ * @param payload_length
+ * @return json_t const* root json object, NULL on failure
+ */
+json_t const *LedMsgJsonCreate(const char *payload, size_t payload_length);
+
 #endif //_LED_MSG_H
\ No newline at end of file
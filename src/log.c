@@ -31,14 +31,27 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <string.h>
+#include <strings.h>
 #include <math.h>
 
+// pico-sdk includes
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
 // FreeRTOS-Kernel includes
 #include "task.h"
-#include "queue.h"
 
 // alert-panel includes
+#include "crash.h"
+#include "log_mqtt.h"
+#include "log_output.h"
+#include "rtos_manifest.h"
+#include "supervisor.h"
 #include "system.h"
+#ifdef TRACE
+#include "trace.h"
+#endif
 #include "util.h"
 
 /**
@@ -53,11 +66,185 @@
  */
 typedef char Message[LOG_MESSAGE_SIZE];
 
+/**
+ * @brief Bytes in each core's log ring, a power of 2
+ *
+ */
+#define LOG_RING_SIZE   2048
+
+/**
+ * @brief Longest time (ms) LogTask sleeps with nothing logged, records logged from interrupts do not wake it
+ *
+ */
+#define LOG_DRAIN_PERIOD    50
+
+/**
+ * @brief Longest time (ms) between loops before the supervisor restarts the panel
+ *
+ */
+#define LOG_HEARTBEAT_DEADLINE  2000
+
+/**
+ * @brief How often (ms) LogTask logs its output statistics
+ *
+ */
+#define LOG_OUTPUT_STATS_PERIOD (15 * 60 * 1000)
+
+/**
+ * @brief Output totals since the last report, busy is the time LogTask spends draining, formatting and writing
+ *
+ */
+typedef struct
+{
+    uint32_t since;
+    uint32_t bytes;
+    uint32_t lines;
+    uint32_t batches;
+    uint32_t stalls; // drains cut short as the batch was full and the last was still being sent
+    uint64_t busy_us;
+}
+LogOutputStats_t;
+
+/**
+ * @brief Header of each ring entry, followed by length bytes of message text (or tokenized record)
+ *
+ */
+typedef struct
+{
+    uint32_t time_us; // orders the entries of both cores
+    uint16_t length;
+    uint8_t level;
+    bool local; // from a LogModule_t local module
+}
+LogRingHeader_t;
+
+/**
+ * @brief Byte ring with a single producer, its core with interrupts masked, and a single consumer, LogTask
+ * head and tail run freely and wrap, only the producer moves head and only LogTask moves tail
+ *
+ */
+typedef struct
+{
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t dropped; // entries that did not fit
+    uint8_t data[LOG_RING_SIZE];
+}
+LogRing_t;
+
+_Static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of 2");
+
+#ifdef LOG_TOKENIZED
+/**
+ * @brief Most bytes of a tokenized record, arguments that do not fit are dropped
+ * A record is token (4 bytes), time in ms (4 bytes), level | core << 4 (1 byte), then the arguments
+ *
+ */
+#define LOG_RECORD_SIZE 96
+
+/**
+ * @brief Line LogTask writes per record: '$', base64 of the record, '\n', '\0'
+ *
+ */
+typedef char LogRecordLine[1 + (((LOG_RECORD_SIZE + 2) / 3) * 4) + 2];
+
+/**
+ * @brief Longest line LogTask writes, including the terminator
+ *
+ */
+#define LOG_LINE_SIZE   sizeof(LogRecordLine)
+#else
+#define LOG_LINE_SIZE   LOG_MESSAGE_SIZE
+#endif
+
+/**
+ * @brief Names of LOG_LEVEL_*, in order
+ *
+ */
+static const char *const LOG_LEVEL_NAMES[] = {"DEBUG", "INFO", "WARN", "ERROR", "FATAL", "OFF"};
+
+/**
+ * @brief Module levels set by name, kept for modules that register later
+ *
+ */
+#define LOG_LEVEL_OVERRIDES 8
+
+/**
+ * @brief Longest console command line, e.g. "log keypad_binding debug"
+ *
+ */
+#define LOG_CONSOLE_LINE_SIZE   48
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    char module[LOG_MODULE_NAME_SIZE]; // empty if unused
+    uint8_t level;
+}
+LogLevelOverride_t;
+
+/**
+ * @brief
+ *
+ */
+static LogRing_t log_rings[configNUMBER_OF_CORES];
+
+/**
+ * @brief
+ *
+ */
+static TaskHandle_t log_task_handle;
+
+/**
+ * @brief
+ *
+ */
+static StackType_t log_task_stack[LOG_TASK_STACK_DEPTH];
+
 /**
  * @brief
  *
  */
-static QueueHandle_t log_queue;
+static StaticTask_t log_task_buffer;
+
+/**
+ * @brief Registered modules, guarded by the FreeRTOS ISR lock so any core or interrupt can register
+ *
+ */
+static LogModule_t *log_modules = NULL;
+
+/**
+ * @brief Level of modules without an override
+ *
+ */
+static uint8_t log_level_default = LOG_LEVEL_MIN;
+
+/**
+ * @brief
+ *
+ */
+static LogLevelOverride_t log_level_overrides[LOG_LEVEL_OVERRIDES];
+
+/**
+ * @brief Only touched by LogTask
+ *
+ */
+static LogOutputStats_t output_stats;
+
+/**
+ * @brief Messages from the coreMQTT library, which logs through LogPrintMqtt*()
+ *
+ */
+static LogModule_t log_module_mqtt = {"coreMQTT", LOG_LEVEL_DEBUG, false, false, NULL};
+
+/**
+ * @brief Modules whose logs are kept off the MQTT log sink, the sink's own publishes would otherwise feed back into it
+ *
+ */
+static const char *const LOG_LOCAL_MODULES[] = {"mqtt", "coreMQTT"};
 
 /**
  * @brief
@@ -67,89 +254,590 @@ static QueueHandle_t log_queue;
 static void LogTask(void *params);
 
 /**
- * @brief
+ * @brief Formats and logs a message, the module's level has been checked
  *
- * @param level
  * @param module
+ * @param level
  * @param fmt
  * @param args
  * @return int
  */
-static int LogVargPrint(const char *level, const char *module, const char *fmt, va_list args);
+static int LogVargPrint(LogModule_t *module, uint8_t level, const char *fmt, va_list args);
 
 /**
  * @brief
  *
  * @param level
- * @param module
  * @param fmt
  * @param args
  * @return int
  */
-static int LogPrintMqtt(const char *level, const char *module, const char *fmt, va_list args);
+static int LogPrintMqtt(uint8_t level, const char *fmt, va_list args);
+
+/**
+ * @brief Registers module on its first call, then checks level against it
+ *
+ * @param module
+ * @param level
+ * @return true if the message is logged
+ * @return false
+ */
+static bool LogModuleEnabled(LogModule_t *module, uint8_t level);
+
+/**
+ * @brief Adds a module to log_modules and gives it its starting level
+ *
+ * @param module
+ */
+static void LogModuleRegister(LogModule_t *module);
+
+/**
+ * @brief Compares a module's file name, without directory or extension, to name
+ *
+ * @param module
+ * @param name
+ * @return true
+ * @return false
+ */
+static bool LogModuleNameMatch(const LogModule_t *module, const char *name);
+
+/**
+ * @brief Logs output statistics once LOG_OUTPUT_STATS_PERIOD has passed, then restarts them
+ *
+ */
+static void LogOutputStatsReport(void);
+
+/**
+ * @brief Reads the console without blocking and runs each complete line
+ *
+ * @param line
+ * @param length characters held in line between calls
+ */
+static void LogConsoleRead(char *line, size_t *length);
+
+/**
+ * @brief Runs a console command, "log <module|all> <level>", or with TRACE "trace"
+ *
+ * @param line
+ */
+static void LogConsoleCommand(const char *line);
+
+#ifdef TRACE
+/**
+ * @brief Writes part of a trace dump to the log output, waiting for room rather than dropping any of it
+ *
+ * @param text
+ * @param length
+ */
+static void LogConsoleTraceWrite(const char *text, size_t length);
+#endif
+
+/**
+ * @brief Adds an entry to the calling core's ring, never blocks
+ *
+ * @param module
+ * @param level
+ * @param payload
+ * @param length
+ * @return true
+ * @return false if the ring is full, the entry is dropped and counted
+ */
+static bool LogRingWrite(const LogModule_t *module, uint8_t level, const void *payload, uint16_t length);
+
+/**
+ * @brief Takes the earliest entry waiting in any ring
+ *
+ * @param payload buffer of LOG_MESSAGE_SIZE bytes
+ * @param header the entry's header
+ * @return int length of the entry, -1 if every ring is empty
+ */
+static int LogRingRead(uint8_t *payload, LogRingHeader_t *header);
+
+/**
+ * @brief Copies into a ring at a free running index, wrapping at the end
+ *
+ * @param ring
+ * @param index
+ * @param src
+ * @param length
+ */
+static void LogRingCopyIn(LogRing_t *ring, uint32_t index, const void *src, size_t length);
+
+/**
+ * @brief Copies out of a ring at a free running index, wrapping at the end
+ *
+ * @param ring
+ * @param index
+ * @param dst
+ * @param length
+ */
+static void LogRingCopyOut(const LogRing_t *ring, uint32_t index, void *dst, size_t length);
+
+#ifdef LOG_TOKENIZED
+/**
+ * @brief Appends an unsigned LEB128 varint
+ *
+ * @param out
+ * @param end
+ * @param value
+ * @return uint8_t* past the varint, NULL if it does not fit
+ */
+static uint8_t *LogRecordVarint(uint8_t *out, const uint8_t *end, uint64_t value);
+
+/**
+ * @brief Base64 encodes a record into a '$' prefixed line
+ *
+ * @param record
+ * @param length
+ * @param line
+ */
+static void LogRecordLineBuild(const uint8_t *record, uint8_t length, char *line);
+#endif
 
 /*-----------------------------------------------------------*/
 
 int LogInit()
 {
-    log_queue = xQueueCreate(10, sizeof(Message));
-
-    if (log_queue == NULL)
-    {
-        int core_id = portGET_CORE_ID();
-        printf("[FATAL] [%s] [%d] Failed to create log_queue", __FILE__, core_id); // Need to printf here as logging not setup
-        Fault();
-    }
+    // Nothing to create, logging works from the first call, before the scheduler starts
+    memset(log_rings, 0, sizeof(log_rings));
+    LogOutputInit();
+    return 0;
 }
 
 /*-----------------------------------------------------------*/
 
 void LogTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask)
 {
-    xTaskCreatePinnedToCore(LogTask, "LogTask", configMINIMAL_STACK_SIZE, NULL, priority, NULL, core_affinity_mask);
+    xTaskCreateStaticPinnedToCore(LogTask, "LogTask", LOG_TASK_STACK_DEPTH, NULL, priority, log_task_stack,
+                                  &log_task_buffer, &log_task_handle, core_affinity_mask);
 }
 
 /*-----------------------------------------------------------*/
 
-int LogPrint(const char *level, const char *module, const char *fmt, ...)
+int LogModulePrint(LogModule_t *module, uint8_t level, const char *fmt, ...)
 {
+    if (!LogModuleEnabled(module, level))
+    {
+        return 0;
+    }
+
     va_list args;
     va_start(args, fmt);
-    int result = LogVargPrint(level, module, fmt, args);
+    int result = LogVargPrint(module, level, fmt, args);
     va_end(args);
     return result;
 }
 
 /*-----------------------------------------------------------*/
 
+bool LogLevelSet(const char *module, uint8_t level)
+{
+    bool all = strcmp(module, "all") == 0;
+    bool kept = true;
+    UBaseType_t interrupts = taskENTER_CRITICAL_FROM_ISR();
+
+    if (all)
+    {
+        log_level_default = level;
+        memset(log_level_overrides, 0, sizeof(log_level_overrides));
+    }
+    else
+    {
+        LogLevelOverride_t *override = NULL;
+
+        for (uint8_t i = 0; i < LOG_LEVEL_OVERRIDES; i++)
+        {
+            if (strcmp(log_level_overrides[i].module, module) == 0)
+            {
+                override = &log_level_overrides[i];
+                break;
+            }
+
+            if (override == NULL && log_level_overrides[i].module[0] == '\0')
+            {
+                override = &log_level_overrides[i];
+            }
+        }
+
+        if (override != NULL)
+        {
+            strncpy(override->module, module, LOG_MODULE_NAME_SIZE - 1);
+            override->module[LOG_MODULE_NAME_SIZE - 1] = '\0';
+            override->level = level;
+        }
+
+        kept = override != NULL;
+    }
+
+    for (LogModule_t *registered = log_modules; registered != NULL; registered = registered->next)
+    {
+        if (all || LogModuleNameMatch(registered, module))
+        {
+            registered->level = level;
+        }
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR(interrupts);
+    return kept;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LogLevelFromName(const char *name, uint8_t *level)
+{
+    for (uint8_t i = 0; i < sizeof(LOG_LEVEL_NAMES) / sizeof(LOG_LEVEL_NAMES[0]); i++)
+    {
+        if (strcasecmp(name, LOG_LEVEL_NAMES[i]) == 0)
+        {
+            *level = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool LogModuleEnabled(LogModule_t *module, uint8_t level)
+{
+    if (!module->registered)
+    {
+        LogModuleRegister(module);
+    }
+
+    return level >= module->level;
+}
+
+/*-----------------------------------------------------------*/
+
+static void LogModuleRegister(LogModule_t *module)
+{
+    UBaseType_t interrupts = taskENTER_CRITICAL_FROM_ISR();
+
+    // Another task may have got here first
+    if (!module->registered)
+    {
+        uint8_t level = log_level_default;
+
+        for (uint8_t i = 0; i < sizeof(LOG_LOCAL_MODULES) / sizeof(LOG_LOCAL_MODULES[0]); i++)
+        {
+            module->local |= LogModuleNameMatch(module, LOG_LOCAL_MODULES[i]);
+        }
+
+        for (uint8_t i = 0; i < LOG_LEVEL_OVERRIDES; i++)
+        {
+            if (log_level_overrides[i].module[0] != '\0' && LogModuleNameMatch(module, log_level_overrides[i].module))
+            {
+                level = log_level_overrides[i].level;
+            }
+        }
+
+        module->level = level;
+        module->next = log_modules;
+        log_modules = module;
+        module->registered = true;
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR(interrupts);
+}
+
+/*-----------------------------------------------------------*/
+
+static bool LogModuleNameMatch(const LogModule_t *module, const char *name)
+{
+    const char *base = strrchr(module->file, '/');
+    base = base != NULL ? base + 1 : module->file;
+    size_t length = strcspn(base, ".");
+    return strlen(name) == length && strncmp(base, name, length) == 0;
+}
+
+/*-----------------------------------------------------------*/
+
 static void LogTask(void *params)
 {
     LogPrintInfo("LogTask running...\n");
-    Message msg;
+    static Message payload; // Too large for the task stack
+    uint32_t reported[configNUMBER_OF_CORES] = {0};
+#ifdef LOG_TOKENIZED
+    static LogRecordLine line;
+#endif
+    static char console_line[LOG_CONSOLE_LINE_SIZE];
+    size_t console_length = 0;
+    SupervisorRegister(LOG_HEARTBEAT_DEADLINE);
 
     for (;;)
     {
-        // Wait for next message
-        if (xQueueReceive(log_queue, &msg, portMAX_DELAY) != pdTRUE)
+        SupervisorCheckIn();
+        LogConsoleRead(console_line, &console_length);
+        uint64_t start_us = GetTimeUs();
+        bool drained = false;
+
+        // Drain both cores, oldest entry first, into batches while there is room for any line
+        do
+        {
+            LogRingHeader_t header;
+            int length;
+
+            while (LogOutputSpace() >= LOG_LINE_SIZE)
+            {
+                if ((length = LogRingRead((uint8_t *)payload, &header)) < 0)
+                {
+                    drained = true;
+                    break;
+                }
+
+#ifdef LOG_TOKENIZED
+                LogRecordLineBuild((uint8_t *)payload, (uint8_t)length, line);
+#else
+                char *line = payload;
+                payload[length] = '\0';
+#endif
+                size_t line_length = strlen(line);
+                LogOutputWrite(line, line_length);
+                output_stats.bytes += line_length;
+                output_stats.lines++;
+
+                if (header.level >= LOG_MQTT_LEVEL && !header.local)
+                {
+                    LogMqttWrite(line, line_length);
+                }
+            }
+
+            output_stats.batches += LogOutputFlush();
+        }
+        while (!drained && LogOutputSpace() >= LOG_LINE_SIZE);
+
+        output_stats.stalls += !drained;
+        LogMqttPoll();
+        output_stats.busy_us += GetTimeUs() - start_us;
+        LogOutputStatsReport();
+
+        for (uint8_t core = 0; core < configNUMBER_OF_CORES; core++)
+        {
+            uint32_t dropped = log_rings[core].dropped;
+
+            if (dropped != reported[core])
+            {
+                LogPrintWarn("%lu log messages dropped on core %u, ring full\n", dropped - reported[core], core);
+                reported[core] = dropped;
+            }
+        }
+
+        // A batch still waiting for the DMA is sent on the next tick, rather than with the next entry
+        ulTaskNotifyTake(pdTRUE, LogOutputSpace() < LOG_OUTPUT_BATCH_SIZE ? 1 : pdMS_TO_TICKS(LOG_DRAIN_PERIOD));
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void LogOutputStatsReport(void)
+{
+    uint32_t time_now = GetTimeMs();
+    uint32_t elapsed = GetElapsedMs(output_stats.since, time_now);
+
+    if (elapsed < LOG_OUTPUT_STATS_PERIOD)
+    {
+        return;
+    }
+
+    uint32_t bytes_per_second = (uint32_t)(((uint64_t)output_stats.bytes * 1000) / elapsed);
+    uint32_t batch_average = output_stats.batches > 0 ? output_stats.bytes / output_stats.batches : 0;
+    uint32_t busy_us_per_kb = output_stats.bytes > 0 ? (uint32_t)((output_stats.busy_us * 1024) / output_stats.bytes) : 0;
+    LogPrintInfo("Log output: %lu B/s, %lu lines, %lu batches avg %lu B, %lu us/KB busy, %lu stalls\n",
+                 bytes_per_second, output_stats.lines, output_stats.batches, batch_average, busy_us_per_kb,
+                 output_stats.stalls);
+    memset(&output_stats, 0, sizeof(output_stats));
+    output_stats.since = time_now;
+}
+
+/*-----------------------------------------------------------*/
+
+static void LogConsoleRead(char *line, size_t *length)
+{
+    int c;
+
+    while ((c = getchar_timeout_us(0)) >= 0)
+    {
+        if (c == '\r' || c == '\n')
+        {
+            line[*length] = '\0';
+
+            if (*length > 0)
+            {
+                LogConsoleCommand(line);
+            }
+
+            *length = 0;
+        }
+        else if (*length < LOG_CONSOLE_LINE_SIZE - 1)
         {
-            int core_id = portGET_CORE_ID();
-            printf("[FATAL] [%s] [%d] log_queue receive failed", __FILE__, core_id);
-            Fault();
+            line[(*length)++] = (char)c;
         }
+    }
+}
+
+/*-----------------------------------------------------------*/
 
-        printf(msg);
+static void LogConsoleCommand(const char *line)
+{
+    char module[LOG_MODULE_NAME_SIZE];
+    char level_name[8];
+    uint8_t level;
+
+#ifdef TRACE
+    if (strcmp(line, "trace") == 0)
+    {
+        TraceDump(LogConsoleTraceWrite);
+        return;
+    }
+#endif
+
+    if (sscanf(line, "log %23s %7s", module, level_name) != 2 || !LogLevelFromName(level_name, &level))
+    {
+        LogPrintWarn("Unknown console command '%s', expected 'log <module|all> <level>'\n", line);
+        return;
+    }
+
+    if (!LogLevelSet(module, level))
+    {
+        LogPrintWarn("No room to keep the log level of %s\n", module);
+        return;
     }
+
+    LogPrintInfo("Log level of %s set to %s\n", module, LOG_LEVEL_NAMES[level]);
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef TRACE
+static void LogConsoleTraceWrite(const char *text, size_t length)
+{
+    // A dump takes many seconds on a slow output
+    SupervisorCheckIn();
+
+    while (LogOutputSpace() < length)
+    {
+        if (!LogOutputFlush())
+        {
+            vTaskDelay(1);
+        }
+    }
+
+    LogOutputWrite(text, length);
 }
+#endif
 
 /*-----------------------------------------------------------*/
 
-static int LogVargPrint(const char *level, const char *module, const char *fmt, va_list args)
+#ifdef LOG_TOKENIZED
+static int LogVargPrint(LogModule_t *module, uint8_t level, const char *fmt, va_list args)
+{
+    Message msg;
+    const char *file = module->file;
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    return LogTokenPrint(module, level, LOG_TOKEN_TEXT, LOG_ARG_COUNT(file, msg) | (LOG_ARG_TYPES(file, msg) << 4),
+                         file, msg);
+}
+
+/*-----------------------------------------------------------*/
+
+int LogTokenPrint(LogModule_t *module, uint8_t level, uint32_t token, uint32_t types, ...)
+{
+    if (!LogModuleEnabled(module, level))
+    {
+        return 0;
+    }
+
+    uint8_t record[LOG_RECORD_SIZE];
+    uint8_t *out = record;
+    const uint8_t *end = record + sizeof(record);
+    uint32_t time_ms = GetTimeMs();
+    memcpy(out, &token, sizeof(token));
+    memcpy(out + 4, &time_ms, sizeof(time_ms));
+    out[8] = level | (portGET_CORE_ID() << 4);
+    out += 9;
+
+    va_list args;
+    va_start(args, types);
+    uint8_t count = types & 0x0f;
+    types >>= 4;
+
+    for (uint8_t i = 0; i < count; i++, types >>= 2)
+    {
+        uint8_t *next = NULL;
+
+        switch (types & 0x03)
+        {
+            case LOG_ARG_INT:
+            {
+                // Zigzag, so small negative values stay short
+                int64_t value = va_arg(args, int);
+                next = LogRecordVarint(out, end, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+                break;
+            }
+
+            case LOG_ARG_INT64:
+            {
+                int64_t value = va_arg(args, long long);
+                next = LogRecordVarint(out, end, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+                break;
+            }
+
+            case LOG_ARG_DOUBLE:
+            {
+                double value = va_arg(args, double);
+
+                if (end - out >= (int)sizeof(value))
+                {
+                    memcpy(out, &value, sizeof(value));
+                    next = out + sizeof(value);
+                }
+
+                break;
+            }
+
+            case LOG_ARG_STRING:
+            {
+                const char *value = va_arg(args, const char *);
+                value = value != NULL ? value : "(null)";
+
+                // Long strings are cut to the space left
+                if (out < end)
+                {
+                    size_t length = strnlen(value, end - out - 1);
+                    *out = (uint8_t)length;
+                    memcpy(out + 1, value, length);
+                    next = out + 1 + length;
+                }
+
+                break;
+            }
+        }
+
+        // Arguments that do not fit are left off, the decoder marks the message as truncated
+        if (next == NULL)
+        {
+            break;
+        }
+
+        out = next;
+    }
+
+    va_end(args);
+    LogRingWrite(module, level, record, (uint16_t)(out - record));
+    return 0;
+}
+#else
+static int LogVargPrint(LogModule_t *module, uint8_t level, const char *fmt, va_list args)
 {
     Message msg;
     int core_id = portGET_CORE_ID();
     uint32_t time_ms = GetTimeMs();
     int bytes_written;
-    bytes_written = snprintf(msg, sizeof(msg), "[%.3f] [%s] [%s] [%d] ", time_ms / 1000.0, level, module, core_id);
+    // Integer seconds and milliseconds, no soft float on the logging path
+    bytes_written = snprintf(msg, sizeof(msg), "[%lu.%03lu] [%s] [%s] [%d] ", (unsigned long)(time_ms / 1000),
+                             (unsigned long)(time_ms % 1000), LOG_LEVEL_NAMES[level], module->file, core_id);
 
     if (bytes_written < 0)
     {
@@ -161,29 +849,29 @@ static int LogVargPrint(const char *level, const char *module, const char *fmt,
 
     if (bytes_written >= sizeof(msg))
     {
-        msg[sizeof(msg) - 1] = '\0';
-    }
-
-    // Send message
-    if (xQueueSend(log_queue, &msg, portMAX_DELAY) != pdTRUE)
-    {
-        LogPrintFatal("Failed to send to log_queue"); // This might not get through?
-        Fault();
+        bytes_written = sizeof(msg) - 1;
     }
 
+    LogRingWrite(module, level, msg, (uint16_t)bytes_written);
     return 0;
 }
+#endif
 
 /*-----------------------------------------------------------*/
 
-static int LogPrintMqtt(const char *level, const char *module, const char *fmt, va_list args)
+static int LogPrintMqtt(uint8_t level, const char *fmt, va_list args)
 {
+    if (!LogModuleEnabled(&log_module_mqtt, level))
+    {
+        return 0;
+    }
+
     char fmt_nl[LOG_MESSAGE_SIZE];
     int bytes_written = vsnprintf(fmt_nl, sizeof(fmt_nl) - 2, fmt, args);
     int nl_pos = (bytes_written < sizeof(fmt_nl) - 2) ? bytes_written : sizeof(fmt_nl) - 2;
     fmt_nl[nl_pos] = '\n';
     fmt_nl[nl_pos + 1] = '\0';
-    return LogPrint(level, module, fmt_nl);
+    return LogModulePrint(&log_module_mqtt, level, "%s", fmt_nl);
 }
 
 /*-----------------------------------------------------------*/
@@ -192,7 +880,7 @@ int LogPrintMqttError(const char *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    int result = LogPrintMqtt("ERROR", "coreMQTT", fmt, args);
+    int result = LogPrintMqtt(LOG_LEVEL_ERROR, fmt, args);
     va_end(args);
     return result;
 }
@@ -203,7 +891,7 @@ int LogPrintMqttWarn(const char *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    int result = LogPrintMqtt("WARN", "coreMQTT", fmt, args);
+    int result = LogPrintMqtt(LOG_LEVEL_WARN, fmt, args);
     va_end(args);
     return result;
 }
@@ -214,7 +902,7 @@ int LogPrintMqttInfo(const char *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    int result = LogPrintMqtt("INFO", "coreMQTT", fmt, args);
+    int result = LogPrintMqtt(LOG_LEVEL_INFO, fmt, args);
     va_end(args);
     return result;
 }
@@ -225,7 +913,135 @@ int LogPrintMqttDebug(const char *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    int result = LogPrintMqtt("DEBUG", "coreMQTT", fmt, args);
+    int result = LogPrintMqtt(LOG_LEVEL_DEBUG, fmt, args);
     va_end(args);
     return result;
-}
\ No newline at end of file
+}
+
+/*-----------------------------------------------------------*/
+
+static bool LogRingWrite(const LogModule_t *module, uint8_t level, const void *payload, uint16_t length)
+{
+    // Nothing else runs on this core until interrupts are restored, so each core's ring has a single producer
+    uint32_t interrupts = save_and_disable_interrupts();
+    CrashLogAppend(level, payload, length);
+    LogRing_t *ring = &log_rings[portGET_CORE_ID()];
+    LogRingHeader_t header = {(uint32_t)GetTimeUs(), length, level, module->local};
+    uint32_t head = ring->head;
+    uint32_t used = head - ring->tail;
+    __mem_fence_acquire();
+
+    if (LOG_RING_SIZE - used < sizeof(header) + length)
+    {
+        ring->dropped++;
+        restore_interrupts(interrupts);
+        return false;
+    }
+
+    LogRingCopyIn(ring, head, &header, sizeof(header));
+    LogRingCopyIn(ring, head + sizeof(header), payload, length);
+    // Entry complete before LogTask can see it
+    __mem_fence_release();
+    ring->head = head + sizeof(header) + length;
+    restore_interrupts(interrupts);
+
+    // Only a wake up, the entry is already in place, interrupts are picked up on the next drain period
+    if (log_task_handle != NULL && !portCHECK_IF_IN_ISR())
+    {
+        xTaskNotifyGive(log_task_handle);
+    }
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static int LogRingRead(uint8_t *payload, LogRingHeader_t *header)
+{
+    LogRing_t *next = NULL;
+    LogRingHeader_t next_header;
+
+    for (uint8_t core = 0; core < configNUMBER_OF_CORES; core++)
+    {
+        LogRing_t *ring = &log_rings[core];
+        LogRingHeader_t ring_header;
+
+        if (ring->head == ring->tail)
+        {
+            continue;
+        }
+
+        __mem_fence_acquire();
+        LogRingCopyOut(ring, ring->tail, &ring_header, sizeof(ring_header));
+
+        if (next == NULL || (int32_t)(ring_header.time_us - next_header.time_us) < 0)
+        {
+            next = ring;
+            next_header = ring_header;
+        }
+    }
+
+    if (next == NULL)
+    {
+        return -1;
+    }
+
+    uint16_t length = next_header.length < LOG_MESSAGE_SIZE ? next_header.length : LOG_MESSAGE_SIZE - 1;
+    LogRingCopyOut(next, next->tail + sizeof(next_header), payload, length);
+    // Entry copied out before its space is handed back
+    __mem_fence_release();
+    next->tail += sizeof(next_header) + next_header.length;
+    *header = next_header;
+    return length;
+}
+
+/*-----------------------------------------------------------*/
+
+static void LogRingCopyIn(LogRing_t *ring, uint32_t index, const void *src, size_t length)
+{
+    size_t offset = index & (LOG_RING_SIZE - 1);
+    size_t first = length < LOG_RING_SIZE - offset ? length : LOG_RING_SIZE - offset;
+    memcpy(&ring->data[offset], src, first);
+    memcpy(ring->data, (const uint8_t *)src + first, length - first);
+}
+
+/*-----------------------------------------------------------*/
+
+static void LogRingCopyOut(const LogRing_t *ring, uint32_t index, void *dst, size_t length)
+{
+    size_t offset = index & (LOG_RING_SIZE - 1);
+    size_t first = length < LOG_RING_SIZE - offset ? length : LOG_RING_SIZE - offset;
+    memcpy(dst, &ring->data[offset], first);
+    memcpy((uint8_t *)dst + first, ring->data, length - first);
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef LOG_TOKENIZED
+static uint8_t *LogRecordVarint(uint8_t *out, const uint8_t *end, uint64_t value)
+{
+    do
+    {
+        if (out == end)
+        {
+            return NULL;
+        }
+
+        *out++ = (uint8_t)(value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+        value >>= 7;
+    }
+    while (value != 0);
+
+    return out;
+}
+
+/*-----------------------------------------------------------*/
+
+static void LogRecordLineBuild(const uint8_t *record, uint8_t length, char *line)
+{
+    line[0] = '$';
+    size_t written = 1 + BytesToBase64(line + 1, sizeof(LogRecordLine) - 2, record, length);
+    line[written] = '\n';
+    line[written + 1] = '\0';
+}
+#endif
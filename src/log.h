@@ -28,16 +28,119 @@
 #ifndef _LOG_H
 #define _LOG_H
 
+// standard includes
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Levels, a module logs messages at or above its level
+ *
+ */
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_FATAL 4
+#define LOG_LEVEL_OFF   5 // module level only
+
+/**
+ * @brief Lowest level built in, the LogPrint* macros of lower levels expand to nothing. Also the starting level of
+ * every module
+ *
+ */
+#ifndef LOG_LEVEL_MIN
 #ifdef DEBUG
-#define LogPrintDebug(message, ...) LogPrint("DEBUG", __FILE__, message, ##__VA_ARGS__)
+#define LOG_LEVEL_MIN   LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL_MIN   LOG_LEVEL_INFO
+#endif
+#endif
+
+/**
+ * @brief Longest module name given to LogLevelSet(), including the terminator
+ *
+ */
+#define LOG_MODULE_NAME_SIZE    24
+
+/**
+ * @brief Run time level of a source file, its name is the file name without directory or extension, e.g. "keypad_rule"
+ *
+ */
+typedef struct LogModule
+{
+    const char *file;
+    volatile uint8_t level; // LOG_LEVEL_DEBUG until registered, so the first call reaches LogModuleRegister()
+    bool registered;
+    bool local; // kept off the MQTT log sink, set for the modules that publish it
+    struct LogModule *next;
+}
+LogModule_t;
+
+/**
+ * @brief The including source file's module, registered by its first log call
+ *
+ */
+static LogModule_t log_module __attribute__((unused)) = {__BASE_FILE__, LOG_LEVEL_DEBUG, false, false, NULL};
+
+#ifdef LOG_TOKENIZED
+// alert-panel includes
+#include "log_token.h"
+
+#define LOG_MODULE_PRINT(level, message, ...) LOG_TOKEN_PRINT(&log_module, level, message, ##__VA_ARGS__)
 #else
-#define LogPrintDebug(message, ...)
+#define LOG_MODULE_PRINT(level, message, ...) LogModulePrint(&log_module, level, message, ##__VA_ARGS__)
 #endif
-#define LogPrintInfo(message, ...) LogPrint("INFO", __FILE__, message, ##__VA_ARGS__)
-#define LogPrintWarn(message, ...) LogPrint("WARN", __FILE__, message, ##__VA_ARGS__)
-#define LogPrintError(message, ...) LogPrint("ERROR", __FILE__, message, ##__VA_ARGS__)
-#define LogPrintFatal(message, ...) LogPrint("FATAL", __FILE__, message, ##__VA_ARGS__)
 
+/**
+ * @brief A single load and compare before anything is formatted
+ *
+ */
+#define LOG_LEVEL_PRINT(log_level, message, ...) \
+    do \
+    { \
+        if ((log_level) >= log_module.level) \
+        { \
+            LOG_MODULE_PRINT(log_level, message, ##__VA_ARGS__); \
+        } \
+    } \
+    while (0)
+
+/**
+ * @brief A log call below LOG_LEVEL_MIN, its arguments are still compiled (so still count as used) but no code is emitted
+ *
+ */
+#define LOG_LEVEL_NONE(message, ...) \
+    do \
+    { \
+        if (0) \
+        { \
+            LogModulePrint(&log_module, LOG_LEVEL_OFF, message, ##__VA_ARGS__); \
+        } \
+    } \
+    while (0)
+
+#if LOG_LEVEL_MIN <= LOG_LEVEL_DEBUG
+#define LogPrintDebug(message, ...) LOG_LEVEL_PRINT(LOG_LEVEL_DEBUG, message, ##__VA_ARGS__)
+#else
+#define LogPrintDebug(message, ...) LOG_LEVEL_NONE(message, ##__VA_ARGS__)
+#endif
+#if LOG_LEVEL_MIN <= LOG_LEVEL_INFO
+#define LogPrintInfo(message, ...) LOG_LEVEL_PRINT(LOG_LEVEL_INFO, message, ##__VA_ARGS__)
+#else
+#define LogPrintInfo(message, ...) LOG_LEVEL_NONE(message, ##__VA_ARGS__)
+#endif
+#if LOG_LEVEL_MIN <= LOG_LEVEL_WARN
+#define LogPrintWarn(message, ...) LOG_LEVEL_PRINT(LOG_LEVEL_WARN, message, ##__VA_ARGS__)
+#else
+#define LogPrintWarn(message, ...) LOG_LEVEL_NONE(message, ##__VA_ARGS__)
+#endif
+#if LOG_LEVEL_MIN <= LOG_LEVEL_ERROR
+#define LogPrintError(message, ...) LOG_LEVEL_PRINT(LOG_LEVEL_ERROR, message, ##__VA_ARGS__)
+#else
+#define LogPrintError(message, ...) LOG_LEVEL_NONE(message, ##__VA_ARGS__)
+#endif
+#define LogPrintFatal(message, ...) LOG_LEVEL_PRINT(LOG_LEVEL_FATAL, message, ##__VA_ARGS__)
 
 // FreeRTOS-Kernel includes
 #include "FreeRTOS.h"
@@ -58,15 +161,37 @@ int LogInit();
 void LogTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask);
 
 /**
- * @brief
+ * @brief Formats and logs a message if module's level allows it, use through the LogPrint* macros
+ * With LOG_TOKENIZED the formatted text is logged under LOG_TOKEN_TEXT
+ * The format attribute has the compiler check the arguments against fmt
  *
- * @param level
  * @param module
+ * @param level LOG_LEVEL_*
  * @param fmt
  * @param ...
  * @return int
  */
-int LogPrint(const char *level, const char *module, const char *fmt, ...);
+int LogModulePrint(LogModule_t *module, uint8_t level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+/**
+ * @brief Sets the level of a module, or of every module with "all", and keeps it for modules not yet registered
+ *
+ * @param module module name, e.g. "keypad" or "coreMQTT", or "all"
+ * @param level LOG_LEVEL_*
+ * @return true
+ * @return false if there is no room left to keep the level
+ */
+bool LogLevelSet(const char *module, uint8_t level);
+
+/**
+ * @brief Looks up a level by name, e.g. "debug", case insensitive
+ *
+ * @param name
+ * @param level
+ * @return true
+ * @return false if name is not a level name
+ */
+bool LogLevelFromName(const char *name, uint8_t *level);
 
 /**
  * @brief
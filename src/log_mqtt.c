@@ -0,0 +1,212 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file log_mqtt.c
+* @brief
+*/
+#include "log_mqtt.h"
+
+// standard includes
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+// alert-panel includes
+#include "log_msg.h"
+#include "mqtt.h"
+#include "util.h"
+#include "alert_panel_config.h"
+
+/**
+ * @brief Longest time (ms) a line waits for others to share its publish
+ *
+ */
+#define LOG_MQTT_BATCH_PERIOD   2000
+
+/**
+ * @brief Most publishes sent in a burst
+ *
+ */
+#define LOG_MQTT_BUCKET_SIZE    4
+
+/**
+ * @brief Time (ms) to earn another publish, the sustained rate
+ *
+ */
+#define LOG_MQTT_BUCKET_PERIOD  10000
+
+/**
+ * @brief
+ *
+ */
+static char batch[MQTT_PAYLOAD_BUFFER_SIZE];
+
+/**
+ * @brief
+ *
+ */
+static size_t batch_length = 0;
+
+/**
+ * @brief
+ *
+ */
+static uint32_t batch_lines = 0;
+
+/**
+ * @brief When the first line of the batch was added
+ *
+ */
+static uint32_t batch_start_ms;
+
+/**
+ * @brief Publishes that can be sent now
+ *
+ */
+static uint32_t bucket = LOG_MQTT_BUCKET_SIZE;
+
+/**
+ * @brief When bucket was last topped up
+ *
+ */
+static uint32_t bucket_time_ms = 0;
+
+/**
+ * @brief Lines dropped and not yet reported in a sent batch
+ *
+ */
+static uint32_t dropped = 0;
+
+/**
+ * @brief Dropped lines reported at the start of the batch
+ *
+ */
+static uint32_t batch_dropped = 0;
+
+/**
+ * @brief
+ *
+ */
+static char topic[MQTT_TOPIC_BUFFER_SIZE];
+
+/**
+ * @brief Sends the batch if the bucket allows, otherwise leaves it in place
+ *
+ * @return true if the batch was sent and is now empty
+ * @return false
+ */
+static bool LogMqttSend(void);
+
+/**
+ * @brief Empties the batch, counting its lines as dropped
+ *
+ */
+static void LogMqttDrop(void);
+
+/*-----------------------------------------------------------*/
+
+void LogMqttWrite(const char *line, size_t length)
+{
+    // A full batch that cannot be sent makes way for newer lines
+    if (batch_length + length > sizeof(batch) && !LogMqttSend())
+    {
+        LogMqttDrop();
+    }
+
+    if (batch_length == 0)
+    {
+        batch_start_ms = GetTimeMs();
+
+        batch_dropped = dropped;
+
+        if (batch_dropped > 0)
+        {
+            batch_length = snprintf(batch, sizeof(batch), "%lu log lines dropped\n", (unsigned long)batch_dropped);
+        }
+    }
+
+    if (length > sizeof(batch) - batch_length)
+    {
+        length = sizeof(batch) - batch_length;
+    }
+
+    memcpy(batch + batch_length, line, length);
+    batch_length += length;
+    batch_lines++;
+}
+
+/*-----------------------------------------------------------*/
+
+void LogMqttPoll(void)
+{
+    if (batch_length > 0 && GetTimeMs() - batch_start_ms >= LOG_MQTT_BATCH_PERIOD)
+    {
+        LogMqttSend();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static bool LogMqttSend(void)
+{
+    uint32_t time_ms = GetTimeMs();
+    uint32_t earned = (time_ms - bucket_time_ms) / LOG_MQTT_BUCKET_PERIOD;
+
+    if (earned > 0)
+    {
+        bucket = bucket + earned < LOG_MQTT_BUCKET_SIZE ? bucket + earned : LOG_MQTT_BUCKET_SIZE;
+        bucket_time_ms += earned * LOG_MQTT_BUCKET_PERIOD;
+    }
+
+    if (bucket == 0)
+    {
+        return false;
+    }
+
+    if (topic[0] == '\0')
+    {
+        LogMsgBuildSinkTopic(topic, sizeof(topic));
+    }
+
+    // Not connected yet or the last batch is still waiting, try again on a later poll
+    if (!MqttSubmitBackgroundPublish(topic, strlen(topic), batch, batch_length, MQTTQoS0, false))
+    {
+        return false;
+    }
+
+    bucket--;
+    dropped -= batch_dropped;
+    batch_length = 0;
+    batch_lines = 0;
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static void LogMqttDrop(void)
+{
+    dropped += batch_lines;
+    batch_length = 0;
+    batch_lines = 0;
+}
@@ -0,0 +1,63 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file log_mqtt.h
+* @brief Public functions in this module file are NOT thread-safe, only LogTask calls them
+*
+* Sends warnings and errors to <client id>/log. Lines are gathered into batches of up to MQTT_PAYLOAD_BUFFER_SIZE
+* bytes, one publish each, limited by a token bucket. Publishes are background ones (see MqttSubmitBackgroundPublish),
+* so they never delay button or LED traffic. Lines that cannot be sent are dropped and counted, the count opens the
+* next batch.
+*/
+#ifndef _LOG_MQTT_H
+#define _LOG_MQTT_H
+
+// standard includes
+#include <stdint.h>
+#include <stddef.h>
+
+// alert-panel includes
+#include "log.h"
+
+/**
+ * @brief Lowest level sent, lower levels only go to stdio
+ *
+ */
+#define LOG_MQTT_LEVEL  LOG_LEVEL_WARN
+
+/**
+ * @brief Adds a line to the batch, sending the batch first if the line does not fit
+ *
+ * @param line
+ * @param length
+ */
+void LogMqttWrite(const char *line, size_t length);
+
+/**
+ * @brief Sends the batch once its oldest line has waited LOG_MQTT_BATCH_PERIOD, call at least every LOG_DRAIN_PERIOD
+ *
+ */
+void LogMqttPoll(void);
+
+#endif //_LOG_MQTT_H
@@ -0,0 +1,226 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file log_msg.c
+* @brief
+*/
+#include "log_msg.h"
+
+// standard includes
+#include <string.h>
+#include <stdio.h>
+
+// tiny-json includes
+#include "tiny-json.h"
+
+// alert-panel includes
+#include "led_msg.h"
+#include "util.h"
+#include "alert_panel_config.h"
+
+// log lines: from alert-panel to broker (publish)
+#define LOG_SINK_TOPIC      MQTT_CLIENT_ID "/log"
+
+// crash record of the last run: from alert-panel to broker (publish)
+#define LOG_CRASH_TOPIC     MQTT_CLIENT_ID "/crash"
+
+// log levels: from broker to alert-panel (subscription)
+#define LOG_LEVEL_TOPIC     MQTT_CLIENT_ID "/log/level"
+
+/**
+ * @brief Appends a crash log entry as a json string
+ *
+ * @param entry
+ * @param tokenized
+ * @param out
+ * @param out_size
+ * @return int characters written, or out_size or more if it did not fit
+ */
+static int LogMsgCrashEntryBuild(const CrashLogEntry_t *entry, bool tokenized, char *out, size_t out_size);
+
+/*-----------------------------------------------------------*/
+
+void LogMsgBuildSinkTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, LOG_SINK_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+void LogMsgBuildLevelTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, LOG_LEVEL_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+bool LogMsgIsLevelTopic(const char *topic, size_t topic_length)
+{
+    return topic_length == strlen(LOG_LEVEL_TOPIC) &&
+           strncmp(topic, LOG_LEVEL_TOPIC, topic_length) == 0;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LogMsgParseLevelPayload(LogMsgLevelParams_t *params, uint8_t *count, const char *payload, size_t payload_length)
+{
+    // Parsed in the buffer every command on the led monitor task shares
+    json_t const *json_obj = LedMsgJsonCreate(payload, payload_length);
+
+    if (!json_obj || json_getType(json_obj) != JSON_OBJ)
+    {
+        LogPrintError("Failed to create json object\n");
+        return false;
+    }
+
+    *count = 0;
+
+    for (json_t const *prop = json_getChild(json_obj); prop != NULL; prop = json_getSibling(prop))
+    {
+        const char *module = json_getName(prop);
+
+        if (*count >= LOG_MSG_LEVELS)
+        {
+            LogPrintError("More than %u log levels\n", LOG_MSG_LEVELS);
+            return false;
+        }
+
+        if (json_getType(prop) != JSON_TEXT || strlen(module) >= LOG_MODULE_NAME_SIZE ||
+            !LogLevelFromName(json_getValue(prop), &params[*count].level))
+        {
+            LogPrintError("Invalid level for module %s\n", module);
+            return false;
+        }
+
+        strcpy(params[*count].module, module);
+        (*count)++;
+    }
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+void LogMsgBuildCrashTopic(char *topic_buffer, size_t buffer_size)
+{
+    snprintf(topic_buffer, buffer_size, LOG_CRASH_TOPIC);
+}
+
+/*-----------------------------------------------------------*/
+
+void LogMsgBuildCrashPayload(const CrashRecord_t *record, char *payload_buffer, size_t buffer_size)
+{
+    // Entries of both cores, oldest first
+    const CrashLogEntry_t *entries[configNUMBER_OF_CORES * CRASH_LOG_ENTRIES];
+    uint8_t count = 0;
+
+    for (uint8_t core = 0; core < configNUMBER_OF_CORES; core++)
+    {
+        for (uint8_t i = 0; i < CRASH_LOG_ENTRIES; i++)
+        {
+            const CrashLogEntry_t *entry = &record->log[core][i];
+
+            if (entry->length == 0)
+            {
+                continue;
+            }
+
+            uint8_t j = count++;
+
+            for (; j > 0 && (int32_t)(entries[j - 1]->time_us - entry->time_us) > 0; j--)
+            {
+                entries[j] = entries[j - 1];
+            }
+
+            entries[j] = entry;
+        }
+    }
+
+    // Leave out the oldest entries until the payload fits
+    for (uint8_t first = 0; first <= count; first++)
+    {
+        size_t length = snprintf(payload_buffer, buffer_size,
+                                 "{\"reason\":\"%s\",\"task\":\"%s\",\"core\":%u,\"uptime_ms\":%lu,"
+                                 "\"heap_free\":%lu,\"heap_min\":%lu,\"log\":[",
+                                 CrashReasonName(record->reason), record->task, record->core,
+                                 (unsigned long)record->uptime_ms, (unsigned long)record->heap_free,
+                                 (unsigned long)record->heap_min);
+
+        for (uint8_t i = first; i < count && length < buffer_size; i++)
+        {
+            if (i > first)
+            {
+                payload_buffer[length++] = ',';
+            }
+
+            if (length < buffer_size)
+            {
+                length += LogMsgCrashEntryBuild(entries[i], record->tokenized, payload_buffer + length,
+                                                buffer_size - length);
+            }
+        }
+
+        if (length + 2 < buffer_size)
+        {
+            snprintf(payload_buffer + length, buffer_size - length, "]}");
+            return;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static int LogMsgCrashEntryBuild(const CrashLogEntry_t *entry, bool tokenized, char *out, size_t out_size)
+{
+    // Escaped text or '$' and base64
+    char text[(CRASH_LOG_ENTRY_SIZE * 2) + 1];
+    size_t length = 0;
+    uint8_t entry_length = entry->length < CRASH_LOG_ENTRY_SIZE ? entry->length : CRASH_LOG_ENTRY_SIZE;
+
+    if (tokenized)
+    {
+        text[0] = '$';
+        BytesToBase64(text + 1, sizeof(text) - 1, entry->data, entry_length);
+        return snprintf(out, out_size, "\"%s\"", text);
+    }
+
+    for (uint8_t i = 0; i < entry_length; i++)
+    {
+        char c = (char)entry->data[i];
+
+        if (c == '"' || c == '\\')
+        {
+            text[length++] = '\\';
+        }
+        else if ((uint8_t)c < ' ')
+        {
+            continue; // The trailing newline and any other control characters
+        }
+
+        text[length++] = c;
+    }
+
+    text[length] = '\0';
+    return snprintf(out, out_size, "\"%s\"", text);
+}
@@ -0,0 +1,113 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file log_msg.h
+* @brief Public functions in this module file are NOT thread-safe
+*/
+#ifndef _LOG_MSG_H
+#define _LOG_MSG_H
+
+// standard includes
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// alert-panel includes
+#include "crash.h"
+#include "log.h"
+
+/**
+ * @brief Most modules set by one log level message
+ *
+ */
+#define LOG_MSG_LEVELS  8
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    char module[LOG_MODULE_NAME_SIZE];
+    uint8_t level;
+}
+LogMsgLevelParams_t;
+
+/**
+ * @brief Topic of the MQTT log sink
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void LogMsgBuildSinkTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void LogMsgBuildLevelTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief
+ *
+ * @param topic
+ * @param topic_length
+ * @return true if topic is the log level topic
+ * @return false
+ */
+bool LogMsgIsLevelTopic(const char *topic, size_t topic_length);
+
+/**
+ * @brief Parses a log level payload, e.g. {"all":"warn","keypad":"debug"}, properties are applied in order
+ *
+ * @param params array of LOG_MSG_LEVELS
+ * @param count number of params filled
+ * @param payload
+ * @param payload_length
+ * @return true
+ * @return false
+ */
+bool LogMsgParseLevelPayload(LogMsgLevelParams_t *params, uint8_t *count, const char *payload, size_t payload_length);
+
+/**
+ * @brief
+ *
+ * @param topic_buffer
+ * @param buffer_size
+ */
+void LogMsgBuildCrashTopic(char *topic_buffer, size_t buffer_size);
+
+/**
+ * @brief Builds the crash record payload, the oldest log entries are left out if they do not fit
+ * Tokenized log entries are given as '$' base64 lines, for scripts/log_decode.py
+ *
+ * @param record
+ * @param payload_buffer
+ * @param buffer_size
+ */
+void LogMsgBuildCrashPayload(const CrashRecord_t *record, char *payload_buffer, size_t buffer_size);
+
+#endif //_LOG_MSG_H
@@ -0,0 +1,136 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file log_output.c
+* @brief
+*/
+#include "log_output.h"
+
+// standard includes
+#include <stdio.h>
+#include <string.h>
+
+#ifdef LOG_OUTPUT_UART
+// pico-sdk includes
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+
+/**
+ * @brief
+ *
+ */
+#define LOG_OUTPUT_UART_INSTANCE    uart0
+#define LOG_OUTPUT_UART_TX_PIN      0
+#define LOG_OUTPUT_UART_BAUD        921600
+#endif
+
+/**
+ * @brief Filled batch and, with LOG_OUTPUT_UART, the one DMA is sending
+ *
+ */
+#ifdef LOG_OUTPUT_UART
+static char batches[2][LOG_OUTPUT_BATCH_SIZE];
+#else
+static char batches[1][LOG_OUTPUT_BATCH_SIZE];
+#endif
+
+/**
+ * @brief
+ *
+ */
+static uint8_t batch_index = 0;
+
+/**
+ * @brief
+ *
+ */
+static size_t batch_length = 0;
+
+#ifdef LOG_OUTPUT_UART
+/**
+ * @brief
+ *
+ */
+static int dma_channel;
+#endif
+
+/*-----------------------------------------------------------*/
+
+void LogOutputInit(void)
+{
+#ifdef LOG_OUTPUT_UART
+    uart_init(LOG_OUTPUT_UART_INSTANCE, LOG_OUTPUT_UART_BAUD);
+    gpio_set_function(LOG_OUTPUT_UART_TX_PIN, GPIO_FUNC_UART);
+    dma_channel = dma_claim_unused_channel(true);
+    dma_channel_config config = dma_channel_get_default_config(dma_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, uart_get_dreq(LOG_OUTPUT_UART_INSTANCE, true));
+    dma_channel_configure(dma_channel, &config, &uart_get_hw(LOG_OUTPUT_UART_INSTANCE)->dr, NULL, 0, false);
+#endif
+}
+
+/*-----------------------------------------------------------*/
+
+size_t LogOutputSpace(void)
+{
+    return LOG_OUTPUT_BATCH_SIZE - batch_length;
+}
+
+/*-----------------------------------------------------------*/
+
+void LogOutputWrite(const char *data, size_t length)
+{
+    length = length < LogOutputSpace() ? length : LogOutputSpace();
+    memcpy(&batches[batch_index][batch_length], data, length);
+    batch_length += length;
+}
+
+/*-----------------------------------------------------------*/
+
+bool LogOutputFlush(void)
+{
+    if (batch_length == 0)
+    {
+        return false;
+    }
+
+#ifdef LOG_OUTPUT_UART
+    if (dma_channel_is_busy(dma_channel))
+    {
+        return false;
+    }
+
+    dma_channel_transfer_from_buffer_now(dma_channel, batches[batch_index], batch_length);
+    batch_index ^= 1;
+#else
+    // One stdio write per batch, rather than one per line
+    fwrite(batches[batch_index], 1, batch_length, stdout);
+    fflush(stdout);
+#endif
+    batch_length = 0;
+    return true;
+}
@@ -0,0 +1,74 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file log_output.h
+* @brief Public functions in this module file are NOT thread-safe, only LogTask calls them
+*
+* Gathers log lines into a batch that is written in one go: to USB CDC through stdio, or with LOG_OUTPUT_UART to a
+* UART by DMA. With DMA the next batch fills while the last one is sent.
+*/
+#ifndef _LOG_OUTPUT_H
+#define _LOG_OUTPUT_H
+
+// standard includes
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @brief Bytes per batch, there are two with LOG_OUTPUT_UART
+ *
+ */
+#define LOG_OUTPUT_BATCH_SIZE   1024
+
+/**
+ * @brief
+ *
+ */
+void LogOutputInit(void);
+
+/**
+ * @brief Bytes the batch can still take
+ *
+ * @return size_t
+ */
+size_t LogOutputSpace(void);
+
+/**
+ * @brief Adds to the batch, only as much as LogOutputSpace() allows
+ *
+ * @param data
+ * @param length
+ */
+void LogOutputWrite(const char *data, size_t length);
+
+/**
+ * @brief Sends the batch, unless the last one is still being sent by DMA, then it stays for a later call
+ *
+ * @return true if a batch was sent
+ * @return false if the batch was empty or has to wait
+ */
+bool LogOutputFlush(void);
+
+#endif //_LOG_OUTPUT_H
@@ -0,0 +1,228 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file log_token.h
+* @brief Tokenized logging (LOG_TOKENIZED), the format string of each log call is replaced by a 32 bit token at build time
+* Public functions in this module file are thread-safe
+*
+* Each call site stores its format string and file in the .log_tokens section, which src/log_tokens.ld keeps out of flash.
+* At run time only the token, time, level, core and raw arguments are packed into a record; LogTask writes each record
+* as a '$' prefixed base64 line. scripts/log_decode.py rebuilds the messages from those lines and the ELF.
+*/
+#ifndef _LOG_TOKEN_H
+#define _LOG_TOKEN_H
+
+// standard includes
+#include <stdint.h>
+
+/**
+ * @brief Characters of a format string covered by the token, longer formats differing only after this may collide
+ * Keep in step with HASH_LENGTH in scripts/log_decode.py
+ *
+ */
+#define LOG_TOKEN_HASH_LENGTH   80
+
+/**
+ * @brief Token of messages formatted at run time, its arguments are the module and the formatted text
+ *
+ */
+#define LOG_TOKEN_TEXT  0
+
+/**
+ * @brief Argument encodings, picked from each argument's type (after promotion)
+ *
+ */
+#define LOG_ARG_INT     0 // 32 bit integers, chars and pointers, zigzag varint
+#define LOG_ARG_INT64   1 // zigzag varint
+#define LOG_ARG_DOUBLE  2 // 8 bytes
+#define LOG_ARG_STRING  3 // length byte then the characters, not terminated
+
+/**
+ * @brief Most arguments of a tokenized log call
+ *
+ */
+#define LOG_ARG_MAX     14
+
+/**
+ * @brief 65599 hash of the first LOG_TOKEN_HASH_LENGTH characters of a string literal and its length, folded to a constant
+ * by the compiler: length + s[0] * 65599 + s[1] * 65599^2 + ...
+ *
+ */
+#define LOG_TOKEN_CHAR(s, i, k) \
+    ((i) < sizeof(s) - 1 ? (uint32_t)(uint8_t)(s)[(i) < sizeof(s) - 1 ? (i) : 0] * (k) : 0u)
+#define LOG_TOKEN(s) ((uint32_t)(sizeof(s) - 1) + \
+    LOG_TOKEN_CHAR(s, 0, 0x0001003fu) + \
+    LOG_TOKEN_CHAR(s, 1, 0x007e0f81u) + \
+    LOG_TOKEN_CHAR(s, 2, 0x2e86d0bfu) + \
+    LOG_TOKEN_CHAR(s, 3, 0x43ec5f01u) + \
+    LOG_TOKEN_CHAR(s, 4, 0x162c613fu) + \
+    LOG_TOKEN_CHAR(s, 5, 0xd62aee81u) + \
+    LOG_TOKEN_CHAR(s, 6, 0xa311b1bfu) + \
+    LOG_TOKEN_CHAR(s, 7, 0xd319be01u) + \
+    LOG_TOKEN_CHAR(s, 8, 0xb156c23fu) + \
+    LOG_TOKEN_CHAR(s, 9, 0x6698cd81u) + \
+    LOG_TOKEN_CHAR(s, 10, 0x0d1b92bfu) + \
+    LOG_TOKEN_CHAR(s, 11, 0xcc881d01u) + \
+    LOG_TOKEN_CHAR(s, 12, 0x7280233fu) + \
+    LOG_TOKEN_CHAR(s, 13, 0x50c7ac81u) + \
+    LOG_TOKEN_CHAR(s, 14, 0x8da473bfu) + \
+    LOG_TOKEN_CHAR(s, 15, 0x4f377c01u) + \
+    LOG_TOKEN_CHAR(s, 16, 0xfaa8843fu) + \
+    LOG_TOKEN_CHAR(s, 17, 0x33b78b81u) + \
+    LOG_TOKEN_CHAR(s, 18, 0x45ac54bfu) + \
+    LOG_TOKEN_CHAR(s, 19, 0x7a27db01u) + \
+    LOG_TOKEN_CHAR(s, 20, 0xeacfe53fu) + \
+    LOG_TOKEN_CHAR(s, 21, 0xae686a81u) + \
+    LOG_TOKEN_CHAR(s, 22, 0x563335bfu) + \
+    LOG_TOKEN_CHAR(s, 23, 0x6c593a01u) + \
+    LOG_TOKEN_CHAR(s, 24, 0xe3f6463fu) + \
+    LOG_TOKEN_CHAR(s, 25, 0x5fda4981u) + \
+    LOG_TOKEN_CHAR(s, 26, 0xe03916bfu) + \
+    LOG_TOKEN_CHAR(s, 27, 0x44cb9901u) + \
+    LOG_TOKEN_CHAR(s, 28, 0x871ba73fu) + \
+    LOG_TOKEN_CHAR(s, 29, 0xe70d2881u) + \
+    LOG_TOKEN_CHAR(s, 30, 0x04bdf7bfu) + \
+    LOG_TOKEN_CHAR(s, 31, 0x227ef801u) + \
+    LOG_TOKEN_CHAR(s, 32, 0x7540083fu) + \
+    LOG_TOKEN_CHAR(s, 33, 0xe3010781u) + \
+    LOG_TOKEN_CHAR(s, 34, 0xe4c1d8bfu) + \
+    LOG_TOKEN_CHAR(s, 35, 0x24735701u) + \
+    LOG_TOKEN_CHAR(s, 36, 0x4f63693fu) + \
+    LOG_TOKEN_CHAR(s, 37, 0xf2b5e681u) + \
+    LOG_TOKEN_CHAR(s, 38, 0xa144b9bfu) + \
+    LOG_TOKEN_CHAR(s, 39, 0x69a8b601u) + \
+    LOG_TOKEN_CHAR(s, 40, 0xb685ca3fu) + \
+    LOG_TOKEN_CHAR(s, 41, 0xb52bc581u) + \
+    LOG_TOKEN_CHAR(s, 42, 0x5b469abfu) + \
+    LOG_TOKEN_CHAR(s, 43, 0x111f1501u) + \
+    LOG_TOKEN_CHAR(s, 44, 0x4ba72b3fu) + \
+    LOG_TOKEN_CHAR(s, 45, 0xc962a481u) + \
+    LOG_TOKEN_CHAR(s, 46, 0x33c77bbfu) + \
+    LOG_TOKEN_CHAR(s, 47, 0x39d67401u) + \
+    LOG_TOKEN_CHAR(s, 48, 0xafc78c3fu) + \
+    LOG_TOKEN_CHAR(s, 49, 0xce5a8381u) + \
+    LOG_TOKEN_CHAR(s, 50, 0x4bc75cbfu) + \
+    LOG_TOKEN_CHAR(s, 51, 0x02ced301u) + \
+    LOG_TOKEN_CHAR(s, 52, 0x83e6ed3fu) + \
+    LOG_TOKEN_CHAR(s, 53, 0x63136281u) + \
+    LOG_TOKEN_CHAR(s, 54, 0xc4463dbfu) + \
+    LOG_TOKEN_CHAR(s, 55, 0x8b083201u) + \
+    LOG_TOKEN_CHAR(s, 56, 0x69054e3fu) + \
+    LOG_TOKEN_CHAR(s, 57, 0x268d4181u) + \
+    LOG_TOKEN_CHAR(s, 58, 0xbe441ebfu) + \
+    LOG_TOKEN_CHAR(s, 59, 0xf1829101u) + \
+    LOG_TOKEN_CHAR(s, 60, 0x0022af3fu) + \
+    LOG_TOKEN_CHAR(s, 61, 0xb7c82081u) + \
+    LOG_TOKEN_CHAR(s, 62, 0x5ac0ffbfu) + \
+    LOG_TOKEN_CHAR(s, 63, 0x553df001u) + \
+    LOG_TOKEN_CHAR(s, 64, 0xea3f103fu) + \
+    LOG_TOKEN_CHAR(s, 65, 0xb5c3ff81u) + \
+    LOG_TOKEN_CHAR(s, 66, 0xbabce0bfu) + \
+    LOG_TOKEN_CHAR(s, 67, 0xd53a4f01u) + \
+    LOG_TOKEN_CHAR(s, 68, 0xc85a713fu) + \
+    LOG_TOKEN_CHAR(s, 69, 0xbf80de81u) + \
+    LOG_TOKEN_CHAR(s, 70, 0xff37c1bfu) + \
+    LOG_TOKEN_CHAR(s, 71, 0x9077ae01u) + \
+    LOG_TOKEN_CHAR(s, 72, 0x3b74d23fu) + \
+    LOG_TOKEN_CHAR(s, 73, 0x73febd81u) + \
+    LOG_TOKEN_CHAR(s, 74, 0x4931a2bfu) + \
+    LOG_TOKEN_CHAR(s, 75, 0xa5f60d01u) + \
+    LOG_TOKEN_CHAR(s, 76, 0xe48e333fu) + \
+    LOG_TOKEN_CHAR(s, 77, 0x723d9c81u) + \
+    LOG_TOKEN_CHAR(s, 78, 0xb9aa83bfu) + \
+    LOG_TOKEN_CHAR(s, 79, 0x34b56c01u))
+
+/**
+ * @brief
+ *
+ */
+#define LOG_ARG_TYPE(arg) _Generic((arg) + 0, \
+    long long: LOG_ARG_INT64, \
+    unsigned long long: LOG_ARG_INT64, \
+    long: (sizeof(long) > 4 ? LOG_ARG_INT64 : LOG_ARG_INT), \
+    unsigned long: (sizeof(long) > 4 ? LOG_ARG_INT64 : LOG_ARG_INT), \
+    float: LOG_ARG_DOUBLE, \
+    double: LOG_ARG_DOUBLE, \
+    char *: LOG_ARG_STRING, \
+    const char *: LOG_ARG_STRING, \
+    default: LOG_ARG_INT)
+
+/**
+ * @brief Number of arguments, 0-LOG_ARG_MAX
+ *
+ */
+#define LOG_ARG_COUNT(...) LOG_ARG_COUNT_(0, ##__VA_ARGS__, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_ARG_COUNT_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, n, ...) n
+
+/**
+ * @brief Encoding of each argument, 2 bits each from the first argument up
+ *
+ */
+#define LOG_ARG_TYPES(...) LOG_ARG_TYPES_N(LOG_ARG_COUNT(__VA_ARGS__), ##__VA_ARGS__)
+#define LOG_ARG_TYPES_N(n, ...) LOG_ARG_TYPES_N_(n, ##__VA_ARGS__)
+#define LOG_ARG_TYPES_N_(n, ...) LOG_ARG_TYPES_##n(__VA_ARGS__)
+#define LOG_ARG_TYPES_0() 0u
+#define LOG_ARG_TYPES_1(a) LOG_ARG_TYPE(a)
+#define LOG_ARG_TYPES_2(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_1(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_3(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_2(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_4(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_3(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_5(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_4(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_6(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_5(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_7(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_6(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_8(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_7(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_9(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_8(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_10(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_9(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_11(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_10(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_12(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_11(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_13(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_12(__VA_ARGS__) << 2))
+#define LOG_ARG_TYPES_14(a, ...) (LOG_ARG_TYPE(a) | (LOG_ARG_TYPES_13(__VA_ARGS__) << 2))
+
+/**
+ * @brief Stores the format in .log_tokens and logs its token with the arguments, message must be a string literal
+ *
+ */
+#define LOG_TOKEN_PRINT(module, level, message, ...) \
+    do \
+    { \
+        static const char log_token_entry[] __attribute__((section(".log_tokens"), used)) = \
+            "\xff" __FILE__ "\0" message; \
+        LogTokenPrint(module, level, LOG_TOKEN(message), \
+                      LOG_ARG_COUNT(__VA_ARGS__) | (LOG_ARG_TYPES(__VA_ARGS__) << 4), ##__VA_ARGS__); \
+    } \
+    while (0)
+
+/**
+ * @brief Packs a tokenized log record and queues it for LogTask if module's level allows it, use through the LogPrint*
+ * macros
+ *
+ * @param module
+ * @param level LOG_LEVEL_*
+ * @param token
+ * @param types argument count in the low 4 bits, then LOG_ARG_* of each argument
+ * @param ...
+ * @return int
+ */
+int LogTokenPrint(LogModule_t *module, uint8_t level, uint32_t token, uint32_t types, ...);
+
+#endif //_LOG_TOKEN_H
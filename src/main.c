@@ -38,16 +38,22 @@
 // alert-panel includes
 #include "activity_led.h"
 #include "button_monitor.h"
+#include "crash.h"
+#include "diag.h"
 #include "keypad.h"
 #include "led_monitor.h"
 #include "log.h"
 #include "mqtt.h"
+#include "rtos_manifest.h"
+#include "storage.h"
+#include "supervisor.h"
 #include "system.h"
 #include "wifi.h"
 #include "alert_panel_config.h"
 
 // Core 0 priorities
 #define PRIORITY_LAUNCH             ( tskIDLE_PRIORITY + 1U )
+#define PRIORITY_STORAGE            ( tskIDLE_PRIORITY + 1U ) // Flash writes wait until the keypad is idle
 #define PRIORITY_ACTIVITY_LED       ( tskIDLE_PRIORITY + 2U )
 #define PRIORITY_LOG                ( tskIDLE_PRIORITY + 3U )
 #define PRIORITY_LED_MONITOR        ( tskIDLE_PRIORITY + 4U )
@@ -57,6 +63,18 @@
 // Core 1 priorities
 #define PRIORITY_MQTT               ( tskIDLE_PRIORITY + 1U ) // Dedicated core for comms
 
+/**
+ * @brief
+ *
+ */
+static StackType_t launch_task_stack[LAUNCH_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t launch_task_buffer;
+
 /**
  * @brief
  *
@@ -77,16 +95,22 @@ static void launch_task(void *params)
     // 4) Start mqtt service task
     MqttInit();
     MqttTaskCreate(PRIORITY_MQTT, AFFINITY_CORE_1);
-    // 5) Start keypad task
+    // 5) Start keypad task, after the storage task that writes its scenes, bindings and rules
+    StorageInit();
+    StorageTaskCreate(PRIORITY_STORAGE, AFFINITY_CORE_0);
     KeypadInit();
     KeypadTaskCreate(PRIORITY_KEYPAD, AFFINITY_CORE_0);
     // 5) Start led & button monitoring
     ButtonMonitorTaskCreate(PRIORITY_BUTTON_MONITOR, AFFINITY_CORE_0);
     LedMonitorTaskCreate(PRIORITY_LED_MONITOR, AFFINITY_CORE_0);
 
-    // Watchdog for hangs
+    // 6) Watchdog for hangs, fed while every supervised task checks in
+    SupervisorStart();
+
     while (true)
     {
+        SupervisorPoll();
+        DiagPoll();
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
 }
@@ -100,13 +124,16 @@ int main(void)
 {
     // Init stdio
     stdio_init_all();
+    // Before anything logs, the crash record of the last run is still in place
+    CrashInit();
 #ifdef DEBUG
     sleep_ms(5000); // Allow for usb connection for debugging purposes
     printf("Debug build\n");
 #endif
     printf("Starting alert-panel...\n");
     // Create launch task
-    xTaskCreatePinnedToCore(launch_task, "LaunchTask", configMINIMAL_STACK_SIZE, NULL, PRIORITY_LAUNCH, NULL, AFFINITY_CORE_0);
+    xTaskCreateStaticPinnedToCore(launch_task, "LaunchTask", LAUNCH_TASK_STACK_DEPTH, NULL, PRIORITY_LAUNCH,
+                                  launch_task_stack, &launch_task_buffer, NULL, AFFINITY_CORE_0);
     // Start scheduler
     vTaskStartScheduler();
 }
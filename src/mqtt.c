@@ -41,13 +41,17 @@
 // FreeRTOS-Kernel includes
 #include "task.h"
 #include "queue.h"
+#include "semphr.h"
 
 // coreMQTT includes
 #include "transport_interface.h"
 
 // alert-panel includes
 #include "activity_led.h"
+#include "diag.h"
 #include "log.h"
+#include "rtos_manifest.h"
+#include "supervisor.h"
 #include "system.h"
 #include "util.h"
 
@@ -57,6 +61,18 @@
  */
 #define SEND_RECV_FAILED    (-1)
 
+/**
+ * @brief Outstanding QoS 1/2 publishes tracked for ack latency, slot is packet id modulo this
+ *
+ */
+#define MQTT_ACK_TIMING_SLOTS   16
+
+/**
+ * @brief Longest time (ms) between loops before the supervisor restarts the panel, longer than a broker connect
+ *
+ */
+#define MQTT_HEARTBEAT_DEADLINE (30 * 1000)
+
 /**
  * @brief
  *
@@ -95,9 +111,21 @@ typedef struct
     MqttMessage_t message;
     MQTTQoS_t qos;
     bool retain;
+    uint64_t submitted_us;
 }
 MqttPublishData_t;
 
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    uint16_t packet_id;
+    uint64_t sent_us;
+}
+MqttAckTiming_t;
+
 /**
  * @brief
  *
@@ -135,9 +163,12 @@ MqttCommandType_t;
 typedef struct
 {
     MqttCommandType_t type;
-    MqttConnectData_t connect;
-    MqttPublishData_t publish;
-    MqttSubscribeData_t subscribe;
+    union // Only one is used per command, keeps the command_queue small
+    {
+        MqttConnectData_t connect;
+        MqttPublishData_t publish;
+        MqttSubscribeData_t subscribe;
+    };
 }
 MqttCommand_t;
 
@@ -167,18 +198,103 @@ static TransportInterface_t transport_interface;
  */
 static QueueHandle_t command_queue;
 
+/**
+ * @brief
+ *
+ */
+static uint8_t command_queue_storage[MQTT_COMMAND_QUEUE_LENGTH * sizeof(MqttCommand_t)];
+
+/**
+ * @brief
+ *
+ */
+static StaticQueue_t command_queue_buffer;
+
 /**
  * @brief
  *
  */
 static QueueHandle_t subscription_queue;
 
+/**
+ * @brief
+ *
+ */
+static uint8_t subscription_queue_storage[MQTT_SUBSCRIPTION_QUEUE_LENGTH * sizeof(MqttMessage_t)];
+
+/**
+ * @brief
+ *
+ */
+static StaticQueue_t subscription_queue_buffer;
+
+/**
+ * @brief A single background publish, sent only once command_queue is empty
+ *
+ */
+static QueueHandle_t background_queue;
+
+/**
+ * @brief
+ *
+ */
+static uint8_t background_queue_storage[MQTT_BACKGROUND_QUEUE_LENGTH * sizeof(MqttPublishData_t)];
+
+/**
+ * @brief
+ *
+ */
+static StaticQueue_t background_queue_buffer;
+
+/**
+ * @brief Background publish being submitted, built here rather than on the submitting task's stack, guarded by
+ * background_mutex
+ *
+ */
+static MqttPublishData_t background_publish;
+
+/**
+ * @brief
+ *
+ */
+static SemaphoreHandle_t background_mutex;
+
+/**
+ * @brief
+ *
+ */
+static StaticSemaphore_t background_mutex_buffer;
+
+/**
+ * @brief
+ *
+ */
+static StackType_t mqtt_task_stack[MQTT_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t mqtt_task_buffer;
+
 /**
  * @brief
  *
  */
 static MqttConnectionState_t connection_state = NOT_CONNECTED;
 
+/**
+ * @brief Updated by MqttTask, read by others under a critical section
+ *
+ */
+static MqttPublishStats_t publish_stats;
+
+/**
+ * @brief Only touched by MqttTask (the event callback runs from MQTT_ProcessLoop)
+ *
+ */
+static MqttAckTiming_t ack_timings[MQTT_ACK_TIMING_SLOTS];
+
 /**
  * @brief
  *
@@ -276,13 +392,24 @@ static void MqttSubscribe(const char *topic,
  * @param payload_length
  * @param qos
  * @param retain
+ * @param submitted_us
  */
 static void MqttPublish(const char *topic,
                         size_t topic_length,
                         const char *payload,
                         size_t payload_length,
                         MQTTQoS_t qos,
-                        bool retain);
+                        bool retain,
+                        uint64_t submitted_us);
+
+/**
+ * @brief Adds a sample to a latency total and max
+ *
+ * @param total
+ * @param max
+ * @param sample_us
+ */
+static void MqttStatsAdd(uint64_t *total, uint32_t *max, uint64_t sample_us);
 
 /*-----------------------------------------------------------*/
 
@@ -292,28 +419,27 @@ void MqttInit(void)
     memset(&transport_interface, 0, sizeof(transport_interface));
     memset(&network_buffer, 0, sizeof(network_buffer));
     memset(&mqtt_context, 0, sizeof(mqtt_context));
-    command_queue = xQueueCreate(20, sizeof(MqttCommand_t));
-
-    if (command_queue == NULL)
-    {
-        LogPrintFatal("Failed to create command_queue\n");
-        Fault();
-    }
-
-    subscription_queue = xQueueCreate(20, sizeof(MqttMessage_t));
-
-    if (subscription_queue == NULL)
-    {
-        LogPrintFatal("Failed to create subscription_queue\n");
-        Fault();
-    }
+    command_queue = xQueueCreateStatic(MQTT_COMMAND_QUEUE_LENGTH, sizeof(MqttCommand_t), command_queue_storage,
+                                       &command_queue_buffer);
+    vQueueAddToRegistry(command_queue, "command_queue");
+
+    subscription_queue = xQueueCreateStatic(MQTT_SUBSCRIPTION_QUEUE_LENGTH, sizeof(MqttMessage_t),
+                                            subscription_queue_storage, &subscription_queue_buffer);
+    vQueueAddToRegistry(subscription_queue, "subscription_queue");
+
+    background_queue = xQueueCreateStatic(MQTT_BACKGROUND_QUEUE_LENGTH, sizeof(MqttPublishData_t),
+                                          background_queue_storage, &background_queue_buffer);
+    vQueueAddToRegistry(background_queue, "background_queue");
+    background_mutex = xSemaphoreCreateMutexStatic(&background_mutex_buffer);
+    vQueueAddToRegistry(background_mutex, "background_mutex");
 }
 
 /*-----------------------------------------------------------*/
 
 void MqttTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask)
 {
-    xTaskCreatePinnedToCore(MqttTask, "MqttTask", 8192, NULL, priority, NULL, core_affinity_mask);
+    xTaskCreateStaticPinnedToCore(MqttTask, "MqttTask", MQTT_TASK_STACK_DEPTH, NULL, priority, mqtt_task_stack,
+                                  &mqtt_task_buffer, NULL, core_affinity_mask);
 }
 
 /*-----------------------------------------------------------*/
@@ -325,9 +451,12 @@ static void MqttTask()
     memset(&command, 0, sizeof(MqttCommand_t));
     MQTTStatus_t status;
     TickType_t ticks_to_wait = pdMS_TO_TICKS(10);
+    SupervisorRegister(MQTT_HEARTBEAT_DEADLINE);
 
     while (1)
     {
+        SupervisorCheckIn();
+
         if (connection_state == CONNECTED)
         {
             // Call process loop to do any timeout processing/qos operations
@@ -361,7 +490,8 @@ static void MqttTask()
                                 command.publish.message.payload.data,
                                 command.publish.message.payload.length,
                                 command.publish.qos,
-                                command.publish.retain);
+                                command.publish.retain,
+                                command.publish.submitted_us);
                     break;
 
                 case SUBSCRIBE:
@@ -371,6 +501,17 @@ static void MqttTask()
                     break;
             }
         }
+        else if (connection_state == CONNECTED && xQueueReceive(background_queue, &command.publish, 0) == pdTRUE)
+        {
+            // Nothing else was waiting, so the background publish holds nothing up
+            MqttPublish(command.publish.message.topic.data,
+                        command.publish.message.topic.length,
+                        command.publish.message.payload.data,
+                        command.publish.message.payload.length,
+                        command.publish.qos,
+                        command.publish.retain,
+                        command.publish.submitted_us);
+        }
     }
 }
 
@@ -445,6 +586,8 @@ void MqttSubmitConnect(
         LogPrintFatal("Failed to send CONNECT to command_queue\n");
         Fault();
     }
+
+    DiagQueueSent(command_queue);
 }
 
 /*-----------------------------------------------------------*/
@@ -477,12 +620,60 @@ void MqttSubmitPublish(const char *topic,
     command.publish.message.payload.length = payload_length;
     command.publish.qos = qos;
     command.publish.retain = retain;
+    command.publish.submitted_us = GetTimeUs();
 
     if (xQueueSend(command_queue, &command, portMAX_DELAY) != pdTRUE)
     {
         LogPrintFatal("Failed to send PUBLISH to command_queue\n");
         Fault();
     }
+
+    DiagQueueSent(command_queue);
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSubmitBackgroundPublish(const char *topic,
+                                 size_t topic_length,
+                                 const char *payload,
+                                 size_t payload_length,
+                                 MQTTQoS_t qos,
+                                 bool retain)
+{
+    if (topic_length > MQTT_TOPIC_BUFFER_SIZE || payload_length > MQTT_PAYLOAD_BUFFER_SIZE)
+    {
+        return false;
+    }
+
+    if (connection_state != CONNECTED)
+    {
+        return false;
+    }
+
+    // Another task submitting at the same time has the buffer, this one is dropped like one finding the queue full
+    if (xSemaphoreTake(background_mutex, 0) != pdTRUE)
+    {
+        return false;
+    }
+
+    MqttPublishData_t *publish = &background_publish;
+    memset(publish, 0, sizeof(MqttPublishData_t));
+    strncpy(publish->message.topic.data, topic, MQTT_TOPIC_BUFFER_SIZE);
+    publish->message.topic.length = topic_length;
+    memcpy(publish->message.payload.data, payload, payload_length);
+    publish->message.payload.length = payload_length;
+    publish->qos = qos;
+    publish->retain = retain;
+    publish->submitted_us = GetTimeUs();
+    bool sent = xQueueSend(background_queue, publish, 0) == pdTRUE;
+    xSemaphoreGive(background_mutex);
+
+    if (sent)
+    {
+        DiagQueueSent(background_queue);
+    }
+
+    return sent;
 }
 
 /*-----------------------------------------------------------*/
@@ -509,6 +700,8 @@ void MqttSubmitSubscribe(const char *topic,
         LogPrintFatal("Failed to send SUBSCRIBE to command_queue\n");
         Fault();
     }
+
+    DiagQueueSent(command_queue);
 }
 
 /*-----------------------------------------------------------*/
@@ -612,6 +805,23 @@ static void MqttContextInit()
 
 void MqttEventCallback(MQTTContext_t *mqtt_context, MQTTPacketInfo_t *packet_info, MQTTDeserializedInfo_t *deserialized_info)
 {
+    // Final ack of one of our QoS 1/2 publishes
+    if (packet_info->type == MQTT_PACKET_TYPE_PUBACK || packet_info->type == MQTT_PACKET_TYPE_PUBCOMP)
+    {
+        MqttAckTiming_t *timing = &ack_timings[deserialized_info->packetIdentifier % MQTT_ACK_TIMING_SLOTS];
+
+        if (timing->packet_id == deserialized_info->packetIdentifier && timing->packet_id != 0)
+        {
+            uint64_t ack_us = GetTimeUs() - timing->sent_us;
+            LogPrintDebug("Publish acked, id:%u, ack us:%lu\n", timing->packet_id, (uint32_t)ack_us);
+            taskENTER_CRITICAL();
+            publish_stats.acks++;
+            MqttStatsAdd(&publish_stats.ack_us_total, &publish_stats.ack_us_max, ack_us);
+            taskEXIT_CRITICAL();
+            timing->packet_id = 0;
+        }
+    }
+
     if (deserialized_info->pPublishInfo != NULL)
     {
         LogPrintDebug("Received subscribed message, t:'%s', tl:%u, p:'%s', pl:%u\n",
@@ -643,6 +853,8 @@ void MqttEventCallback(MQTTContext_t *mqtt_context, MQTTPacketInfo_t *packet_inf
             LogPrintFatal("Failed to send message to subscription_queue\n");
             Fault();
         }
+
+        DiagQueueSent(subscription_queue);
     }
 }
 
@@ -708,16 +920,16 @@ static int32_t MqttTransportSend(NetworkContext_t *network_context, const void *
     // Send error
     else if (result < 0)
     {
-        LogPrintDebug("Send failed: %s\n", result);
+        LogPrintDebug("Send failed: %li\n", (long)result);
         return SEND_RECV_FAILED;
     }
     // Sent some some data
     else
     {
+        bytes_sent = result;
         char output_hex[(bytes_sent * 3) + 1];
         BytesToHex(output_hex, sizeof(output_hex), buffer, bytes_sent);
-        LogPrintDebug("Sent bytes on socket: %s\n", &output_hex);
-        bytes_sent = result;
+        LogPrintDebug("Sent bytes on socket: %s\n", output_hex);
     }
 
     return bytes_sent;
@@ -738,7 +950,7 @@ static int32_t MqttTransportRecv(NetworkContext_t *network_context, void *buffer
     // Recv error
     else if (result < 0)
     {
-        LogPrintDebug("Recv failed: %s\n", result);
+        LogPrintDebug("Recv failed: %li\n", (long)result);
         return SEND_RECV_FAILED;
     }
     // Got some data
@@ -752,7 +964,7 @@ static int32_t MqttTransportRecv(NetworkContext_t *network_context, void *buffer
         bytes_received = result;
         char output_hex[(bytes_received * 3) + 1];
         BytesToHex(output_hex, sizeof(output_hex), buffer, bytes_received);
-        LogPrintDebug("Recvd %i bytes on socket: %s\n", bytes_received, &output_hex);
+        LogPrintDebug("Recvd %i bytes on socket: %s\n", bytes_received, output_hex);
     }
 
     return bytes_received;
@@ -793,8 +1005,10 @@ static void MqttPublish(const char *topic,
                         const char *payload,
                         size_t payload_length,
                         MQTTQoS_t qos,
-                        bool retain)
+                        bool retain,
+                        uint64_t submitted_us)
 {
+    uint64_t started_us = GetTimeUs();
     // Publish to a topic
     MQTTPublishInfo_t publish_info =
     {
@@ -831,5 +1045,40 @@ static void MqttPublish(const char *topic,
         Fault();
     }
 
-    LogPrintDebug("...publish success\n");
+    // Record latencies, acks are matched up in MqttEventCallback
+    uint64_t sent_us = GetTimeUs();
+    taskENTER_CRITICAL();
+    publish_stats.publishes++;
+    MqttStatsAdd(&publish_stats.queue_us_total, &publish_stats.queue_us_max, started_us - submitted_us);
+    MqttStatsAdd(&publish_stats.send_us_total, &publish_stats.send_us_max, sent_us - started_us);
+    taskEXIT_CRITICAL();
+
+    if (publish_info.qos != MQTTQoS0)
+    {
+        ack_timings[packet_id % MQTT_ACK_TIMING_SLOTS].packet_id = packet_id;
+        ack_timings[packet_id % MQTT_ACK_TIMING_SLOTS].sent_us = sent_us;
+    }
+
+    LogPrintDebug("...publish success, id:%u, queue us:%lu, send us:%lu\n",
+                  packet_id,
+                  (uint32_t)(started_us - submitted_us),
+                  (uint32_t)(sent_us - started_us));
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttPublishStatsGet(MqttPublishStats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = publish_stats;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+static void MqttStatsAdd(uint64_t *total, uint32_t *max, uint64_t sample_us)
+{
+    uint32_t sample = sample_us > UINT32_MAX ? UINT32_MAX : (uint32_t)sample_us;
+    *total += sample;
+    *max = sample > *max ? sample : *max;
 }
@@ -76,6 +76,24 @@ typedef struct
 }
 MqttMessage_t;
 
+/**
+ * @brief Publish latency totals (us) since start, queue is submit to send start, send is the time in MQTT_Publish,
+ * ack is send to PUBACK/PUBCOMP for QoS 1/2
+ *
+ */
+typedef struct
+{
+    uint32_t publishes;
+    uint64_t queue_us_total;
+    uint32_t queue_us_max;
+    uint64_t send_us_total;
+    uint32_t send_us_max;
+    uint32_t acks;
+    uint64_t ack_us_total;
+    uint32_t ack_us_max;
+}
+MqttPublishStats_t;
+
 /**
  * @brief
  *
@@ -140,6 +158,27 @@ void MqttSubmitPublish(const char *topic,
                        MQTTQoS_t qos,
                        bool retain);
 
+/**
+ * @brief Submits a publish that is only sent while no other command is waiting, never blocks
+ * For traffic that must not delay the rest, e.g. logs, one can be waiting at a time
+ *
+ * @param topic
+ * @param topic_length
+ * @param payload
+ * @param payload_length
+ * @param qos
+ * @param retain
+ * @return true
+ * @return false if not connected, too large, the previous background publish is still waiting or another task is
+ * submitting one, nothing is submitted
+ */
+bool MqttSubmitBackgroundPublish(const char *topic,
+                                 size_t topic_length,
+                                 const char *payload,
+                                 size_t payload_length,
+                                 MQTTQoS_t qos,
+                                 bool retain);
+
 /**
  * @brief
  *
@@ -158,4 +197,11 @@ void MqttSubmitSubscribe(const char *topic,
  */
 MqttMessage_t MqttSubscriptionReceive();
 
+/**
+ * @brief Gets the publish latency totals, published in the diag/system message
+ *
+ * @param stats
+ */
+void MqttPublishStatsGet(MqttPublishStats_t *stats);
+
 #endif //_MQTT_H
\ No newline at end of file
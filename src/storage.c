@@ -0,0 +1,333 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file storage.c
+* @brief
+*/
+#include "storage.h"
+
+// standard includes
+#include <string.h>
+
+// pico-sdk includes
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+
+// FreeRTOS-Kernel includes
+#include "task.h"
+#include "semphr.h"
+
+// alert-panel includes
+#include "log.h"
+#include "rtos_manifest.h"
+#include "system.h"
+
+/**
+ * @brief Marks a sector as holding a valid record ('APNL')
+ *
+ */
+#define STORAGE_MAGIC       0x4C4E5041
+
+/**
+ * @brief How long to wait for the other core to be locked out of flash
+ *
+ */
+#define STORAGE_SAFE_EXECUTE_TIMEOUT    1000
+
+/**
+ * @brief Header written at the start of every sector
+ *
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t length;
+    uint16_t checksum;
+}
+StorageHeader_t;
+
+/**
+ * @brief Parameters passed through flash_safe_execute
+ *
+ */
+typedef struct
+{
+    uint32_t offset;
+    StorageHeader_t header;
+    const uint8_t *data;
+}
+StorageWriteData_t;
+
+/**
+ * @brief Flash is programmed a page at a time through this buffer
+ *
+ */
+static uint8_t page_buffer[FLASH_PAGE_SIZE];
+
+/**
+ * @brief Latest record queued for each sector, guarded by pending_mutex
+ *
+ */
+static uint8_t pending_data[STORAGE_SECTOR_COUNT][STORAGE_RECORD_MAX_SIZE];
+
+/**
+ * @brief
+ *
+ */
+static uint16_t pending_length[STORAGE_SECTOR_COUNT];
+
+/**
+ * @brief Bit set per sector with a record waiting, guarded by pending_mutex
+ *
+ */
+static uint32_t pending_sectors;
+
+_Static_assert(STORAGE_SECTOR_COUNT <= 32, "pending_sectors has a bit per sector");
+
+_Static_assert(STORAGE_SECTOR_COUNT == 3, "Update the reserved sector count in src/storage.ld");
+
+/**
+ * @brief Held while a record is queued and through its write, so it cannot change between checksum and program
+ *
+ */
+static SemaphoreHandle_t pending_mutex;
+
+/**
+ * @brief
+ *
+ */
+static StaticSemaphore_t pending_mutex_buffer;
+
+/**
+ * @brief
+ *
+ */
+static TaskHandle_t storage_task_handle;
+
+/**
+ * @brief
+ *
+ */
+static StackType_t storage_task_stack[STORAGE_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t storage_task_buffer;
+
+/**
+ * @brief Writes the queued records, lowest sector first
+ *
+ * @param params
+ */
+static void StorageTask(void *params);
+
+/**
+ * @brief Offset of a sector from the start of flash
+ *
+ * @param sector
+ * @return uint32_t
+ */
+static uint32_t StorageSectorOffset(StorageSector_t sector);
+
+/**
+ * @brief Fletcher-16 checksum of a record
+ *
+ * @param data
+ * @param length
+ * @return uint16_t
+ */
+static uint16_t StorageChecksum(const uint8_t *data, size_t length);
+
+/**
+ * @brief Erases and programs a sector, runs with the other core locked out of flash
+ *
+ * @param params
+ */
+static void StorageWriteUnsafe(void *params);
+
+/*-----------------------------------------------------------*/
+
+void StorageInit(void)
+{
+    pending_sectors = 0;
+    pending_mutex = xSemaphoreCreateMutexStatic(&pending_mutex_buffer);
+    vQueueAddToRegistry(pending_mutex, "pending_mutex");
+}
+
+/*-----------------------------------------------------------*/
+
+void StorageTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask)
+{
+    xTaskCreateStaticPinnedToCore(StorageTask, "StorageTask", STORAGE_TASK_STACK_DEPTH, NULL, priority,
+                                  storage_task_stack, &storage_task_buffer, &storage_task_handle, core_affinity_mask);
+}
+
+/*-----------------------------------------------------------*/
+
+bool StorageRead(StorageSector_t sector, void *data, size_t length)
+{
+    const uint8_t *flash = (const uint8_t *)(XIP_BASE + StorageSectorOffset(sector));
+    StorageHeader_t header;
+    memcpy(&header, flash, sizeof(header));
+
+    if (header.magic != STORAGE_MAGIC || header.length != length)
+    {
+        return false;
+    }
+
+    if (StorageChecksum(flash + sizeof(header), length) != header.checksum)
+    {
+        LogPrintWarn("Storage sector %u checksum mismatch, ignoring it\n", sector);
+        return false;
+    }
+
+    memcpy(data, flash + sizeof(header), length);
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+bool StorageWrite(StorageSector_t sector, const void *data, size_t length)
+{
+    if (sector >= STORAGE_SECTOR_COUNT || length > STORAGE_RECORD_MAX_SIZE)
+    {
+        LogPrintError("Invalid storage write, sector: %u, length: %u\n", sector, length);
+        return false;
+    }
+
+    StorageWriteData_t write_data =
+    {
+        .offset = StorageSectorOffset(sector),
+        .header =
+        {
+            .magic = STORAGE_MAGIC,
+            .length = (uint16_t)length,
+            .checksum = StorageChecksum(data, length)
+        },
+        .data = data
+    };
+    int result = flash_safe_execute(StorageWriteUnsafe, &write_data, STORAGE_SAFE_EXECUTE_TIMEOUT);
+
+    if (result != PICO_OK)
+    {
+        LogPrintError("Storage sector %u write failed with: %i\n", sector, result);
+        return false;
+    }
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+bool StorageWriteQueueSend(StorageSector_t sector, const void *data, size_t length)
+{
+    if (sector >= STORAGE_SECTOR_COUNT || length > STORAGE_RECORD_MAX_SIZE)
+    {
+        LogPrintError("Invalid storage write, sector: %u, length: %u\n", sector, length);
+        return false;
+    }
+
+    // Waits at most for a write in progress, which locks every task out of flash anyway
+    xSemaphoreTake(pending_mutex, portMAX_DELAY);
+    memcpy(pending_data[sector], data, length);
+    pending_length[sector] = (uint16_t)length;
+    pending_sectors |= 1U << sector;
+    xSemaphoreGive(pending_mutex);
+    xTaskNotifyGive(storage_task_handle);
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static void StorageTask(void *params)
+{
+    LogPrintInfo("StorageTask running...\n");
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xSemaphoreTake(pending_mutex, portMAX_DELAY);
+
+        while (pending_sectors != 0)
+        {
+            StorageSector_t sector = (StorageSector_t)__builtin_ctz(pending_sectors);
+            pending_sectors &= pending_sectors - 1;
+            StorageWrite(sector, pending_data[sector], pending_length[sector]);
+        }
+
+        xSemaphoreGive(pending_mutex);
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t StorageSectorOffset(StorageSector_t sector)
+{
+    // Counted back from the end, so adding sectors never moves existing records
+    return PICO_FLASH_SIZE_BYTES - ((sector + 1) * FLASH_SECTOR_SIZE);
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t StorageChecksum(const uint8_t *data, size_t length)
+{
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+
+    return (sum2 << 8) | sum1;
+}
+
+/*-----------------------------------------------------------*/
+
+static void StorageWriteUnsafe(void *params)
+{
+    StorageWriteData_t *write_data = (StorageWriteData_t *)params;
+    size_t total = sizeof(StorageHeader_t) + write_data->header.length;
+    flash_range_erase(write_data->offset, FLASH_SECTOR_SIZE);
+
+    // Program page by page, the header followed by the record
+    for (size_t page = 0; page < total; page += FLASH_PAGE_SIZE)
+    {
+        memset(page_buffer, 0xFF, sizeof(page_buffer));
+
+        for (size_t i = 0; i < FLASH_PAGE_SIZE && (page + i) < total; i++)
+        {
+            size_t pos = page + i;
+            page_buffer[i] = pos < sizeof(StorageHeader_t) ?
+                             ((const uint8_t *)&write_data->header)[pos] :
+                             write_data->data[pos - sizeof(StorageHeader_t)];
+        }
+
+        flash_range_program(write_data->offset + page, page_buffer, FLASH_PAGE_SIZE);
+    }
+}
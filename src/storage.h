@@ -0,0 +1,111 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file storage.h
+* @brief Persistent records in reserved flash sectors at the end of flash
+* StorageWriteQueueSend() is thread-safe, the other public functions in this module file are NOT
+*
+* Writes queued with StorageWriteQueueSend() are made by the storage task, at a low priority, so the task that changed
+* a record never waits for the erase and program. Both cores are still locked out of flash while a write runs.
+*/
+#ifndef _STORAGE_H
+#define _STORAGE_H
+
+// standard includes
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// FreeRTOS-Kernel includes
+#include "FreeRTOS.h"
+
+/**
+ * @brief Reserved flash sectors, one record per sector, allocated backwards from the end of flash
+ *
+ */
+typedef enum
+{
+    STORAGE_SECTOR_SCENES = 0,
+    STORAGE_SECTOR_BINDINGS = 1,
+    STORAGE_SECTOR_RULES = 2,
+    STORAGE_SECTOR_COUNT
+}
+StorageSector_t;
+
+/**
+ * @brief Largest record that fits in a sector (sector size less the record header)
+ *
+ */
+#define STORAGE_RECORD_MAX_SIZE  (4096 - 8)
+
+/**
+ * @brief Initialises the write queue, call before StorageTaskCreate() and before any StorageWriteQueueSend()
+ *
+ */
+void StorageInit(void);
+
+/**
+ * @brief Creates the task that makes the queued writes
+ *
+ * @param priority below that of the tasks queueing writes
+ * @param core_affinity_mask
+ */
+void StorageTaskCreate(UBaseType_t priority, UBaseType_t core_affinity_mask);
+
+/**
+ * @brief Reads the record stored in a sector
+ *
+ * @param sector
+ * @param data
+ * @param length expected record length
+ * @return true
+ * @return false if the sector is blank, corrupt or holds a record of a different length
+ */
+bool StorageRead(StorageSector_t sector, void *data, size_t length);
+
+/**
+ * @brief Erases a sector and writes a record to it
+ * Flash is unavailable to both cores while this runs (tens of ms), so keep writes rare
+ *
+ * @param sector
+ * @param data
+ * @param length
+ * @return true
+ * @return false
+ */
+bool StorageWrite(StorageSector_t sector, const void *data, size_t length);
+
+/**
+ * @brief Copies a record for the storage task to write, replacing any record still waiting for the same sector
+ * Never waits for flash, a write that fails is logged by the storage task
+ *
+ * @param sector
+ * @param data
+ * @param length
+ * @return true
+ * @return false if the sector or length is invalid
+ */
+bool StorageWriteQueueSend(StorageSector_t sector, const void *data, size_t length);
+
+#endif //_STORAGE_H
@@ -0,0 +1,153 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file supervisor.c
+* @brief
+*/
+#include "supervisor.h"
+
+// standard includes
+#include <stdbool.h>
+
+// pico-sdk includes
+#include "hardware/watchdog.h"
+
+// FreeRTOS-Kernel includes
+#include "FreeRTOS.h"
+#include "task.h"
+
+// alert-panel includes
+#include "crash.h"
+#include "log.h"
+#include "system.h"
+#include "util.h"
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    TaskHandle_t task;
+    uint32_t deadline_ms;
+    volatile uint32_t check_in_ms;
+}
+SupervisorTask_t;
+
+/**
+ * @brief Slots below supervised_count are filled and never change, other than their check in time
+ *
+ */
+static SupervisorTask_t supervised[SUPERVISOR_TASKS];
+
+/**
+ * @brief
+ *
+ */
+static volatile uint8_t supervised_count = 0;
+
+/**
+ * @brief Set once a task has missed its deadline, the watchdog is no longer fed
+ *
+ */
+static bool stalled = false;
+
+/*-----------------------------------------------------------*/
+
+void SupervisorRegister(uint32_t deadline_ms)
+{
+    bool registered = false;
+    taskENTER_CRITICAL();
+
+    if (supervised_count < SUPERVISOR_TASKS)
+    {
+        supervised[supervised_count].task = xTaskGetCurrentTaskHandle();
+        supervised[supervised_count].deadline_ms = deadline_ms;
+        supervised[supervised_count].check_in_ms = GetTimeMs();
+        supervised_count++;
+        registered = true;
+    }
+
+    taskEXIT_CRITICAL();
+
+    if (!registered)
+    {
+        LogPrintFatal("More than %u supervised tasks\n", SUPERVISOR_TASKS);
+        Fault();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void SupervisorCheckIn(void)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+    // Each task only writes its own check in time, so no lock is needed
+    for (uint8_t i = 0; i < supervised_count; i++)
+    {
+        if (supervised[i].task == task)
+        {
+            supervised[i].check_in_ms = GetTimeMs();
+            break;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void SupervisorStart(void)
+{
+    // Paused while a debugger halts the cores
+    watchdog_enable(SUPERVISOR_WATCHDOG_TIMEOUT, true);
+}
+
+/*-----------------------------------------------------------*/
+
+void SupervisorPoll(void)
+{
+    if (stalled)
+    {
+        return;
+    }
+
+    uint32_t time_now = GetTimeMs();
+
+    for (uint8_t i = 0; i < supervised_count; i++)
+    {
+        // Signed, as a task may check in after time_now was taken
+        int32_t elapsed = (int32_t)GetElapsedMs(supervised[i].check_in_ms, time_now);
+
+        if (elapsed > (int32_t)supervised[i].deadline_ms)
+        {
+            const char *name = pcTaskGetName(supervised[i].task);
+            LogPrintFatal("%s has not checked in for %lu ms, restarting\n", name, (unsigned long)elapsed);
+            CrashRecordFault(CRASH_TASK_STALL, name);
+            stalled = true;
+            return;
+        }
+    }
+
+    watchdog_update();
+}
@@ -0,0 +1,76 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file supervisor.h
+* @brief SupervisorRegister() and SupervisorCheckIn() are thread-safe, SupervisorStart() and SupervisorPoll() are NOT,
+* only LaunchTask calls them
+*
+* Each long running task registers a heartbeat deadline and checks in from its loop. The hardware watchdog is only fed
+* while every registered task has checked in within its deadline. A task that misses it is recorded in the crash
+* record (see CrashRecordFault) and the watchdog then resets the panel, within SUPERVISOR_WATCHDOG_TIMEOUT.
+*/
+#ifndef _SUPERVISOR_H
+#define _SUPERVISOR_H
+
+// standard includes
+#include <stdint.h>
+
+/**
+ * @brief Most tasks supervised
+ *
+ */
+#define SUPERVISOR_TASKS                8
+
+/**
+ * @brief Time (ms) without a feed before the hardware watchdog resets, at most 8388
+ *
+ */
+#define SUPERVISOR_WATCHDOG_TIMEOUT     5000
+
+/**
+ * @brief Supervises the calling task, which must then check in at least every deadline_ms
+ *
+ * @param deadline_ms longer than the task's longest blocking wait
+ */
+void SupervisorRegister(uint32_t deadline_ms);
+
+/**
+ * @brief Tells the supervisor the calling task is still making progress, call from the task's loop
+ *
+ */
+void SupervisorCheckIn(void);
+
+/**
+ * @brief Starts the hardware watchdog, SupervisorPoll() must then be called at least every second
+ *
+ */
+void SupervisorStart(void);
+
+/**
+ * @brief Feeds the hardware watchdog if every supervised task is within its deadline
+ *
+ */
+void SupervisorPoll(void);
+
+#endif //_SUPERVISOR_H
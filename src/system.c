@@ -31,9 +31,10 @@
 #include "pico/stdlib.h"
 #include "hardware/watchdog.h"
 
-// FreeRTOS-Kernel includes
-#include "semphr.h"
+// alert-panel includes
+#include "crash.h"
 #include "log.h"
+#include "rtos_manifest.h"
 
 /**
  * @brief
@@ -41,33 +42,47 @@
  */
 #define PRIORITY_FAULT   ( 0xFF )
 
+/**
+ * @brief Set by the first Fault(), the fault tasks' storage is only used once
+ *
+ */
+static bool faulted = false;
+
 /**
  * @brief
  *
  */
-typedef struct
-{
-    // task to create
-    TaskFunction_t task_code;
-    const char *name;
-    const uint32_t stack_depth;
-    void *parameters;
-    UBaseType_t priority;
-    TaskHandle_t *created_task;
-    const BaseType_t core_id;
-
-    // process signaling
-    SemaphoreHandle_t affinity_set_signal;
-    SemaphoreHandle_t create_complete_signal;
-}
-TaskData_t;
+static StackType_t fault_task_stacks[configNUMBER_OF_CORES][FAULT_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t fault_task_buffers[configNUMBER_OF_CORES];
+
+/**
+ * @brief Kernel tasks, handed over by the vApplicationGet*TaskMemory() callbacks
+ *
+ */
+static StackType_t idle_task_stacks[configNUMBER_OF_CORES][IDLE_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t idle_task_buffers[configNUMBER_OF_CORES];
 
 /**
  * @brief
  *
- * @param params
  */
-static void TaskCreatePinnedToCoreTask(void *params);
+static StackType_t timer_task_stack[TIMER_TASK_STACK_DEPTH];
+
+/**
+ * @brief
+ *
+ */
+static StaticTask_t timer_task_buffer;
 
 /**
  * @brief
@@ -85,75 +100,40 @@ static void Core1FaultTask(void *params);
 
 /*-----------------------------------------------------------*/
 
-BaseType_t xTaskCreatePinnedToCore(
+BaseType_t xTaskCreateStaticPinnedToCore(
     TaskFunction_t pvTaskCode,
     const char *pcName,
-    const uint32_t usStackDepth,
+    const uint32_t ulStackDepth,
     void *pvParameters,
     UBaseType_t uxPriority,
+    StackType_t *puxStackBuffer,
+    StaticTask_t *pxTaskBuffer,
     TaskHandle_t *pvCreatedTask,
     const BaseType_t xCoreID)
 {
-    // Create a temp task object if none was passed in
-    if (pvCreatedTask == NULL)
+    bool scheduler_running = xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+
+    // Keeps a higher priority task from running before pvCreatedTask is set
+    if (scheduler_running)
     {
-        static TaskHandle_t created_task;
-        pvCreatedTask = &created_task;
+        vTaskSuspendAll();
     }
 
-    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)
+    // The affinity is set before the task is made ready, so it never starts on the other core
+    TaskHandle_t created_task = xTaskCreateStaticAffinitySet(pvTaskCode, pcName, ulStackDepth, pvParameters, uxPriority,
+                                                             puxStackBuffer, pxTaskBuffer, xCoreID);
+
+    if (pvCreatedTask != NULL)
     {
-        xTaskCreate(pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pvCreatedTask);
-        vTaskCoreAffinitySet(*pvCreatedTask, xCoreID);
+        *pvCreatedTask = created_task;
     }
-    else
+
+    if (scheduler_running)
     {
-        // Initialize TaskData_t with task information
-        TaskData_t task_data =
-        {
-            .task_code = pvTaskCode,
-            .name = pcName,
-            .stack_depth = usStackDepth,
-            .parameters = pvParameters,
-            .priority = uxPriority,
-            .created_task = pvCreatedTask,
-            .core_id = xCoreID,
-            .affinity_set_signal = xSemaphoreCreateBinary(),
-            .create_complete_signal = xSemaphoreCreateBinary()
-        };
-        // Create a task to handle pinning
-        TaskHandle_t pinning_task;
-        xTaskCreate(TaskCreatePinnedToCoreTask, "TaskCreatePinnedToCoreTask", configMINIMAL_STACK_SIZE, &task_data, uxPriority, &pinning_task);
-        // Temporarily suspend, set affinity, and resume on the correct core
-        vTaskSuspend(pinning_task);
-        vTaskCoreAffinitySet(pinning_task, xCoreID);
-        vTaskResume(pinning_task);
-        // Signal the helper task that it is running on the desired core
-        xSemaphoreGive(task_data.affinity_set_signal);
-        // Wait until task creation completes
-        xSemaphoreTake(task_data.create_complete_signal, portMAX_DELAY);
-        // Clean up
-        vSemaphoreDelete(task_data.affinity_set_signal);
-        vSemaphoreDelete(task_data.create_complete_signal);
+        xTaskResumeAll();
     }
 
-    return pdPASS;
-}
-
-/*-----------------------------------------------------------*/
-
-static void TaskCreatePinnedToCoreTask(void *params)
-{
-    TaskData_t *task_data = (TaskData_t *) params;
-    // Wait for mutex confirming the new affinity has been set and we're executing on desired core
-    xSemaphoreTake(task_data->affinity_set_signal, portMAX_DELAY);
-    taskENTER_CRITICAL(); // We're now executing on the desire core, prevent any new task we create from executing code
-    xTaskCreate(task_data->task_code, task_data->name, task_data->stack_depth, task_data->parameters, task_data->priority,
-                task_data->created_task);
-    vTaskCoreAffinitySet(*(task_data->created_task), task_data->core_id);
-    taskEXIT_CRITICAL(); // Allow the task to execute (this will happen immediately if it's priority is higher)
-    xSemaphoreGive(task_data->create_complete_signal); // Notify that task has been created
-    vTaskDelete( NULL );
+    return created_task != NULL ? pdPASS : pdFAIL;
 }
 
 /*-----------------------------------------------------------*/
@@ -196,9 +176,27 @@ static void Core1FaultTask(void *params)
 
 void Fault()
 {
-    vTaskDelay(pdMS_TO_TICKS(1000)); // Wait for prior log messages to flush
-    xTaskCreatePinnedToCore(Core0FaultTask, "Core0FaultTask", configMINIMAL_STACK_SIZE, NULL, PRIORITY_FAULT, NULL, AFFINITY_CORE_0);
-    xTaskCreatePinnedToCore(Core1FaultTask, "Core1FaultTask", configMINIMAL_STACK_SIZE, NULL, PRIORITY_FAULT, NULL, AFFINITY_CORE_1);
+    CrashRecordFault(CRASH_FAULT, NULL);
+    UBaseType_t interrupts = taskENTER_CRITICAL_FROM_ISR();
+    bool first = !faulted;
+    faulted = true;
+    taskEXIT_CRITICAL_FROM_ISR(interrupts);
+
+    // The first fault is already bringing the system down, the fault tasks are only created once
+    if (first)
+    {
+        vTaskDelay(pdMS_TO_TICKS(1000)); // Wait for prior log messages to flush
+        xTaskCreateStaticPinnedToCore(Core0FaultTask, "Core0FaultTask", FAULT_TASK_STACK_DEPTH, NULL, PRIORITY_FAULT,
+                                      fault_task_stacks[0], &fault_task_buffers[0], NULL, AFFINITY_CORE_0);
+        xTaskCreateStaticPinnedToCore(Core1FaultTask, "Core1FaultTask", FAULT_TASK_STACK_DEPTH, NULL, PRIORITY_FAULT,
+                                      fault_task_stacks[1], &fault_task_buffers[1], NULL, AFFINITY_CORE_1);
+    }
+
+    // Never returns, callers rely on it to stop them going past whatever check failed
+    for (;;)
+    {
+        vTaskDelay(portMAX_DELAY);
+    }
 }
 
 /*-----------------------------------------------------------*/
@@ -206,5 +204,38 @@ void Fault()
 void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName)
 {
     LogPrintFatal("Stack overflow detected in: %s\n", pcTaskName);
+    CrashRecordFault(CRASH_STACK_OVERFLOW, pcTaskName);
     Fault();
-}
\ No newline at end of file
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer,
+                                   configSTACK_DEPTH_TYPE *puxIdleTaskStackSize)
+{
+    *ppxIdleTaskTCBBuffer = &idle_task_buffers[0];
+    *ppxIdleTaskStackBuffer = idle_task_stacks[0];
+    *puxIdleTaskStackSize = IDLE_TASK_STACK_DEPTH;
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationGetPassiveIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer,
+                                          configSTACK_DEPTH_TYPE *puxIdleTaskStackSize,
+                                          BaseType_t xPassiveIdleTaskIndex)
+{
+    // Idle task 0 is the one vApplicationGetIdleTaskMemory() hands out
+    *ppxIdleTaskTCBBuffer = &idle_task_buffers[xPassiveIdleTaskIndex + 1];
+    *ppxIdleTaskStackBuffer = idle_task_stacks[xPassiveIdleTaskIndex + 1];
+    *puxIdleTaskStackSize = IDLE_TASK_STACK_DEPTH;
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer, StackType_t **ppxTimerTaskStackBuffer,
+                                    configSTACK_DEPTH_TYPE *puxTimerTaskStackSize)
+{
+    *ppxTimerTaskTCBBuffer = &timer_task_buffer;
+    *ppxTimerTaskStackBuffer = timer_task_stack;
+    *puxTimerTaskStackSize = TIMER_TASK_STACK_DEPTH;
+}
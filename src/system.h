@@ -30,6 +30,7 @@
 
 // standard includes
 #include <stdint.h>
+#include <stdbool.h>
 
 // FreeRTOS-Kernel includes
 #include "FreeRTOS.h"
@@ -39,31 +40,35 @@
 #define AFFINITY_CORE_1 ( 2U )
 
 /**
- * @brief Own implementation of xTaskCreatePinnedToCore as FreeRTOS pico doesn't support it natively
+ * @brief Own implementation of xTaskCreateStaticPinnedToCore, the task never runs on another core
  *
+ * pvCreatedTask is set before the task can run, even when it preempts the caller.
  *
  * @param pvTaskCode
  * @param pcName
- * @param usStackDepth
+ * @param ulStackDepth words in puxStackBuffer, sized in rtos_manifest.h
  * @param pvParameters
  * @param uxPriority
- * @param pvCreatedTask
- * @param xCoreID
+ * @param puxStackBuffer
+ * @param pxTaskBuffer
+ * @param pvCreatedTask may be NULL
+ * @param xCoreID core affinity mask
  * @return BaseType_t
  */
-BaseType_t xTaskCreatePinnedToCore(
+BaseType_t xTaskCreateStaticPinnedToCore(
     TaskFunction_t pvTaskCode,
     const char *pcName,
-    const uint32_t usStackDepth,
+    const uint32_t ulStackDepth,
     void *pvParameters,
     UBaseType_t uxPriority,
+    StackType_t *puxStackBuffer,
+    StaticTask_t *pxTaskBuffer,
     TaskHandle_t *pvCreatedTask,
     const BaseType_t xCoreID
 );
 
 /**
- * @brief
- *
+ * @brief Records the fault and restarts the panel, never returns
  *
  */
 void Fault();
@@ -74,4 +79,26 @@ void Fault();
  */
 void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName);
 
+/**
+ * @brief Storage of the idle task on core 0, for the kernel
+ *
+ */
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer,
+                                   configSTACK_DEPTH_TYPE *puxIdleTaskStackSize);
+
+/**
+ * @brief Storage of the idle tasks on the other cores, for the kernel
+ *
+ */
+void vApplicationGetPassiveIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer,
+                                          configSTACK_DEPTH_TYPE *puxIdleTaskStackSize,
+                                          BaseType_t xPassiveIdleTaskIndex);
+
+/**
+ * @brief Storage of the timer task, for the kernel
+ *
+ */
+void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer, StackType_t **ppxTimerTaskStackBuffer,
+                                    configSTACK_DEPTH_TYPE *puxTimerTaskStackSize);
+
 #endif //_SYSTEM_H
\ No newline at end of file
@@ -0,0 +1,320 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file trace.c
+* @brief
+*/
+#include "trace.h"
+
+// standard includes
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+// pico-sdk includes
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+// FreeRTOS-Kernel includes
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+/**
+ * @brief Tasks TraceDump() can name, any others are shown by handle
+ *
+ */
+#define TRACE_TASKS         24
+
+/**
+ * @brief
+ *
+ */
+#define TRACE_LINE_SIZE     160
+
+/**
+ * @brief
+ *
+ */
+#define TRACE_NAME_SIZE     24
+
+/**
+ * @brief Opens the trace, its first event names the process
+ *
+ */
+#define TRACE_DUMP_START    TRACE_LINE_PREFIX "{\"traceEvents\":[\n" \
+                            TRACE_LINE_PREFIX "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"alert-panel\"}}\n"
+
+/**
+ * @brief
+ *
+ */
+#define TRACE_DUMP_END      TRACE_LINE_PREFIX "]}\n"
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    uint32_t time_us;
+    const void *object;
+    uint8_t type;
+}
+TraceRecord_t;
+
+/**
+ * @brief Only written by its own core, with interrupts disabled
+ *
+ */
+typedef struct
+{
+    TraceRecord_t records[TRACE_RING_EVENTS];
+    uint32_t next;  // Events ever added, the oldest are overwritten
+}
+TraceRing_t;
+
+/**
+ * @brief Timeline names of each event type, %s is the task or queue
+ *
+ */
+static const char *TRACE_EVENT_NAMES[TRACE_EVENT_TYPES] = {
+    [TRACE_TASK_SWITCHED_IN] = "%s",
+    [TRACE_TASK_DELAY] = "delay",
+    [TRACE_TASK_NOTIFY] = "notify %s",
+    [TRACE_TASK_NOTIFY_BLOCK] = "block on notify",
+    [TRACE_QUEUE_SEND] = "send %s",
+    [TRACE_QUEUE_SEND_FAILED] = "send %s failed",
+    [TRACE_QUEUE_SEND_BLOCK] = "block sending %s",
+    [TRACE_QUEUE_RECEIVE] = "receive %s",
+    [TRACE_QUEUE_RECEIVE_FAILED] = "receive %s failed",
+    [TRACE_QUEUE_RECEIVE_BLOCK] = "block receiving %s",
+    [TRACE_ISR_QUEUE_SEND] = "ISR send %s",
+    [TRACE_ISR_QUEUE_RECEIVE] = "ISR receive %s",
+    [TRACE_ISR_TASK_NOTIFY] = "ISR notify %s"
+};
+
+/**
+ * @brief
+ *
+ */
+static TraceRing_t trace_rings[configNUMBER_OF_CORES];
+
+/**
+ * @brief Cleared while TraceDump() reads the rings
+ *
+ */
+static volatile bool trace_recording = true;
+
+/**
+ * @brief Name of the task or queue an event refers to, by handle when it has none
+ *
+ * @param record
+ * @param tasks live tasks
+ * @param task_count
+ * @param name buffer of TRACE_NAME_SIZE bytes, for a handle
+ * @return const char*
+ */
+static const char *TraceObjectName(const TraceRecord_t *record, const TaskStatus_t *tasks, UBaseType_t task_count,
+                                   char *name);
+
+/**
+ * @brief Writes one trace event, as a line of the traceEvents array
+ *
+ * @param write
+ * @param line buffer of TRACE_LINE_SIZE bytes
+ * @param format a JSON object, then the arguments
+ * @param ...
+ */
+static void TraceDumpLine(TraceWrite_t write, char *line, const char *format, ...);
+
+/*-----------------------------------------------------------*/
+
+void TraceEvent(TraceEventType_t type, const void *object)
+{
+    if (!trace_recording)
+    {
+        return;
+    }
+
+    // Stops an interrupt on this core taking the same slot, the other core has its own ring
+    uint32_t interrupts = save_and_disable_interrupts();
+    TraceRing_t *ring = &trace_rings[portGET_CORE_ID()];
+    TraceRecord_t *record = &ring->records[ring->next & (TRACE_RING_EVENTS - 1)];
+    record->time_us = time_us_32();
+    record->object = object;
+    record->type = type;
+    ring->next++;
+    restore_interrupts(interrupts);
+}
+
+/*-----------------------------------------------------------*/
+
+void TraceTaskSwitchedIn(void)
+{
+    TraceEvent(TRACE_TASK_SWITCHED_IN, xTaskGetCurrentTaskHandle());
+}
+
+/*-----------------------------------------------------------*/
+
+void TraceDump(TraceWrite_t write)
+{
+    static TaskStatus_t tasks[TRACE_TASKS]; // Too large for the calling task's stack
+    static char line[TRACE_LINE_SIZE];
+    char name[TRACE_NAME_SIZE];
+
+    trace_recording = false;
+    // An event being added on the other core is long finished a tick later
+    vTaskDelay(1);
+    uint32_t end_us = time_us_32();
+    UBaseType_t task_count = uxTaskGetSystemState(tasks, TRACE_TASKS, NULL);
+
+    // The timeline starts at the oldest event kept on either core
+    uint32_t span_us = 0;
+
+    for (uint8_t core = 0; core < configNUMBER_OF_CORES; core++)
+    {
+        const TraceRing_t *ring = &trace_rings[core];
+        uint32_t count = ring->next < TRACE_RING_EVENTS ? ring->next : TRACE_RING_EVENTS;
+
+        if (count > 0)
+        {
+            uint32_t oldest_us = ring->records[(ring->next - count) & (TRACE_RING_EVENTS - 1)].time_us;
+            span_us = end_us - oldest_us > span_us ? end_us - oldest_us : span_us;
+        }
+    }
+
+    uint32_t start_us = end_us - span_us;
+    write(TRACE_DUMP_START, sizeof(TRACE_DUMP_START) - 1);
+
+    for (uint8_t core = 0; core < configNUMBER_OF_CORES; core++)
+    {
+        const TraceRing_t *ring = &trace_rings[core];
+        uint32_t count = ring->next < TRACE_RING_EVENTS ? ring->next : TRACE_RING_EVENTS;
+        const TraceRecord_t *running = NULL;
+        TraceDumpLine(write, line, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                      "\"args\":{\"name\":\"core %u\"}}", core, core);
+
+        for (uint32_t i = ring->next - count; i != ring->next; i++)
+        {
+            const TraceRecord_t *record = &ring->records[i & (TRACE_RING_EVENTS - 1)];
+
+            if (record->type >= TRACE_EVENT_TYPES)
+            {
+                continue;
+            }
+
+            const char *object_name = TraceObjectName(record, tasks, task_count, name);
+
+            if (record->type != TRACE_TASK_SWITCHED_IN)
+            {
+                char event_name[TRACE_NAME_SIZE + 24];
+                snprintf(event_name, sizeof(event_name), TRACE_EVENT_NAMES[record->type], object_name);
+                TraceDumpLine(write, line, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%lu}",
+                              event_name, core, (unsigned long)(record->time_us - start_us));
+                continue;
+            }
+
+            // A task runs on its core until the next task is switched in
+            if (running != NULL)
+            {
+                TraceDumpLine(write, line, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lu,\"dur\":%lu}",
+                              TraceObjectName(running, tasks, task_count, name), core,
+                              (unsigned long)(running->time_us - start_us),
+                              (unsigned long)(record->time_us - running->time_us));
+            }
+
+            running = record;
+        }
+
+        if (running != NULL)
+        {
+            TraceDumpLine(write, line, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lu,\"dur\":%lu}",
+                          TraceObjectName(running, tasks, task_count, name), core,
+                          (unsigned long)(running->time_us - start_us), (unsigned long)(end_us - running->time_us));
+        }
+    }
+
+    write(TRACE_DUMP_END, sizeof(TRACE_DUMP_END) - 1);
+
+    for (uint8_t core = 0; core < configNUMBER_OF_CORES; core++)
+    {
+        trace_rings[core].next = 0;
+    }
+
+    trace_recording = true;
+}
+
+/*-----------------------------------------------------------*/
+
+static const char *TraceObjectName(const TraceRecord_t *record, const TaskStatus_t *tasks, UBaseType_t task_count,
+                                   char *name)
+{
+    if (record->object == NULL)
+    {
+        return "";
+    }
+
+    if (record->type == TRACE_TASK_SWITCHED_IN || record->type == TRACE_TASK_NOTIFY ||
+        record->type == TRACE_ISR_TASK_NOTIFY)
+    {
+        // Only live tasks are named, a deleted task's handle may no longer point at one
+        for (UBaseType_t i = 0; i < task_count; i++)
+        {
+            if (tasks[i].xHandle == record->object)
+            {
+                return tasks[i].pcTaskName;
+            }
+        }
+
+        snprintf(name, TRACE_NAME_SIZE, "task %p", record->object);
+        return name;
+    }
+
+    const char *queue_name = pcQueueGetName((QueueHandle_t)record->object);
+
+    if (queue_name != NULL)
+    {
+        return queue_name;
+    }
+
+    snprintf(name, TRACE_NAME_SIZE, "queue %p", record->object);
+    return name;
+}
+
+/*-----------------------------------------------------------*/
+
+static void TraceDumpLine(TraceWrite_t write, char *line, const char *format, ...)
+{
+    // Every event follows the process_name one, so each starts with a comma
+    size_t length = snprintf(line, TRACE_LINE_SIZE, TRACE_LINE_PREFIX ",");
+    va_list args;
+    va_start(args, format);
+    length += vsnprintf(line + length, TRACE_LINE_SIZE - length - 1, format, args);
+    va_end(args);
+    length = length < TRACE_LINE_SIZE - 2 ? length : TRACE_LINE_SIZE - 2;
+    line[length++] = '\n';
+    line[length] = '\0';
+    write(line, length);
+}
@@ -0,0 +1,124 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file trace.h
+* @brief Public functions in this module file are thread-safe
+*
+* A flight recorder for the scheduler, built with TRACE. FreeRTOSConfig.h includes this header so the kernel's trace
+* hook macros record context switches, queue and semaphore sends and receives, blocking and calls made from interrupts
+* into a ring per core, overwriting the oldest events. TraceDump() writes the rings as a Chrome trace (JSON) that
+* ui.perfetto.dev and chrome://tracing open, one track per core.
+*
+* This header is included by every FreeRTOS source, so it only uses standard types.
+*/
+#ifndef _TRACE_H
+#define _TRACE_H
+
+// standard includes
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Events kept per core, a power of 2
+ *
+ */
+#define TRACE_RING_EVENTS   1024
+
+/**
+ * @brief Prefix of every line TraceDump() writes, so the trace can be cut out of the log output
+ *
+ */
+#define TRACE_LINE_PREFIX   "TRACE "
+
+/**
+ * @brief
+ *
+ */
+typedef enum
+{
+    TRACE_TASK_SWITCHED_IN = 0,         // object is the task
+    TRACE_TASK_DELAY,                   // the rest are on the running task, object is the queue unless noted
+    TRACE_TASK_NOTIFY,                  // object is the task notified
+    TRACE_TASK_NOTIFY_BLOCK,
+    TRACE_QUEUE_SEND,
+    TRACE_QUEUE_SEND_FAILED,
+    TRACE_QUEUE_SEND_BLOCK,
+    TRACE_QUEUE_RECEIVE,
+    TRACE_QUEUE_RECEIVE_FAILED,
+    TRACE_QUEUE_RECEIVE_BLOCK,
+    TRACE_ISR_QUEUE_SEND,               // the TRACE_ISR_ ones are called from an interrupt
+    TRACE_ISR_QUEUE_RECEIVE,
+    TRACE_ISR_TASK_NOTIFY,              // object is the task notified
+    TRACE_EVENT_TYPES
+}
+TraceEventType_t;
+
+/**
+ * @brief Writes part of a dump, called from TraceDump()'s task
+ *
+ */
+typedef void (*TraceWrite_t)(const char *text, size_t length);
+
+/**
+ * @brief Adds an event to the calling core's ring, callable from interrupts and kernel critical sections
+ *
+ * @param type
+ * @param object task or queue handle, NULL for none
+ */
+void TraceEvent(TraceEventType_t type, const void *object);
+
+/**
+ * @brief Adds a TRACE_TASK_SWITCHED_IN event for the task now running on the calling core
+ *
+ */
+void TraceTaskSwitchedIn(void);
+
+/**
+ * @brief Writes the rings as a Chrome trace, one TRACE_LINE_PREFIX line at a time, then starts them again
+ *
+ * Recording stops for the dump. Call from a task, never with the scheduler suspended.
+ *
+ * @param write
+ */
+void TraceDump(TraceWrite_t write);
+
+// FreeRTOS trace hooks, variadic where the kernel's arguments differ between versions
+#define traceTASK_SWITCHED_IN()                 TraceTaskSwitchedIn()
+#define traceTASK_DELAY(...)                    TraceEvent(TRACE_TASK_DELAY, NULL)
+#define traceTASK_DELAY_UNTIL(...)              TraceEvent(TRACE_TASK_DELAY, NULL)
+#define traceTASK_NOTIFY(...)                   TraceEvent(TRACE_TASK_NOTIFY, xTaskToNotify)
+#define traceTASK_NOTIFY_TAKE_BLOCK(...)        TraceEvent(TRACE_TASK_NOTIFY_BLOCK, NULL)
+#define traceTASK_NOTIFY_WAIT_BLOCK(...)        TraceEvent(TRACE_TASK_NOTIFY_BLOCK, NULL)
+#define traceTASK_NOTIFY_FROM_ISR(...)          TraceEvent(TRACE_ISR_TASK_NOTIFY, xTaskToNotify)
+#define traceTASK_NOTIFY_GIVE_FROM_ISR(...)     TraceEvent(TRACE_ISR_TASK_NOTIFY, xTaskToNotify)
+#define traceQUEUE_SEND(queue)                  TraceEvent(TRACE_QUEUE_SEND, queue)
+#define traceQUEUE_SEND_FAILED(queue)           TraceEvent(TRACE_QUEUE_SEND_FAILED, queue)
+#define traceBLOCKING_ON_QUEUE_SEND(queue)      TraceEvent(TRACE_QUEUE_SEND_BLOCK, queue)
+#define traceQUEUE_RECEIVE(queue)               TraceEvent(TRACE_QUEUE_RECEIVE, queue)
+#define traceQUEUE_RECEIVE_FAILED(queue)        TraceEvent(TRACE_QUEUE_RECEIVE_FAILED, queue)
+#define traceBLOCKING_ON_QUEUE_RECEIVE(queue)   TraceEvent(TRACE_QUEUE_RECEIVE_BLOCK, queue)
+#define traceQUEUE_SEND_FROM_ISR(queue)         TraceEvent(TRACE_ISR_QUEUE_SEND, queue)
+#define traceQUEUE_RECEIVE_FROM_ISR(queue)      TraceEvent(TRACE_ISR_QUEUE_RECEIVE, queue)
+
+#endif //_TRACE_H
@@ -30,6 +30,9 @@
 // standard includes
 #include <stdio.h>
 
+// pico-sdk includes
+#include "pico/time.h"
+
 // FreeRTOS-Kernel includes
 #include "FreeRTOS.h"
 #include "task.h"
@@ -46,6 +49,28 @@ void BytesToHex(char *output_hex, size_t output_hex_length, const char *buffer,
 
 /*-----------------------------------------------------------*/
 
+size_t BytesToBase64(char *output, size_t output_length, const uint8_t *buffer, size_t buffer_length)
+{
+    static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char *out = output;
+
+    for (size_t i = 0; i < buffer_length && (size_t)(out - output) + 4 < output_length; i += 3)
+    {
+        uint32_t bits = (uint32_t)buffer[i] << 16;
+        bits |= i + 1 < buffer_length ? (uint32_t)buffer[i + 1] << 8 : 0;
+        bits |= i + 2 < buffer_length ? (uint32_t)buffer[i + 2] : 0;
+        *out++ = BASE64[(bits >> 18) & 0x3f];
+        *out++ = BASE64[(bits >> 12) & 0x3f];
+        *out++ = i + 1 < buffer_length ? BASE64[(bits >> 6) & 0x3f] : '=';
+        *out++ = i + 2 < buffer_length ? BASE64[bits & 0x3f] : '=';
+    }
+
+    *out = '\0';
+    return out - output;
+}
+
+/*-----------------------------------------------------------*/
+
 uint32_t GetTimeMs(void)
 {
     // Implement a platform-specific way to return current time in milliseconds.
@@ -57,4 +82,11 @@ uint32_t GetTimeMs(void)
 uint32_t GetElapsedMs(uint32_t earlier, uint32_t later)
 {
     return later - earlier;
-}
\ No newline at end of file
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t GetTimeUs(void)
+{
+    return time_us_64();
+}
@@ -43,6 +43,17 @@
  */
 void BytesToHex(char *output_hex, size_t output_hex_length, const char *buffer, const size_t buffer_length);
 
+/**
+ * @brief Base64 encodes a byte array, output_length must be >= (((buffer_length + 2) / 3) * 4) + 1
+ *
+ * @param output
+ * @param output_length
+ * @param buffer
+ * @param buffer_length
+ * @return size_t characters written, not counting the terminator
+ */
+size_t BytesToBase64(char *output, size_t output_length, const uint8_t *buffer, size_t buffer_length);
+
 /**
  * @brief Get the current time since start in ms
  *
@@ -56,4 +67,11 @@ uint32_t GetTimeMs(void);
  */
 uint32_t GetElapsedMs(uint32_t earlier, uint32_t later);
 
+/**
+ * @brief Get the current time since start in us, from the hardware timer rather than the tick count
+ *
+ * @return uint64_t
+ */
+uint64_t GetTimeUs(void);
+
 #endif //_UTIL_H
\ No newline at end of file
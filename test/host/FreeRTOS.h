@@ -0,0 +1,67 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file FreeRTOS.h
+* @brief Host stand-in for the FreeRTOS-Kernel types and constants used by the keypad modules, see host_rtos.h
+*/
+#ifndef _HOST_FREERTOS_H
+#define _HOST_FREERTOS_H
+
+// standard includes
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t StackType_t;
+#define configSTACK_DEPTH_TYPE uint32_t
+
+/**
+ * @brief Tasks and queues are kept by the shim, the static buffers handed to it are unused
+ *
+ */
+typedef struct HostTask *TaskHandle_t;
+typedef struct HostQueue *QueueHandle_t;
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef struct { uint8_t unused; } StaticTask_t;
+typedef struct { uint8_t unused; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+
+#define pdFALSE                         ( ( BaseType_t ) 0 )
+#define pdTRUE                          ( ( BaseType_t ) 1 )
+#define pdPASS                          ( pdTRUE )
+#define pdFAIL                          ( pdFALSE )
+#define portMAX_DELAY                   ( ( TickType_t ) 0xffffffffUL )
+#define portTICK_PERIOD_MS              ( ( TickType_t ) 1 )
+#define pdMS_TO_TICKS( xTimeInMs )      ( ( TickType_t ) ( xTimeInMs ) )
+
+#define tskIDLE_PRIORITY                ( ( UBaseType_t ) 0U )
+#define configMINIMAL_STACK_SIZE        512
+#define configTIMER_TASK_STACK_DEPTH    1024
+#define configMAX_TASK_NAME_LEN         16
+#define configNUMBER_OF_CORES           2
+
+#endif //_HOST_FREERTOS_H
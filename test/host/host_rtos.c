@@ -0,0 +1,527 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file host_rtos.c
+* @brief
+*/
+#include "host_rtos.h"
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+// FreeRTOS-Kernel includes
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+// alert-panel includes
+#include "system.h"
+
+/**
+ * @brief Host stack for each task, the firmware's stack depths are sized for the RP2040, not for glibc
+ *
+ */
+#define HOST_RTOS_STACK_SIZE    (256 * 1024)
+
+/**
+ * @brief Test of whether a blocked task (or the test) can carry on
+ *
+ */
+typedef bool (*HostRtosReady_t)(const void *object);
+
+/**
+ * @brief
+ *
+ */
+struct HostTask
+{
+    ucontext_t context;
+    TaskFunction_t code;
+    void *params;
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    HostRtosReady_t ready;  // NULL while it only waits for wake_us
+    const void *object;
+    uint64_t wake_us;       // UINT64_MAX to wait for ready alone
+    uint32_t notify;
+    bool finished;
+    struct HostTask *next;
+};
+
+/**
+ * @brief
+ *
+ */
+struct HostQueue
+{
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;  // 0 for semaphores
+    UBaseType_t count;
+    UBaseType_t head;
+    const char *name;
+};
+
+/**
+ * @brief
+ *
+ */
+static uint64_t time_us = 0;
+
+/**
+ * @brief In creation order
+ *
+ */
+static struct HostTask *tasks = NULL;
+
+/**
+ * @brief NULL while the test runs
+ *
+ */
+static struct HostTask *current = NULL;
+
+/**
+ * @brief
+ *
+ */
+static ucontext_t test_context;
+
+/**
+ * @brief Blocks the caller until ready(object) or wake_us
+ *
+ * @param ready NULL to wait for wake_us alone
+ * @param object
+ * @param wake_us UINT64_MAX to wait for ready alone
+ * @return true
+ * @return false if it timed out
+ */
+static bool HostRtosWait(HostRtosReady_t ready, const void *object, uint64_t wake_us);
+
+/**
+ * @brief Runs the most important task that can carry on, or moves the clock on to the next timeout
+ *
+ * @param limit_us furthest the clock is moved
+ */
+static void HostRtosStep(uint64_t limit_us);
+
+/**
+ * @brief
+ *
+ * @param ticks
+ * @return uint64_t
+ */
+static uint64_t HostRtosWakeTime(TickType_t ticks);
+
+/**
+ * @brief
+ *
+ */
+static void HostRtosTaskStart(void);
+
+/**
+ * @brief
+ *
+ * @param object
+ * @return true
+ * @return false
+ */
+static bool HostRtosQueueHasItem(const void *object);
+
+/**
+ * @brief
+ *
+ * @param object
+ * @return true
+ * @return false
+ */
+static bool HostRtosQueueHasSpace(const void *object);
+
+/**
+ * @brief
+ *
+ * @param object
+ * @return true
+ * @return false
+ */
+static bool HostRtosNotified(const void *object);
+
+/**
+ * @brief
+ *
+ * @param length
+ * @param item_size
+ * @return QueueHandle_t
+ */
+static QueueHandle_t HostRtosQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+/*-----------------------------------------------------------*/
+
+void HostRtosRunFor(uint32_t ms)
+{
+    HostRtosWait(NULL, NULL, time_us + ((uint64_t)ms * 1000));
+}
+
+/*-----------------------------------------------------------*/
+
+void HostRtosBusy(uint32_t us)
+{
+    time_us += us;
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t HostRtosTimeUs(void)
+{
+    return time_us;
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t time_us_64(void)
+{
+    return time_us;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xTaskCreateStaticPinnedToCore(TaskFunction_t pvTaskCode, const char *const pcName,
+                                         const uint32_t ulStackDepth, void *const pvParameters,
+                                         UBaseType_t uxPriority, StackType_t *const puxStackBuffer,
+                                         StaticTask_t *const pxTaskBuffer, TaskHandle_t *const pvCreatedTask,
+                                         const BaseType_t xCoreID)
+{
+    struct HostTask *task = calloc(1, sizeof(struct HostTask));
+    task->code = pvTaskCode;
+    task->params = pvParameters;
+    strncpy(task->name, pcName, configMAX_TASK_NAME_LEN - 1);
+    task->priority = uxPriority;
+    task->wake_us = 0; // Ready to start
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = malloc(HOST_RTOS_STACK_SIZE);
+    task->context.uc_stack.ss_size = HOST_RTOS_STACK_SIZE;
+    task->context.uc_link = &test_context;
+    makecontext(&task->context, HostRtosTaskStart, 0);
+
+    struct HostTask **last = &tasks;
+
+    while (*last != NULL)
+    {
+        last = &(*last)->next;
+    }
+
+    *last = task;
+
+    if (pvCreatedTask != NULL)
+    {
+        *pvCreatedTask = task;
+    }
+
+    return pdPASS;
+}
+
+/*-----------------------------------------------------------*/
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(time_us / 1000);
+}
+
+/*-----------------------------------------------------------*/
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    HostRtosWait(NULL, NULL, HostRtosWakeTime(xTicksToDelay));
+}
+
+/*-----------------------------------------------------------*/
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current;
+}
+
+/*-----------------------------------------------------------*/
+
+char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    struct HostTask *task = xTaskToQuery != NULL ? xTaskToQuery : current;
+    return task != NULL ? task->name : "test";
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    if (current == NULL || !HostRtosWait(HostRtosNotified, current, HostRtosWakeTime(xTicksToWait)))
+    {
+        return 0;
+    }
+
+    uint32_t notify = current->notify;
+    current->notify = xClearCountOnExit ? 0 : notify - 1;
+    return notify;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    xTaskToNotify->notify++;
+    return pdPASS;
+}
+
+/*-----------------------------------------------------------*/
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t uxQueueLength, UBaseType_t uxItemSize, uint8_t *pucQueueStorage,
+                                 StaticQueue_t *pxStaticQueue)
+{
+    return HostRtosQueueCreate(uxQueueLength, uxItemSize);
+}
+
+/*-----------------------------------------------------------*/
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *pxSemaphoreBuffer)
+{
+    return HostRtosQueueCreate(1, 0);
+}
+
+/*-----------------------------------------------------------*/
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *pxMutexBuffer)
+{
+    // Nothing is preempted, so priority inheritance has nothing to do
+    SemaphoreHandle_t mutex = HostRtosQueueCreate(1, 0);
+    mutex->count = 1;
+    return mutex;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    if (!HostRtosWait(HostRtosQueueHasSpace, xQueue, HostRtosWakeTime(xTicksToWait)))
+    {
+        return pdFALSE;
+    }
+
+    UBaseType_t tail = (xQueue->head + xQueue->count) % xQueue->length;
+    if (xQueue->item_size > 0)
+    {
+        memcpy(xQueue->storage + (tail * xQueue->item_size), pvItemToQueue, xQueue->item_size);
+    }
+
+    xQueue->count++;
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    if (!HostRtosWait(HostRtosQueueHasItem, xQueue, HostRtosWakeTime(xTicksToWait)))
+    {
+        return pdFALSE;
+    }
+
+    if (xQueue->item_size > 0)
+    {
+        memcpy(pvBuffer, xQueue->storage + (xQueue->head * xQueue->item_size), xQueue->item_size);
+    }
+
+    xQueue->head = (xQueue->head + 1) % xQueue->length;
+    xQueue->count--;
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    return xQueue->count;
+}
+
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue)
+{
+    return xQueue->length - xQueue->count;
+}
+
+/*-----------------------------------------------------------*/
+
+void vQueueAddToRegistry(QueueHandle_t xQueue, const char *pcQueueName)
+{
+    xQueue->name = pcQueueName;
+}
+
+/*-----------------------------------------------------------*/
+
+const char *pcQueueGetName(QueueHandle_t xQueue)
+{
+    return xQueue->name;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool HostRtosWait(HostRtosReady_t ready, const void *object, uint64_t wake_us)
+{
+    while (ready == NULL || !ready(object))
+    {
+        if (time_us >= wake_us)
+        {
+            return false;
+        }
+
+        if (current == NULL)
+        {
+            HostRtosStep(wake_us);
+            continue;
+        }
+
+        struct HostTask *task = current;
+        task->ready = ready;
+        task->object = object;
+        task->wake_us = wake_us;
+        current = NULL;
+        swapcontext(&task->context, &test_context);
+    }
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static void HostRtosStep(uint64_t limit_us)
+{
+    struct HostTask *next = NULL;
+    uint64_t next_wake_us = limit_us;
+
+    for (struct HostTask *task = tasks; task != NULL; task = task->next)
+    {
+        if (task->finished)
+        {
+            continue;
+        }
+
+        if (time_us >= task->wake_us || (task->ready != NULL && task->ready(task->object)))
+        {
+            // The first of equal priority, round robin comes from moving it to the end once it has run
+            if (next == NULL || task->priority > next->priority)
+            {
+                next = task;
+            }
+        }
+        else if (task->wake_us < next_wake_us)
+        {
+            next_wake_us = task->wake_us;
+        }
+    }
+
+    if (next == NULL)
+    {
+        if (next_wake_us == UINT64_MAX)
+        {
+            fprintf(stderr, "host_rtos: every task and the test are blocked for ever at %llu us\n",
+                    (unsigned long long)time_us);
+            exit(EXIT_FAILURE);
+        }
+
+        time_us = next_wake_us;
+        return;
+    }
+
+    struct HostTask **link = &tasks;
+
+    while (*link != next)
+    {
+        link = &(*link)->next;
+    }
+
+    *link = next->next;
+    next->next = NULL;
+    link = &tasks;
+
+    while (*link != NULL)
+    {
+        link = &(*link)->next;
+    }
+
+    *link = next;
+    current = next;
+    swapcontext(&test_context, &next->context);
+    current = NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint64_t HostRtosWakeTime(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY ? UINT64_MAX : time_us + ((uint64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+/*-----------------------------------------------------------*/
+
+static void HostRtosTaskStart(void)
+{
+    current->code(current->params);
+    current->finished = true;
+    current = NULL; // uc_link returns to the test
+}
+
+/*-----------------------------------------------------------*/
+
+static bool HostRtosQueueHasItem(const void *object)
+{
+    return ((const struct HostQueue *)object)->count > 0;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool HostRtosQueueHasSpace(const void *object)
+{
+    const struct HostQueue *queue = object;
+    return queue->count < queue->length;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool HostRtosNotified(const void *object)
+{
+    return ((const struct HostTask *)object)->notify > 0;
+}
+
+/*-----------------------------------------------------------*/
+
+static QueueHandle_t HostRtosQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct HostQueue *queue = calloc(1, sizeof(struct HostQueue));
+    queue->storage = calloc(length, item_size > 0 ? item_size : 1);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
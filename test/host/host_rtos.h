@@ -0,0 +1,60 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file host_rtos.h
+* @brief Runs firmware tasks on the host, deterministically, against a simulated clock. NOT thread-safe
+*
+* Each task gets its own context and runs until it blocks, the most important ready task first, so nothing is ever
+* preempted. Once every task is blocked the clock jumps to the earliest timeout. The test itself runs outside the
+* tasks: when it blocks, for example in KeypadButtonEventReceive(), the tasks run until it can carry on. Time only
+* passes while something waits, work is free unless HostRtosBusy() says otherwise.
+*/
+#ifndef _HOST_RTOS_H
+#define _HOST_RTOS_H
+
+// standard includes
+#include <stdint.h>
+
+/**
+ * @brief Runs the tasks for a stretch of simulated time
+ *
+ * @param ms
+ */
+void HostRtosRunFor(uint32_t ms);
+
+/**
+ * @brief Spends simulated time in the calling task without letting any other task run, e.g. a flash erase
+ *
+ * @param us
+ */
+void HostRtosBusy(uint32_t us);
+
+/**
+ * @brief
+ *
+ * @return uint64_t simulated time (us) since start
+ */
+uint64_t HostRtosTimeUs(void);
+
+#endif //_HOST_RTOS_H
@@ -0,0 +1,155 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file host_stubs.c
+* @brief
+*/
+#include "host_stubs.h"
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+
+// alert-panel includes
+#include "diag.h"
+#include "host_rtos.h"
+#include "log.h"
+#include "storage.h"
+#include "supervisor.h"
+#include "system.h"
+
+/**
+ * @brief
+ *
+ */
+static uint32_t log_counts[LOG_LEVEL_OFF];
+
+/**
+ * @brief
+ *
+ */
+static struct
+{
+    size_t length; // 0 while blank
+    uint8_t data[STORAGE_RECORD_MAX_SIZE];
+}
+sectors[STORAGE_SECTOR_COUNT];
+
+/**
+ * @brief
+ *
+ */
+static uint32_t storage_writes = 0;
+
+/*-----------------------------------------------------------*/
+
+uint32_t HostStubsLogCount(uint8_t level)
+{
+    return log_counts[level];
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t HostStubsStorageWrites(void)
+{
+    return storage_writes;
+}
+
+/*-----------------------------------------------------------*/
+
+int LogModulePrint(LogModule_t *module, uint8_t level, const char *fmt, ...)
+{
+    static const char *const LEVEL_NAMES[] = {"DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+    log_counts[level < LOG_LEVEL_OFF ? level : LOG_LEVEL_FATAL]++;
+
+    if (level < HOST_STUBS_LOG_LEVEL)
+    {
+        return 0;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    printf("[%.3f] [%s] [%s] ", HostRtosTimeUs() / 1e6, LEVEL_NAMES[level < LOG_LEVEL_OFF ? level : LOG_LEVEL_FATAL],
+           module->file);
+    int length = vprintf(fmt, args);
+    va_end(args);
+    return length;
+}
+
+/*-----------------------------------------------------------*/
+
+bool StorageRead(StorageSector_t sector, void *data, size_t length)
+{
+    if (sectors[sector].length == 0 || sectors[sector].length != length)
+    {
+        return false;
+    }
+
+    memcpy(data, sectors[sector].data, length);
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+bool StorageWriteQueueSend(StorageSector_t sector, const void *data, size_t length)
+{
+    if (length == 0 || length > STORAGE_RECORD_MAX_SIZE)
+    {
+        return false;
+    }
+
+    memcpy(sectors[sector].data, data, length);
+    sectors[sector].length = length;
+    storage_writes++;
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+void Fault()
+{
+    printf("Fault() in %s\n", pcTaskGetName(NULL));
+    exit(EXIT_FAILURE);
+}
+
+/*-----------------------------------------------------------*/
+
+void DiagQueueSent(QueueHandle_t queue)
+{
+}
+
+/*-----------------------------------------------------------*/
+
+void SupervisorRegister(uint32_t deadline_ms)
+{
+}
+
+/*-----------------------------------------------------------*/
+
+void SupervisorCheckIn(void)
+{
+}
@@ -0,0 +1,60 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file host_stubs.h
+* @brief Host stand-ins for the firmware modules the keypad modules call: log, storage, system, diag and supervisor.
+* NOT thread-safe
+*
+* Log messages at or above HOST_STUBS_LOG_LEVEL are printed, all are counted. Storage sectors are kept in RAM and a
+* queued write lands at once, the storage task that makes them on the panel is not part of the host build. Fault()
+* ends the test with a failure.
+*/
+#ifndef _HOST_STUBS_H
+#define _HOST_STUBS_H
+
+// standard includes
+#include <stdint.h>
+
+/**
+ * @brief Lowest level printed
+ *
+ */
+#define HOST_STUBS_LOG_LEVEL            2
+
+/**
+ * @brief
+ *
+ * @param level
+ * @return uint32_t messages logged at level since start
+ */
+uint32_t HostStubsLogCount(uint8_t level);
+
+/**
+ * @brief
+ *
+ * @return uint32_t storage writes since start
+ */
+uint32_t HostStubsStorageWrites(void);
+
+#endif //_HOST_STUBS_H
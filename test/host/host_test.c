@@ -0,0 +1,58 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file host_test.c
+* @brief
+*/
+#include "host_test.h"
+
+// standard includes
+#include <string.h>
+
+/*-----------------------------------------------------------*/
+
+int HostTestMain(const HostTest_t *tests, size_t count, int argc, char **argv)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (argc < 2)
+        {
+            printf("%s\n", tests[i].name);
+        }
+        else if (strcmp(argv[1], tests[i].name) == 0)
+        {
+            tests[i].run();
+            printf("%s passed\n", tests[i].name);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    if (argc < 2)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    printf("No test named %s\n", argv[1]);
+    return EXIT_FAILURE;
+}
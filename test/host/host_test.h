@@ -0,0 +1,73 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file host_test.h
+* @brief Minimal test runner, each test runs in its own process so firmware state starts fresh. NOT thread-safe
+*/
+#ifndef _HOST_TEST_H
+#define _HOST_TEST_H
+
+// standard includes
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @brief Ends the test with a failure, printing where and why, if condition is false
+ *
+ */
+#define HOST_TEST_ASSERT(condition, message, ...) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            printf("%s:%d: %s: " message "\n", __FILE__, __LINE__, #condition, ##__VA_ARGS__); \
+            exit(EXIT_FAILURE); \
+        } \
+    } \
+    while (0)
+
+/**
+ * @brief
+ *
+ */
+typedef struct
+{
+    const char *name;
+    void (*run)(void);
+}
+HostTest_t;
+
+/**
+ * @brief Runs the test named by argv[1], or lists the tests without one
+ *
+ * @param tests
+ * @param count
+ * @param argc
+ * @param argv
+ * @return int exit status
+ */
+int HostTestMain(const HostTest_t *tests, size_t count, int argc, char **argv);
+
+#endif //_HOST_TEST_H
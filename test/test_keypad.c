@@ -0,0 +1,375 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file test_keypad.c
+* @brief Runs keypad.c, the gesture recogniser and the animation renderer on the virtual keypad driver, scripting
+* button presses and checking the button events and led frames that come out, and when
+*/
+// standard includes
+#include <string.h>
+
+// alert-panel includes
+#include "keypad.h"
+#include "keypad_animation.h"
+#include "keypad_driver_virtual.h"
+#include "log.h"
+#include "system.h"
+
+// host includes
+#include "host_rtos.h"
+#include "host_stubs.h"
+#include "host_test.h"
+
+/**
+ * @brief Driver mask of the key at a position in KEYPAD_KEY_ID
+ *
+ */
+#define TEST_KEY(position)  ((KeypadDriverMask_t)1 << KEYPAD_KEY_INDEX[position])
+
+/**
+ * @brief Longest time (us) between a button change and the poll that sees it, at the fast poll period
+ *
+ */
+#define TEST_POLL_LATENCY_US    (10 * 1000)
+
+/**
+ * @brief
+ *
+ */
+static KeypadDriverVirtualFrame_t frames[256];
+
+/**
+ * @brief Time (us) the button script started
+ *
+ */
+static uint64_t script_start_us;
+
+/**
+ * @brief Starts the keypad task and its button script
+ *
+ * @param steps
+ * @param count
+ * @param config NULL for the default timings
+ */
+static void TestKeypadStart(const KeypadDriverVirtualStep_t *steps, size_t count, const KeypadButtonConfig_t *config)
+{
+    KeypadInit();
+
+    if (config != NULL)
+    {
+        KeypadButtonConfigSet(config);
+    }
+
+    KeypadTaskCreate(tskIDLE_PRIORITY + 6, AFFINITY_CORE_0);
+    HostRtosRunFor(1); // Keypad driver initialised
+    KeypadDriverVirtualScript(steps, count);
+    script_start_us = HostRtosTimeUs();
+}
+
+/**
+ * @brief Takes every frame recorded so far, in small batches to check none are lost between them
+ *
+ * @return size_t
+ */
+static size_t TestFramesTake(void)
+{
+    size_t count = 0;
+    size_t taken;
+
+    do
+    {
+        taken = KeypadDriverVirtualFramesTake(&frames[count], 8);
+        count += taken;
+    }
+    while (taken > 0 && count + 8 <= sizeof(frames) / sizeof(frames[0]));
+
+    return count;
+}
+
+/**
+ * @brief
+ *
+ * @param frame
+ * @param position in KEYPAD_KEY_ID
+ * @return const uint8_t* global, blue, green, red
+ */
+static const uint8_t *TestFrameLed(const KeypadDriverVirtualFrame_t *frame, uint8_t position)
+{
+    return &frame->data[4 + (KEYPAD_KEY_INDEX[position] * 4)];
+}
+
+/**
+ * @brief Receives the next button event, one at a time as they are published
+ *
+ * @param event
+ */
+static void TestButtonEventReceive(KeypadButtonParams_t *event)
+{
+    static KeypadButtonParams_t received[KEYPAD_BUTTON_EVENTS_MAX];
+    static uint8_t count = 0;
+    static uint8_t next = 0;
+
+    if (next == count)
+    {
+        count = KeypadButtonEventReceive(received, KEYPAD_BUTTON_EVENTS_MAX);
+        next = 0;
+    }
+
+    *event = received[next++];
+}
+
+/**
+ * @brief Checks the next button event
+ *
+ * @param key_id
+ * @param type
+ * @param from_ms earliest detection, ms after the script started
+ * @param to_ms latest detection
+ */
+static void TestButtonEventExpect(const char *key_id, KeypadButtonEvent_t type, uint32_t from_ms, uint32_t to_ms)
+{
+    KeypadButtonParams_t event;
+    TestButtonEventReceive(&event);
+    uint64_t detected_ms = (event.timestamps.detected_us - script_start_us) / 1000;
+    HOST_TEST_ASSERT(strcmp(event.key_id, key_id) == 0 && event.event == type,
+                     "expected key %s event %d, got key %s event %d", key_id, type, event.key_id, event.event);
+    HOST_TEST_ASSERT(event.count == 1, "key %s event %d coalesced %u times", key_id, type, event.count);
+    HOST_TEST_ASSERT(detected_ms >= from_ms && detected_ms <= to_ms, "key %s event %d detected at %llu ms, expected %lu-%lu",
+                     key_id, type, (unsigned long long)detected_ms, (unsigned long)from_ms, (unsigned long)to_ms);
+}
+
+/*-----------------------------------------------------------*/
+
+static void TestPressHoldDoublePress(void)
+{
+    static const KeypadButtonConfig_t CONFIG = {.hold_ms = 800, .repeat_ms = 0, .multi_press_ms = 250, .chord_ms = 0};
+    // Not static, key indexes are not constant expressions, but it stays in scope while the script runs
+    const KeypadDriverVirtualStep_t STEPS[] =
+    {
+        {100, TEST_KEY(0)},
+        {150, 0},
+        {1000, TEST_KEY(1)},
+        {2200, 0},
+        {3000, TEST_KEY(2)},
+        {3050, 0},
+        {3150, TEST_KEY(2)},
+        {3200, 0},
+    };
+    TestKeypadStart(STEPS, sizeof(STEPS) / sizeof(STEPS[0]), &CONFIG);
+
+    // A tap is reported once the multi-press window after its release closes, a hold hold_ms after the key went down
+    TestButtonEventExpect("0", PRESS, 150 + 250, 150 + 250 + 50);
+    TestButtonEventExpect("1", HOLD, 1000 + 800, 1000 + 800 + (TEST_POLL_LATENCY_US / 1000));
+    TestButtonEventExpect("1", HOLD_RELEASE, 2200, 2200 + (TEST_POLL_LATENCY_US / 1000));
+    TestButtonEventExpect("2", DOUBLE_PRESS, 3200 + 250, 3200 + 250 + (TEST_POLL_LATENCY_US / 1000));
+    HOST_TEST_ASSERT(HostStubsLogCount(LOG_LEVEL_WARN) == 0, "unexpected warnings");
+}
+
+/*-----------------------------------------------------------*/
+
+static void TestEventOrder(void)
+{
+    static const KeypadButtonConfig_t CONFIG = {.hold_ms = 800, .repeat_ms = 0, .multi_press_ms = 250, .chord_ms = 0};
+    static const KeypadButtonEvent_t EXPECTED[] = {HOLD, HOLD_RELEASE, PRESS, HOLD, HOLD_RELEASE, PRESS};
+    const KeypadDriverVirtualStep_t STEPS[] =
+    {
+        {100, TEST_KEY(0)},
+        {1300, 0},
+        {1500, TEST_KEY(0)},
+        {1550, 0},
+        {2000, TEST_KEY(0)},
+        {3000, 0},
+        {3200, TEST_KEY(0)},
+        {3250, 0},
+        {3600, TEST_KEY(0)},
+        {3650, 0},
+    };
+    TestKeypadStart(STEPS, sizeof(STEPS) / sizeof(STEPS[0]), &CONFIG);
+
+    // Nothing is taken until every event has piled up, so only the last two presses may be coalesced
+    HostRtosRunFor(4200);
+    KeypadButtonParams_t events[KEYPAD_BUTTON_EVENTS_MAX];
+    uint8_t count = KeypadButtonEventReceive(events, KEYPAD_BUTTON_EVENTS_MAX);
+    HOST_TEST_ASSERT(count == sizeof(EXPECTED) / sizeof(EXPECTED[0]), "took %u events", count);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t expected_count = i == count - 1 ? 2 : 1;
+        HOST_TEST_ASSERT(events[i].event == EXPECTED[i] && events[i].count == expected_count,
+                         "event %u is %d x%u, expected %d x%u", i, events[i].event, events[i].count, EXPECTED[i],
+                         expected_count);
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void TestLedSetFrame(void)
+{
+    TestKeypadStart(NULL, 0, NULL);
+    TestFramesTake();
+    KeypadLedParams_t params =
+    {
+        .key_id = "3",
+        .state_set = true,
+        .state = true,
+        .brightness_set = true,
+        .brightness = 255,
+        .colour_set = true,
+        .red = 255,
+        .green = 0,
+        .blue = 0
+    };
+    uint64_t sent_us = HostRtosTimeUs();
+    KeypadLedEventQueueSend(&params);
+    HostRtosRunFor(200);
+
+    size_t count = TestFramesTake();
+    HOST_TEST_ASSERT(count == 1, "expected a single flush, got %zu", count);
+    HOST_TEST_ASSERT(frames[0].time_us - sent_us <= 52 * 1000, "led applied %llu us after being sent",
+                     (unsigned long long)(frames[0].time_us - sent_us));
+
+    for (uint8_t position = 0; position < KEYPAD_KEYS; position++)
+    {
+        // Full global current and red, give or take the brightness scaling, everything else off
+        const uint8_t *led = TestFrameLed(&frames[0], position);
+        bool red = led[0] == 0xff && led[1] == 0 && led[2] == 0 && led[3] >= 250;
+        bool off = led[0] == 0xe0 && led[1] == 0 && led[2] == 0 && led[3] == 0;
+        HOST_TEST_ASSERT(position == 3 ? red : off, "key %s is %02x %02x %02x %02x", KEYPAD_KEY_ID[position], led[0],
+                         led[1], led[2], led[3]);
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void TestFadeFrameRate(void)
+{
+    TestKeypadStart(NULL, 0, NULL);
+    TestFramesTake();
+    KeypadLedFadeParams_t params =
+    {
+        .led =
+        {
+            .key_id = "5",
+            .state_set = true,
+            .state = true,
+            .brightness_set = true,
+            .brightness = 255,
+            .colour_set = true,
+            .red = 255,
+            .green = 255,
+            .blue = 255
+        },
+        .transition_ms = 500
+    };
+    KeypadLedEventQueueSendFade(&params);
+    HostRtosRunFor(1000);
+
+    // Frames at a steady rate, brightening, until the fade ends at full white
+    size_t count = TestFramesTake();
+    uint32_t expected = params.transition_ms / KEYPAD_ANIMATION_FRAME_PERIOD;
+    HOST_TEST_ASSERT(count >= expected && count <= expected + 2, "expected about %lu frames, got %zu",
+                     (unsigned long)expected, count);
+    HOST_TEST_ASSERT(count == KeypadDriverVirtualFrameCount() - 2, "frames lost, %zu of %lu taken", count,
+                     (unsigned long)(KeypadDriverVirtualFrameCount() - 2)); // Less the two KeypadDriverInit() flushes
+
+    for (size_t i = 1; i < count; i++)
+    {
+        uint64_t period_us = frames[i].time_us - frames[i - 1].time_us;
+        const uint8_t *led = TestFrameLed(&frames[i], 5);
+        const uint8_t *last_led = TestFrameLed(&frames[i - 1], 5);
+        // The fade's first frame may come with the flush of the event that started it
+        HOST_TEST_ASSERT((i == 1 && period_us == 0) || period_us == KEYPAD_ANIMATION_FRAME_PERIOD * 1000,
+                         "frame %zu came %llu us after the last", i, (unsigned long long)period_us);
+        HOST_TEST_ASSERT((led[0] & 0x1f) > (last_led[0] & 0x1f) || ((led[0] == last_led[0]) && led[3] >= last_led[3]),
+                         "frame %zu is dimmer than the last", i);
+    }
+
+    const uint8_t *led = TestFrameLed(&frames[count - 1], 5);
+    HOST_TEST_ASSERT(led[0] == 0xff && led[1] >= 250 && led[2] >= 250 && led[3] >= 250,
+                     "the fade ended at %02x %02x %02x %02x, not full white", led[0], led[1], led[2], led[3]);
+}
+
+/*-----------------------------------------------------------*/
+
+static void TestAnimationOrder(void)
+{
+    TestKeypadStart(NULL, 0, NULL);
+    TestFramesTake();
+    static KeypadAnimationParams_t animation; // Sent the way LedMonitorAnimationCommand sends it
+    memset(&animation, 0, sizeof(animation));
+    animation.keyframe_count = 1;
+    animation.repeat = 1;
+    animation.keyframes[0] = (KeypadAnimationKeyframe_t){.duration_ms = 100, .easing = EASE_STEP, .count = 2};
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        animation.colours[i] = (KeypadAnimationColour_t)
+        {
+            .position = i == 0 ? 2 : 4,
+            .set = KEYPAD_ANIMATION_SET_COLOUR | KEYPAD_ANIMATION_SET_BRIGHTNESS,
+            .red = 255,
+            .brightness = 255
+        };
+    }
+
+    KeypadLedParams_t params =
+    {
+        .key_id = "2",
+        .state_set = true,
+        .state = true,
+        .brightness_set = true,
+        .brightness = 255,
+        .colour_set = true,
+        .blue = 255
+    };
+    KeypadAnimationEventQueueSend(&animation);
+    KeypadLedEventQueueSend(&params);
+    HostRtosRunFor(500);
+
+    // The timeline started before the write, which took key 2 out of it, key 4 played to the end
+    size_t count = TestFramesTake();
+    HOST_TEST_ASSERT(count > 0, "no frames");
+    const uint8_t *led = TestFrameLed(&frames[count - 1], 2);
+    HOST_TEST_ASSERT(led[0] == 0xff && led[1] >= 250 && led[2] == 0 && led[3] == 0, "key 2 is %02x %02x %02x %02x",
+                     led[0], led[1], led[2], led[3]);
+    led = TestFrameLed(&frames[count - 1], 4);
+    HOST_TEST_ASSERT(led[0] == 0xff && led[1] == 0 && led[2] == 0 && led[3] >= 250, "key 4 is %02x %02x %02x %02x",
+                     led[0], led[1], led[2], led[3]);
+}
+
+/*-----------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+    static const HostTest_t TESTS[] =
+    {
+        {"press_hold_double_press", TestPressHoldDoublePress},
+        {"event_order", TestEventOrder},
+        {"led_set_frame", TestLedSetFrame},
+        {"fade_frame_rate", TestFadeFrameRate},
+        {"animation_order", TestAnimationOrder},
+    };
+
+    return HostTestMain(TESTS, sizeof(TESTS) / sizeof(TESTS[0]), argc, argv);
+}
@@ -0,0 +1,183 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 tijy
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+* @file test_keypad_rule.c
+* @brief Feeds rule programs to the bytecode checks of keypad_rule.c, checking which are accepted and that accepted
+* ones run
+*/
+// standard includes
+#include <string.h>
+
+// alert-panel includes
+#include "keypad_rule.h"
+#include "log.h"
+
+// host includes
+#include "host_stubs.h"
+#include "host_test.h"
+
+/**
+ * @brief Wraps a body in a rule triggered by a press of key 0
+ *
+ * @param program
+ * @param body
+ * @param length
+ */
+static void TestRuleProgram(KeypadRuleProgram_t *program, const uint8_t *body, uint8_t length)
+{
+    memset(program, 0, sizeof(*program));
+    program->code[0] = PRESS;
+    program->code[1] = 0;
+    program->code[2] = length;
+    memcpy(&program->code[3], body, length);
+    program->length = 3 + length;
+}
+
+/**
+ * @brief Checks whether a rule body is accepted, a rejected one must be logged and leave the running rules alone
+ *
+ * @param body
+ * @param length
+ * @param accept
+ */
+static void TestRuleLoad(const uint8_t *body, uint8_t length, bool accept)
+{
+    static KeypadRuleProgram_t program;
+    TestRuleProgram(&program, body, length);
+    KeypadRuleLoad(&(KeypadRuleProgram_t){0}); // Start with no rules
+    uint32_t errors = HostStubsLogCount(LOG_LEVEL_ERROR);
+    bool loaded = KeypadRuleLoad(&program);
+
+    HOST_TEST_ASSERT(loaded == accept, "body of %u bytes was %s", length, loaded ? "accepted" : "rejected");
+    HOST_TEST_ASSERT(accept || HostStubsLogCount(LOG_LEVEL_ERROR) > errors, "rejection was not logged");
+    HOST_TEST_ASSERT(accept || KeypadRuleKeys(PRESS) == 0, "rejected program replaced the running rules");
+}
+
+/*-----------------------------------------------------------*/
+
+static void TestRuleValidProgram(void)
+{
+    // on press 0 if red(0) == 255: effect 1 flash
+    static const uint8_t BODY[] =
+    {
+        KEYPAD_RULE_OP_GET_RED, 0, KEYPAD_RULE_OP_PUSH, 255, KEYPAD_RULE_OP_EQ, KEYPAD_RULE_OP_JZ, 3,
+        KEYPAD_RULE_OP_SET_EFFECT, 1, FLASH
+    };
+    KeypadRuleInit();
+    TestRuleLoad(BODY, sizeof(BODY), true);
+    HOST_TEST_ASSERT(KeypadRuleKeys(PRESS) == 1, "press rule keys are %llx", (unsigned long long)KeypadRuleKeys(PRESS));
+
+    KeypadLedState_t states[KEYPAD_KEYS] = {0};
+    KeypadLedParams_t writes[KEYPAD_KEYS] = {0};
+    HOST_TEST_ASSERT(KeypadRuleRun(PRESS, 0, states, writes) == 0, "rule wrote a led with the condition false");
+
+    states[0].red = 255;
+    KeypadMask_t written = KeypadRuleRun(PRESS, 0, states, writes);
+    HOST_TEST_ASSERT(written == 2 && writes[1].effect_set && writes[1].effect == FLASH,
+                     "rule wrote %llx with the condition true", (unsigned long long)written);
+}
+
+/*-----------------------------------------------------------*/
+
+static void TestRuleStackDepth(void)
+{
+    static const uint8_t PUSH8[] =
+    {
+        KEYPAD_RULE_OP_PUSH, 1, KEYPAD_RULE_OP_PUSH, 2, KEYPAD_RULE_OP_PUSH, 3, KEYPAD_RULE_OP_PUSH, 4,
+        KEYPAD_RULE_OP_PUSH, 5, KEYPAD_RULE_OP_PUSH, 6, KEYPAD_RULE_OP_PUSH, 7, KEYPAD_RULE_OP_PUSH, 8
+    };
+    static const uint8_t PUSH9[] =
+    {
+        KEYPAD_RULE_OP_PUSH, 1, KEYPAD_RULE_OP_PUSH, 2, KEYPAD_RULE_OP_PUSH, 3, KEYPAD_RULE_OP_PUSH, 4,
+        KEYPAD_RULE_OP_PUSH, 5, KEYPAD_RULE_OP_PUSH, 6, KEYPAD_RULE_OP_PUSH, 7, KEYPAD_RULE_OP_PUSH, 8,
+        KEYPAD_RULE_OP_KEY
+    };
+    static const uint8_t UNDERFLOW[] = {KEYPAD_RULE_OP_PUSH, 1, KEYPAD_RULE_OP_EQ};
+    // Only the path that skips the push reaches EQ with one value
+    static const uint8_t UNDERFLOW_ON_ONE_PATH[] =
+    {
+        KEYPAD_RULE_OP_KEY, KEYPAD_RULE_OP_KEY, KEYPAD_RULE_OP_JZ, 2, KEYPAD_RULE_OP_PUSH, 1, KEYPAD_RULE_OP_EQ
+    };
+    // Code after an unconditional jump is never run, so its stack use does not count
+    static const uint8_t SKIPPED[] = {KEYPAD_RULE_OP_JMP, 1, KEYPAD_RULE_OP_EQ, KEYPAD_RULE_OP_SET_ON, 0};
+    KeypadRuleInit();
+    TestRuleLoad(PUSH8, sizeof(PUSH8), true);
+    TestRuleLoad(PUSH9, sizeof(PUSH9), false);
+    TestRuleLoad(UNDERFLOW, sizeof(UNDERFLOW), false);
+    TestRuleLoad(UNDERFLOW_ON_ONE_PATH, sizeof(UNDERFLOW_ON_ONE_PATH), false);
+    TestRuleLoad(SKIPPED, sizeof(SKIPPED), true);
+}
+
+/*-----------------------------------------------------------*/
+
+static void TestRuleJumpTargets(void)
+{
+    static const uint8_t TO_END[] = {KEYPAD_RULE_OP_KEY, KEYPAD_RULE_OP_JZ, 2, KEYPAD_RULE_OP_SET_ON, 0};
+    static const uint8_t PAST_END[] = {KEYPAD_RULE_OP_KEY, KEYPAD_RULE_OP_JZ, 3, KEYPAD_RULE_OP_SET_ON, 0};
+    // Lands on the push's operand, which would run as SET_EFFECT
+    static const uint8_t INTO_OPERANDS[] =
+    {
+        KEYPAD_RULE_OP_JMP, 1, KEYPAD_RULE_OP_PUSH, KEYPAD_RULE_OP_SET_EFFECT, 0, 0
+    };
+    KeypadRuleInit();
+    TestRuleLoad(TO_END, sizeof(TO_END), true);
+    TestRuleLoad(PAST_END, sizeof(PAST_END), false);
+    TestRuleLoad(INTO_OPERANDS, sizeof(INTO_OPERANDS), false);
+}
+
+/*-----------------------------------------------------------*/
+
+static void TestRuleMalformed(void)
+{
+    static const uint8_t UNKNOWN_OP[] = {0x30};
+    static const uint8_t BAD_KEY[] = {KEYPAD_RULE_OP_GET_ON, KEYPAD_RULE_KEY_ALL};
+    static const uint8_t BAD_EFFECT[] = {KEYPAD_RULE_OP_SET_EFFECT, 0, PULSE + 1};
+    static const uint8_t CUT_SHORT[] = {KEYPAD_RULE_OP_SET_COLOUR, 0, 255, 255};
+    KeypadRuleInit();
+    TestRuleLoad(UNKNOWN_OP, sizeof(UNKNOWN_OP), false);
+    TestRuleLoad(BAD_KEY, sizeof(BAD_KEY), false);
+    TestRuleLoad(BAD_EFFECT, sizeof(BAD_EFFECT), false);
+    TestRuleLoad(CUT_SHORT, sizeof(CUT_SHORT), false);
+
+    // A rule whose body runs past the end of the program
+    static KeypadRuleProgram_t program;
+    TestRuleProgram(&program, UNKNOWN_OP, sizeof(UNKNOWN_OP));
+    program.code[2] = 2;
+    HOST_TEST_ASSERT(!KeypadRuleLoad(&program), "rule overrunning the program was accepted");
+}
+
+/*-----------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+    static const HostTest_t TESTS[] =
+    {
+        {"valid_program", TestRuleValidProgram},
+        {"stack_depth", TestRuleStackDepth},
+        {"jump_targets", TestRuleJumpTargets},
+        {"malformed", TestRuleMalformed},
+    };
+
+    return HostTestMain(TESTS, sizeof(TESTS) / sizeof(TESTS[0]), argc, argv);
+}